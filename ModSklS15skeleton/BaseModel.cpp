@@ -76,9 +76,8 @@ void BaseModel::draw()
 
 }
 
-// main runtime (disable it when creating other)
-/*
-int main()
+// makes the controls and starts the model; run it with --model base
+static void setupBaseModel()
 {
   // init controller
   ModelerControl controls[BASE_NUM_CONTROLS];
@@ -87,6 +86,6 @@ int main()
   controls[ANGLE   ] = ModelerControl("Angle"   , -180, 180, 1, 0);
 
   ModelerApplication::Instance()->Init(&createBaseModel, controls, BASE_NUM_CONTROLS);
-  return ModelerApplication::Instance()->Run();
 }
-*/
+
+static ModelerModel s_baseModel("base", setupBaseModel);
@@ -4,6 +4,10 @@
 #include "modelerview.h"
 #include "modelerapp.h"
 #include "modelerdraw.h"
+#include "tessellation.h"
+#include "animchannels.h"
+#include "drivencontrols.h"
+#include "controlgraph.h"
 #include <FL/gl.h>
 #include <math.h>
 
@@ -16,11 +20,14 @@ class RkAlphaModel : public ModelerView
 {
 public:
   RkAlphaModel(int x, int y, int w, int h, char *label)
-    : ModelerView(x, y, w, h, label) { }
+    : ModelerView(x, y, w, h, label) { buildAnimation(); buildRig(); }
 
   // main driver
   virtual void draw();
-  virtual void animate();
+  virtual bool drawModelAt(double time);
+  virtual void animate(double tick);
+  virtual void buildAnimation();
+  virtual void buildRig();
 
   // COMPONENT
   virtual void TopHead();
@@ -37,10 +44,30 @@ public:
   // Helpers
   virtual void drawOrigin();
   virtual void drawPoint();
-  virtual void drawEdges(double x, double y1, double y2, double t);
+  virtual void addEdges(TriangleMesh &mesh, double x, double y1, double y2, double t);
 
 private:
-  int ticks = 0;
+  // the idle loop, keyed once and played back by animate()
+  AnimChannels animation;
+
+  // fixed geometry, rebuilt only when what it's made from changes
+  TriangleMesh scaleraMesh;
+  TriangleMesh halfDiskMesh;
+  TriangleMesh earMesh;
+  TriangleMesh tuftMesh;
+
+  // sub-assemblies drawn more than once, compiled once and replayed
+  InstancedGeometry ears;
+  InstancedGeometry topTeeth;
+  InstancedGeometry bottomTeeth;
+  InstancedGeometry tufts;
+  InstancedGeometry jawSupports;
+
+  static void drawEar(void *model)         { ((RkAlphaModel *)model)->TopEar(); }
+  static void drawTopTeeth(void *model)    { ((RkAlphaModel *)model)->TopTeeth(); }
+  static void drawBottomTeeth(void *model) { ((RkAlphaModel *)model)->BottomTeeth(); }
+  static void drawTuft(void *model)        { ((RkAlphaModel *)model)->BackTuft(); }
+  static void drawJawSupport(void *model)  { ((RkAlphaModel *)model)->JawSupport(); }
 
 };
 
@@ -56,15 +83,24 @@ void RkAlphaModel::draw()
   // main ModelerView::draw() interface
   ModelerView::draw();
 
-  glPushMatrix();
+  // the model itself, through drawModelAt()
+  drawModel();
+}
+
+bool RkAlphaModel::drawModelAt(double time)
+{
+  pushMatrix();
     /* ANIMATION */
-    animate();
+    if (time >= 0)
+      animate(time);
+    rotate(VAL(SWAY_TURN), 0,1,0);
+    rotate(VAL(SWAY_NOD),  1,0,0);
 
     /* PRELOAD MATRIX */
-    glTranslated(0,0.7,-HEAD_RAD+0.3);
+    translate(0,0.7,-HEAD_RAD+0.3);
     
     /* INITIAL TRANSFORMATION */
-    glTranslated(VAL(X_POS), VAL(Y_POS), VAL(Z_POS));
+    translate(VAL(X_POS), VAL(Y_POS), VAL(Z_POS));
     EULER_ROT(VAL(X_ROT), VAL(Y_ROT), VAL(Z_ROT));
     UNI_SCALE(VAL(SCALE));
 
@@ -72,114 +108,160 @@ void RkAlphaModel::draw()
     drawOrigin();
     
     /* MAIN RENDER */
-    glTranslated(0,-0.7,HEAD_RAD-0.3);
+    translate(0,-0.7,HEAD_RAD-0.3);
     TopHead();
     Muzzle();
 
-  glPopMatrix();
+  popMatrix();
+  return true;
 }
 
-void RkAlphaModel::animate()
+// keys the idle loop: a 240 tick sway, keyed at its quarter turns (the
+// right side and the bottom teeth follow through the rig)
+void RkAlphaModel::buildAnimation()
 {
-  if (ModelerApplication::Instance()->IsAnimated())
-  {
-    double sines1   = sin(M_PI * ticks / 120);
-    double sinessq1 = pow(sines1,2);
-    double possin1 = sines1 > 0 ?  sines1 : 0;
-    double possin2 = sines1 < 0 ? -sines1 : 0;
-
-
-    SET(Z_ROT, -sines1*15);
-    SET(Y_ROT, sines1*180/8);
-    SET(X_ROT, -sinessq1*15);
-
-    SET( LEFT_EAR_SHIFT,  sines1);
-    SET(RIGHT_EAR_SHIFT, -sines1);
-
-    SET( LEFT_EYE_SHIFT,  sines1);
-    SET(RIGHT_EYE_SHIFT,  sines1);
-
-    SET( LEFT_BROW_TILT, -sines1*10);
-    SET(RIGHT_BROW_TILT, -sines1*10);
+  static const struct { int control; double key[5]; Interpolation_t interp; } loop[] = {
+    { Z_ROT,           { 0, -15,    0,    15,     0 }, INTERP_CATMULL_ROM },
+    { Y_ROT,           { 0, 22.5,   0,   -22.5,   0 }, INTERP_CATMULL_ROM },
+    { X_ROT,           { 0, -15,    0,   -15,     0 }, INTERP_BEZIER },
+    { LEFT_EAR_SHIFT,  { 0,  1,     0,    -1,     0 }, INTERP_CATMULL_ROM },
+    { LEFT_EYE_SHIFT,  { 0,  1,     0,    -1,     0 }, INTERP_CATMULL_ROM },
+    { LEFT_BROW_TILT,  { 0, -10,    0,    10,     0 }, INTERP_CATMULL_ROM },
+    { JAW_OPEN,        { 0,  15,    0,     0,     0 }, INTERP_BEZIER },
+    { TOP_TEETH,       { 0,  0,     0,     1,     0 }, INTERP_BEZIER },
+    { SWAY_TURN,       { 0, -60,    0,    60,     0 }, INTERP_CATMULL_ROM },
+    { SWAY_NOD,        { -10, -12.5, -10, -12.5, -10 }, INTERP_BEZIER },
+  };
+  const int numLoop = sizeof(loop) / sizeof(loop[0]);
+
+  animation.setLoop(240);
+  for (int i = 0; i < numLoop; i++) {
+    int channel = animation.addChannel(loop[i].control);
+    for (int k = 0; k < 5; k++)
+      animation.setKey(channel, Keyframe(k * 60, loop[i].key[k], loop[i].interp));
+  }
+  animation.bake();
+}
 
-    SET(JAW_OPEN, possin1 * 15);
+// names the controls as the code does, and drives the ones that only
+// follow others (see drivencontrols.h)
+void RkAlphaModel::buildRig()
+{
+#define NAME(control) driven->setName(control, #control)
+  DrivenControls *driven = ModelerApplication::Instance()->GetDrivenControls();
+  NAME(SCALE);
+  NAME(Z_ROT); NAME(X_ROT); NAME(Y_ROT);
+  NAME(X_POS); NAME(Y_POS); NAME(Z_POS);
+  NAME(LEFT_EAR_SHIFT);  NAME(RIGHT_EAR_SHIFT);
+  NAME(LEFT_EYE_SHIFT);  NAME(RIGHT_EYE_SHIFT);
+  NAME(LEFT_BROW_TILT);  NAME(RIGHT_BROW_TILT);
+  NAME(SNOUT_DELTA); NAME(JAW_OPEN); NAME(TOP_TEETH); NAME(BOT_TEETH);
+  NAME(SWAY_TURN); NAME(SWAY_NOD);
+  NAME(ORIGIN);
+#undef NAME
+
+  static const struct { int control; const char *expression; } rig[] = {
+    { RIGHT_EAR_SHIFT, "-LEFT_EAR_SHIFT" },
+    { RIGHT_EYE_SHIFT, "LEFT_EYE_SHIFT" },
+    { RIGHT_BROW_TILT, "LEFT_BROW_TILT" },
+    { BOT_TEETH,       "JAW_OPEN / 15" },
+  };
+  for (int i = 0; i < (int)(sizeof(rig) / sizeof(rig[0])); i++)
+    driven->drive(rig[i].control, rig[i].expression);
+}
 
-    SET(BOT_TEETH, possin1);
-    SET(TOP_TEETH, possin2);
+// poses the model for the given tick of its loop
+void RkAlphaModel::animate(double tick)
+{
+  // each thread plays from where it last was, so playback steps along
+  // its segments rather than searching for them
+  static thread_local AnimPlayhead playhead;
+  animation.evaluate(tick, playhead);
 
-    glRotated(   -sines1*60, 0,1,0);
-    glRotated(-sinessq1*2.5-10, 1,0,0);
+  for (int c = 0; c < animation.channelCount(); c++)
+    SET(animation.control(c), playhead.value(c));
 
-    ticks++;
-  }
+  // then everything driven from what was just set
+  ModelerApplication::Instance()->DriveControls(tick);
 }
 
 /* COMPONENTS */
 void RkAlphaModel::TopHead()
 {
+  // parts are only posed again when a control they read changes
+  ModelScope scope("TopHead");
+  if (!scope.evaluate())
+    return;
+
   // VARIABLES
   double headHeight = 1.0;
   double eyePop = 0.05;
 
   // RENDER
-  glPushMatrix();
+  pushMatrix();
     //drawPoint();
 
     // base head
     SET_COLOR(COLOR_BASE);
-    glPushMatrix();
-      glRotated(-90, 1,0,0);
+    pushMatrix();
+      rotate(-90, 1,0,0);
       drawCylinder(headHeight, HEAD_RAD, HEAD_RAD);
-    glPopMatrix();
+    popMatrix();
     
-    glPushMatrix();
-      glTranslated(-HEAD_RAD, 0, -HEAD_RAD);
+    pushMatrix();
+      translate(-HEAD_RAD, 0, -HEAD_RAD);
       drawBox(HEAD_DIAM, headHeight, HEAD_RAD);
-    glPopMatrix();
+    popMatrix();
 
     // ear base
-    glPushMatrix();
-      glTranslated(0, headHeight, 0);
+    pushMatrix();
+      translate(0, headHeight, 0);
       // left ear
-      glPushMatrix();
-        glTranslated(HEAD_RAD, 0, -HEAD_RAD + 0.7 + VAL(RIGHT_EAR_SHIFT)*0.2);
-        glRotated(90, 0,1,0);
-        TopEar();
-      glPopMatrix();
+      pushMatrix();
+        translate(HEAD_RAD, 0, -HEAD_RAD + 0.7 + VAL(RIGHT_EAR_SHIFT)*0.2);
+        rotate(90, 0,1,0);
+        ears.addInstance();
+      popMatrix();
       // right ear
-      glPushMatrix();
-        glTranslated(-HEAD_RAD, 0, -HEAD_RAD + 0.7 + VAL(LEFT_EAR_SHIFT)*0.2);
-        glRotated(-90, 0,1,0);
-        TopEar();
-      glPopMatrix();
+      pushMatrix();
+        translate(-HEAD_RAD, 0, -HEAD_RAD + 0.7 + VAL(LEFT_EAR_SHIFT)*0.2);
+        rotate(-90, 0,1,0);
+        ears.addInstance();
+      popMatrix();
+      ears.draw(NULL, 0, drawEar, this);
 
-    glPopMatrix();
+    popMatrix();
 
     // base eyes
-    glPushMatrix();
-      glTranslated(0, headHeight-0.3, 0);
+    pushMatrix();
+      translate(0, headHeight-0.3, 0);
       
       // left eye
-      glPushMatrix();
-        glRotated(VAL(LEFT_EYE_SHIFT)*15-35, 0,1,0);
-        glTranslated(0, 0, HEAD_RAD+eyePop);
+      pushMatrix();
+        rotate(VAL(LEFT_EYE_SHIFT)*15-35, 0,1,0);
+        translate(0, 0, HEAD_RAD+eyePop);
         TopEye(VAL(LEFT_EYE_SHIFT), -VAL(LEFT_BROW_TILT));
-      glPopMatrix();
+      popMatrix();
       
       // left eye
-      glPushMatrix();
-        glRotated(VAL(RIGHT_EYE_SHIFT)*15+35, 0,1,0);
-        glTranslated(0, 0, HEAD_RAD+eyePop);
+      pushMatrix();
+        rotate(VAL(RIGHT_EYE_SHIFT)*15+35, 0,1,0);
+        translate(0, 0, HEAD_RAD+eyePop);
         TopEye(VAL(RIGHT_EYE_SHIFT), VAL(RIGHT_BROW_TILT));
-      glPopMatrix();
+      popMatrix();
       
-    glPopMatrix();
+    popMatrix();
    
-  glPopMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::TopEye(double eyeShift, double browTilt)
 {
+  double params[] = { eyeShift, browTilt };
+  ModelScope scope("TopEye", params, 2);
+  if (!scope.evaluate())
+    return;
+
   ModelerDrawState *mds = ModelerDrawState::Instance();
 
   double browSize = 0.1;
@@ -189,94 +271,86 @@ void RkAlphaModel::TopEye(double eyeShift, double browTilt)
   double   pupilRad = irisRad-0.1;
   double depth = browLength;
 
-  int fidelity;
+  // half circles from the tessellation tables; no trig per frame
+  const CircleTable &circle = unitCircle(mds->m_quality);
+  int fidelity = circle.divisions;
 
-  switch (mds->m_quality)
-  {
-    case HIGH:
-      fidelity = 32; break;
-    case MEDIUM:
-      fidelity = 20; break;
-    case LOW:
-      fidelity = 12; break;
-    case POOR:
-      fidelity = 8; break;
-  }
-
-  glPushMatrix();
+  pushMatrix();
     //drawPoint();
 
     // brow
     SET_COLOR(COLOR_DARK);
-    glPushMatrix();
-      glTranslated(-browLength/2, 0.1,-depth);
+    pushMatrix();
+      translate(-browLength/2, 0.1,-depth);
       // centered rotation
-      glTranslated( browLength/2,  browSize/2, 0);
-      glRotated(browTilt, 0,0,1);
-      glTranslated(-browLength/2, -browSize/2, 0);
+      translate( browLength/2,  browSize/2, 0);
+      rotate(browTilt, 0,0,1);
+      translate(-browLength/2, -browSize/2, 0);
 
       drawBox(browLength, browSize, depth);
-    glPopMatrix();
-
-    // eye-top
-    SET_COLOR(COLOR_WHITE);
-    drawTriangle(-scaleraRad,0,0, scaleraRad,0,0, -scaleraRad,0,-depth);
-    drawTriangle(scaleraRad,0,0, scaleraRad,0,-depth, -scaleraRad,0,-depth);
-    
-    // scalera
-    glPushMatrix();
-      glScaled(scaleraRad,scaleraRad,1);
-
+    popMatrix();
+
+    // eye-top and scalera: half disk plus rim, sharing the rim vertices
+    double scaleraParams[] = { (double)fidelity, scaleraRad, depth };
+    if (scaleraMesh.stale(scaleraParams, 3))
+    {
+      scaleraMesh.clear();
+      int center = scaleraMesh.addVertex(0,0,0);
+      int front  = scaleraMesh.vertexCount();
+      for (int i = 0; i <= fidelity; ++i)
+        scaleraMesh.addVertex(-circle.cosines[i]*scaleraRad, -circle.sines[i]*scaleraRad, 0);
+      int back   = scaleraMesh.vertexCount();
+      for (int i = 0; i <= fidelity; ++i)
+        scaleraMesh.addVertex(-circle.cosines[i]*scaleraRad, -circle.sines[i]*scaleraRad, -depth);
+
+      scaleraMesh.addTriangle(front, front+fidelity, back);
+      scaleraMesh.addTriangle(front+fidelity, back+fidelity, back);
       for (int i = 0; i < fidelity; ++i)
       {
-        double x1 = -cos(M_PI/fidelity*i);
-        double y1 = -sin(M_PI/fidelity*i);
-        double x2 = -cos(M_PI/fidelity*(i+1));
-        double y2 = -sin(M_PI/fidelity*(i+1));
-
-        drawTriangle(x1,y1,0, x2,y2,0, 0,0,0);
-        drawTriangle(x1,y1,0, x1,y1,-depth, x2,y2,0);
-        drawTriangle(x2,y2,0, x1,y1,-depth, x2,y2,-depth);
+        scaleraMesh.addTriangle(front+i, front+i+1, center);
+        scaleraMesh.addTriangle(front+i, back+i, front+i+1);
+        scaleraMesh.addTriangle(front+i+1, back+i, back+i+1);
       }
-    glPopMatrix();
-    // iris
-    SET_COLOR(COLOR_IRIS);
-    glPushMatrix();
-      glTranslated(eyeShift*0.1,0,0.01);
-      glScaled(irisRad,irisRad,1);
-
+    }
+
+    // iris and pupil: the same unit half disk, scaled
+    double halfDiskParams[] = { (double)fidelity };
+    if (halfDiskMesh.stale(halfDiskParams, 1))
+    {
+      halfDiskMesh.clear();
+      int center = halfDiskMesh.addVertex(0,0,0);
+      for (int i = 0; i <= fidelity; ++i)
+        halfDiskMesh.addVertex(-circle.cosines[i], -circle.sines[i], 0);
       for (int i = 0; i < fidelity; ++i)
-      {
-        double x1 = -cos(M_PI/fidelity*i);
-        double y1 = -sin(M_PI/fidelity*i);
-        double x2 = -cos(M_PI/fidelity*(i+1));
-        double y2 = -sin(M_PI/fidelity*(i+1));
+        halfDiskMesh.addTriangle(center+1+i, center+2+i, center);
+    }
 
-        drawTriangle(x1,y1,0, x2,y2,0, 0,0,0);
-      }
-    glPopMatrix();
+    SET_COLOR(COLOR_WHITE);
+    drawTriangleMesh(scaleraMesh);
+    // iris
+    SET_COLOR(COLOR_IRIS);
+    pushMatrix();
+      translate(eyeShift*0.1,0,0.01);
+      scale(irisRad,irisRad,1);
+      drawTriangleMesh(halfDiskMesh);
+    popMatrix();
     // pupil
     SET_COLOR(COLOR_PUPIL);
-    glPushMatrix();
-      glTranslated(eyeShift*0.2,0,0.02);
-      glScaled(pupilRad,pupilRad,1);
+    pushMatrix();
+      translate(eyeShift*0.2,0,0.02);
+      scale(pupilRad,pupilRad,1);
+      drawTriangleMesh(halfDiskMesh);
+    popMatrix();
 
-      for (int i = 0; i < fidelity; ++i)
-      {
-        double x1 = -cos(M_PI/fidelity*i);
-        double y1 = -sin(M_PI/fidelity*i);
-        double x2 = -cos(M_PI/fidelity*(i+1));
-        double y2 = -sin(M_PI/fidelity*(i+1));
-
-        drawTriangle(x1,y1,0, x2,y2,0, 0,0,0);
-      }
-    glPopMatrix();
-
-  glPopMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::TopEar()
 {
+  ModelScope scope("TopEar");
+  if (!scope.evaluate())
+    return;
+
   double earWidth  = 1;
   double earHeight = 1.5;
   double  inWidth  = 0.6;
@@ -292,117 +366,144 @@ void RkAlphaModel::TopEar()
   double    margin = 0.01;
 
   // RENDER
-  glPushMatrix();
+  pushMatrix();
     //drawPoint();
 
+    // ear prism
+    double earParams[] = { earWidth, earHeight, thickness };
+    if (earMesh.stale(earParams, 3))
+    {
+      earMesh.clear();
+      int top   = earMesh.addVertex(0,earHeight,0);
+      int left  = earMesh.addVertex(-earWidth/2,0,0);
+      int right = earMesh.addVertex( earWidth/2,0,0);
+      int backTop   = earMesh.addVertex(0,earHeight,-thickness);
+      int backLeft  = earMesh.addVertex(-earWidth/2,0,-thickness);
+      int backRight = earMesh.addVertex( earWidth/2,0,-thickness);
+
+      earMesh.addTriangle(top, left, right);
+      earMesh.addTriangle(backLeft, backTop, backRight);
+      earMesh.addTriangle(backTop, backLeft, left);
+      earMesh.addTriangle(top, backTop, left);
+      earMesh.addTriangle(top, backTop, right);
+      earMesh.addTriangle(right, backTop, backRight);
+    }
+
     SET_COLOR(COLOR_BASE);
-    drawTriangle(0,earHeight,0, -earWidth/2,0,0, earWidth/2,0,0);
-    drawTriangle(-earWidth/2,0,-thickness, 0,earHeight,-thickness, earWidth/2,0,-thickness);
-    drawTriangle(0,earHeight,-thickness, -earWidth/2,0,-thickness, -earWidth/2,0,0);
-    drawTriangle(0,earHeight,0, 0,earHeight,-thickness, -earWidth/2,0,0);
-    drawTriangle(0,earHeight,0, 0,earHeight,-thickness, earWidth/2,0,0);
-    drawTriangle(earWidth/2,0,0, 0,earHeight,-thickness, earWidth/2,0,-thickness);
-
-    glPushMatrix();
-      glTranslated(-baseRadius, 0, -baseLength);
+    drawTriangleMesh(earMesh);
+
+    pushMatrix();
+      translate(-baseRadius, 0, -baseLength);
       drawBox(baseWidth, thick, baseLength);
-    glPopMatrix();
+    popMatrix();
 
-    glPushMatrix();
-      glTranslated(0,0,-baseLength);
-      glRotated(-90, 1,0,0);
+    pushMatrix();
+      translate(0,0,-baseLength);
+      rotate(-90, 1,0,0);
       drawCylinder(thick, baseRadius, baseRadius);
       // bolt
       SET_COLOR(COLOR_BOLT);
-      glTranslated(0,0,thick);
+      translate(0,0,thick);
       drawCylinder(thick/2, boltRadius, boltRadius);
-    glPopMatrix();
+    popMatrix();
 
     SET_COLOR(COLOR_DARK);
     drawTriangle(0,inHeight,margin, -inWidth/2,0,margin, inWidth/2,0,margin);
     
-  glPopMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::Muzzle()
 {
+  ModelScope scope("Muzzle");
+  if (!scope.evaluate())
+    return;
+
   // VARABLES
   double muzzleLength = 4;
   double muzzleWidth  = 3.3;  // 0.5*2 + 2.3
   double muzzleHeight = 0.9;
 
   // RENDER
-  glPushMatrix();
+  pushMatrix();
     //drawPoint();
 
     SET_COLOR(COLOR_BASE);
     // Muzzle Base
-    glPushMatrix();
-      glTranslated(-muzzleWidth/2, -muzzleHeight, -HEAD_RAD);
+    pushMatrix();
+      translate(-muzzleWidth/2, -muzzleHeight, -HEAD_RAD);
       drawBox(muzzleWidth, muzzleHeight, muzzleLength);
-    glPopMatrix();
+    popMatrix();
 
     // snout
-    glPushMatrix();
-      glTranslated(0, -0.6, muzzleLength -1.05 -0.9);
+    pushMatrix();
+      translate(0, -0.6, muzzleLength -1.05 -0.9);
       Snout(muzzleWidth);
-    glPopMatrix();
+    popMatrix();
 
     // teeth
-    glPushMatrix();
-      glTranslated(0, -muzzleHeight, muzzleLength-HEAD_RAD-0.25);
+    pushMatrix();
+      translate(0, -muzzleHeight, muzzleLength-HEAD_RAD-0.25);
+      translate(0, (1.0-VAL(TOP_TEETH))*TOP_TEETH_HIGH, 0);
       // left teeth
-      glPushMatrix();
-        glTranslated(-muzzleWidth/2+0.25, 0, 0);
-        TopTeeth();
-      glPopMatrix();
+      pushMatrix();
+        translate(-muzzleWidth/2+0.25, 0, 0);
+        topTeeth.addInstance();
+      popMatrix();
       // right teeth
-      glPushMatrix();
-        glTranslated( muzzleWidth/2-0.25, 0, 0);
-        TopTeeth();
-      glPopMatrix();
-    glPopMatrix();
+      pushMatrix();
+        translate( muzzleWidth/2-0.25, 0, 0);
+        topTeeth.addInstance();
+      popMatrix();
+      topTeeth.draw(NULL, 0, drawTopTeeth, this);
+    popMatrix();
 
     // back-tuft
-    glPushMatrix();
-      glRotated(90, 0,1,0);
-      glTranslated(HEAD_RAD, 0, 0);
+    pushMatrix();
+      rotate(90, 0,1,0);
+      translate(HEAD_RAD, 0, 0);
       // left
-      glPushMatrix();
-        glTranslated(0, 0, -muzzleWidth/2+0.1);
-        BackTuft();
-      glPopMatrix();
+      pushMatrix();
+        translate(0, 0, -muzzleWidth/2+0.1);
+        tufts.addInstance();
+      popMatrix();
       // right
-      glPushMatrix();
-        glTranslated(0, 0,  muzzleWidth/2-0.1);
-        BackTuft();
-      glPopMatrix();
-    glPopMatrix();
+      pushMatrix();
+        translate(0, 0,  muzzleWidth/2-0.1);
+        tufts.addInstance();
+      popMatrix();
+      tufts.draw(NULL, 0, drawTuft, this);
+    popMatrix();
 
     // right reinforce
-    glPushMatrix();
-      glTranslated(muzzleWidth/2, -muzzleHeight+0.1, -1.05);
-      glRotated(90, 0,1,0);
-      JawSupport();
-    glPopMatrix();
+    pushMatrix();
+      translate(muzzleWidth/2, -muzzleHeight+0.1, -1.05);
+      rotate(90, 0,1,0);
+      jawSupports.addInstance();
+    popMatrix();
     // left reinforce
-    glPushMatrix();
-      glTranslated(-muzzleWidth/2, -muzzleHeight+0.1, -1.05);
-      glRotated(-90, 0,1,0);
-      JawSupport();
-    glPopMatrix();
+    pushMatrix();
+      translate(-muzzleWidth/2, -muzzleHeight+0.1, -1.05);
+      rotate(-90, 0,1,0);
+      jawSupports.addInstance();
+    popMatrix();
+    jawSupports.draw(NULL, 0, drawJawSupport, this);
 
     // Bottom Jaw
-    glPushMatrix();
-      glTranslated(0, -muzzleHeight-0.3, -HEAD_RAD+0.3);
+    pushMatrix();
+      translate(0, -muzzleHeight-0.3, -HEAD_RAD+0.3);
       BottomJaw();
-    glPopMatrix();
+    popMatrix();
 
-  glPopMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::Snout(double muzzleWidth)
 {
+  ModelScope scope("Snout", &muzzleWidth, 1);
+  if (!scope.evaluate())
+    return;
+
   double snoutLength = muzzleWidth + 0.2;
   double snoutWidth = 0.7;
   double snoutHeight = snoutWidth;
@@ -414,30 +515,30 @@ void RkAlphaModel::Snout(double muzzleWidth)
   double shiftDelta = (snoutLength - nostrilWid) / 2;
   double shiftRatio = pow(VAL(SNOUT_DELTA), 1.6);
 
-  glPushMatrix();
+  pushMatrix();
     drawPoint();
     // base snout
     SET_COLOR(COLOR_DARK);
-    glTranslated(-snoutLength/2, 0, 0);
+    translate(-snoutLength/2, 0, 0);
     drawBox(snoutLength, snoutHeight, snoutWidth);
-  glPopMatrix();
+  popMatrix();
 
   // nostrils
-  glPushMatrix();
+  pushMatrix();
     SET_COLOR(COLOR_GS_00);
-    glTranslated(-nostrilWid/2, nostrilCtr, nostrilCtr);
+    translate(-nostrilWid/2, nostrilCtr, nostrilCtr);
 
     // left nostril
-    glPushMatrix();
-      glTranslated(shiftDelta * shiftRatio, 0, 0);
+    pushMatrix();
+      translate(shiftDelta * shiftRatio, 0, 0);
       drawBox(nostrilWid, nostrilLen, nostrilLen);
-    glPopMatrix();
+    popMatrix();
     // left nostril
-    glPushMatrix();
-      glTranslated(-shiftDelta * shiftRatio, 0, 0);
+    pushMatrix();
+      translate(-shiftDelta * shiftRatio, 0, 0);
       drawBox(nostrilWid, nostrilLen, nostrilLen);
-    glPopMatrix();
-  glPopMatrix();
+    popMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::BackTuft()
@@ -446,14 +547,21 @@ void RkAlphaModel::BackTuft()
   double y[] = { 0.0, -0.3, -0.4, -0.6, -0.8, -1.2};
   double t = 0.1;
 
-  glPushMatrix();
+  pushMatrix();
     //drawPoint();
     // edge
+    double tuftParams[] = { x[0], x[1], x[2], y[0], y[1], y[2], y[3], y[4], y[5], t };
+    if (tuftMesh.stale(tuftParams, 10))
+    {
+      tuftMesh.clear();
+      addEdges(tuftMesh, x[0],y[0],y[2],t);
+      addEdges(tuftMesh, x[1],y[1],y[4],t);
+      addEdges(tuftMesh, x[2],y[3],y[5],t);
+    }
+
     SET_COLOR(COLOR_BASE);
-    drawEdges(x[0],y[0],y[2],t);
-    drawEdges(x[1],y[1],y[4],t);
-    drawEdges(x[2],y[3],y[5],t);
-  glPopMatrix();
+    drawTriangleMesh(tuftMesh);
+  popMatrix();
 }
 
 void RkAlphaModel::TopTeeth()
@@ -461,78 +569,81 @@ void RkAlphaModel::TopTeeth()
   // VARIABLES
   double bigDiam   = 0.2 ;
   double smallDiam = 0.15; 
-  double bigHigh   = 0.4 ;
+  double bigHigh   = TOP_TEETH_HIGH;
   double smallHigh = 0.3 ;
 
-  double shift = (1.0-VAL(TOP_TEETH))*bigHigh;
-
-  // RENDER
-  glPushMatrix();
+  // RENDER (slid by TOP_TEETH where the teeth are placed)
+  pushMatrix();
     //drawPoint();
 
     // first teeth
     SET_COLOR(COLOR_WHITE);
-    glPushMatrix();
-      glTranslated(0,shift,0);
-      glRotated(180, 0,0,1);
-      glRotated(-90, 1,0,0);
+    pushMatrix();
+      rotate(180, 0,0,1);
+      rotate(-90, 1,0,0);
 
       drawCylinder(bigHigh, bigDiam, 0);
       // second teeth
-      glPushMatrix();
-        glTranslated(0, bigDiam+smallDiam+0.1, 0);
+      pushMatrix();
+        translate(0, bigDiam+smallDiam+0.1, 0);
         drawCylinder(smallHigh, smallDiam, 0);
         // third teeth
-        glPushMatrix();
-          glTranslated(0, smallDiam*2+0.1, 0);
+        pushMatrix();
+          translate(0, smallDiam*2+0.1, 0);
           drawCylinder(smallHigh, smallDiam, 0);
-        glPopMatrix();
-      glPopMatrix();
-    glPopMatrix();
-  glPopMatrix();
+        popMatrix();
+      popMatrix();
+    popMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::BottomJaw()
 {
+  ModelScope scope("BottomJaw");
+  if (!scope.evaluate())
+    return;
+
   // VARIABLES
   double jawLength = 3.5;
   double jawWidth  = 2.3;  // 3.3 - 0.5*2
   double rotRadius = JAW_HEIGHT/2;
 
   // RENDER
-  glPushMatrix();
-    glRotated(VAL(JAW_OPEN), 1,0,0);
+  pushMatrix();
+    rotate(VAL(JAW_OPEN), 1,0,0);
     //drawPoint();
 
     SET_COLOR(COLOR_BASE);
-    glPushMatrix();
-      glTranslated(-jawWidth/2, -JAW_HEIGHT/2, 0);
+    pushMatrix();
+      translate(-jawWidth/2, -JAW_HEIGHT/2, 0);
       drawBox(jawWidth, JAW_HEIGHT, jawLength);
-    glPopMatrix();
+    popMatrix();
 
-    glPushMatrix();
-      glTranslated(-jawWidth/2, 0, 0);
-      glRotated(90, 0,1,0);
+    pushMatrix();
+      translate(-jawWidth/2, 0, 0);
+      rotate(90, 0,1,0);
       drawCylinder(jawWidth, rotRadius, rotRadius);
-    glPopMatrix();
+    popMatrix();
 
     // teeth
     SET_COLOR(COLOR_WHITE);
-    glPushMatrix();
-      glTranslated(0, rotRadius, jawLength-0.65);
+    pushMatrix();
+      translate(0, rotRadius, jawLength-0.65);
+      translate(0, -(1.0-VAL(BOT_TEETH))*BOT_TEETH_HIGH, 0);
       // left teeth
-      glPushMatrix();
-        glTranslated(-jawWidth/2+0.2, 0, 0);
-        BottomTeeth();
-      glPopMatrix();
+      pushMatrix();
+        translate(-jawWidth/2+0.2, 0, 0);
+        bottomTeeth.addInstance();
+      popMatrix();
       // left teeth
-      glPushMatrix();
-        glTranslated( jawWidth/2-0.2, 0, 0);
-        BottomTeeth();
-      glPopMatrix();
-    glPopMatrix();
-
-  glPopMatrix();
+      pushMatrix();
+        translate( jawWidth/2-0.2, 0, 0);
+        bottomTeeth.addInstance();
+      popMatrix();
+      bottomTeeth.draw(NULL, 0, drawBottomTeeth, this);
+    popMatrix();
+
+  popMatrix();
 }
 
 void RkAlphaModel::JawSupport()
@@ -545,67 +656,68 @@ void RkAlphaModel::JawSupport()
   double boltThick = 0.1;
   double boltDepth = 0.3 + reinThick;
 
-  glPushMatrix();
+  pushMatrix();
     //drawPoint();
-    glTranslated(0, -reinBase, -reinThick);
+    translate(0, -reinBase, -reinThick);
 
     SET_COLOR(COLOR_BASE);
     drawCylinder(reinThick, reinRadius, reinRadius);
-    glPushMatrix();
-      glTranslated(-reinRadius, 0, 0);
+    pushMatrix();
+      translate(-reinRadius, 0, 0);
       drawBox(reinSize, reinBase, reinThick);
-    glPopMatrix();
+    popMatrix();
 
     SET_COLOR(COLOR_BOLT);
-    glPushMatrix();
-      glTranslated(0, 0, boltThick+reinThick-boltDepth);
+    pushMatrix();
+      translate(0, 0, boltThick+reinThick-boltDepth);
       drawCylinder(boltDepth, boltRadius, boltRadius);
-    glPopMatrix();
+    popMatrix();
 
-  glPopMatrix();
+  popMatrix();
 }
 
 void RkAlphaModel::BottomTeeth()
 {
   // VARIABLES
   double radius = 0.15; 
-  double height = 0.3 ;
+  double height = BOT_TEETH_HIGH;
   double delta  = radius*2 + 0.1;
 
-  double shift = -(1.0-VAL(BOT_TEETH))*height;
-
-  // RENDER
-  glPushMatrix();
+  // RENDER (slid by BOT_TEETH where the teeth are placed)
+  pushMatrix();
     //drawPoint();
 
     // first teeth
     SET_COLOR(COLOR_WHITE);
-    glPushMatrix();
-      glTranslated(0,shift,0);
-      glRotated(-90, 1,0,0);
+    pushMatrix();
+      rotate(-90, 1,0,0);
 
       drawCylinder(height, radius, 0);
       // second teeth
-      glPushMatrix();
-        glTranslated(0, delta, 0);
+      pushMatrix();
+        translate(0, delta, 0);
         drawCylinder(height, radius, 0);
         // third teeth
-        glPushMatrix();
-          glTranslated(0, delta, 0);
+        pushMatrix();
+          translate(0, delta, 0);
           drawCylinder(height, radius, 0);
-        glPopMatrix();
+        popMatrix();
 
-      glPopMatrix();
+      popMatrix();
 
-    glPopMatrix();
+    popMatrix();
 
-  glPopMatrix();
+  popMatrix();
 }
 
 
 /* HELPERS */
 void RkAlphaModel::drawOrigin()
 {
+  ModelScope scope("Origin");
+  if (!scope.evaluate())
+    return;
+
   float size = 0.4f;
   float length = 6.0f;
   float thick = 0.06f;
@@ -616,25 +728,25 @@ void RkAlphaModel::drawOrigin()
     //drawSphere(size);
 
     // X-AXIS (RED)
-    glPushMatrix();
+    pushMatrix();
       SET_COLOR(COLOR_RED);
-      glTranslated(-length/2, -thick/2, -thick/2);
+      translate(-length/2, -thick/2, -thick/2);
       drawBox(length, thick, thick);
-    glPopMatrix();
+    popMatrix();
 
     // Y-AXIS (GREEN)
-    glPushMatrix();
+    pushMatrix();
       SET_COLOR(COLOR_GREEN);
-      glTranslated(-thick/2, -length/2, -thick/2);
+      translate(-thick/2, -length/2, -thick/2);
       drawBox(thick, length, thick);
-    glPopMatrix();
+    popMatrix();
 
     // Z-AXIS (BLUE)
-    glPushMatrix();
+    pushMatrix();
       SET_COLOR(COLOR_BLUE);
-      glTranslated(-thick/2, -thick/2, -length/2);
+      translate(-thick/2, -thick/2, -length/2);
       drawBox(thick, thick, length);
-    glPopMatrix();
+    popMatrix();
   }
 }
 
@@ -646,27 +758,34 @@ void RkAlphaModel::drawPoint()
 
   SET_COLOR(COLOR_CYAN);
   drawSphere(rad);
-  glPushMatrix();
-    glTranslated(off, off, off);
+  pushMatrix();
+    translate(off, off, off);
     drawBox(len, len, len);
-  glPopMatrix();
+  popMatrix();
 }
 
-void RkAlphaModel::drawEdges(double x, double y1, double y2, double t)
+void RkAlphaModel::addEdges(TriangleMesh &mesh, double x, double y1, double y2, double t)
 {
+  int frontTop  = mesh.addVertex(0,y2, t);
+  int frontTip  = mesh.addVertex(x,y2, t);
+  int frontBase = mesh.addVertex(0,y1, t);
+  int backTop   = mesh.addVertex(0,y2,-t);
+  int backTip   = mesh.addVertex(x,y2,-t);
+  int backBase  = mesh.addVertex(0,y1,-t);
+
   // front
-  drawTriangle(0,y2, t, x,y2, t, 0,y1, t);
+  mesh.addTriangle(frontTop, frontTip, frontBase);
   // back
-  drawTriangle(x,y2,-t, 0,y2,-t, 0,y1,-t);
+  mesh.addTriangle(backTip, backTop, backBase);
   // edge
-  drawTriangle(x,y2, t, x,y2,-t, 0,y1,-t);
-  drawTriangle(0,y1, t, x,y2, t, 0,y1,-t);
-  drawTriangle(x,y2, t, 0,y2, t, x,y2,-t);
-  drawTriangle(0,y2, t, 0,y2,-t, x,y2,-t);
+  mesh.addTriangle(frontTip, backTip, backBase);
+  mesh.addTriangle(frontBase, frontTip, backBase);
+  mesh.addTriangle(frontTip, frontTop, backTip);
+  mesh.addTriangle(frontTop, backTop, backTip);
 }
 
-// main runtime (disable it when creating other)
-int main()
+// makes the controls and starts the model; listed as the default model
+static void setupRkAlphaModel()
 {
   // init controller
   ModelerControl controls[NUM_CONTROLS];
@@ -709,6 +828,12 @@ int main()
   controls[DEBUGGER] = ModelerControl("!!!! Debugger !!!!", 0,1,1,0);
     controls[ORIGIN] = ModelerControl("  !! Origin Visible !!", 0,1,1,0);
 
+  // SWAY
+  controls[SWAY] = ModelerControl("** Sway **", 0, 1, 1, 0);
+    controls[SWAY_TURN] = ModelerControl("    Turn", -60, 60, 0.1f, 0);
+    controls[SWAY_NOD] = ModelerControl("    Nod", -15, 15, 0.1f, 0);
+
   ModelerApplication::Instance()->Init(&createRkAlphaModel, controls, NUM_CONTROLS);
-  return ModelerApplication::Instance()->Run();
 }
+
+static ModelerModel s_rkAlphaModel("rkalpha", setupRkAlphaModel, true);
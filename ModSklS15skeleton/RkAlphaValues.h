@@ -27,6 +27,10 @@ enum RkAlphaModelConbrotrols
             TOP_TEETH, BOT_TEETH,
   /* DEBUG */
   DEBUGGER, ORIGIN,
+  /* SWAY */
+    // The whole head, as the idle animation turns it.  Added last, so
+    // position files saved before it still load into the right sliders.
+  SWAY, SWAY_TURN, SWAY_NOD,
 
   /* COUNTER */
   NUM_CONTROLS
@@ -59,12 +63,14 @@ enum RkAlphaModelConbrotrols
 #define HEAD_DIAM 2.7
 #define HEAD_RAD HEAD_DIAM/2
 #define JAW_HEIGHT 0.6
+#define TOP_TEETH_HIGH 0.4
+#define BOT_TEETH_HIGH 0.3
 
 // Macro for accessing control values
 #define VAL(x) (ModelerApplication::Instance()->GetControlValue(x))
 #define SET(x,v) (ModelerApplication::Instance()->SetControlValue(x,v))
 #define SET_COLOR(x) setAmbientColor(.1f, .1f, .1f); setDiffuseColor(x)
-#define EULER_ROT(x,y,z) glRotated(z,0,0,1); glRotated(x,1,0,0); glRotated(y,0,1,0)
-#define UNI_SCALE(x) glScaled(x,x,x)
+#define EULER_ROT(x,y,z) rotateEuler(x,y,z)
+#define UNI_SCALE(x) scale(x,x,x)
 
 #endif
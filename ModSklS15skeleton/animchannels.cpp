@@ -0,0 +1,356 @@
+// animchannels.cpp
+
+#include "animchannels.h"
+#include "cpufeatures.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(MODELER_X86)
+#include <immintrin.h>
+#endif
+
+// Keys closer than this are at the same time
+static const double kTimeEpsilon = 1e-9;
+
+// Every bake gets a number no other bake has, so a playhead can tell
+// whether its arrays are still current
+static std::atomic<unsigned> s_bakes(0);
+
+// ****************************************************************************
+// Tangents
+// ****************************************************************************
+
+// True if keys loop round: they start at 0 and end at the loop length,
+// which makes the first and last key the same point
+static bool _wraps(const std::vector<Keyframe> &keys, double loop)
+{
+    return loop > 0 && keys.size() >= 3 &&
+           fabs(keys.front().m_time) < kTimeEpsilon &&
+           fabs(keys.back().m_time - loop) < kTimeEpsilon;
+}
+
+// The key before (step -1) or after (step 1) key i, across the wrap when
+// wrap is the loop length; false at an open end
+static bool _neighbour(const std::vector<Keyframe> &keys, int i, int step, double wrap,
+                       double &time, double &value)
+{
+    int n = (int)keys.size(), j = i + step;
+    double shift = 0;
+    if (j < 0 || j >= n)
+    {
+        if (wrap <= 0)
+            return false;
+        j = j < 0 ? n - 2 : 1;
+        shift = step * wrap;
+    }
+    time = keys[j].m_time + shift;
+    value = keys[j].m_value;
+    return true;
+}
+
+// The Catmull-Rom slope at key i: from its neighbour before to its
+// neighbour after, or from itself at an open end
+static double _catmull_rom_slope(const std::vector<Keyframe> &keys, int i, double wrap)
+{
+    double t0 = keys[i].m_time, v0 = keys[i].m_value, t1 = t0, v1 = v0;
+    _neighbour(keys, i, -1, wrap, t0, v0);
+    _neighbour(keys, i, 1, wrap, t1, v1);
+    return t1 - t0 > kTimeEpsilon ? (v1 - v0) / (t1 - t0) : 0;
+}
+
+// The slopes a Bezier segment leaves key i with and arrives at it with
+static void _bezier_slopes(const std::vector<Keyframe> &keys, int i, double wrap,
+                           double &in, double &out)
+{
+    const Keyframe &key = keys[i];
+    in = out = 0;
+    switch (key.m_tangents)
+    {
+    case TANGENT_FREE:
+        in = key.m_inSlope;
+        out = key.m_outSlope;
+        break;
+
+    case TANGENT_FLAT:
+        break;
+
+    case TANGENT_AUTO:
+    {
+        // level at an end or where the curve turns, so it never overshoots
+        double t0, v0, t1, v1;
+        if (_neighbour(keys, i, -1, wrap, t0, v0) && _neighbour(keys, i, 1, wrap, t1, v1) &&
+            (key.m_value - v0) * (v1 - key.m_value) > 0)
+            in = out = (v1 - v0) / (t1 - t0);
+        break;
+    }
+    }
+}
+
+// ****************************************************************************
+// Authoring
+// ****************************************************************************
+
+AnimChannels::AnimChannels()
+    : m_loopLength(0), m_bakedLoopLength(0), m_version(++s_bakes)
+{
+}
+
+int AnimChannels::addChannel(int control)
+{
+    m_keys.push_back(std::vector<Keyframe>());
+    m_control.push_back(control);
+    return channelCount() - 1;
+}
+
+static bool _key_before(const Keyframe &key, double time)
+{
+    return key.m_time < time;
+}
+
+void AnimChannels::setKey(int channel, const Keyframe &key)
+{
+    std::vector<Keyframe> &keys = m_keys[channel];
+    std::vector<Keyframe>::iterator at =
+        std::lower_bound(keys.begin(), keys.end(), key.m_time - kTimeEpsilon, _key_before);
+    if (at != keys.end() && at->m_time - key.m_time < kTimeEpsilon)
+        *at = key;
+    else
+        keys.insert(at, key);
+}
+
+void AnimChannels::clearKeys(int channel)
+{
+    m_keys[channel].clear();
+}
+
+void AnimChannels::setLoop(double length)
+{
+    m_loopLength = length > 0 ? length : 0;
+}
+
+void AnimChannels::_addSegment(double start, double invLength,
+                               double c0, double c1, double c2, double c3)
+{
+    m_segStart.push_back(start);
+    m_segInvLength.push_back(invLength);
+    m_c0.push_back(c0);
+    m_c1.push_back(c1);
+    m_c2.push_back(c2);
+    m_c3.push_back(c3);
+}
+
+void AnimChannels::bake()
+{
+    int numChannels = channelCount();
+    m_firstSegment.assign(numChannels, 0);
+    m_segmentCount.assign(numChannels, 0);
+    m_segStart.clear();
+    m_segInvLength.clear();
+    m_c0.clear();
+    m_c1.clear();
+    m_c2.clear();
+    m_c3.clear();
+
+    for (int c = 0; c < numChannels; ++c)
+    {
+        const std::vector<Keyframe> &keys = m_keys[c];
+        int n = (int)keys.size();
+        double wrap = _wraps(keys, m_loopLength) ? m_loopLength : 0;
+        m_firstSegment[c] = (int)m_segStart.size();
+
+        // one key holds its value for all time
+        if (n == 1)
+            _addSegment(keys[0].m_time, 0, keys[0].m_value, 0, 0, 0);
+
+        for (int i = 0; i + 1 < n; ++i)
+        {
+            const Keyframe &a = keys[i], &b = keys[i + 1];
+            double length = b.m_time - a.m_time;
+            double p0 = a.m_value, p1 = b.m_value, m0, m1, unused;
+
+            switch (a.m_interp)
+            {
+            case INTERP_LINEAR:
+                _addSegment(a.m_time, 1 / length, p0, p1 - p0, 0, 0);
+                continue;
+
+            case INTERP_CATMULL_ROM:
+                m0 = _catmull_rom_slope(keys, i, wrap);
+                m1 = _catmull_rom_slope(keys, i + 1, wrap);
+                break;
+
+            case INTERP_BEZIER:
+            default:
+                _bezier_slopes(keys, i, wrap, unused, m0);
+                _bezier_slopes(keys, i + 1, wrap, m1, unused);
+                break;
+            }
+
+            // Hermite form in u = 0..1, the same curve as the Bezier with
+            // handles a third of the segment along the slopes
+            m0 *= length;
+            m1 *= length;
+            _addSegment(a.m_time, 1 / length, p0, m0, 3 * (p1 - p0) - 2 * m0 - m1,
+                        2 * (p0 - p1) + m0 + m1);
+        }
+        m_segmentCount[c] = (int)m_segStart.size() - m_firstSegment[c];
+    }
+
+    m_bakedLoopLength = m_loopLength;
+    m_version = ++s_bakes;
+}
+
+// ****************************************************************************
+// Evaluation
+// ****************************************************************************
+
+static void _cubic_scalar(double time, const double *start, const double *invLength,
+                          const double *c0, const double *c1, const double *c2,
+                          const double *c3, double *value, int begin, int end)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        double u = (time - start[i]) * invLength[i];
+        u = u < 0 ? 0 : (u > 1 ? 1 : u);
+        value[i] = ((c3[i] * u + c2[i]) * u + c1[i]) * u + c0[i];
+    }
+}
+
+#if defined(MODELER_X86)
+
+// 2 channels at a time
+static int _cubic_sse2(double time, const double *start, const double *invLength,
+                       const double *c0, const double *c1, const double *c2,
+                       const double *c3, double *value, int count)
+{
+    const __m128d t = _mm_set1_pd(time), zero = _mm_setzero_pd(), one = _mm_set1_pd(1);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d u = _mm_mul_pd(_mm_sub_pd(t, _mm_loadu_pd(start + i)), _mm_loadu_pd(invLength + i));
+        u = _mm_min_pd(_mm_max_pd(u, zero), one);
+        __m128d v = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(c3 + i), u), _mm_loadu_pd(c2 + i));
+        v = _mm_add_pd(_mm_mul_pd(v, u), _mm_loadu_pd(c1 + i));
+        v = _mm_add_pd(_mm_mul_pd(v, u), _mm_loadu_pd(c0 + i));
+        _mm_storeu_pd(value + i, v);
+    }
+    return i;
+}
+
+// 4 channels at a time
+MODELER_TARGET("avx")
+static int _cubic_avx(double time, const double *start, const double *invLength,
+                      const double *c0, const double *c1, const double *c2,
+                      const double *c3, double *value, int count)
+{
+    const __m256d t = _mm256_set1_pd(time), zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256d u = _mm256_mul_pd(_mm256_sub_pd(t, _mm256_loadu_pd(start + i)),
+                                  _mm256_loadu_pd(invLength + i));
+        u = _mm256_min_pd(_mm256_max_pd(u, zero), one);
+        __m256d v = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(c3 + i), u), _mm256_loadu_pd(c2 + i));
+        v = _mm256_add_pd(_mm256_mul_pd(v, u), _mm256_loadu_pd(c1 + i));
+        v = _mm256_add_pd(_mm256_mul_pd(v, u), _mm256_loadu_pd(c0 + i));
+        _mm256_storeu_pd(value + i, v);
+    }
+    _mm256_zeroupper();
+    return i;
+}
+
+#endif
+
+// Sizes playhead for the current bake, with every channel at its first segment
+void AnimChannels::_reset(AnimPlayhead &playhead) const
+{
+    int numChannels = (int)m_firstSegment.size();
+    playhead.m_segment.assign(numChannels, -1);
+    playhead.m_start.assign(numChannels, 0);
+    playhead.m_invLength.assign(numChannels, 0);
+    playhead.m_c0.assign(numChannels, 0);
+    playhead.m_c1.assign(numChannels, 0);
+    playhead.m_c2.assign(numChannels, 0);
+    playhead.m_c3.assign(numChannels, 0);
+    playhead.m_value.assign(numChannels, 0);
+    for (int c = 0; c < numChannels; ++c)
+        if (m_segmentCount[c] > 0)
+            _select(playhead, c, m_firstSegment[c]);
+    playhead.m_version = m_version;
+}
+
+// The segment of channel that time falls in
+int AnimChannels::_find(int channel, double time) const
+{
+    const double *starts = &m_segStart[0];
+    int first = m_firstSegment[channel], count = m_segmentCount[channel];
+    return (int)(std::upper_bound(starts + first + 1, starts + first + count, time) - starts) - 1;
+}
+
+void AnimChannels::_select(AnimPlayhead &playhead, int channel, int segment) const
+{
+    playhead.m_segment[channel]   = segment;
+    playhead.m_start[channel]     = m_segStart[segment];
+    playhead.m_invLength[channel] = m_segInvLength[segment];
+    playhead.m_c0[channel]        = m_c0[segment];
+    playhead.m_c1[channel]        = m_c1[segment];
+    playhead.m_c2[channel]        = m_c2[segment];
+    playhead.m_c3[channel]        = m_c3[segment];
+}
+
+void AnimChannels::evaluate(double time, AnimPlayhead &playhead) const
+{
+    if (playhead.m_version != m_version)
+        _reset(playhead);
+
+    if (m_bakedLoopLength > 0)
+    {
+        time = fmod(time, m_bakedLoopLength);
+        if (time < 0)
+            time += m_bakedLoopLength;
+    }
+
+    // Move each channel's playhead to the segment time is in: usually the
+    // one it's in already or the next, otherwise search for it
+    int numChannels = (int)m_firstSegment.size();
+    for (int c = 0; c < numChannels; ++c)
+    {
+        int count = m_segmentCount[c];
+        if (count < 2)
+            continue;
+        int first = m_firstSegment[c], last = first + count - 1;
+        int s = playhead.m_segment[c];
+        if ((s == first || time >= m_segStart[s]) && (s == last || time < m_segStart[s + 1]))
+            continue;
+        if (s < last && time >= m_segStart[s + 1] && (s + 1 == last || time < m_segStart[s + 2]))
+            ++s;
+        else
+        {
+            s = _find(c, time);
+            ++playhead.m_seeks;
+        }
+        _select(playhead, c, s);
+    }
+
+    if (numChannels == 0)
+        return;
+
+    // Then every channel's cubic in one pass
+    const double *start = &playhead.m_start[0], *invLength = &playhead.m_invLength[0];
+    const double *c0 = &playhead.m_c0[0], *c1 = &playhead.m_c1[0];
+    const double *c2 = &playhead.m_c2[0], *c3 = &playhead.m_c3[0];
+    double *value = &playhead.m_value[0];
+
+    int done = 0;
+#if defined(MODELER_X86)
+    if (cpuHasAVX())
+        done = _cubic_avx(time, start, invLength, c0, c1, c2, c3, value, numChannels);
+    done += _cubic_sse2(time, start + done, invLength + done, c0 + done, c1 + done,
+                        c2 + done, c3 + done, value + done, numChannels - done);
+#endif
+    _cubic_scalar(time, start, invLength, c0, c1, c2, c3, value, done, numChannels);
+}
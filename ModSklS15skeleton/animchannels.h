@@ -0,0 +1,140 @@
+// animchannels.h
+
+// Keyframed animation curves, one channel per animated value.
+//
+// Each channel holds keys sorted by time; the segment between two keys is
+// interpolated linearly, as a Bezier curve whose handles come from the
+// keys' tangents, or as a Catmull-Rom spline through the neighbouring keys.
+// Before the first key and after the last a channel holds its end value.
+//
+// Editing keys only touches the authoring side.  bake() then turns every
+// segment of every channel into a cubic in its local parameter, with the
+// coefficients laid out as structure of arrays, and evaluate() reads only
+// that.  Per-playback state lives in an AnimPlayhead: it remembers which
+// segment each channel was in, so stepping forward costs a compare or two
+// per channel and only a seek (or the wrap of a loop) binary searches.  The
+// active segments are copied into contiguous arrays as the playhead moves,
+// so the per-frame pass over all channels is one SIMD loop with no lookups.
+//
+// A baked AnimChannels is read-only: any number of threads may evaluate it
+// at once, each with a playhead of its own.
+
+#ifndef ANIMCHANNELS_H
+#define ANIMCHANNELS_H
+
+#include <cstddef>
+#include <vector>
+
+// How the segment from a key to the next one is drawn
+enum Interpolation_t
+{
+    INTERP_LINEAR,
+    INTERP_BEZIER,          // handles from the keys' tangent modes
+    INTERP_CATMULL_ROM,     // through the neighbouring keys, ignoring tangents
+};
+
+// Where a key's Bezier handles point
+enum TangentMode_t
+{
+    TANGENT_AUTO,           // smooth through the neighbours, flat at a peak or trough
+    TANGENT_FLAT,           // level
+    TANGENT_FREE,           // m_inSlope and m_outSlope, in value per unit time
+};
+
+struct Keyframe
+{
+    Keyframe(double time = 0, double value = 0, Interpolation_t interp = INTERP_BEZIER,
+             TangentMode_t tangents = TANGENT_AUTO, double inSlope = 0, double outSlope = 0)
+        : m_time(time), m_value(value), m_interp(interp), m_tangents(tangents),
+          m_inSlope(inSlope), m_outSlope(outSlope) {}
+
+    double          m_time;
+    double          m_value;
+    Interpolation_t m_interp;       // of the segment starting here
+    TangentMode_t   m_tangents;
+    double          m_inSlope;
+    double          m_outSlope;
+};
+
+class AnimChannels;
+
+// Where one playback is up to, and what it evaluated to last
+class AnimPlayhead
+{
+public:
+    AnimPlayhead() : m_version(0), m_seeks(0) {}
+
+    double value(int channel) const { return m_value[channel]; }
+    const double *values() const { return m_value.empty() ? NULL : &m_value[0]; }
+
+    // How many times a channel had to search for its segment
+    long seeks() const { return m_seeks; }
+
+private:
+    friend class AnimChannels;
+
+    unsigned            m_version;      // of the bake the arrays below are from
+    long                m_seeks;
+
+    // Per channel: the segment it's in and that segment's cubic
+    std::vector<int>    m_segment;
+    std::vector<double> m_start;
+    std::vector<double> m_invLength;
+    std::vector<double> m_c0, m_c1, m_c2, m_c3;
+    std::vector<double> m_value;
+};
+
+class AnimChannels
+{
+public:
+    AnimChannels();
+
+    // A channel driving control (or -1 for a value the caller reads itself);
+    // returns its index.  Playheads see it from the next bake() on.
+    int addChannel(int control = -1);
+    int channelCount() const { return (int)m_keys.size(); }
+    int control(int channel) const { return m_control[channel]; }
+
+    // Adds key, replacing any key at the same time
+    void setKey(int channel, const Keyframe &key);
+    void clearKeys(int channel);
+    int keyCount(int channel) const { return (int)m_keys[channel].size(); }
+    const Keyframe &key(int channel, int i) const { return m_keys[channel][i]; }
+
+    // Plays time modulo length (0 plays it straight); a channel keyed at
+    // both 0 and length joins up smoothly across the wrap
+    void setLoop(double length);
+    double loopLength() const { return m_loopLength; }
+
+    // Rebuilds the evaluation arrays.  Key and loop edits take effect
+    // here; until then the channels play as they were last baked.
+    void bake();
+
+    // Evaluates every channel at time into playhead, from wherever the
+    // playhead was; channels with no keys evaluate to 0
+    void evaluate(double time, AnimPlayhead &playhead) const;
+
+private:
+    void _addSegment(double start, double invLength, double c0, double c1, double c2, double c3);
+    void _reset(AnimPlayhead &playhead) const;
+    int  _find(int channel, double time) const;
+    void _select(AnimPlayhead &playhead, int channel, int segment) const;
+
+    // Authoring side
+    std::vector<std::vector<Keyframe> > m_keys;
+    std::vector<int>    m_control;
+    double              m_loopLength;
+
+    // Baked: each channel's segments are m_firstSegment .. + m_segmentCount
+    // in the arrays below, as value = c0 + c1 u + c2 u^2 + c3 u^3 with
+    // u = (time - start) * invLength clamped to [0, 1]
+    std::vector<int>    m_firstSegment;
+    std::vector<int>    m_segmentCount;
+    std::vector<double> m_segStart;
+    std::vector<double> m_segInvLength;
+    std::vector<double> m_c0, m_c1, m_c2, m_c3;
+    double              m_bakedLoopLength;
+    unsigned            m_version;      // unique to every bake
+};
+
+#endif
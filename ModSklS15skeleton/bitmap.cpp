@@ -2,155 +2,505 @@
 // bitmap.cpp
 //
 // handle MS bitmap I/O. For portability, we don't use the data structure defined in Windows.h
-// However, there is some strange thing, the side of our structure is different from what it 
+// However, there is some strange thing, the side of our structure is different from what it
 // should though we define it in the same way as MS did. So, there is a hack, we use the hardcoded
 // constanr, 14, instead of the sizeof to calculate the size of the structure.
 // You are not supposed to worry about this part. However, I will appreciate if you find out the
 // reason and let me know. Thanks.
 //
+// (The reason: BMP_BITMAPFILEHEADER has a DWORD after its first WORD, so
+// the compiler pads it to 16 bytes.  The reader below parses the headers
+// field by field out of the mapped file, which sidesteps it.)
+//
 
 #include "bitmap.h"
- 
-BMP_BITMAPFILEHEADER bmfh; 
-BMP_BITMAPINFOHEADER bmih; 
+#include "cpufeatures.h"
+#include "mappedfile.h"
 
-unsigned char *readBMP(char *fname, int& width, int& height)
-{ 
-        FILE* file; 
-        BMP_DWORD pos; 
- 
-        if ( (file=fopen( fname, "rb" )) == NULL )  
-                return NULL; 
-         
-//      I am doing fread( &bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, file ) in a safe way. :}
-        fread( &(bmfh.bfType), 2, 1, file); 
-        fread( &(bmfh.bfSize), 4, 1, file); 
-        fread( &(bmfh.bfReserved1), 2, 1, file); 
-        fread( &(bmfh.bfReserved2), 2, 1, file); 
-        fread( &(bmfh.bfOffBits), 4, 1, file); 
-
-        pos = bmfh.bfOffBits; 
- 
-        fread( &bmih, sizeof(BMP_BITMAPINFOHEADER), 1, file ); 
- 
-        // error checking
-        if ( bmfh.bfType!= 0x4d42 ) {   // "BM" actually
-                return NULL;
+#include <cstring>
+
+#if defined(MODELER_X86)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+// ****************************************************************************
+// Swizzles
+// ****************************************************************************
+
+static void _swap_rb24_scalar( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        for ( int i = 0; i < pixels; ++i, src += 3, dst += 3 )
+        {
+                unsigned char r = src[0];
+                dst[1] = src[1];
+                dst[0] = src[2];
+                dst[2] = r;
         }
-        if ( bmih.biBitCount != 24 )  
-                return NULL; 
-/*
-        if ( bmih.biCompression != BMP_BI_RGB ) {
-                return NULL;
+}
+
+static void _swap_rb32_scalar( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        for ( int i = 0; i < pixels; ++i, src += 4, dst += 4 )
+        {
+                unsigned char r = src[0];
+                dst[1] = src[1];
+                dst[0] = src[2];
+                dst[2] = r;
+                dst[3] = src[3];
         }
-*/
-        fseek( file, pos, SEEK_SET ); 
- 
-        width = bmih.biWidth; 
-        height = bmih.biHeight; 
- 
-        int padWidth = width * 3; 
-        int pad = 0; 
-        if ( padWidth % 4 != 0 ) 
-        { 
-                pad = 4 - (padWidth % 4); 
-                padWidth += pad; 
-        } 
-        int bytes = height*padWidth; 
- 
-        unsigned char *data = new unsigned char [bytes]; 
-
-        int foo = fread( data, bytes, 1, file ); 
-        
-        if (!foo) {
-                delete [] data;
-                return NULL;
+}
+
+static void _bgra_to_rgb_scalar( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        for ( int i = 0; i < pixels; ++i, src += 4, dst += 3 )
+        {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+        }
+}
+
+static void _bgr_to_rgba_scalar( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        for ( int i = 0; i < pixels; ++i, src += 3, dst += 4 )
+        {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                dst[3] = 255;
+        }
+}
+
+#if defined(MODELER_X86)
+
+// The 24-bit loops work on four pixels (12 bytes) per 16-byte register and
+// let the top four bytes spill into the next group, so they stop while
+// there's still a little more than one block of slack left.
+
+MODELER_TARGET("ssse3")
+static int _swap_rb24_ssse3( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        const __m128i mask = _mm_setr_epi8( 2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15 );
+        int i = 0;
+        for ( ; i + 18 <= pixels; i += 16 )
+        {
+                // all loads before any store, so dst == src works
+                const unsigned char *s = src + i * 3;
+                __m128i a = _mm_loadu_si128( (const __m128i *)(s) );
+                __m128i b = _mm_loadu_si128( (const __m128i *)(s + 12) );
+                __m128i c = _mm_loadu_si128( (const __m128i *)(s + 24) );
+                __m128i d = _mm_loadu_si128( (const __m128i *)(s + 36) );
+                unsigned char *o = dst + i * 3;
+                _mm_storeu_si128( (__m128i *)(o),      _mm_shuffle_epi8( a, mask ) );
+                _mm_storeu_si128( (__m128i *)(o + 12), _mm_shuffle_epi8( b, mask ) );
+                _mm_storeu_si128( (__m128i *)(o + 24), _mm_shuffle_epi8( c, mask ) );
+                _mm_storeu_si128( (__m128i *)(o + 36), _mm_shuffle_epi8( d, mask ) );
+        }
+        return i;
+}
+
+MODELER_TARGET("ssse3")
+static int _bgra_to_rgb_ssse3( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        const __m128i mask = _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+        int i = 0;
+        for ( ; i + 18 <= pixels; i += 16 )
+        {
+                const __m128i *s = (const __m128i *)(src + i * 4);
+                __m128i a = _mm_shuffle_epi8( _mm_loadu_si128( s ),     mask );
+                __m128i b = _mm_shuffle_epi8( _mm_loadu_si128( s + 1 ), mask );
+                __m128i c = _mm_shuffle_epi8( _mm_loadu_si128( s + 2 ), mask );
+                __m128i d = _mm_shuffle_epi8( _mm_loadu_si128( s + 3 ), mask );
+                unsigned char *o = dst + i * 3;
+                _mm_storeu_si128( (__m128i *)(o),      a );
+                _mm_storeu_si128( (__m128i *)(o + 12), b );
+                _mm_storeu_si128( (__m128i *)(o + 24), c );
+                _mm_storeu_si128( (__m128i *)(o + 36), d );
+        }
+        return i;
+}
+
+MODELER_TARGET("ssse3")
+static int _bgr_to_rgba_ssse3( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        const __m128i mask  = _mm_setr_epi8( 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 );
+        const __m128i alpha = _mm_set1_epi32( (int)0xFF000000 );
+        int i = 0;
+        for ( ; i + 18 <= pixels; i += 16 )
+        {
+                const unsigned char *s = src + i * 3;
+                __m128i *o = (__m128i *)(dst + i * 4);
+                _mm_storeu_si128( o,     _mm_or_si128( _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(s) ),      mask ), alpha ) );
+                _mm_storeu_si128( o + 1, _mm_or_si128( _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(s + 12) ), mask ), alpha ) );
+                _mm_storeu_si128( o + 2, _mm_or_si128( _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(s + 24) ), mask ), alpha ) );
+                _mm_storeu_si128( o + 3, _mm_or_si128( _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(s + 36) ), mask ), alpha ) );
         }
+        return i;
+}
+
+// Plain SSE2 is enough for the 32-bit swap: it's shifts and masks
+static int _swap_rb32_sse2( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        const __m128i ga = _mm_set1_epi32( (int)0xFF00FF00 );
+        const __m128i lo = _mm_set1_epi32( 0x000000FF );
+        int i = 0;
+        for ( ; i + 4 <= pixels; i += 4 )
+        {
+                __m128i v = _mm_loadu_si128( (const __m128i *)(src + i * 4) );
+                __m128i r = _mm_and_si128( _mm_srli_epi32( v, 16 ), lo );
+                __m128i b = _mm_slli_epi32( _mm_and_si128( v, lo ), 16 );
+                v = _mm_or_si128( _mm_and_si128( v, ga ), _mm_or_si128( r, b ) );
+                _mm_storeu_si128( (__m128i *)(dst + i * 4), v );
+        }
+        return i;
+}
+
+#endif
+
+void bmpSwapRB24( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        int done = 0;
+#if defined(MODELER_X86)
+        if ( cpuHasSSSE3() )
+                done = _swap_rb24_ssse3( dst, src, pixels );
+#endif
+        _swap_rb24_scalar( dst + done * 3, src + done * 3, pixels - done );
+}
 
-        fclose( file );
-        
-        // shuffle bitmap data such that it is (R,G,B) tuples in row-major order
-        int i, j;
-        j = 0;
-        unsigned char temp;
-        unsigned char* in;
-        unsigned char* out;
+void bmpSwapRB32( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        int done = 0;
+#if defined(MODELER_X86)
+        done = _swap_rb32_sse2( dst, src, pixels );
+#endif
+        _swap_rb32_scalar( dst + done * 4, src + done * 4, pixels - done );
+}
 
-        in = data;
-        out = data;
+void bmpBGRAToRGB( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        int done = 0;
+#if defined(MODELER_X86)
+        if ( cpuHasSSSE3() )
+                done = _bgra_to_rgb_ssse3( dst, src, pixels );
+#endif
+        _bgra_to_rgb_scalar( dst + done * 3, src + done * 4, pixels - done );
+}
+
+void bmpBGRToRGBA( unsigned char *dst, const unsigned char *src, int pixels )
+{
+        int done = 0;
+#if defined(MODELER_X86)
+        if ( cpuHasSSSE3() )
+                done = _bgr_to_rgba_ssse3( dst, src, pixels );
+#endif
+        _bgr_to_rgba_scalar( dst + done * 4, src + done * 3, pixels - done );
+}
+
+// ****************************************************************************
+// Reading
+// ****************************************************************************
+
+static inline BMP_WORD _le16( const unsigned char *p )
+{
+        return (BMP_WORD)( p[0] | ( p[1] << 8 ) );
+}
+
+static inline BMP_DWORD _le32( const unsigned char *p )
+{
+        return (BMP_DWORD)p[0] | ( (BMP_DWORD)p[1] << 8 ) | ( (BMP_DWORD)p[2] << 16 ) | ( (BMP_DWORD)p[3] << 24 );
+}
+
+static unsigned char *_read_bmp( const char *fname, int& width, int& height, int channels )
+{
+        MappedFile file;
+        if ( !file.open( fname ) )
+                return NULL;
 
-        for ( j = 0; j < height; ++j )
+        const unsigned char *p = file.m_data;
+        if ( file.m_size < 14 + 40 || _le16( p ) != 0x4d42 )    // "BM" actually
+                return NULL;
+
+        BMP_DWORD offBits     = _le32( p + 10 );
+        BMP_DWORD infoSize    = _le32( p + 14 );
+        BMP_LONG  w           = (BMP_LONG)_le32( p + 18 );
+        BMP_LONG  h           = (BMP_LONG)_le32( p + 22 );
+        BMP_WORD  bitCount    = _le16( p + 28 );
+        BMP_DWORD compression = _le32( p + 30 );
+
+        if ( infoSize < 40 || w <= 0 || h == 0 || h == (BMP_LONG)0x80000000 )
+                return NULL;
+
+        bool keepAlpha = false;
+        bool bgra      = true;      // the usual layout, which has fast paths
+        int  order[4]  = { 2, 1, 0, 3 };    // byte holding R, G, B, A
+        if ( bitCount == 24 )
+        {
+                if ( compression != BMP_BI_RGB )
+                        return NULL;
+        }
+        else if ( bitCount == 32 )
         {
-                for ( i = 0; i < width; ++i )
+                if ( compression == BMP_BI_BITFIELDS )
                 {
-                        out[1] = in[1];
-                        temp = in[2];
-                        out[2] = in[0];
-                        out[0] = temp;
+                        // Any layout with one whole byte per channel.  The
+                        // masks follow a 40 byte header and sit at the same
+                        // place in V4/V5 ones, which add the alpha mask.
+                        int numMasks = infoSize >= 56 ? 4 : 3;
+                        if ( file.m_size < (size_t)( 54 + 4 * numMasks ) )
+                                return NULL;
+                        for ( int c = 0; c < numMasks; ++c )
+                        {
+                                BMP_DWORD mask = _le32( p + 54 + 4 * c );
+                                int b = 0;
+                                while ( b < 4 && mask != ( 0xFFu << ( 8 * b ) ) )
+                                        ++b;
+                                if ( b == 4 )
+                                {
+                                        if ( c == 3 && mask == 0 )
+                                                break;          // no alpha
+                                        return NULL;
+                                }
+                                order[c] = b;
+                                if ( c == 3 )
+                                        keepAlpha = true;
+                        }
+                        bgra = order[0] == 2 && order[1] == 1 && order[2] == 0 &&
+                               ( !keepAlpha || order[3] == 3 );
+                        if ( !keepAlpha )
+                                order[3] = 6 - order[0] - order[1] - order[2];
+                }
+                else if ( compression != BMP_BI_RGB )
+                        return NULL;
+        }
+        else
+                return NULL;
+
+        bool   topDown = h < 0;
+        int    rows    = topDown ? -h : h;
+        size_t stride  = ( (size_t)w * ( bitCount / 8 ) + 3 ) & ~(size_t)3;
+        if ( offBits > file.m_size || ( file.m_size - offBits ) / stride < (size_t)rows )
+                return NULL;
 
-                        in += 3;
-                        out += 3;
+        unsigned char *data = new unsigned char [ (size_t)w * rows * channels ];
+        for ( int y = 0; y < rows; ++y )
+        {
+                // bottom-up out, whatever the file's order
+                const unsigned char *in = p + offBits + stride * ( topDown ? rows - 1 - y : y );
+                unsigned char *out = data + (size_t)y * w * channels;
+
+                if ( bitCount == 24 )
+                {
+                        if ( channels == 3 )
+                                bmpSwapRB24( out, in, w );
+                        else
+                                bmpBGRToRGBA( out, in, w );
+                }
+                else if ( !bgra )
+                {
+                        for ( int i = 0; i < w; ++i, in += 4, out += channels )
+                        {
+                                out[0] = in[order[0]];
+                                out[1] = in[order[1]];
+                                out[2] = in[order[2]];
+                                if ( channels == 4 )
+                                        out[3] = keepAlpha ? in[order[3]] : 255;
+                        }
+                }
+                else if ( channels == 3 )
+                        bmpBGRAToRGB( out, in, w );
+                else
+                {
+                        bmpSwapRB32( out, in, w );
+                        // BI_RGB's fourth byte is unused, not alpha
+                        if ( !keepAlpha )
+                                for ( int i = 0; i < w; ++i )
+                                        out[i * 4 + 3] = 255;
                 }
-                in += pad;
         }
-                          
-        return data; 
-} 
- 
-void writeBMP(char *iname, int width, int height, unsigned char *data) 
-{ 
-        int bytes, pad;
-        bytes = width * 3;
-        pad = (bytes%4) ? 4-(bytes%4) : 0;
-        bytes += pad;
-        bytes *= height;
+
+        width  = w;
+        height = rows;
+        return data;
+}
+
+unsigned char *readBMP(const char *fname, int& width, int& height)
+{
+        return _read_bmp( fname, width, height, 3 );
+}
+
+unsigned char *readBMP(char *fname, int& width, int& height)
+{
+        return _read_bmp( fname, width, height, 3 );
+}
+
+unsigned char *readBMPAlpha(const char *fname, int& width, int& height)
+{
+        return _read_bmp( fname, width, height, 4 );
+}
+
+// ****************************************************************************
+// Writing
+// ****************************************************************************
+
+// Writes the file and info headers; 32-bit images get a V4 header so their
+// alpha mask survives a round trip
+static bool _write_headers( FILE *foo, int width, int height, int bitCount )
+{
+        BMP_BITMAPFILEHEADER bmfh;
+        BMP_BITMAPINFOHEADER bmih;
+
+        int rows = height < 0 ? -height : height;
+        unsigned long long bytes = ( ( (unsigned long long)width * ( bitCount / 8 ) + 3 ) & ~3ull ) * rows;
+        BMP_DWORD infoSize = bitCount == 32 ? 108 : sizeof(BMP_BITMAPINFOHEADER);
 
         bmfh.bfType = 0x4d42;    // "BM"
-        bmfh.bfSize = sizeof(BMP_BITMAPFILEHEADER) + sizeof(BMP_BITMAPINFOHEADER) + bytes;
+        bmfh.bfOffBits = /*hack sizeof(BMP_BITMAPFILEHEADER)=14, sizeof doesn't work?*/
+                                         14 + infoSize;
+        // past 4GB the size field can't be right; readers go by the header
+        unsigned long long total = bmfh.bfOffBits + bytes;
+        bmfh.bfSize = total > 0xFFFFFFFFull ? 0xFFFFFFFFu : (BMP_DWORD)total;
         bmfh.bfReserved1 = 0;
         bmfh.bfReserved2 = 0;
-        bmfh.bfOffBits = /*hack sizeof(BMP_BITMAPFILEHEADER)=14, sizeof doesn't work?*/ 
-                                         14 + sizeof(BMP_BITMAPINFOHEADER);
 
-        bmih.biSize = sizeof(BMP_BITMAPINFOHEADER);
+        bmih.biSize = infoSize;
         bmih.biWidth = width;
         bmih.biHeight = height;
         bmih.biPlanes = 1;
-        bmih.biBitCount = 24;
-        bmih.biCompression = BMP_BI_RGB;
+        bmih.biBitCount = (BMP_WORD)bitCount;
+        bmih.biCompression = bitCount == 32 ? BMP_BI_BITFIELDS : BMP_BI_RGB;
         bmih.biSizeImage = 0;
         bmih.biXPelsPerMeter = (int)(100 / 2.54 * 72);
         bmih.biYPelsPerMeter = (int)(100 / 2.54 * 72);
         bmih.biClrUsed = 0;
         bmih.biClrImportant = 0;
 
-		// "w+b", not "wb" -- Eugene
-        FILE *foo=fopen(iname, "w+b"); 
-
         //      fwrite(&bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, foo);
-        fwrite( &(bmfh.bfType), 2, 1, foo); 
-        fwrite( &(bmfh.bfSize), 4, 1, foo); 
-        fwrite( &(bmfh.bfReserved1), 2, 1, foo); 
-        fwrite( &(bmfh.bfReserved2), 2, 1, foo); 
-        fwrite( &(bmfh.bfOffBits), 4, 1, foo); 
+        fwrite( &(bmfh.bfType), 2, 1, foo);
+        fwrite( &(bmfh.bfSize), 4, 1, foo);
+        fwrite( &(bmfh.bfReserved1), 2, 1, foo);
+        fwrite( &(bmfh.bfReserved2), 2, 1, foo);
+        fwrite( &(bmfh.bfOffBits), 4, 1, foo);
+
+        fwrite(&bmih, sizeof(BMP_BITMAPINFOHEADER), 1, foo);
+
+        if ( bitCount == 32 )
+        {
+                // BGRA masks, sRGB, then unused endpoints and gammas
+                unsigned char v4[108 - 40];
+                memset( v4, 0, sizeof( v4 ) );
+                const BMP_DWORD masks[5] = { 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000, 0x73524742 };
+                for ( int i = 0; i < 5; ++i )
+                        for ( int b = 0; b < 4; ++b )
+                                v4[i * 4 + b] = (unsigned char)( masks[i] >> ( 8 * b ) );
+                fwrite( v4, sizeof( v4 ), 1, foo );
+        }
 
-        fwrite(&bmih, sizeof(BMP_BITMAPINFOHEADER), 1, foo); 
+        return !ferror( foo );
+}
+
+void writeBMP(char *iname, int width, int height, unsigned char *data)
+{
+        int bytes = width * 3;
+        bytes += (bytes%4) ? 4-(bytes%4) : 0;
 
-        bytes /= height;
         unsigned char* scanline = new unsigned char [bytes];
-        for ( int j = 0; j < height; ++j )
+        writeBMP( iname, width, height, data, scanline );
+        delete [] scanline;
+}
+
+bool writeBMP(const char *iname, int width, int height,
+              const unsigned char *data, unsigned char *scanline)
+{
+        int bytes, pad;
+        bytes = width * 3;
+        pad = (bytes%4) ? 4-(bytes%4) : 0;
+        bytes += pad;
+
+		// "w+b", not "wb" -- Eugene
+        FILE *foo=fopen(iname, "w+b");
+        if (foo == NULL)
+                return false;
+
+        bool ok = _write_headers( foo, width, height, 24 );
+
+        memset( scanline + bytes - pad, 0, pad );
+        for ( int j = 0; j < height && ok; ++j )
+        {
+                bmpSwapRB24( scanline, data + (size_t)j*3*width, width );
+                ok = fwrite( scanline, bytes, 1, foo) == 1;
+        }
+
+        if ( fclose(foo) != 0 )
+                ok = false;
+        return ok;
+}
+
+// ****************************************************************************
+// BmpRowWriter
+// ****************************************************************************
+
+BmpRowWriter::BmpRowWriter()
+        : m_file( NULL ), m_width( 0 ), m_height( 0 ), m_channels( 3 ), m_rows( 0 ), m_failed( false )
+{
+}
+
+BmpRowWriter::~BmpRowWriter()
+{
+        if ( m_file )
+                close();
+}
+
+bool BmpRowWriter::open( const char *fname, int width, int height, int channels, bool topDown )
+{
+        if ( m_file || width <= 0 || height <= 0 || ( channels != 3 && channels != 4 ) )
+                return false;
+
+        m_file = fopen( fname, "w+b" );
+        if ( m_file == NULL )
+                return false;
+
+        m_width    = width;
+        m_height   = height;
+        m_channels = channels;
+        m_rows     = 0;
+        m_failed   = !_write_headers( m_file, width, topDown ? -height : height, channels * 8 );
+
+        // padding stays zero; only the pixels are rewritten per row
+        m_scanline.assign( ( (size_t)width * channels + 3 ) & ~(size_t)3, 0 );
+        return !m_failed;
+}
+
+bool BmpRowWriter::writeRows( const unsigned char *rows, int count )
+{
+        if ( m_file == NULL || m_failed || m_rows + count > m_height )
+                return false;
+
+        size_t rowBytes = (size_t)m_width * m_channels;
+        for ( int j = 0; j < count; ++j, rows += rowBytes )
         {
-                memcpy( scanline, data + j*3*width, bytes );
-                for ( int i = 0; i < width; ++i )
+                if ( m_channels == 3 )
+                        bmpSwapRB24( &m_scanline[0], rows, m_width );
+                else
+                        bmpSwapRB32( &m_scanline[0], rows, m_width );
+                if ( fwrite( &m_scanline[0], m_scanline.size(), 1, m_file ) != 1 )
                 {
-                        unsigned char temp = scanline[i*3];
-                        scanline[i*3] = scanline[i*3+2];
-                        scanline[i*3+2] = temp;
+                        m_failed = true;
+                        return false;
                 }
-                fwrite( scanline, bytes, 1, foo);
         }
+        m_rows += count;
+        return true;
+}
 
-        delete [] scanline;
+bool BmpRowWriter::close()
+{
+        if ( m_file == NULL )
+                return false;
 
-        fclose(foo);
-} 
\ No newline at end of file
+        bool ok = !m_failed && m_rows == m_height;
+        if ( fclose( m_file ) != 0 )
+                ok = false;
+        m_file = NULL;
+        return ok;
+}
@@ -10,8 +10,10 @@
 
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 #define BMP_BI_RGB        0L
+#define BMP_BI_BITFIELDS  3L
 
 typedef unsigned short  BMP_WORD; 
 typedef unsigned int    BMP_DWORD; 
@@ -40,7 +42,55 @@ typedef struct {
 } BMP_BITMAPINFOHEADER; 
 
 // global I/O routines
+// readBMP accepts 24-bit and 32-bit uncompressed images, bottom-up or
+// top-down, and always returns bottom-up RGB rows (delete[] when done).
+// The file is memory-mapped rather than read through a FILE*.
 extern unsigned char *readBMP(char *fname, int& width, int& height);
+extern unsigned char *readBMP(const char *fname, int& width, int& height);
+// Same, but returns RGBA; 24-bit images get an alpha of 255
+extern unsigned char *readBMPAlpha(const char *fname, int& width, int& height);
 extern void writeBMP(char *iname, int width, int height, unsigned char *data); 
+// Same as above, but safe to call from any thread and doesn't allocate:
+// scanline must hold at least one padded row ((width*3+3) & ~3 bytes)
+extern bool writeBMP(const char *iname, int width, int height,
+                     const unsigned char *data, unsigned char *scanline);
+
+// Channel swizzles, vectorized where the CPU allows.  dst may equal src
+// for the two swaps.
+extern void bmpSwapRB24(unsigned char *dst, const unsigned char *src, int pixels);   // BGR <-> RGB
+extern void bmpSwapRB32(unsigned char *dst, const unsigned char *src, int pixels);   // BGRA <-> RGBA
+extern void bmpBGRAToRGB(unsigned char *dst, const unsigned char *src, int pixels);
+extern void bmpBGRToRGBA(unsigned char *dst, const unsigned char *src, int pixels);
+
+// Writes a BMP a few rows at a time, for images too big to hold in memory.
+// Rows are RGB (channels 3, written as 24-bit) or RGBA (channels 4,
+// written as 32-bit BGRA), given bottom-up like glReadPixels unless
+// topDown is set.
+class BmpRowWriter
+{
+public:
+        BmpRowWriter();
+        ~BmpRowWriter();
+
+        bool open( const char *fname, int width, int height, int channels = 3, bool topDown = false );
+        // count rows of width*channels bytes each, tightly packed
+        bool writeRows( const unsigned char *rows, int count );
+        // Fails if fewer than height rows were written
+        bool close();
+
+        int rowsWritten() const { return m_rows; }
+
+private:
+        BmpRowWriter( const BmpRowWriter & ) {}
+        BmpRowWriter& operator=( const BmpRowWriter & ) { return *this; }
+
+        FILE                       *m_file;
+        int                         m_width;
+        int                         m_height;
+        int                         m_channels;
+        int                         m_rows;
+        bool                        m_failed;
+        std::vector<unsigned char>  m_scanline;
+};
 
 #endif
\ No newline at end of file
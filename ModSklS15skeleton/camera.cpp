@@ -3,6 +3,7 @@
 #include <gl/glu.h>
 
 #include "camera.h"
+#include "vecexpr.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -88,8 +89,8 @@ void Camera::calculateViewingTransformParameters()
 	MakeHTrans(originXform, mLookAt);
 	
 	mPosition = Vec3f(0,0,0);
-	// grouped for (mat4 * vec3) ops instead of (mat4 * mat4) ops
-	mPosition = originXform * (azimXform * (elevXform * (dollyXform * mPosition)));
+	// lazy product, applied as (mat4 * vec3) ops instead of (mat4 * mat4) ops
+	mPosition = lazy(originXform) * azimXform * elevXform * dollyXform * mPosition;
 
 	if ( fmod((double)mElevation, 2.0*M_PI) < 3*M_PI/2 && fmod((double)mElevation, 2.0*M_PI) > M_PI/2 )
 		mUpVector= Vec3f(0,-1,0);
@@ -138,7 +139,7 @@ void Camera::dragMouse( int x, int y )
 			Vec3f transYAxis = (mPosition - mLookAt) ^ transXAxis;
 			transYAxis /= sqrt((transYAxis*transYAxis));
 
-			setLookAt(getLookAt() + transXAxis*xTrack + transYAxis*yTrack);
+			setLookAt(lazy(getLookAt()) + lazy(transXAxis)*xTrack + lazy(transYAxis)*yTrack);
 			
 			break;
 		}
@@ -185,6 +186,23 @@ void Camera::applyViewingTransform() {
   //lookAt(mPosition, mLookAt, mUpVector);
 }
 
+Mat4f Camera::getViewingTransform()
+{
+	if( mDirtyTransform )
+		calculateViewingTransformParameters();
+
+	// what gluLookAt builds
+	Vec3f forward = mLookAt - mPosition;
+	forward.normalize();
+	Vec3f side = forward ^ mUpVector;
+	side.normalize();
+	Vec3f up = side ^ forward;
+
+	return Mat4f( side[0],     side[1],     side[2],     -(side * mPosition),
+	              up[0],       up[1],       up[2],       -(up * mPosition),
+	              -forward[0], -forward[1], -forward[2], forward * mPosition,
+	              0,           0,           0,           1 );
+}
 
 void Camera::lookAt(Vec3f eye, Vec3f at, Vec3f up)
 {
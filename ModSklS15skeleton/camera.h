@@ -80,6 +80,9 @@ public:
     
     //---[ Viewing Transform ]--------------------------------
     void applyViewingTransform();
+    // The matrix applyViewingTransform() multiplies by, for drawing
+    // without GL
+    Mat4f getViewingTransform();
 
 	// gluLookAt equivalent
 	void lookAt(Vec3f eye, Vec3f at, Vec3f up);
@@ -0,0 +1,238 @@
+// controlgraph.cpp
+
+#include "controlgraph.h"
+
+#include <algorithm>
+#include <cstring>
+
+// The graph recording on each thread
+static thread_local ControlGraph *s_current = NULL;
+
+static bool _sameMaterial(const DrawMaterial &a, const DrawMaterial &b)
+{
+    // a texture by name could only be told apart by its list's names
+    if (a.m_textureName >= 0 || b.m_textureName >= 0)
+        return false;
+    return memcmp(a.m_ambient, b.m_ambient, sizeof(a.m_ambient)) == 0 &&
+           memcmp(a.m_diffuse, b.m_diffuse, sizeof(a.m_diffuse)) == 0 &&
+           memcmp(a.m_specular, b.m_specular, sizeof(a.m_specular)) == 0 &&
+           a.m_shininess == b.m_shininess && a.m_texture == b.m_texture;
+}
+
+ControlGraph::ControlGraph()
+    : m_indexed(true), m_list(NULL), m_controls(NULL), m_numControls(0), m_compared(false),
+      m_drawMode(-1), m_quality(-1)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+ControlGraph *ControlGraph::current()
+{
+    return s_current;
+}
+
+void ControlGraph::clear()
+{
+    m_nodes.clear();
+    m_roots.clear();
+    m_readers.clear();
+    m_indexed = true;
+    m_last.clear();
+}
+
+// ****************************************************************************
+// Poses
+// ****************************************************************************
+
+void ControlGraph::begin(DrawList &list, const double *controls, int numControls)
+{
+    // the fragments were drawn at one draw mode and quality
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+    if (mds->m_drawMode != m_drawMode || mds->m_quality != m_quality)
+    {
+        clear();
+        m_drawMode = mds->m_drawMode;
+        m_quality  = mds->m_quality;
+    }
+
+    m_list        = &list;
+    m_controls    = controls;
+    m_numControls = numControls;
+    m_compared    = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    Open root;
+    root.m_node      = -1;
+    root.m_recording = false;
+    m_open.assign(1, root);
+    s_current = this;
+}
+
+void ControlGraph::end()
+{
+    // a pose that opened no scopes still keeps the comparison in step
+    if (!m_compared)
+        markChanged();
+
+    m_stats.m_items = m_list->itemCount();
+    m_open.clear();
+    m_list = NULL;
+    m_controls = NULL;
+    if (s_current == this)
+        s_current = NULL;
+}
+
+// Marks the scopes reading controls that have changed since the last pose
+// stale, and remembers the controls for the next
+void ControlGraph::markChanged()
+{
+    m_compared = true;
+    // the index has a list for each control, so it's redone when they change
+    if (!m_indexed || (int)m_readers.size() != m_numControls)
+        reindex();
+
+    if ((int)m_last.size() != m_numControls)
+    {
+        for (size_t n = 0; n < m_nodes.size(); ++n)
+            m_nodes[n].m_stale = true;
+    }
+    else
+    {
+        for (int c = 0; c < m_numControls; ++c)
+        {
+            if (m_last[c] == m_controls[c])
+                continue;
+            const std::vector<int> &readers = m_readers[c];
+            for (size_t r = 0; r < readers.size(); ++r)
+                m_nodes[readers[r]].m_stale = true;
+        }
+    }
+    m_last.assign(m_controls, m_controls + m_numControls);
+}
+
+void ControlGraph::reindex()
+{
+    m_readers.assign(m_numControls, std::vector<int>());
+    for (size_t n = 0; n < m_nodes.size(); ++n)
+        for (size_t r = 0; r < m_nodes[n].m_reads.size(); ++r)
+            if (m_nodes[n].m_reads[r] < m_numControls)
+                m_readers[m_nodes[n].m_reads[r]].push_back((int)n);
+    m_indexed = true;
+}
+
+void ControlGraph::noteRead(int control)
+{
+    ControlGraph *graph = s_current;
+    if (graph && graph->m_open.size() > 1)
+        graph->m_open.back().m_reads.push_back(control);
+}
+
+// ****************************************************************************
+// Scopes
+// ****************************************************************************
+
+// Opens the scope called name in the one open now.  Returns true if its
+// body has to run (and is being recorded); false if its fragment from an
+// earlier pose has been put in its place.
+bool ControlGraph::open(const char *name, const double *params, int count)
+{
+    if (!m_compared)
+        markChanged();
+
+    // which of its parent's children of that name this is
+    std::vector<std::pair<const char *, int> > &named = m_open.back().m_named;
+    int ordinal = 0;
+    size_t i = 0;
+    while (i < named.size() && strcmp(named[i].first, name) != 0)
+        ++i;
+    if (i == named.size())
+        named.push_back(std::make_pair(name, 0));
+    else
+        ordinal = ++named[i].second;
+
+    int parent = m_open.back().m_node;
+    const std::vector<int> &siblings = parent < 0 ? m_roots : m_nodes[parent].m_children;
+    int node = -1;
+    for (size_t s = 0; s < siblings.size() && node < 0; ++s)
+        if (m_nodes[siblings[s]].m_ordinal == ordinal &&
+            strcmp(m_nodes[siblings[s]].m_name, name) == 0)
+            node = siblings[s];
+    if (node < 0)
+    {
+        Node fresh;
+        fresh.m_name    = name;
+        fresh.m_parent  = parent;
+        fresh.m_ordinal = ordinal;
+        fresh.m_valid   = false;
+        fresh.m_stale   = true;
+        node = (int)m_nodes.size();
+        m_nodes.push_back(fresh);
+        (parent < 0 ? m_roots : m_nodes[parent].m_children).push_back(node);
+    }
+
+    Node &n = m_nodes[node];
+    const DrawMaterial &material = m_list->currentMaterial();
+    ++m_stats.m_scopes;
+
+    Open scope;
+    scope.m_node = node;
+    if (n.m_valid && !n.m_stale && n.m_params.size() == (size_t)count &&
+        std::equal(params, params + count, n.m_params.begin()) &&
+        _sameMaterial(n.m_material, material))
+    {
+        m_list->addFragment(n.m_fragment);
+        ++m_stats.m_reused;
+        m_stats.m_reusedItems += (long)n.m_fragment.m_items.size();
+
+        // the parent depends on what this one reads as much as if it had run
+        std::vector<int> &reads = m_open.back().m_reads;
+        reads.insert(reads.end(), n.m_reads.begin(), n.m_reads.end());
+
+        scope.m_recording = false;
+        m_open.push_back(scope);
+        return false;
+    }
+
+    n.m_params.assign(params, params + count);
+    n.m_material = material;
+    scope.m_recording = true;
+    scope.m_mark = m_list->beginFragment();
+    m_open.push_back(scope);
+    return true;
+}
+
+void ControlGraph::close()
+{
+    Open &scope = m_open.back();
+    if (scope.m_recording)
+    {
+        Node &n = m_nodes[scope.m_node];
+        std::vector<int> &reads = scope.m_reads;
+        std::sort(reads.begin(), reads.end());
+        reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+        if (reads != n.m_reads)
+        {
+            n.m_reads.swap(reads);
+            m_indexed = false;
+        }
+        n.m_valid = m_list->endFragment(scope.m_mark, &n.m_fragment);
+        n.m_stale = false;
+
+        std::vector<int> &parentReads = m_open[m_open.size() - 2].m_reads;
+        parentReads.insert(parentReads.end(), n.m_reads.begin(), n.m_reads.end());
+    }
+    m_open.pop_back();
+}
+
+ModelScope::ModelScope(const char *name, const double *params, int count)
+    : m_graph(ControlGraph::current()), m_evaluate(true)
+{
+    if (m_graph)
+        m_evaluate = m_graph->open(name, params, count);
+}
+
+ModelScope::~ModelScope()
+{
+    if (m_graph)
+        m_graph->close();
+}
@@ -0,0 +1,154 @@
+// controlgraph.h
+
+// Which parts of the model read which controls, so that posing it again
+// after a control changes only runs the parts that read that control.
+//
+// A model marks parts of its hierarchy as scopes:
+//
+//     void Model::Eye(double shift)
+//     {
+//         ModelScope scope("Eye", &shift, 1);
+//         if (!scope.evaluate())
+//             return;
+//         ...                     // reads VAL()s, draws
+//     }
+//
+// The first time a pose is recorded with a ControlGraph attached, each
+// scope notes the controls read inside it (its nested scopes' included)
+// and keeps what it drew as a DrawFragment.  The graph indexes the scopes
+// by control.  At the next pose the controls that changed mark just the
+// scopes that read them stale; every other scope puts its fragment back
+// under the current matrix and skips its body, and only the stale ones run
+// and are recorded again.
+//
+// A scope's drawing must depend only on the controls it reads, the values
+// given to it (anything worked out from controls outside it, such as a
+// function's arguments), the draw mode and quality, and the material it
+// starts with.  The matrix it starts with doesn't matter.  Controls are
+// compared when the first scope of a pose opens, so set them (animate)
+// before that.
+//
+// Without a graph attached (drawing straight to GL or a .ray file, crowd
+// copies, baking) scopes do nothing and their bodies always run.
+
+#ifndef CONTROLGRAPH_H
+#define CONTROLGRAPH_H
+
+#include "drawlist.h"
+
+#include <vector>
+
+struct ControlGraphStats
+{
+    int  m_scopes;          // opened in the pose
+    int  m_reused;          // of those, put back from the last pose
+    long m_items;           // drawn in the pose
+    long m_reusedItems;     // of those, from reused scopes
+
+    // The share of the pose that wasn't evaluated again
+    double reuseRatio() const { return m_items ? (double)m_reusedItems / m_items : 0; }
+};
+
+class ControlGraph
+{
+public:
+    ControlGraph();
+
+    // Brackets one pose recorded into list, from controls[numControls]
+    // (which the model may change as it poses).  The graph is current on
+    // the calling thread in between.
+    void begin(DrawList &list, const double *controls, int numControls);
+    void end();
+
+    // The graph recording on the calling thread, or NULL
+    static ControlGraph *current();
+
+    // Everything is evaluated again at the next pose
+    void clear();
+
+    int numScopes() const { return (int)m_nodes.size(); }
+    // How the last pose went
+    const ControlGraphStats &stats() const { return m_stats; }
+
+    // For GetControlValue: notes a read of control by the scope open on
+    // the calling thread, if any
+    static void noteRead(int control);
+
+private:
+    friend class ModelScope;
+
+    struct Node
+    {
+        const char         *m_name;
+        int                 m_parent;
+        int                 m_ordinal;      // among same-named siblings
+        std::vector<int>    m_children;
+        std::vector<int>    m_reads;        // its own and its children's, sorted
+        std::vector<double> m_params;
+        DrawMaterial        m_material;     // what it began with
+        DrawFragment        m_fragment;
+        bool                m_valid;        // m_fragment can stand in for the body
+        bool                m_stale;        // a control it reads has changed
+    };
+
+    // A scope open in the current pose
+    struct Open
+    {
+        int                 m_node;
+        bool                m_recording;
+        DrawListMark        m_mark;
+        std::vector<int>    m_reads;
+        std::vector<std::pair<const char *, int> > m_named;   // children opened, by name
+    };
+
+    bool open(const char *name, const double *params, int count);
+    void close();
+    void markChanged();
+    void reindex();
+
+    std::vector<Node>              m_nodes;
+    std::vector<int>               m_roots;
+    std::vector<std::vector<int> > m_readers;   // per control, the nodes reading it
+    bool                           m_indexed;
+
+    // the pose being recorded
+    DrawList                      *m_list;
+    const double                  *m_controls;
+    int                            m_numControls;
+    bool                           m_compared;
+    std::vector<Open>              m_open;      // the root first
+
+    // as of the last pose
+    std::vector<double>            m_last;
+    int                            m_drawMode;
+    int                            m_quality;
+
+    ControlGraphStats              m_stats;
+
+    ControlGraph(const ControlGraph &);
+    ControlGraph &operator=(const ControlGraph &);
+};
+
+// A part of the model that can be reused while the controls it reads stay
+// the same; see above.  name should be a string literal: scopes are told
+// apart by name, by order among their siblings of the same name, and by
+// their parents.
+class ModelScope
+{
+public:
+    ModelScope(const char *name, const double *params = NULL, int count = 0);
+    ~ModelScope();
+
+    // False if the scope was put back from the last pose, so its body
+    // should be skipped
+    bool evaluate() const { return m_evaluate; }
+
+private:
+    ControlGraph *m_graph;
+    bool          m_evaluate;
+
+    ModelScope(const ModelScope &);
+    ModelScope &operator=(const ModelScope &);
+};
+
+#endif
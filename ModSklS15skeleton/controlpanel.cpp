@@ -0,0 +1,252 @@
+// controlpanel.cpp
+
+#include "controlpanel.h"
+
+#include <FL/Fl.H>
+#include <FL/Fl_Box.H>
+#include <FL/Fl_Scrollbar.H>
+#include <FL/Fl_Value_Slider.H>
+#include <FL/fl_draw.H>
+
+#include <algorithm>
+
+// The sizes the panel has always had
+static const int kLabelHeight  = 20;
+static const int kSliderHeight = 20;
+static const int kRowHeight    = kLabelHeight + kSliderHeight;
+
+// Beyond this many changes at once, the list of picked controls is built
+// again from the flags rather than edited
+static const int kMaxEdits = 32;
+
+ControlPanel::ControlPanel(int x, int y, int w, int h, const char *label)
+    : Fl_Group(x, y, w, h, label), m_values(NULL), m_moved(NULL), m_first(0)
+{
+    box(FL_FLAT_BOX);
+
+    int width = Fl::scrollbar_size();
+    m_scrollbar = new Fl_Scrollbar(x + w - width, y, width, h);
+    m_scrollbar->type(FL_VERTICAL);
+    m_scrollbar->linesize(1);
+    m_scrollbar->callback(_scrolled);
+    end();
+}
+
+void ControlPanel::setControls(const ModelerControl controls[], int numControls,
+                               double *values, ControlMoved_f moved)
+{
+    m_controls.assign(controls, controls + numControls);
+    m_values = values;
+    m_moved  = moved;
+
+    m_picked.assign(numControls, 0);
+    m_shown.clear();
+    m_changes.clear();
+    m_first = 0;
+    if (layout())
+        redraw();
+}
+
+// ****************************************************************************
+// Picking
+
+void ControlPanel::showControl(int control)
+{
+    if (m_picked[control])
+        return;
+    m_picked[control] = 1;
+    m_changes.push_back(control);
+}
+
+void ControlPanel::hideControl(int control)
+{
+    if (!m_picked[control])
+        return;
+    m_picked[control] = 0;
+    m_changes.push_back(control);
+}
+
+void ControlPanel::update()
+{
+    if (m_changes.empty())
+        return;
+
+    if ((int)m_changes.size() <= kMaxEdits)
+    {
+        // a few clicks' worth: edit the list in place
+        for (size_t i = 0; i < m_changes.size(); ++i)
+        {
+            int control = m_changes[i];
+            std::vector<int>::iterator at =
+                std::lower_bound(m_shown.begin(), m_shown.end(), control);
+            bool listed = at != m_shown.end() && *at == control;
+            if (m_picked[control] && !listed)
+                m_shown.insert(at, control);
+            else if (!m_picked[control] && listed)
+                m_shown.erase(at);
+        }
+    }
+    else
+    {
+        m_shown.clear();
+        for (int control = 0; control < (int)m_picked.size(); ++control)
+            if (m_picked[control])
+                m_shown.push_back(control);
+    }
+    m_changes.clear();
+
+    if (layout())
+        redraw();
+}
+
+// ****************************************************************************
+// Values
+
+void ControlPanel::refresh()
+{
+    for (size_t r = 0; r < m_rows.size(); ++r)
+        if (m_rows[r].m_control >= 0)
+            m_rows[r].m_slider->value(m_values[m_rows[r].m_control]);
+}
+
+void ControlPanel::refresh(int control)
+{
+    for (size_t r = 0; r < m_rows.size(); ++r)
+        if (m_rows[r].m_control == control)
+            m_rows[r].m_slider->value(m_values[control]);
+}
+
+void ControlPanel::_moved(Fl_Widget *slider, void *control)
+{
+    ControlPanel *panel = (ControlPanel *)slider->parent();
+    int c = (int)(size_t)control;
+    panel->m_values[c] = ((Fl_Value_Slider *)slider)->value();
+    if (panel->m_moved)
+        panel->m_moved(c, panel->m_values[c]);
+}
+
+// ****************************************************************************
+// Rows
+
+// Points the rows at the picked controls from m_first on, making more rows
+// if the ones there are don't fill the panel yet.  Returns true if anything
+// in view changed.
+bool ControlPanel::layout()
+{
+    int width  = w() - m_scrollbar->w();
+    int slots  = (h() + kRowHeight - 1) / kRowHeight;
+    int full   = std::max(1, h() / kRowHeight);
+    int shown  = (int)m_shown.size();
+
+    m_first = std::max(0, std::min(m_first, shown - full));
+    m_scrollbar->value(m_first, full, 0, shown);
+
+    int  needed  = std::min(slots, shown - m_first);
+    bool changed = false;
+    while ((int)m_rows.size() < needed)
+    {
+        // made here rather than in the constructor's begin()/end()
+        Fl_Group *current = Fl_Group::current();
+        Fl_Group::current(0);
+
+        Row row;
+        row.m_label = new Fl_Box(0, 0, width, kLabelHeight);
+        row.m_label->labelsize(10);
+        row.m_label->box(FL_FLAT_BOX);
+        row.m_slider = new Fl_Value_Slider(0, 0, width, kSliderHeight);
+        row.m_slider->type(FL_HOR_SLIDER);
+        row.m_slider->precision(2);
+        row.m_slider->callback(_moved);
+        row.m_control = -1;
+        row.m_label->hide();
+        row.m_slider->hide();
+        add(row.m_label);
+        add(row.m_slider);
+        m_rows.push_back(row);
+
+        Fl_Group::current(current);
+    }
+
+    for (size_t r = 0; r < m_rows.size(); ++r)
+    {
+        Row &row = m_rows[r];
+        int top = y() + (int)r * kRowHeight;
+        if (row.m_label->x() != x() || row.m_label->y() != top || row.m_label->w() != width)
+        {
+            row.m_label->resize(x(), top, width, kLabelHeight);
+            row.m_slider->resize(x(), top + kLabelHeight, width, kSliderHeight);
+            changed = true;
+        }
+
+        int control = (int)r < needed ? m_shown[m_first + r] : -1;
+        if (control == row.m_control)
+            continue;
+        changed = true;
+
+        row.m_control = control;
+        if (control < 0)
+        {
+            row.m_label->hide();
+            row.m_slider->hide();
+            continue;
+        }
+        const ModelerControl &c = m_controls[control];
+        row.m_label->label(c.m_name);
+        row.m_slider->range(c.m_minimum, c.m_maximum);
+        row.m_slider->step(c.m_stepsize);
+        row.m_slider->value(m_values[control]);
+        row.m_slider->user_data((void *)(size_t)control);
+        row.m_label->show();
+        row.m_slider->show();
+    }
+    return changed;
+}
+
+void ControlPanel::scrollTo(int first)
+{
+    if (first == m_first)
+        return;
+    m_first = first;
+    if (layout())
+        redraw();
+}
+
+void ControlPanel::_scrolled(Fl_Widget *scrollbar, void *)
+{
+    ControlPanel *panel = (ControlPanel *)scrollbar->parent();
+    panel->scrollTo(((Fl_Scrollbar *)scrollbar)->value());
+}
+
+// ****************************************************************************
+// Fl_Group
+
+void ControlPanel::resize(int x, int y, int w, int h)
+{
+    // not Fl_Group::resize, which would stretch the rows
+    Fl_Widget::resize(x, y, w, h);
+    int width = Fl::scrollbar_size();
+    m_scrollbar->resize(x + w - width, y, width, h);
+    layout();
+    redraw();
+}
+
+int ControlPanel::handle(int event)
+{
+    if (Fl_Group::handle(event))
+        return 1;
+
+    if (event == FL_MOUSEWHEEL && Fl::event_dy())
+    {
+        scrollTo(m_first + Fl::event_dy());
+        return 1;
+    }
+    return 0;
+}
+
+void ControlPanel::draw()
+{
+    // the bottom row may be only partly in view
+    fl_push_clip(x(), y(), w(), h());
+    Fl_Group::draw();
+    fl_pop_clip();
+}
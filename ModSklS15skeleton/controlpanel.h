@@ -0,0 +1,91 @@
+// controlpanel.h
+
+// The sliders for the controls picked in the browser.
+//
+// A rig can have thousands of controls, so the panel doesn't keep a label
+// and a slider for each of them.  It keeps a list of the controls picked,
+// in control order, and only as many rows (a label over a slider) as fit in
+// its height, made the first time they're needed.  Scrolling points the
+// same rows at other controls; picking or dropping a control that's out of
+// view touches no widget at all.
+//
+// The values live in an array the panel is given, not in the sliders, so a
+// control keeps its value while it has no row.
+
+#ifndef CONTROLPANEL_H
+#define CONTROLPANEL_H
+
+#include "modelerapp.h"
+
+#include <FL/Fl_Group.H>
+
+#include <vector>
+
+class Fl_Box;
+class Fl_Scrollbar;
+class Fl_Value_Slider;
+
+// Called when the user moves control's slider to value
+typedef void (*ControlMoved_f)(int control, double value);
+
+class ControlPanel : public Fl_Group
+{
+public:
+    ControlPanel(int x, int y, int w, int h, const char *label = 0);
+
+    // The controls the panel offers, shown from and moved in
+    // values[numControls], which must outlive the panel.  Nothing is picked.
+    void setControls(const ModelerControl controls[], int numControls,
+                     double *values, ControlMoved_f moved);
+
+    // Picks or drops control.  The rows change at the next update(), so a
+    // new selection can be given a control at a time.
+    void showControl(int control);
+    void hideControl(int control);
+    bool isShown(int control) const { return m_picked[control] != 0; }
+
+    // Lays the picked controls out after showControl/hideControl, redrawing
+    // only if a row in view changed
+    void update();
+
+    // The values changed: moves the sliders in view to them
+    void refresh();
+    void refresh(int control);
+
+    virtual void resize(int x, int y, int w, int h);
+    virtual int  handle(int event);
+
+protected:
+    virtual void draw();
+
+private:
+    struct Row
+    {
+        Fl_Box          *m_label;
+        Fl_Value_Slider *m_slider;
+        int              m_control;     // or -1 if the row is hidden
+    };
+
+    bool layout();
+    void scrollTo(int first);
+
+    static void _scrolled(Fl_Widget *scrollbar, void *);
+    static void _moved(Fl_Widget *slider, void *control);
+
+    std::vector<ModelerControl> m_controls;
+    double                     *m_values;
+    ControlMoved_f              m_moved;
+
+    std::vector<char>           m_picked;   // per control
+    std::vector<int>            m_shown;    // the picked controls, in order
+    std::vector<int>            m_changes;  // picked or dropped since update()
+
+    std::vector<Row>            m_rows;     // top to bottom
+    Fl_Scrollbar               *m_scrollbar;
+    int                         m_first;    // m_shown index in the top row
+
+    ControlPanel(const ControlPanel &);
+    ControlPanel &operator=(const ControlPanel &);
+};
+
+#endif
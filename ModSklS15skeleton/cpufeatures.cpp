@@ -0,0 +1,92 @@
+// cpufeatures.cpp
+
+#include "cpufeatures.h"
+
+#if defined(MODELER_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+enum CpuFeature_t
+{ CPU_SSSE3=1, CPU_SSE41=2, CPU_AVX=4, CPU_AVX2=8, CPU_FMA=16, };
+
+#if defined(MODELER_X86)
+
+static void _cpuid(int leaf, int sub, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, sub);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long _xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+static unsigned _detect()
+{
+    unsigned regs[4];
+    _cpuid(0, 0, regs);
+    unsigned maxLeaf = regs[0];
+    if (maxLeaf < 1)
+        return 0;
+
+    unsigned features = 0;
+    _cpuid(1, 0, regs);
+    unsigned ecx = regs[2];
+    if (ecx & (1u << 9))  features |= CPU_SSSE3;
+    if (ecx & (1u << 19)) features |= CPU_SSE41;
+
+    // AVX needs OSXSAVE and the OS preserving XMM and YMM state
+    bool osYmm = (ecx & (1u << 27)) && (_xgetbv0() & 6) == 6;
+    if (osYmm && (ecx & (1u << 28)))
+    {
+        features |= CPU_AVX;
+        if (ecx & (1u << 12))
+            features |= CPU_FMA;
+        if (maxLeaf >= 7)
+        {
+            _cpuid(7, 0, regs);
+            if (regs[1] & (1u << 5))
+                features |= CPU_AVX2;
+        }
+    }
+    return features;
+}
+
+#else
+
+static unsigned _detect()
+{
+    return 0;
+}
+
+#endif
+
+static unsigned _features()
+{
+    // initialized once, thread-safely, on first use
+    static const unsigned features = _detect();
+    return features;
+}
+
+bool cpuHasSSSE3() { return (_features() & CPU_SSSE3) != 0; }
+bool cpuHasSSE41() { return (_features() & CPU_SSE41) != 0; }
+bool cpuHasAVX()   { return (_features() & CPU_AVX) != 0; }
+bool cpuHasAVX2()  { return (_features() & CPU_AVX2) != 0; }
+bool cpuHasFMA()   { return (_features() & CPU_FMA) != 0; }
@@ -0,0 +1,29 @@
+// cpufeatures.h
+
+// Run-time x86 SIMD feature checks.  The project is built for the Win32
+// default (SSE2), so anything wider has to be chosen at run time: put the
+// wide code in a function marked MODELER_TARGET("ssse3") or ("avx2") and
+// only call it after checking the matching cpuHas*() here.
+
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MODELER_X86 1
+#endif
+
+// MSVC lets any function use any intrinsic; GCC and clang need to be told
+#if defined(__GNUC__)
+#define MODELER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MODELER_TARGET(isa)
+#endif
+
+bool cpuHasSSSE3();
+bool cpuHasSSE41();
+// AVX/AVX2/FMA also need the OS to save the YMM registers, which is checked
+bool cpuHasAVX();
+bool cpuHasAVX2();
+bool cpuHasFMA();
+
+#endif
@@ -0,0 +1,173 @@
+// crowd.cpp
+
+#include "crowd.h"
+#include "modelerapp.h"
+
+#include <FL/gl.h>
+
+#include <chrono>
+#include <cmath>
+
+// Length of the model's animation loop, in ticks; members are spread over it
+static const double kCrowdPeriod = 240.0;
+
+static double _now()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double> >(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+Crowd::Crowd(int members, int numThreads)
+    : m_pool(numThreads), m_spacing(6.0),
+      m_model(NULL), m_context(NULL), m_time(0), m_baseControls(NULL),
+      m_numControls(0), m_ok(true),
+      m_frames(0), m_intervals(0), m_evaluateTime(0), m_submitTime(0), m_frameTime(0),
+      m_lastDraw(0), m_triangles(0), m_stolen(0)
+{
+    if (members < 1)
+        members = 1;
+    m_lists.resize(members);
+
+    // Golden-ratio steps cover the loop evenly for any count, so no two
+    // neighbours move in step
+    m_phases.resize(members);
+    for (int i = 0; i < members; ++i)
+    {
+        double f = i * 0.6180339887498949;
+        m_phases[i] = (f - floor(f)) * kCrowdPeriod;
+    }
+}
+
+// ****************************************************************************
+// Evaluation
+// ****************************************************************************
+
+void Crowd::evaluateOne(int index)
+{
+    double *controls = NULL;
+    if (m_numControls > 0)
+    {
+        controls = &m_controls[(size_t)index * m_numControls];
+        for (int i = 0; i < m_numControls; ++i)
+            controls[i] = m_baseControls[i];
+    }
+
+    DrawList &list = m_lists[index];
+    ModelerApplication::SetThreadControls(controls);
+    list.begin();
+    if (!m_model(m_context, m_time + m_phases[index]))
+        m_ok = false;
+    list.end();
+    ModelerApplication::SetThreadControls(NULL);
+}
+
+void Crowd::evaluateMember(void *crowd, int index, int)
+{
+    // member 0 was done up front
+    ((Crowd *)crowd)->evaluateOne(index + 1);
+}
+
+bool Crowd::evaluate(ModelAt_f model, void *context, double time,
+                     const double *controls, int numControls)
+{
+    m_model        = model;
+    m_context      = context;
+    m_time         = time;
+    m_baseControls = controls;
+    m_numControls  = numControls;
+    m_ok           = true;
+    m_controls.resize((size_t)members() * numControls);
+
+    // The first member alone, so whatever the model builds and caches on
+    // its first draw is built once here and only read by the rest
+    evaluateOne(0);
+    if (!m_ok)
+        return false;
+
+    m_pool.parallelFor(members() - 1, evaluateMember, this);
+    return m_ok;
+}
+
+// ****************************************************************************
+// Submission
+// ****************************************************************************
+
+void Crowd::submit() const
+{
+    int n = members();
+    int side = (int)ceil(sqrt((double)n));
+    double offset = (side - 1) * m_spacing * 0.5;
+
+    glMatrixMode( GL_MODELVIEW );
+    for (int i = 0; i < n; ++i)
+    {
+        glPushMatrix();
+        glTranslated( (i % side) * m_spacing - offset, 0, (i / side) * m_spacing - offset );
+        m_lists[i].replay();
+        glPopMatrix();
+    }
+}
+
+long Crowd::triangleCount() const
+{
+    long triangles = 0;
+    for (size_t i = 0; i < m_lists.size(); ++i)
+        triangles += m_lists[i].triangleCount();
+    return triangles;
+}
+
+// ****************************************************************************
+// Stats
+// ****************************************************************************
+
+bool Crowd::draw(ModelAt_f model, void *context, double time,
+                 const double *controls, int numControls)
+{
+    double start = _now();
+    if (!evaluate(model, context, time, controls, numControls))
+        return false;
+    double evaluated = _now();
+    submit();
+    double submitted = _now();
+
+    // the first frame has nothing before it to measure from
+    if (m_lastDraw > 0)
+    {
+        m_frameTime += start - m_lastDraw;
+        ++m_intervals;
+    }
+    m_lastDraw = start;
+
+    ++m_frames;
+    m_evaluateTime += evaluated - start;
+    m_submitTime   += submitted - evaluated;
+    m_triangles    += triangleCount();
+    m_stolen       += m_pool.stolenCount();
+    return true;
+}
+
+CrowdStats Crowd::stats(bool reset)
+{
+    CrowdStats s;
+    int frames = m_frames > 0 ? m_frames : 1;
+
+    s.m_members    = members();
+    s.m_threads    = threadCount();
+    s.m_frames     = m_frames;
+    s.m_evaluateMs = m_evaluateTime * 1000.0 / frames;
+    s.m_submitMs   = m_submitTime * 1000.0 / frames;
+    s.m_frameMs    = m_intervals > 0 ? m_frameTime * 1000.0 / m_intervals : 0;
+    s.m_triangles  = m_triangles / frames;
+    s.m_trianglesPerSecond = s.m_frameMs > 0 ? s.m_triangles * 1000.0 / s.m_frameMs : 0;
+    s.m_stolen     = m_stolen / frames;
+
+    if (reset)
+    {
+        m_frames = m_intervals = 0;
+        m_evaluateTime = m_submitTime = m_frameTime = 0;
+        m_triangles = 0;
+        m_stolen = 0;
+    }
+    return s;
+}
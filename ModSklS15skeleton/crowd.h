@@ -0,0 +1,99 @@
+// crowd.h
+
+// Crowd stress mode: many copies of the model on a grid, each at its own
+// point in the animation and with its own control values.
+//
+// Every frame, each member is posed and drawn into a DrawList on a
+// WorkPool (the hierarchy evaluation), then the lists are replayed into GL
+// on the UI thread (the submission).  Both are timed, and the averages are
+// printed to stdout once a second, so the crowd doubles as a standing
+// scalability benchmark for the evaluation and rendering paths.
+
+#ifndef CROWD_H
+#define CROWD_H
+
+#include "drawlist.h"
+#include "workpool.h"
+
+#include <atomic>
+#include <vector>
+
+struct CrowdStats
+{
+    int    m_members;
+    int    m_threads;
+    int    m_frames;            // averaged over
+    double m_evaluateMs;        // per frame, posing and recording
+    double m_submitMs;          // per frame, replaying into GL
+    double m_frameMs;           // per frame, from one draw to the next
+    long   m_triangles;         // per frame
+    double m_trianglesPerSecond;
+    int    m_stolen;            // members per frame run on another thread
+};
+
+class Crowd
+{
+public:
+    // numThreads <= 0 uses one per core
+    Crowd(int members, int numThreads = 0);
+
+    int members() const     { return (int)m_lists.size(); }
+    int threadCount() const { return m_pool.threadCount(); }
+
+    // Space between neighbours on the grid
+    void   setSpacing(double spacing) { m_spacing = spacing; }
+    double spacing() const { return m_spacing; }
+
+    // Poses and records every member, at time plus its own phase, without
+    // touching GL; model is called on pool threads, several at once.
+    // controls[numControls] are the values each member starts from; each
+    // gets its own copy (see ModelerApplication::SetThreadControls), so
+    // whatever the model sets while posing stays with that member.
+    // Returns false if the model can't be drawn this way.
+    bool evaluate(ModelAt_f model, void *context, double time,
+                  const double *controls, int numControls);
+
+    // Replays the last evaluate() into GL, each member at its place on the
+    // grid, centred on the origin in the xz plane
+    void submit() const;
+
+    // evaluate() then submit(), timed into the stats
+    bool draw(ModelAt_f model, void *context, double time,
+              const double *controls, int numControls);
+
+    // Averages since the last call to this with reset
+    CrowdStats stats(bool reset = true);
+
+    // Triangles recorded by the last evaluate()
+    long triangleCount() const;
+
+private:
+    static void evaluateMember(void *crowd, int index, int thread);
+    void evaluateOne(int index);
+
+    WorkPool                 m_pool;
+    std::vector<DrawList>    m_lists;
+    std::vector<double>      m_phases;
+    std::vector<double>      m_controls;    // members x numControls
+    double                   m_spacing;
+
+    // What the current evaluate() is working on
+    ModelAt_f                m_model;
+    void                    *m_context;
+    double                   m_time;
+    const double            *m_baseControls;
+    int                      m_numControls;
+    std::atomic<bool>        m_ok;
+
+    // Running totals for the stats
+    int                      m_frames;
+    int                      m_intervals;   // between frames
+    double                   m_evaluateTime;
+    double                   m_submitTime;
+    double                   m_frameTime;
+    double                   m_lastDraw;
+    long                     m_triangles;
+    int                      m_stolen;
+};
+
+#endif
@@ -0,0 +1,503 @@
+// drawlist.cpp
+
+#include "drawlist.h"
+#include "tessellation.h"
+#include "rayparser.h"
+
+// The list recording on each thread
+static thread_local DrawList *s_current = NULL;
+
+DrawList::DrawList() : m_materialUsed(false), m_triangles(0)
+{
+}
+
+void DrawList::begin()
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    m_items.clear();
+    m_materials.clear();
+    m_textures.clear();
+    m_instances.clear();
+    m_fragments.clear();
+    m_fragmentBases.clear();
+    m_triangles = 0;
+
+    while (m_transforms.depth() > 1)
+        m_transforms.pop();
+    m_transforms.loadIdentity();
+
+    DrawMaterial m;
+    for (int i = 0; i < 3; ++i)
+    {
+        m.m_ambient[i]  = mds->m_ambientColor[i];
+        m.m_diffuse[i]  = mds->m_diffuseColor[i];
+        m.m_specular[i] = mds->m_specularColor[i];
+    }
+    m.m_shininess   = mds->m_shininess;
+    m.m_textureName = -1;
+    m.m_texture     = mds->m_texture;
+    m_materials.push_back(m);
+    m_materialUsed = false;
+
+    s_current = this;
+}
+
+void DrawList::end()
+{
+    if (s_current == this)
+        s_current = NULL;
+}
+
+DrawList *DrawList::current()
+{
+    return s_current;
+}
+
+// ****************************************************************************
+// Recording
+// ****************************************************************************
+
+// Items refer to materials by index, so once one has been drawn with,
+// changing it starts a new one
+DrawMaterial &DrawList::material()
+{
+    if (m_materialUsed)
+    {
+        DrawMaterial m = m_materials.back();
+        m_materials.push_back(m);
+        m_materialUsed = false;
+    }
+    return m_materials.back();
+}
+
+void DrawList::setTexture(const char bmpFileName[])
+{
+    DrawMaterial &m = material();
+    m.m_texture = 0;
+    m.m_textureName = -1;
+    if (bmpFileName)
+    {
+        m.m_textureName = (int)m_textures.size();
+        m_textures.push_back(bmpFileName);
+    }
+}
+
+void DrawList::add(DrawPrimitive_t type, const double *params, int count,
+                   const TriangleMesh *mesh)
+{
+    DrawItem item;
+    item.m_type     = type;
+    item.m_material = (int)m_materials.size() - 1;
+    item.m_matrix   = m_transforms.matrix();
+    if (mesh)
+        item.m_vertices = mesh->sharedGLVertices();
+    for (int i = 0; i < 9; ++i)
+        item.m_params[i] = i < count ? params[i] : 0;
+    m_items.push_back(std::move(item));
+    m_materialUsed = true;
+
+    // the same tessellation the GL path uses
+    int n = qualityDivisions(ModelerDrawState::Instance()->m_quality);
+    switch (type)
+    {
+    case DRAW_SPHERE:
+        m_triangles += 2 * n * n;
+        break;
+    case DRAW_BOX:
+    case DRAW_TEXTURE_BOX:
+        m_triangles += 12;
+        break;
+    case DRAW_CYLINDER:
+        m_triangles += 2 * n * n + (params[1] > 0 ? n : 0) + (params[2] > 0 ? n : 0);
+        break;
+    case DRAW_TRIANGLE:
+        m_triangles += 1;
+        break;
+    case DRAW_MESH:
+        m_triangles += mesh->triangleCount();
+        break;
+    case DRAW_INSTANCE:
+        break;
+    }
+}
+
+void DrawList::addInstance(const void *geometry, const float *color)
+{
+    DrawInstance instance;
+    instance.m_geometry = geometry;
+    instance.m_matrix = m_transforms.matrix();
+    if (!m_fragmentBases.empty())
+        instance.m_matrix = m_fragmentBases.back() * instance.m_matrix;
+    instance.m_hasColor = color != NULL;
+    for (int i = 0; i < 3; ++i)
+        instance.m_color[i] = color ? color[i] : 0;
+    m_instances.push_back(instance);
+}
+
+void DrawList::takeInstances(const void *geometry, std::vector<DrawInstance> &instances)
+{
+    instances.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        if (m_instances[i].m_geometry != geometry)
+        {
+            m_instances[kept++] = m_instances[i];
+            continue;
+        }
+        instances.push_back(m_instances[i]);
+
+        // One from before an open fragment began (the i - kept taken so far
+        // have moved its start down): the fragment's own instances move
+        // down one, and what it drew depends on more than its own code
+        for (size_t f = 0; f < m_fragments.size(); ++f)
+            if (i < m_fragments[f].first + (i - kept))
+            {
+                --m_fragments[f].first;
+                m_fragments[f].second = true;
+            }
+    }
+    m_instances.resize(kept);
+
+    if (!m_fragmentBases.empty() && !instances.empty())
+    {
+        Mat4f inverse = m_fragmentBases.back().inverse();
+        for (size_t i = 0; i < instances.size(); ++i)
+            instances[i].m_matrix = inverse * instances[i].m_matrix;
+    }
+}
+
+std::shared_ptr<const DrawFragment> DrawList::recordShape(void (*drawOne)(void *), void *context)
+{
+    // Whatever drawOne changes starts a material of its own, so the
+    // shape's first is only used by items drawn in the current one
+    DrawListMark mark = beginFragment();
+    m_materialUsed = true;
+    drawOne(context);
+
+    std::shared_ptr<DrawFragment> shape(new DrawFragment);
+    endFragment(mark, shape.get());
+
+    m_items.erase(m_items.begin() + mark.m_items, m_items.end());
+    m_materials.erase(m_materials.begin() + mark.m_materials, m_materials.end());
+    m_textures.erase(m_textures.begin() + mark.m_textures, m_textures.end());
+    m_triangles = mark.m_triangles;
+    m_materialUsed = true;
+    return shape;
+}
+
+void DrawList::addInstances(InstancedGeometry *geometry, const std::shared_ptr<const DrawFragment> &shape,
+                            const std::vector<DrawInstance> &instances)
+{
+    if (instances.empty())
+        return;
+
+    DrawItem item;
+    item.m_type     = DRAW_INSTANCE;
+    item.m_material = (int)m_materials.size() - 1;
+    item.m_geometry = geometry;
+    item.m_shape    = shape;
+    for (int i = 0; i < 9; ++i)
+        item.m_params[i] = 0;
+    for (size_t i = 0; i < instances.size(); ++i)
+    {
+        const DrawInstance &instance = instances[i];
+        item.m_matrix = instance.m_matrix;
+        for (int c = 0; c < 3; ++c)
+            item.m_params[c] = instance.m_color[c];
+        item.m_params[3] = instance.m_hasColor;
+        m_items.push_back(item);
+    }
+    m_materialUsed = true;
+    m_triangles += shape->m_triangles * (long)instances.size();
+
+    // the current material as drawing the copies one by one would leave it
+    if (shape->m_materials.size() > 1)
+    {
+        DrawMaterial m = shape->m_materials.back();
+        if (m.m_textureName >= 0)
+        {
+            m_textures.push_back(shape->m_textures[m.m_textureName]);
+            m.m_textureName = (int)m_textures.size() - 1;
+        }
+        m_materials.push_back(m);
+        m_materialUsed = false;
+    }
+}
+
+// ****************************************************************************
+// Fragments
+// ****************************************************************************
+
+DrawListMark DrawList::beginFragment()
+{
+    DrawListMark mark;
+    mark.m_entry = m_transforms.matrix();
+    m_transforms.push();
+    m_transforms.loadIdentity();
+
+    DrawMaterial m = m_materials.back();
+    m_materials.push_back(m);
+    m_materialUsed = false;
+
+    mark.m_items     = m_items.size();
+    mark.m_materials = m_materials.size() - 1;
+    mark.m_textures  = m_textures.size();
+    mark.m_triangles = m_triangles;
+
+    m_fragments.push_back(std::make_pair(m_instances.size(), false));
+    m_fragmentBases.push_back(m_fragmentBases.empty() ? mark.m_entry
+                                                      : m_fragmentBases.back() * mark.m_entry);
+    return mark;
+}
+
+bool DrawList::endFragment(const DrawListMark &mark, DrawFragment *fragment)
+{
+    m_transforms.pop();
+    size_t instances = m_fragments.back().first;
+    bool standalone = !m_fragments.back().second;
+    Mat4f base = m_fragmentBases.back();
+    m_fragments.pop_back();
+    m_fragmentBases.pop_back();
+
+    if (fragment)
+    {
+        fragment->m_items.assign(m_items.begin() + mark.m_items, m_items.end());
+        for (size_t i = 0; i < fragment->m_items.size(); ++i)
+            fragment->m_items[i].m_material -= (int)mark.m_materials;
+
+        // textures by name, numbered from 0 in the fragment
+        fragment->m_materials.assign(m_materials.begin() + mark.m_materials, m_materials.end());
+        fragment->m_textures.clear();
+        for (size_t i = 0; i < fragment->m_materials.size(); ++i)
+        {
+            DrawMaterial &m = fragment->m_materials[i];
+            if (m.m_textureName < 0)
+                continue;
+            fragment->m_textures.push_back(m_textures[m.m_textureName]);
+            m.m_textureName = (int)fragment->m_textures.size() - 1;
+        }
+
+        fragment->m_instances.assign(m_instances.begin() + instances, m_instances.end());
+        if (!fragment->m_instances.empty())
+        {
+            Mat4f inverse = base.inverse();
+            for (size_t i = 0; i < fragment->m_instances.size(); ++i)
+                fragment->m_instances[i].m_matrix = inverse * fragment->m_instances[i].m_matrix;
+        }
+
+        fragment->m_materialUsed = m_materialUsed;
+        fragment->m_triangles    = m_triangles - mark.m_triangles;
+    }
+
+    for (size_t i = mark.m_items; i < m_items.size(); ++i)
+        m_items[i].m_matrix = mark.m_entry * m_items[i].m_matrix;
+    return standalone;
+}
+
+void DrawList::addFragment(const DrawFragment &fragment)
+{
+    Mat4f entry = m_transforms.matrix();
+    int materials = (int)m_materials.size();
+    int textures = (int)m_textures.size();
+
+    for (size_t i = 0; i < fragment.m_items.size(); ++i)
+    {
+        m_items.push_back(fragment.m_items[i]);
+        DrawItem &item = m_items.back();
+        item.m_material += materials;
+        item.m_matrix = entry * item.m_matrix;
+    }
+
+    m_materials.insert(m_materials.end(), fragment.m_materials.begin(), fragment.m_materials.end());
+    for (size_t i = materials; i < m_materials.size(); ++i)
+        if (m_materials[i].m_textureName >= 0)
+            m_materials[i].m_textureName += textures;
+    m_textures.insert(m_textures.end(), fragment.m_textures.begin(), fragment.m_textures.end());
+    m_materialUsed = fragment.m_materialUsed;
+
+    if (!fragment.m_instances.empty())
+    {
+        Mat4f base = m_fragmentBases.empty() ? entry : m_fragmentBases.back() * entry;
+        for (size_t i = 0; i < fragment.m_instances.size(); ++i)
+        {
+            m_instances.push_back(fragment.m_instances[i]);
+            m_instances.back().m_matrix = base * m_instances.back().m_matrix;
+        }
+    }
+    m_triangles += fragment.m_triangles;
+}
+
+// ****************************************************************************
+// Replay
+// ****************************************************************************
+
+// Draws items from the given materials, starting with the material
+// already set (none if -1)
+static void _replayItems(const std::vector<DrawItem> &items, const std::vector<DrawMaterial> &materials,
+                         const std::vector<std::string> &textures, int material)
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    glMatrixMode( GL_MODELVIEW );
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const DrawItem &item = items[i];
+        const double *p = item.m_params;
+
+        if (item.m_material != material)
+        {
+            const DrawMaterial &m = materials[item.m_material];
+            setAmbientColor(m.m_ambient[0], m.m_ambient[1], m.m_ambient[2]);
+            setDiffuseColor(m.m_diffuse[0], m.m_diffuse[1], m.m_diffuse[2]);
+            setSpecularColor(m.m_specular[0], m.m_specular[1], m.m_specular[2]);
+            setShininess(m.m_shininess);
+            if (m.m_textureName >= 0)
+                ::setTexture(textures[m.m_textureName].c_str());
+            else
+                mds->m_texture = m.m_texture;
+            material = item.m_material;
+        }
+
+        GLfloat matrix[16];
+        item.m_matrix.getGLMatrix(matrix);
+        glPushMatrix();
+        glMultMatrixf(matrix);
+
+        switch (item.m_type)
+        {
+        case DRAW_SPHERE:
+            drawSphere(p[0]);
+            break;
+        case DRAW_BOX:
+            drawBox(p[0], p[1], p[2]);
+            break;
+        case DRAW_TEXTURE_BOX:
+            drawTextureBox(p[0], p[1], p[2]);
+            break;
+        case DRAW_CYLINDER:
+            drawCylinder(p[0], p[1], p[2]);
+            break;
+        case DRAW_TRIANGLE:
+            drawTriangle(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+            break;
+        case DRAW_MESH:
+            drawTriangleArray(*item.m_vertices);
+            break;
+        case DRAW_INSTANCE:
+            // the shape's display list may leave any material set
+            if (p[3])
+                setDiffuseColor((float)p[0], (float)p[1], (float)p[2]);
+            item.m_geometry->callShape(item.m_shape);
+            material = -1;
+            break;
+        }
+
+        glPopMatrix();
+    }
+}
+
+void DrawList::replay() const
+{
+    _replayItems(m_items, m_materials, m_textures, -1);
+}
+
+void DrawList::replayShape(const DrawFragment &shape)
+{
+    _replayItems(shape.m_items, shape.m_materials, shape.m_textures, 0);
+}
+
+DrawMaterial DrawList::shapeMaterial(const DrawItem &instance, int i, const DrawMaterial &current)
+{
+    const DrawFragment &shape = *instance.m_shape;
+    int material = shape.m_items[i].m_material;
+    if (material > 0)
+        return shape.m_materials[material];
+
+    DrawMaterial m = current;
+    if (instance.m_params[3])
+        for (int c = 0; c < 3; ++c)
+            m.m_diffuse[c] = (float)instance.m_params[c];
+    return m;
+}
+
+// Writes item to a .ray file under m (the viewing transform times its
+// matrix), in material; an instance as each item of its shape
+static void _writeRayItem(FILE *file, const DrawItem &item, const Mat4f &m, const DrawMaterial &material)
+{
+    if (item.m_type == DRAW_INSTANCE)
+    {
+        const std::vector<DrawItem> &items = item.m_shape->m_items;
+        for (size_t i = 0; i < items.size(); ++i)
+            _writeRayItem(file, items[i], m * items[i].m_matrix,
+                          DrawList::shapeMaterial(item, (int)i, material));
+        return;
+    }
+
+    const double *p = item.m_params;
+
+    fprintf(file, RAY_FMT_TRANSFORM,
+            m[0][0], m[0][1], m[0][2], m[0][3],
+            m[1][0], m[1][1], m[1][2], m[1][3],
+            m[2][0], m[2][1], m[2][2], m[2][3],
+            m[3][0], m[3][1], m[3][2], m[3][3]);
+
+    const char *close = RAY_FMT_CLOSE_MESH;
+    switch (item.m_type)
+    {
+    case DRAW_SPHERE:
+        fprintf(file, RAY_FMT_SPHERE, p[0], p[0], p[0]);
+        close = RAY_FMT_CLOSE_SPHERE;
+        break;
+    case DRAW_BOX:
+    case DRAW_TEXTURE_BOX:
+        fprintf(file, RAY_FMT_BOX, p[0], p[1], p[2]);
+        close = RAY_FMT_CLOSE_BOX;
+        break;
+    case DRAW_CYLINDER:
+        fprintf(file, RAY_FMT_CONE, p[0], p[1], p[2]);
+        close = RAY_FMT_CLOSE_CONE;
+        break;
+    case DRAW_TRIANGLE:
+        fprintf(file, RAY_FMT_TRIANGLE, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+        break;
+    case DRAW_MESH:
+    {
+        // the recorded vertices (normal, point) are a triangle each
+        // three, so the faces just count up
+        const std::vector<GLfloat> &v = *item.m_vertices;
+        fputs("polymesh { points=(", file);
+        for (size_t j = 0; j < v.size(); j += 6)
+            fprintf(file, "%s(%f,%f,%f)", j ? "," : "", v[j + 3], v[j + 4], v[j + 5]);
+        fputs("); faces=(", file);
+        for (size_t j = 0; j < v.size() / 6; j += 3)
+            fprintf(file, "%s(%d,%d,%d)", j ? "," : "", (int)j, (int)j + 1, (int)j + 2);
+        fputs(");\n", file);
+        break;
+    }
+    case DRAW_INSTANCE:
+        break;
+    }
+
+    const float *diffuse = material.m_diffuse;
+    fprintf(file, RAY_FMT_MATERIAL, diffuse[0], diffuse[1], diffuse[2],
+            diffuse[0], diffuse[1], diffuse[2]);
+    fputs(close, file);
+}
+
+bool DrawList::saveRay(const char fname[], const Mat4f &view) const
+{
+    FILE *file = fopen(fname, "w");
+    if (!file)
+        return false;
+
+    fputs(RAY_FMT_HEADER, file);
+    fputs(RAY_FMT_CAMERA, file);
+    fputs(RAY_FMT_LIGHT, file);
+
+    for (size_t i = 0; i < m_items.size(); ++i)
+        _writeRayItem(file, m_items[i], view * m_items[i].m_matrix, m_materials[m_items[i].m_material]);
+
+    return fclose(file) == 0;
+}
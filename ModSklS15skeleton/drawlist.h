@@ -0,0 +1,189 @@
+// drawlist.h
+
+// Records what model code draws instead of drawing it.
+//
+// While a DrawList is recording on a thread, the modelerdraw.h functions
+// called from that thread touch neither GL nor the shared draw state: the
+// matrix functions (pushMatrix, translate, ...) work on the list's own
+// TransformStack, the material setters on the list's current material, and
+// each draw* call appends one item holding its final matrix.  So model
+// code can run on worker threads, several copies at once, and the results
+// be replayed into GL on the UI thread afterwards.
+//
+//     DrawList list;
+//     list.begin();
+//     view->drawModelAt(time);      // any thread
+//     list.end();
+//     ...
+//     list.replay();                // GL thread
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include "modelerdraw.h"
+#include "transformstack.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Draws a whole model, posed at time (in animation ticks, or as the
+// controls have it when negative), with the modelerdraw.h functions; for
+// recording it on another thread.  Returns false if it can't.
+typedef bool (*ModelAt_f)(void *context, double time);
+
+enum DrawPrimitive_t
+{ DRAW_SPHERE, DRAW_BOX, DRAW_TEXTURE_BOX, DRAW_CYLINDER, DRAW_TRIANGLE, DRAW_MESH,
+  DRAW_INSTANCE, };
+
+struct DrawFragment;
+
+struct DrawMaterial
+{
+    float m_ambient[3];
+    float m_diffuse[3];
+    float m_specular[3];
+    float m_shininess;
+
+    // A texture set while recording is kept by name and loaded on replay;
+    // otherwise the one already bound when recording began (0 for none)
+    int    m_textureName;   // index into the list's texture names, or -1
+    GLuint m_texture;
+};
+
+struct DrawItem
+{
+    DrawPrimitive_t     m_type;
+    int                 m_material;     // index into the list's materials
+    Mat4f               m_matrix;       // relative to where recording began
+    double              m_params[9];    // the draw call's arguments
+
+    // DRAW_MESH: the mesh's vertices as they were when recorded
+    std::shared_ptr<const std::vector<GLfloat> > m_vertices;
+
+    // DRAW_INSTANCE: one copy of an InstancedGeometry, drawing the shape
+    // recorded for it (shared by every copy) under m_matrix; m_params[3] is
+    // nonzero if the copy has a color of its own, in m_params[0..2]
+    InstancedGeometry                   *m_geometry;
+    std::shared_ptr<const DrawFragment>  m_shape;
+};
+
+// An instance queued on an InstancedGeometry while recording
+struct DrawInstance
+{
+    const void *m_geometry;
+    Mat4f       m_matrix;
+    bool        m_hasColor;
+    float       m_color[3];
+};
+
+// A stretch of a recording kept apart from it, with its matrices relative
+// to where the stretch began, so it can be put into a later recording under
+// another matrix without running the code that drew it
+struct DrawFragment
+{
+    std::vector<DrawItem>     m_items;
+    std::vector<DrawMaterial> m_materials;  // the items' and then the current one
+    std::vector<std::string>  m_textures;
+    std::vector<DrawInstance> m_instances;
+    bool                      m_materialUsed;
+    long                      m_triangles;
+};
+
+// Where a fragment began; see DrawList::beginFragment
+struct DrawListMark
+{
+    Mat4f  m_entry;
+    size_t m_items;
+    size_t m_materials;
+    size_t m_textures;
+    long   m_triangles;
+};
+
+class DrawList
+{
+public:
+    DrawList();
+
+    // Starts recording on the calling thread, discarding what was there.
+    // The matrix starts at identity and the material at the current one.
+    void begin();
+    void end();
+
+    // The list recording on the calling thread, or NULL
+    static DrawList *current();
+
+    // For modelerdraw.cpp: the recording matrix stack, the material
+    // setters and the primitives
+    TransformStack &transforms() { return m_transforms; }
+    DrawMaterial   &material();
+    void setTexture(const char bmpFileName[]);
+    void add(DrawPrimitive_t type, const double *params, int count,
+             const TriangleMesh *mesh = NULL);
+
+    // Instances queued on an InstancedGeometry while recording, with the
+    // color they were given, if any
+    void addInstance(const void *geometry, const float *color = NULL);
+    void takeInstances(const void *geometry, std::vector<DrawInstance> &instances);
+
+    // For InstancedGeometry: records what drawOne draws from the origin
+    // once, apart from the list, as the shape its instances draw.  Items
+    // left in the shape's first material take the one current where each
+    // instance is drawn.
+    std::shared_ptr<const DrawFragment> recordShape(void (*drawOne)(void *), void *context);
+    // Records an item drawing shape for each of instances
+    void addInstances(InstancedGeometry *geometry, const std::shared_ptr<const DrawFragment> &shape,
+                      const std::vector<DrawInstance> &instances);
+
+    // Starts a fragment: pushes the matrix and records from identity, and
+    // starts a new material (a copy of the current one) for the fragment
+    // to change.  Fragments nest.
+    DrawListMark beginFragment();
+    // Ends the fragment begun at mark, popping the matrix and moving what
+    // was recorded since under the matrix it began at.  fragment, if given,
+    // gets a copy; returns false if the copy can't stand on its own because
+    // the fragment drew instances queued before it began.
+    bool endFragment(const DrawListMark &mark, DrawFragment *fragment);
+    // Records fragment again under the current matrix, leaving the current
+    // material as the fragment did
+    void addFragment(const DrawFragment &fragment);
+    const DrawMaterial &currentMaterial() const { return m_materials.back(); }
+
+    // Draws everything recorded, relative to the current modelview
+    void replay() const;
+    // Draws a shape from recordShape, leaving its first material as it finds it
+    static void replayShape(const DrawFragment &shape);
+    // Writes everything recorded to a .ray file, under view (the camera's
+    // viewing transform), as openRayFile() and drawing would have; for
+    // writing scenes without GL
+    bool saveRay(const char fname[], const Mat4f &view) const;
+
+    int itemCount() const     { return (int)m_items.size(); }
+    const DrawItem &item(int i) const { return m_items[i]; }
+    const DrawMaterial &materialOf(const DrawItem &item) const { return m_materials[item.m_material]; }
+    // The material item i of a DRAW_INSTANCE's shape is drawn in, where
+    // current is the instance's own
+    static DrawMaterial shapeMaterial(const DrawItem &instance, int i, const DrawMaterial &current);
+    // Triangles the items come to at the quality they were recorded at
+    long triangleCount() const { return m_triangles; }
+
+private:
+    std::vector<DrawItem>     m_items;
+    std::vector<DrawMaterial> m_materials;
+    std::vector<std::string>  m_textures;
+    bool                      m_materialUsed;  // items point at the last material
+    TransformStack            m_transforms;
+    long                      m_triangles;
+
+    std::vector<DrawInstance> m_instances;
+
+    // Queued instances are kept relative to where recording began, and
+    // handed back relative to the innermost open fragment: for each open
+    // fragment, where its instances start in m_instances, whether it's
+    // taken any from before that, and where it began
+    std::vector<std::pair<size_t, bool> > m_fragments;
+    std::vector<Mat4f>                    m_fragmentBases;
+};
+
+#endif
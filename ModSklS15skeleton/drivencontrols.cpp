@@ -0,0 +1,629 @@
+// drivencontrols.cpp
+
+#include "drivencontrols.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+enum DrivenOp_t
+{
+    // leaves, only in parsed expressions
+    OP_CONST,
+    OP_TIME,
+    OP_CONTROL,
+
+    // only in programs
+    OP_LOAD,                // register m_dst = controls[m_a]
+    OP_STORE,               // controls[m_dst] = register m_a
+
+    // of one register
+    OP_NEG,
+    OP_SIN,
+    OP_COS,
+    OP_TAN,
+    OP_ASIN,
+    OP_ACOS,
+    OP_ATAN,
+    OP_SQRT,
+    OP_ABS,
+    OP_EXP,
+    OP_LOG,
+    OP_FLOOR,
+    OP_CEIL,
+
+    // of two
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_MIN,
+    OP_MAX,
+    OP_ATAN2,
+};
+
+static const double kPi = 3.14159265358979323846;
+
+static bool _unary(int op)  { return op >= OP_NEG && op <= OP_CEIL; }
+static bool _binary(int op) { return op >= OP_ADD && op <= OP_ATAN2; }
+
+static double _apply(int op, double a, double b)
+{
+    switch (op)
+    {
+    case OP_NEG:   return -a;
+    case OP_SIN:   return sin(a);
+    case OP_COS:   return cos(a);
+    case OP_TAN:   return tan(a);
+    case OP_ASIN:  return asin(a);
+    case OP_ACOS:  return acos(a);
+    case OP_ATAN:  return atan(a);
+    case OP_SQRT:  return sqrt(a);
+    case OP_ABS:   return fabs(a);
+    case OP_EXP:   return exp(a);
+    case OP_LOG:   return log(a);
+    case OP_FLOOR: return floor(a);
+    case OP_CEIL:  return ceil(a);
+    case OP_ADD:   return a + b;
+    case OP_SUB:   return a - b;
+    case OP_MUL:   return a * b;
+    case OP_DIV:   return a / b;
+    case OP_POW:   return pow(a, b);
+    case OP_MIN:   return a < b ? a : b;
+    case OP_MAX:   return a > b ? a : b;
+    case OP_ATAN2: return atan2(a, b);
+    }
+    return 0;
+}
+
+static std::string _upper(const char *name)
+{
+    std::string s(name);
+    for (size_t i = 0; i < s.size(); ++i)
+        s[i] = (char)toupper((unsigned char)s[i]);
+    return s;
+}
+
+// ****************************************************************************
+// Parsing
+// ****************************************************************************
+
+static const struct { const char *m_name; int m_op; int m_args; } s_functions[] = {
+    { "sin",   OP_SIN,   1 },
+    { "cos",   OP_COS,   1 },
+    { "tan",   OP_TAN,   1 },
+    { "asin",  OP_ASIN,  1 },
+    { "acos",  OP_ACOS,  1 },
+    { "atan",  OP_ATAN,  1 },
+    { "sqrt",  OP_SQRT,  1 },
+    { "abs",   OP_ABS,   1 },
+    { "exp",   OP_EXP,   1 },
+    { "log",   OP_LOG,   1 },
+    { "floor", OP_FLOOR, 1 },
+    { "ceil",  OP_CEIL,  1 },
+    { "pow",   OP_POW,   2 },
+    { "min",   OP_MIN,   2 },
+    { "max",   OP_MAX,   2 },
+    { "atan2", OP_ATAN2, 2 },
+    { "clamp", -1,       3 },   // max(min(x, hi), lo)
+};
+static const int s_numFunctions = sizeof(s_functions) / sizeof(s_functions[0]);
+
+// Recursive descent, each rule returning the index of the node it made, or
+// -1 once m_error has been set:
+//
+//     sum     = product { (+ | -) product }
+//     product = unary { (* | /) unary }
+//     unary   = - unary | power
+//     power   = primary [ ^ unary ]
+//     primary = number | t | pi | control | function ( sum {, sum} ) | ( sum )
+class _Parser
+{
+public:
+    _Parser(const DrivenControls &controls, const char *text, std::vector<DrivenNode> &nodes)
+        : m_controls(controls), m_at(text), m_nodes(nodes) {}
+
+    bool parse(std::string &error)
+    {
+        int root = sum();
+        skipSpace();
+        if (root >= 0 && *m_at)
+            fail("unexpected '", std::string(m_at, 1).c_str(), "'");
+        error = m_error;
+        return m_error.empty();
+    }
+
+private:
+    int sum()
+    {
+        int left = product();
+        while (left >= 0)
+        {
+            int op = accept('+') ? OP_ADD : accept('-') ? OP_SUB : -1;
+            if (op < 0)
+                break;
+            int right = product();
+            left = right < 0 ? -1 : node(op, left, right);
+        }
+        return left;
+    }
+
+    int product()
+    {
+        int left = unary();
+        while (left >= 0)
+        {
+            int op = accept('*') ? OP_MUL : accept('/') ? OP_DIV : -1;
+            if (op < 0)
+                break;
+            int right = unary();
+            left = right < 0 ? -1 : node(op, left, right);
+        }
+        return left;
+    }
+
+    int unary()
+    {
+        if (accept('-'))
+        {
+            int arg = unary();
+            return arg < 0 ? -1 : node(OP_NEG, arg, -1);
+        }
+        return power();
+    }
+
+    int power()
+    {
+        int base = primary();
+        if (base < 0 || !accept('^'))
+            return base;
+        int exponent = unary();
+        return exponent < 0 ? -1 : node(OP_POW, base, exponent);
+    }
+
+    int primary()
+    {
+        skipSpace();
+        if (accept('('))
+        {
+            int inner = sum();
+            if (inner >= 0 && !accept(')'))
+                return fail("missing ')'");
+            return inner;
+        }
+
+        if (isdigit((unsigned char)*m_at) || *m_at == '.')
+        {
+            char *end;
+            double value = strtod(m_at, &end);
+            if (end == m_at)
+                return fail("bad number");
+            m_at = end;
+            return leaf(OP_CONST, value, -1);
+        }
+
+        if (!*m_at)
+            return fail("expression ends too soon");
+        if (!isalpha((unsigned char)*m_at) && *m_at != '_')
+            return fail("unexpected '", std::string(m_at, 1).c_str(), "'");
+
+        const char *start = m_at;
+        while (isalnum((unsigned char)*m_at) || *m_at == '_')
+            ++m_at;
+        std::string name(start, m_at);
+
+        for (int f = 0; f < s_numFunctions; ++f)
+            if (name == s_functions[f].m_name)
+                return call(f);
+        if (name == "t")
+            return leaf(OP_TIME, 0, -1);
+        if (name == "pi")
+            return leaf(OP_CONST, kPi, -1);
+
+        int control = m_controls.control(name.c_str());
+        if (control < 0)
+            return fail("no control called ", name.c_str());
+        return leaf(OP_CONTROL, 0, control);
+    }
+
+    int call(int f)
+    {
+        int args[3];
+        if (!accept('('))
+            return fail(s_functions[f].m_name, " needs '('");
+        for (int i = 0; i < s_functions[f].m_args; ++i)
+        {
+            if (i > 0 && !accept(','))
+                return *m_at ? fail(s_functions[f].m_name, " takes more arguments")
+                             : fail("expression ends too soon");
+            if ((args[i] = sum()) < 0)
+                return -1;
+        }
+        if (!accept(')'))
+            return *m_at == ',' ? fail(s_functions[f].m_name, " takes fewer arguments")
+                 : *m_at        ? fail("unexpected '", std::string(m_at, 1).c_str(), "'")
+                                : fail("missing ')'");
+
+        if (s_functions[f].m_op < 0)
+            return node(OP_MAX, node(OP_MIN, args[0], args[2]), args[1]);
+        return node(s_functions[f].m_op, args[0], s_functions[f].m_args > 1 ? args[1] : -1);
+    }
+
+    int leaf(int op, double value, int control)
+    {
+        DrivenNode n;
+        n.m_op = op;
+        n.m_value = value;
+        n.m_control = control;
+        n.m_args[0] = n.m_args[1] = -1;
+        m_nodes.push_back(n);
+        return (int)m_nodes.size() - 1;
+    }
+
+    // An operation, worked out here if its arguments are constants
+    int node(int op, int a, int b)
+    {
+        if (m_nodes[a].m_op == OP_CONST && (b < 0 || m_nodes[b].m_op == OP_CONST))
+            return leaf(OP_CONST, _apply(op, m_nodes[a].m_value, b < 0 ? 0 : m_nodes[b].m_value), -1);
+
+        int n = leaf(op, 0, -1);
+        m_nodes[n].m_args[0] = a;
+        m_nodes[n].m_args[1] = b;
+        return n;
+    }
+
+    void skipSpace()
+    {
+        while (isspace((unsigned char)*m_at))
+            ++m_at;
+    }
+
+    bool accept(char c)
+    {
+        skipSpace();
+        if (*m_at != c)
+            return false;
+        ++m_at;
+        return true;
+    }
+
+    int fail(const char *a, const char *b = "", const char *c = "")
+    {
+        if (m_error.empty())
+            m_error = std::string(a) + b + c;
+        return -1;
+    }
+
+    const DrivenControls    &m_controls;
+    const char              *m_at;
+    std::vector<DrivenNode> &m_nodes;
+    std::string              m_error;
+};
+
+// ****************************************************************************
+// Editing
+// ****************************************************************************
+
+DrivenControls::DrivenControls()
+    : m_compiled(true), m_numRegisters(1)
+{
+}
+
+void DrivenControls::setName(int control, const char *name)
+{
+    m_names[_upper(name)] = control;
+    if (!m_controlNames.count(control))
+        m_controlNames[control] = name;
+}
+
+int DrivenControls::control(const char *name) const
+{
+    std::map<std::string, int>::const_iterator it = m_names.find(_upper(name));
+    return it == m_names.end() ? -1 : it->second;
+}
+
+const char *DrivenControls::controlName(int control) const
+{
+    std::map<int, std::string>::const_iterator it = m_controlNames.find(control);
+    return it == m_controlNames.end() ? "?" : it->second.c_str();
+}
+
+bool DrivenControls::drive(int control, const char *expression, std::string *error)
+{
+    Expression driven;
+    driven.m_control = control;
+    driven.m_source  = expression;
+
+    std::string message;
+    _Parser parser(*this, expression, driven.m_nodes);
+    if (!parser.parse(message))
+    {
+        if (error)
+            *error = message;
+        return false;
+    }
+    for (size_t n = 0; n < driven.m_nodes.size(); ++n)
+        if (driven.m_nodes[n].m_op == OP_CONTROL)
+            driven.m_reads.push_back(driven.m_nodes[n].m_control);
+    std::sort(driven.m_reads.begin(), driven.m_reads.end());
+    driven.m_reads.erase(std::unique(driven.m_reads.begin(), driven.m_reads.end()),
+                         driven.m_reads.end());
+
+    if (circle(control, driven.m_reads, error))
+        return false;
+
+    std::map<int, int>::const_iterator it = m_drivenBy.find(control);
+    if (it == m_drivenBy.end())
+    {
+        m_drivenBy[control] = (int)m_expressions.size();
+        m_expressions.push_back(driven);
+    }
+    else
+        std::swap(m_expressions[it->second], driven);
+    m_compiled = false;
+    return true;
+}
+
+void DrivenControls::undrive(int control)
+{
+    std::map<int, int>::iterator it = m_drivenBy.find(control);
+    if (it == m_drivenBy.end())
+        return;
+
+    m_expressions.erase(m_expressions.begin() + it->second);
+    m_drivenBy.clear();
+    for (size_t e = 0; e < m_expressions.size(); ++e)
+        m_drivenBy[m_expressions[e].m_control] = (int)e;
+    m_compiled = false;
+}
+
+void DrivenControls::clear()
+{
+    m_expressions.clear();
+    m_drivenBy.clear();
+    m_compiled = false;
+}
+
+const char *DrivenControls::expression(int control) const
+{
+    std::map<int, int>::const_iterator it = m_drivenBy.find(control);
+    return it == m_drivenBy.end() ? NULL : m_expressions[it->second].m_source.c_str();
+}
+
+// True, with the circle in error, if driving control from reads would have
+// it drive itself through the controls already driven.  Those never go
+// round in a circle on their own, so only paths back to control count.
+bool DrivenControls::circle(int control, const std::vector<int> &reads, std::string *error) const
+{
+    // each control reached, with the one reading it that it was reached from
+    std::map<int, int> from;
+    std::vector<int> stack;
+    for (size_t r = 0; r < reads.size(); ++r)
+        if (from.insert(std::make_pair(reads[r], control)).second)
+            stack.push_back(reads[r]);
+
+    while (!stack.empty())
+    {
+        int c = stack.back();
+        stack.pop_back();
+        if (c == control)
+        {
+            if (error)
+            {
+                std::vector<int> path;
+                for (int p = from[control]; p != control; p = from[p])
+                    path.push_back(p);
+                *error = std::string("controls would drive each other: ") + controlName(control);
+                for (size_t p = path.size(); p-- > 0;)
+                    *error += std::string(" <- ") + controlName(path[p]);
+                *error += std::string(" <- ") + controlName(control);
+            }
+            return true;
+        }
+
+        std::map<int, int>::const_iterator it = m_drivenBy.find(c);
+        if (it == m_drivenBy.end())
+            continue;
+        const std::vector<int> &next = m_expressions[it->second].m_reads;
+        for (size_t r = 0; r < next.size(); ++r)
+            if (from.insert(std::make_pair(next[r], c)).second)
+                stack.push_back(next[r]);
+    }
+    return false;
+}
+
+// Depth first into m_order, each expression after those driving the
+// controls it reads
+void DrivenControls::order()
+{
+    // 0 unvisited, 1 on the path being followed, 2 ordered
+    std::vector<int> state(m_expressions.size(), 0);
+    // the path, as (expression, next read to follow)
+    std::vector<std::pair<int, size_t> > path;
+    m_order.clear();
+
+    for (size_t root = 0; root < m_expressions.size(); ++root)
+    {
+        if (state[root])
+            continue;
+        path.push_back(std::make_pair((int)root, (size_t)0));
+        state[root] = 1;
+        while (!path.empty())
+        {
+            int e = path.back().first;
+            size_t &next = path.back().second;
+            if (next == m_expressions[e].m_reads.size())
+            {
+                state[e] = 2;
+                m_order.push_back(e);
+                path.pop_back();
+                continue;
+            }
+
+            std::map<int, int>::const_iterator it = m_drivenBy.find(m_expressions[e].m_reads[next++]);
+            // drive() keeps circles out, so nothing read is on the path
+            if (it == m_drivenBy.end() || state[it->second] != 0)
+                continue;
+            state[it->second] = 1;
+            path.push_back(std::make_pair(it->second, (size_t)0));
+        }
+    }
+}
+
+// ****************************************************************************
+// Compiling
+// ****************************************************************************
+
+// Constants are told apart by their bits, so that a NaN folded out of
+// asin(2) or 0/0 still finds its register, and -0 keeps its sign
+static unsigned long long _constantBits(double value)
+{
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// The register holding value, one of m_constants
+int DrivenControls::constant(double value) const
+{
+    return m_constantRegisters.find(_constantBits(value))->second;
+}
+
+// Generates the code for node, using registers from free up as
+// temporaries.  Returns the register its value ends up in: free itself,
+// or for a leaf perhaps t's or a constant's.
+int DrivenControls::emit(const Expression &expression, int node, int free)
+{
+    const DrivenNode &n = expression.m_nodes[node];
+    DrivenInstruction instruction;
+    instruction.m_op  = n.m_op;
+    instruction.m_dst = free;
+    instruction.m_a   = instruction.m_b = 0;
+
+    if (n.m_op == OP_CONST)
+        return constant(n.m_value);
+    if (n.m_op == OP_TIME)
+        return 0;
+    if (n.m_op == OP_CONTROL)
+    {
+        instruction.m_op = OP_LOAD;
+        instruction.m_a  = n.m_control;
+    }
+    else
+    {
+        instruction.m_a = emit(expression, n.m_args[0], free);
+        if (_binary(n.m_op))
+            instruction.m_b = emit(expression, n.m_args[1],
+                                   instruction.m_a == free ? free + 1 : free);
+    }
+
+    m_program.push_back(instruction);
+    m_numRegisters = std::max(m_numRegisters, free + 1);
+    return free;
+}
+
+// Adds the constants under node to constants, each once, with their
+// registers in registers.  Folding leaves constants in m_nodes that nothing
+// uses any more, so only what's reachable counts.
+static void _collectConstants(const std::vector<DrivenNode> &nodes, int node,
+                              std::vector<double> &constants,
+                              std::map<unsigned long long, int> &registers)
+{
+    const DrivenNode &n = nodes[node];
+    if (n.m_op == OP_CONST)
+    {
+        if (registers.insert(std::make_pair(_constantBits(n.m_value),
+                                            1 + (int)constants.size())).second)
+            constants.push_back(n.m_value);
+        return;
+    }
+    for (int a = 0; a < 2; ++a)
+        if (n.m_args[a] >= 0)
+            _collectConstants(nodes, n.m_args[a], constants, registers);
+}
+
+// Compiles the program if the expressions have changed since it was last
+// compiled.  Evaluating threads may get here at once; one compiles and the
+// rest wait for it.
+void DrivenControls::prepare() const
+{
+    if (m_compiled.load(std::memory_order_acquire))
+        return;
+
+    DrivenControls *self = const_cast<DrivenControls *>(this);
+    std::lock_guard<std::mutex> lock(self->m_compileLock);
+    if (m_compiled.load(std::memory_order_relaxed))
+        return;
+    self->compile();
+    self->m_compiled.store(true, std::memory_order_release);
+}
+
+void DrivenControls::compile()
+{
+    order();
+    m_program.clear();
+    m_constants.clear();
+    m_constantRegisters.clear();
+    for (size_t e = 0; e < m_expressions.size(); ++e)
+        _collectConstants(m_expressions[e].m_nodes, (int)m_expressions[e].m_nodes.size() - 1,
+                          m_constants, m_constantRegisters);
+
+    int temporaries = 1 + (int)m_constants.size();
+    m_numRegisters = temporaries;
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        const Expression &expression = m_expressions[m_order[i]];
+        DrivenInstruction store;
+        store.m_op  = OP_STORE;
+        store.m_dst = expression.m_control;
+        store.m_a   = emit(expression, (int)expression.m_nodes.size() - 1, temporaries);
+        store.m_b   = 0;
+        m_program.push_back(store);
+    }
+}
+
+// ****************************************************************************
+// Evaluating
+// ****************************************************************************
+
+void DrivenControls::evaluate(double time, double *controls, std::vector<double> &registers) const
+{
+    prepare();
+    if (m_program.empty())
+        return;
+    if (registers.size() < (size_t)m_numRegisters)
+        registers.resize(m_numRegisters);
+
+    double *r = &registers[0];
+    r[0] = time;
+    if (!m_constants.empty())
+        memcpy(r + 1, &m_constants[0], m_constants.size() * sizeof(double));
+
+    const DrivenInstruction *i   = &m_program[0];
+    const DrivenInstruction *end = i + m_program.size();
+    for (; i != end; ++i)
+    {
+        if (i->m_op == OP_LOAD)
+        {
+            r[i->m_dst] = controls[i->m_a];
+            continue;
+        }
+
+        double a = r[i->m_a];
+        switch (i->m_op)
+        {
+        case OP_STORE: controls[i->m_dst] = a; break;
+        case OP_NEG:   r[i->m_dst] = -a; break;
+        case OP_ADD:   r[i->m_dst] = a + r[i->m_b]; break;
+        case OP_SUB:   r[i->m_dst] = a - r[i->m_b]; break;
+        case OP_MUL:   r[i->m_dst] = a * r[i->m_b]; break;
+        case OP_DIV:   r[i->m_dst] = a / r[i->m_b]; break;
+        case OP_MIN:   r[i->m_dst] = a < r[i->m_b] ? a : r[i->m_b]; break;
+        case OP_MAX:   r[i->m_dst] = a > r[i->m_b] ? a : r[i->m_b]; break;
+        default:       r[i->m_dst] = _apply(i->m_op, a, _unary(i->m_op) ? 0 : r[i->m_b]); break;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+// drivencontrols.h
+
+// Controls set from expressions over other controls and time, such as
+//
+//     BOT_TEETH = max(0, sin(t))
+//
+// An expression is parsed once, when it's given.  Before the next
+// evaluation the driven controls are put in dependency order (a control
+// driven from another driven control comes after it) and compiled together,
+// once however many were given in between, into one program for a
+// small register machine: loads of the controls read, arithmetic from
+// registers to registers and stores of the results.  Register 0 holds t and
+// the constants follow it.  Evaluating every driven control is then one
+// loop over the instructions, with no tree to walk and nothing allocated.
+//
+// Expressions are made of numbers, t (the animation tick), pi, the names
+// of controls, + - * / and ^ (power), unary minus, parentheses and the
+// functions sin cos tan asin acos atan atan2 sqrt abs exp log floor ceil
+// min max pow and clamp(x, lo, hi).  Parts that are all constants are
+// worked out while compiling.
+//
+// Editing isn't thread safe, but a DrivenControls may be evaluated by any
+// number of threads at once, each with registers of its own.
+
+#ifndef DRIVENCONTROLS_H
+#define DRIVENCONTROLS_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// An expression as parsed: m_op is a leaf (a constant, t or a control) or
+// an operation on the nodes in m_args
+struct DrivenNode
+{
+    int    m_op;
+    double m_value;             // a constant's
+    int    m_control;           // a control's
+    int    m_args[2];
+};
+
+struct DrivenInstruction
+{
+    int m_op;
+    int m_dst;                  // a register, or the control a store sets
+    int m_a;                    // a register, or the control a load reads
+    int m_b;
+};
+
+class DrivenControls
+{
+public:
+    DrivenControls();
+
+    // Lets expressions refer to control as name, in any case.  A control
+    // may have several names.
+    void setName(int control, const char *name);
+    // The control called name, or -1
+    int  control(const char *name) const;
+
+    // Drives control by expression instead of whatever drove it before.
+    // Returns false, with the reason in error and nothing changed, if the
+    // expression doesn't parse or would have controls driving each other
+    // round in a circle.
+    bool drive(int control, const char *expression, std::string *error = NULL);
+    void undrive(int control);
+    void clear();
+
+    // The driven controls, in the order they're evaluated
+    int numDriven() const { return (int)m_expressions.size(); }
+    int drivenControl(int i) const { prepare(); return m_expressions[m_order[i]].m_control; }
+    // What drives control, or NULL if nothing does
+    const char *expression(int control) const;
+    int numInstructions() const { prepare(); return (int)m_program.size(); }
+
+    // Sets every driven control in controls[] for the tick time.  registers
+    // is scratch space, sized on first use: keep one per thread and this
+    // allocates nothing.
+    void evaluate(double time, double *controls, std::vector<double> &registers) const;
+
+private:
+    struct Expression
+    {
+        int                     m_control;
+        std::string             m_source;
+        std::vector<DrivenNode> m_nodes;    // the root last
+        std::vector<int>        m_reads;    // controls, each once
+    };
+
+    const char *controlName(int control) const;
+    bool circle(int control, const std::vector<int> &reads, std::string *error) const;
+    void order();
+    void prepare() const;
+    void compile();
+    int  constant(double value) const;
+    int  emit(const Expression &expression, int node, int free);
+
+    std::map<std::string, int>     m_names;        // upper case
+    std::map<int, std::string>     m_controlNames; // the first given, for messages
+    std::vector<Expression>        m_expressions;
+    std::map<int, int>             m_drivenBy;     // control to m_expressions
+
+    // Made by compile() when first needed after a change; until then
+    // m_compiled is false
+    std::atomic<bool>              m_compiled;
+    std::mutex                     m_compileLock;
+    std::vector<int>               m_order;        // into m_expressions
+    std::vector<DrivenInstruction> m_program;
+    std::vector<double>            m_constants;    // registers 1 on
+    std::map<unsigned long long, int> m_constantRegisters;  // by their bits
+    int                            m_numRegisters;
+
+    DrivenControls(const DrivenControls &);
+    DrivenControls &operator=(const DrivenControls &);
+};
+
+#endif
@@ -0,0 +1,148 @@
+// evalthread.cpp
+
+#include "evalthread.h"
+#include "modelerapp.h"
+
+#include <algorithm>
+#include <chrono>
+
+// The rate the redraw loop has always animated at
+const double EvalThread::kTickSeconds = 0.025;
+
+static double _now()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double> >(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+EvalThread::EvalThread(ModelAt_f model, PosePublished_f published, void *context,
+                       CommandQueue &commands, const double *controls, int numControls,
+                       bool animating, const Camera &camera, double tick)
+    : m_model(model), m_published(published), m_context(context), m_commands(commands),
+      m_controls(controls, controls + numControls), m_animating(animating),
+      m_drawState(*ModelerDrawState::Instance()), m_camera(camera),
+      m_tick(tick), m_stop(false), m_woken(false), m_havePose(false)
+{
+    // poses only ever go to the screen
+    m_drawState.m_rayFile = NULL;
+
+    m_thread = std::thread(&EvalThread::run, this);
+}
+
+EvalThread::~EvalThread()
+{
+    stop();
+}
+
+void EvalThread::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeLock);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool EvalThread::post(const ModelerCommand &command)
+{
+    if (!m_commands.push(command))
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(m_wakeLock);
+        m_woken = true;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+const Pose *EvalThread::latestPose()
+{
+    if (m_poses.update())
+        m_havePose = true;
+    return currentPose();
+}
+
+// ****************************************************************************
+// Evaluation
+// ****************************************************************************
+
+void EvalThread::run()
+{
+    // The model reads the draw state through Instance(); this thread's copy
+    // only changes by command
+    ModelerDrawState::SetThreadState(&m_drawState);
+
+    CommandTarget target = { m_controls.empty() ? NULL : &m_controls[0], (int)m_controls.size(),
+                             &m_animating, &m_drawState, &m_camera };
+    bool first = true;
+    bool wasAnimating = false;
+    double nextTick = 0;
+
+    while (!m_stop)
+    {
+        // Everything the UI has sent since the last pose, in one batch
+        bool changed = first;
+        ModelerCommand command;
+        while (m_commands.pop(command))
+            changed = applyCommand(command, target) || changed;
+        first = false;
+
+        // A pose is due for new state, every tick while animating, and
+        // once more when the animation stops
+        double now = _now();
+        if (m_animating && !wasAnimating)
+            nextTick = now;
+        bool tickDue = m_animating && now >= nextTick;
+        if (!changed && !tickDue && m_animating == wasAnimating)
+        {
+            // Nothing to do until a command comes in or the next tick
+            std::unique_lock<std::mutex> lock(m_wakeLock);
+            if (m_animating)
+                m_wake.wait_for(lock, std::chrono::duration<double>(nextTick - now),
+                                [this] { return m_woken || m_stop; });
+            else
+                m_wake.wait(lock, [this] { return m_woken || m_stop; });
+            m_woken = false;
+            continue;
+        }
+        wasAnimating = m_animating;
+
+        Pose &pose = m_poses.back();
+        pose.m_controls = m_controls;
+        pose.m_tick = m_animating ? (double)m_tick : -1;
+
+        ModelerApplication::SetThreadControls(
+            pose.m_controls.empty() ? NULL : &pose.m_controls[0]);
+        pose.m_list.begin();
+        m_graph.begin(pose.m_list, pose.m_controls.empty() ? NULL : &pose.m_controls[0],
+                      (int)pose.m_controls.size());
+        pose.m_ok = m_model(m_context, pose.m_tick);
+        m_graph.end();
+        pose.m_list.end();
+        pose.m_graphStats = m_graph.stats();
+        ModelerApplication::SetThreadControls(NULL);
+
+        pose.m_camera   = m_camera;
+        pose.m_drawMode = m_drawState.m_drawMode;
+        pose.m_quality  = m_drawState.m_quality;
+
+        // What the animation sets stays set, as it does on the sliders
+        if (m_animating)
+            m_controls = pose.m_controls;
+        if (tickDue)
+        {
+            m_tick = m_tick + 1;
+            // after a stall, carry on from now rather than catch up
+            nextTick = std::max(nextTick + kTickSeconds, now);
+        }
+
+        m_poses.publish();
+        if (m_published)
+            m_published(m_context);
+    }
+
+    ModelerDrawState::SetThreadState(NULL);
+}
@@ -0,0 +1,107 @@
+// evalthread.h
+
+// Poses the model on a thread of its own, so a slow frame doesn't hold up
+// the UI and a busy UI doesn't hold up the animation.
+//
+// The thread starts from a copy of the UI's state (the controls, the draw
+// state and the camera) and from then on owns it: the UI sends changes as
+// commands through a CommandQueue, which the thread applies in a batch
+// before each pose, and with nothing to do it sleeps until one is posted
+// or the next animation tick is due.  It runs the animation clock, poses the model into a
+// DrawList (see drawlist.h) and publishes the result, with the state it
+// came from, through a TripleBuffer, so the UI always draws the newest
+// complete pose and neither thread ever waits for the other.  Poses go
+// through a ControlGraph (see controlgraph.h), so a pose after a control
+// changes only runs the parts of the model that read it.
+
+#ifndef EVALTHREAD_H
+#define EVALTHREAD_H
+
+#include "camera.h"
+#include "controlgraph.h"
+#include "drawlist.h"
+#include "modelercommand.h"
+#include "triplebuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What the thread publishes
+struct Pose
+{
+    DrawList            m_list;
+    std::vector<double> m_controls;     // after the model's SETs
+    double              m_tick;         // the clock, or -1 if not animated
+    bool                m_ok;           // false if the model couldn't be drawn
+    ControlGraphStats   m_graphStats;   // how much of it was reused
+
+    // The view state the commands so far came to, for the UI to draw with
+    Camera              m_camera;
+    DrawModeSetting_t   m_drawMode;
+    QualitySetting_t    m_quality;
+};
+
+// Called on the evaluation thread after each pose is published
+typedef void (*PosePublished_f)(void *context);
+
+class EvalThread
+{
+public:
+    // Starts the thread, from copies of controls[numControls], animating,
+    // the current draw state and camera, with the clock at tick.  model
+    // and published are only ever called on the new thread, one call at a
+    // time.  Until it's stopped, only the new thread may pop commands or
+    // pose the model.
+    EvalThread(ModelAt_f model, PosePublished_f published, void *context,
+               CommandQueue &commands, const double *controls, int numControls,
+               bool animating, const Camera &camera, double tick);
+    // Stops and joins the thread; the last pose stays readable
+    void stop();
+    ~EvalThread();
+
+    // UI side: queues command for the thread and wakes it; false if the
+    // queue is full
+    bool post(const ModelerCommand &command);
+
+    // UI side: the newest pose (NULL until the first is ready), and the
+    // one latestPose() last returned
+    const Pose *latestPose();
+    const Pose *currentPose() const { return m_havePose ? &m_poses.front() : NULL; }
+
+    // The animation clock, in ticks of kTickSeconds
+    double tick() const { return m_tick; }
+
+    static const double kTickSeconds;
+
+private:
+    void run();
+
+    ModelAt_f                 m_model;
+    PosePublished_f           m_published;
+    void                     *m_context;
+    CommandQueue             &m_commands;
+
+    // The thread's own state
+    std::vector<double>       m_controls;
+    bool                      m_animating;
+    ModelerDrawState          m_drawState;
+    Camera                    m_camera;
+    // which parts of the model to pose again when controls change
+    ControlGraph              m_graph;
+
+    TripleBuffer<Pose>        m_poses;
+    std::atomic<double>       m_tick;
+    std::atomic<bool>         m_stop;
+    // what the thread sleeps on when it has nothing to do
+    std::mutex                m_wakeLock;
+    std::condition_variable   m_wake;
+    bool                      m_woken;
+    bool                      m_havePose;     // UI side
+
+    std::thread               m_thread;
+};
+
+#endif
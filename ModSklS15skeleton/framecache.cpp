@@ -0,0 +1,137 @@
+// framecache.cpp
+
+#include "framecache.h"
+
+#include <cstring>
+
+// What a frame counts against the budget
+static size_t _bytes(const std::vector<unsigned char> &rgb, const std::vector<double> &key)
+{
+    return rgb.size() + key.size() * sizeof(double) + sizeof(CachedFrame);
+}
+
+FrameCache::FrameCache(size_t budget)
+    : m_budget(budget), m_bytes(0), m_hits(0), m_misses(0), m_evictions(0)
+{
+}
+
+// FNV-1a over the key's bytes, with -0 folded into 0 so equal keys hash
+// equally
+unsigned long long FrameCache::hash(const std::vector<double> &key)
+{
+    unsigned long long h = 14695981039346656037ull;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        double value = key[i] == 0 ? 0 : key[i];
+        unsigned char bytes[sizeof(double)];
+        memcpy(bytes, &value, sizeof(value));
+        for (size_t b = 0; b < sizeof(bytes); ++b)
+        {
+            h ^= bytes[b];
+            h *= 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+const CachedFrame *FrameCache::find(const std::vector<double> &key)
+{
+    unsigned long long h = hash(key);
+    auto range = m_index.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second->m_key != key)
+            continue;
+
+        // to the front, as the most recently used
+        m_frames.splice(m_frames.begin(), m_frames, it->second);
+        ++m_hits;
+        return &m_frames.front();
+    }
+    ++m_misses;
+    return NULL;
+}
+
+void FrameCache::insert(const std::vector<double> &key, int width, int height,
+                        std::vector<unsigned char> &rgb)
+{
+    size_t bytes = _bytes(rgb, key);
+    if (bytes > m_budget)
+    {
+        rgb.clear();
+        return;
+    }
+
+    // a frame stored twice keeps only the newer image
+    unsigned long long h = hash(key);
+    auto range = m_index.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it)
+        if (it->second->m_key == key)
+        {
+            m_bytes -= _bytes(it->second->m_rgb, it->second->m_key);
+            m_frames.erase(it->second);
+            m_index.erase(it);
+            break;
+        }
+
+    evict(m_budget - bytes);
+
+    m_frames.push_front(CachedFrame());
+    CachedFrame &frame = m_frames.front();
+    frame.m_key    = key;
+    frame.m_hash   = h;
+    frame.m_width  = width;
+    frame.m_height = height;
+    frame.m_rgb.swap(rgb);
+    rgb.clear();
+    m_index.insert(std::make_pair(h, m_frames.begin()));
+    m_bytes += bytes;
+}
+
+void FrameCache::setBudget(size_t bytes)
+{
+    m_budget = bytes;
+    evict(m_budget);
+}
+
+// Drops the least recently used frames until at most budget bytes are held
+void FrameCache::evict(size_t budget)
+{
+    while (m_bytes > budget && !m_frames.empty())
+    {
+        CachedFrame &frame = m_frames.back();
+        auto range = m_index.equal_range(frame.m_hash);
+        for (auto it = range.first; it != range.second; ++it)
+            if (&*it->second == &frame)
+            {
+                m_index.erase(it);
+                break;
+            }
+        m_bytes -= _bytes(frame.m_rgb, frame.m_key);
+        m_frames.pop_back();
+        ++m_evictions;
+    }
+}
+
+void FrameCache::clear()
+{
+    m_frames.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+FrameCacheStats FrameCache::stats() const
+{
+    FrameCacheStats stats;
+    stats.m_hits      = m_hits;
+    stats.m_misses    = m_misses;
+    stats.m_evictions = m_evictions;
+    stats.m_frames    = (int)m_frames.size();
+    stats.m_bytes     = m_bytes;
+    return stats;
+}
+
+void FrameCache::resetStats()
+{
+    m_hits = m_misses = m_evictions = 0;
+}
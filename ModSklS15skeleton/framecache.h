@@ -0,0 +1,85 @@
+// framecache.h
+
+// Rendered frames, kept by what they show, so a pose that comes round again
+// (scrubbing back and forth, flipping between draw modes) is put straight
+// on screen instead of drawn again.
+//
+// A frame's key is every number that decides its pixels: the control
+// values, the camera, the draw mode and quality and the window size, in
+// whatever order the caller likes as long as it's always the same.  Frames
+// are found by a 64-bit hash of the key and then the whole key is
+// compared, so a hash collision can only cost a miss.  The cache holds RGB
+// images up to a memory budget, dropping the least recently shown first.
+// One thread only.
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct CachedFrame
+{
+    std::vector<double>        m_key;
+    unsigned long long         m_hash;
+    int                        m_width;
+    int                        m_height;
+    std::vector<unsigned char> m_rgb;       // bottom-up rows, tightly packed
+};
+
+struct FrameCacheStats
+{
+    long   m_hits;
+    long   m_misses;
+    long   m_evictions;
+    int    m_frames;        // held now
+    size_t m_bytes;
+};
+
+class FrameCache
+{
+public:
+    explicit FrameCache(size_t budget = 128 << 20);
+
+    // Evicts down to the new budget at once; 0 turns the cache off
+    void   setBudget(size_t bytes);
+    size_t budget() const { return m_budget; }
+
+    // The frame stored under key, now the most recently used, or NULL
+    const CachedFrame *find(const std::vector<double> &key);
+
+    // Stores a width x height image under key, taking rgb's contents
+    // (rgb is left empty).  Evicts the least recently used frames to make
+    // room; an image bigger than the whole budget isn't kept.
+    void insert(const std::vector<double> &key, int width, int height,
+                std::vector<unsigned char> &rgb);
+
+    void clear();
+
+    FrameCacheStats stats() const;
+    void resetStats();
+
+    static unsigned long long hash(const std::vector<double> &key);
+
+private:
+    typedef std::list<CachedFrame> FrameList;
+
+    void evict(size_t budget);
+
+    // Most recently used first
+    FrameList                                                 m_frames;
+    std::unordered_multimap<unsigned long long, FrameList::iterator> m_index;
+
+    size_t m_budget;
+    size_t m_bytes;
+    long   m_hits;
+    long   m_misses;
+    long   m_evictions;
+
+    FrameCache(const FrameCache &);
+    FrameCache &operator=(const FrameCache &);
+};
+
+#endif
@@ -0,0 +1,423 @@
+// framecapture.cpp
+
+#include "framecapture.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define _GET_PROC(name) wglGetProcAddress(name)
+#else
+#include <GL/glx.h>
+#define _GET_PROC(name) glXGetProcAddressARB((const GLubyte *)(name))
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// ****************************************************************************
+// GL_ARB_pixel_buffer_object entry points (opengl32 only exports GL 1.1)
+// ****************************************************************************
+
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#define GL_PIXEL_PACK_BUFFER_ARB 0x88EB
+#endif
+#ifndef GL_STREAM_READ_ARB
+#define GL_STREAM_READ_ARB       0x88E1
+#endif
+#ifndef GL_READ_ONLY_ARB
+#define GL_READ_ONLY_ARB         0x88B8
+#endif
+
+typedef void   (APIENTRY *_GenBuffers_f)(GLsizei n, GLuint *buffers);
+typedef void   (APIENTRY *_DeleteBuffers_f)(GLsizei n, const GLuint *buffers);
+typedef void   (APIENTRY *_BindBuffer_f)(GLenum target, GLuint buffer);
+typedef void   (APIENTRY *_BufferData_f)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+typedef void * (APIENTRY *_MapBuffer_f)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *_UnmapBuffer_f)(GLenum target);
+
+static _GenBuffers_f    s_glGenBuffers    = NULL;
+static _DeleteBuffers_f s_glDeleteBuffers = NULL;
+static _BindBuffer_f    s_glBindBuffer    = NULL;
+static _BufferData_f    s_glBufferData    = NULL;
+static _MapBuffer_f     s_glMapBuffer     = NULL;
+static _UnmapBuffer_f   s_glUnmapBuffer   = NULL;
+
+static bool _load_pbo_entry_points()
+{
+    const char *ext = (const char *)glGetString(GL_EXTENSIONS);
+    if (ext == NULL || strstr(ext, "GL_ARB_pixel_buffer_object") == NULL)
+        return false;
+
+    s_glGenBuffers    = (_GenBuffers_f)   _GET_PROC("glGenBuffersARB");
+    s_glDeleteBuffers = (_DeleteBuffers_f)_GET_PROC("glDeleteBuffersARB");
+    s_glBindBuffer    = (_BindBuffer_f)   _GET_PROC("glBindBufferARB");
+    s_glBufferData    = (_BufferData_f)   _GET_PROC("glBufferDataARB");
+    s_glMapBuffer     = (_MapBuffer_f)    _GET_PROC("glMapBufferARB");
+    s_glUnmapBuffer   = (_UnmapBuffer_f)  _GET_PROC("glUnmapBufferARB");
+
+    return s_glGenBuffers && s_glDeleteBuffers && s_glBindBuffer &&
+           s_glBufferData && s_glMapBuffer && s_glUnmapBuffer;
+}
+
+// ****************************************************************************
+
+FrameCapture::FrameCapture(int numBuffers, int numEncoders)
+    : m_inFlight(-1), m_nextSequence(0), m_framesWritten(0), m_framesDropped(0),
+      m_recording(false), m_recordPolicy(CAPTURE_BLOCK), m_recordFrame(0),
+      m_recordSeconds(0), m_gif(NULL),
+      m_glReady(false), m_usePBO(false), m_stop(false)
+{
+    m_slots.resize(numBuffers < 2 ? 2 : numBuffers);
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        m_slots[i].m_state    = SLOT_FREE;
+        m_slots[i].m_sequence = 0;
+        m_slots[i].m_width    = 0;
+        m_slots[i].m_height   = 0;
+        m_slots[i].m_pbo      = 0;
+        m_slots[i].m_pboBytes = 0;
+        m_slots[i].m_format   = IMAGE_BMP;
+        m_slots[i].m_animation = false;
+        m_slots[i].m_filename[0] = '\0';
+    }
+
+    if (numEncoders <= 0)
+    {
+        // leave a core for the UI thread
+        numEncoders = (int)std::thread::hardware_concurrency() - 1;
+        if (numEncoders < 1) numEncoders = 1;
+        if (numEncoders > 4) numEncoders = 4;
+    }
+    // more encoders than buffers could never all be busy
+    if (numEncoders > (int)m_slots.size() - 1)
+        numEncoders = (int)m_slots.size() - 1;
+
+    for (int i = 0; i < numEncoders; ++i)
+        m_encoders.push_back(std::thread(&FrameCapture::encoderLoop, this));
+}
+
+FrameCapture::~FrameCapture()
+{
+    // A recording still going: what's been read back is written out and a
+    // GIF gets its trailer.  A readback still in flight needs the GL
+    // context, which a destructor can't promise, so that frame is lost.
+    if (m_recording)
+        finishRecording();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_queued.notify_all();
+    for (size_t i = 0; i < m_encoders.size(); ++i)
+        m_encoders[i].join();
+
+    // The PBOs go away with the context; deleting them here would need
+    // the context current, which a destructor can't promise.
+}
+
+void FrameCapture::initGL()
+{
+    m_glReady = true;
+    m_usePBO  = _load_pbo_entry_points();
+
+    if (m_usePBO)
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i)
+            s_glGenBuffers(1, &m_slots[i].m_pbo);
+    }
+}
+
+int FrameCapture::acquireSlot(CapturePolicy_t policy)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i)
+        {
+            if (m_slots[i].m_state == SLOT_FREE)
+            {
+                m_slots[i].m_state = SLOT_READING;
+                return (int)i;
+            }
+        }
+        // every buffer is busy; the encoders are behind
+        if (policy == CAPTURE_DROP)
+        {
+            ++m_framesDropped;
+            return -1;
+        }
+        m_freed.wait(lock);
+    }
+}
+
+bool FrameCapture::capture(int w, int h, const char filename[], CapturePolicy_t policy)
+{
+    return readback(w, h, filename, policy, false);
+}
+
+bool FrameCapture::readback(int w, int h, const char filename[], CapturePolicy_t policy,
+                            bool animation)
+{
+    if (!m_glReady)
+        initGL();
+
+    int index = acquireSlot(policy);
+    if (index < 0)
+        return false;
+    Slot &slot = m_slots[index];
+
+    // only reallocates when the view size changes
+    int bytes = 3 * w * h;
+    if ((int)slot.m_pixels.size() != bytes)
+        slot.m_pixels.resize(bytes);
+
+    slot.m_width    = w;
+    slot.m_height   = h;
+    slot.m_sequence = m_nextSequence++;
+    slot.m_format   = imageFormatFromName(filename);
+    slot.m_animation = animation;
+    strncpy(slot.m_filename, filename, sizeof(slot.m_filename) - 1);
+    slot.m_filename[sizeof(slot.m_filename) - 1] = '\0';
+
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, w);
+
+    if (m_usePBO)
+    {
+        s_glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, slot.m_pbo);
+        if (slot.m_pboBytes != bytes)
+        {
+            s_glBufferData(GL_PIXEL_PACK_BUFFER_ARB, bytes, NULL, GL_STREAM_READ_ARB);
+            slot.m_pboBytes = bytes;
+        }
+        // returns as soon as the copy is queued on the GPU
+        glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        s_glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+        // the previous frame's copy has had a whole frame to land
+        if (m_inFlight >= 0)
+            resolveSlot(m_inFlight);
+        m_inFlight = index;
+    }
+    else
+    {
+        glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, &slot.m_pixels[0]);
+        queueSlot(index);
+    }
+    return true;
+}
+
+void FrameCapture::resolve()
+{
+    if (m_inFlight >= 0)
+        resolveSlot(m_inFlight);
+    m_inFlight = -1;
+}
+
+void FrameCapture::resolveSlot(int index)
+{
+    Slot &slot = m_slots[index];
+
+    s_glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, slot.m_pbo);
+    const void *mapped = s_glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+    if (mapped)
+    {
+        memcpy(&slot.m_pixels[0], mapped, slot.m_pixels.size());
+        s_glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+    }
+    s_glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    if (mapped)
+        queueSlot(index);
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            slot.m_state = SLOT_FREE;
+        }
+        m_freed.notify_all();
+    }
+}
+
+// Hands a slot whose pixels have landed to the encoders, or straight to
+// the GIF being recorded.  Called on the GL thread in capture order, which
+// is the order an animation needs its frames in.
+void FrameCapture::queueSlot(int index)
+{
+    Slot &slot = m_slots[index];
+
+    if (!slot.m_animation)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            slot.m_state = SLOT_QUEUED;
+        }
+        m_queued.notify_one();
+        return;
+    }
+
+    bool added = false;
+    if (m_gif)
+    {
+        if (!m_gif->isOpen())
+        {
+            std::string name = m_recordBase + m_recordExt;
+            if (!m_gif->open(name.c_str(), slot.m_width, slot.m_height, m_recordSeconds))
+                fprintf(stderr, "Unable to write %s\n", name.c_str());
+        }
+        // an animation can't change size part way through
+        if (m_gif->isOpen() && m_gif->width() == slot.m_width && m_gif->height() == slot.m_height)
+            added = m_gif->addFrame(&slot.m_pixels[0], m_recordPolicy == CAPTURE_BLOCK);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        slot.m_state = SLOT_FREE;
+        if (!added)
+            ++m_framesDropped;
+    }
+    m_freed.notify_all();
+}
+
+void FrameCapture::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        bool busy = false;
+        for (size_t i = 0; i < m_slots.size(); ++i)
+            if (m_slots[i].m_state == SLOT_QUEUED || m_slots[i].m_state == SLOT_WRITING)
+                busy = true;
+        if (!busy)
+            return;
+        m_freed.wait(lock);
+    }
+}
+
+int FrameCapture::framesWritten()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_framesWritten;
+}
+
+int FrameCapture::framesDropped()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_framesDropped;
+}
+
+// ****************************************************************************
+// Image sequence recording
+// ****************************************************************************
+
+void FrameCapture::startRecording(const char pattern[], CapturePolicy_t policy,
+                                  double frameSeconds)
+{
+    std::string name(pattern);
+    size_t dot   = name.rfind('.');
+    size_t slash = name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        m_recordBase = name;
+        m_recordExt  = ".bmp";
+    }
+    else
+    {
+        m_recordBase = name.substr(0, dot);
+        m_recordExt  = name.substr(dot);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_framesDropped = 0;
+    }
+    m_recordPolicy  = policy;
+    m_recordSeconds = frameSeconds;
+    m_recordFrame   = 0;
+    m_recording     = true;
+
+    // the GIF is opened by the first frame, which knows the view size
+    if (imageFormatFromName(m_recordExt.c_str()) == IMAGE_GIF)
+        m_gif = new GifWriter;
+}
+
+bool FrameCapture::recordFrame(int w, int h)
+{
+    if (!m_recording)
+        return false;
+
+    char filename[sizeof(((Slot *)0)->m_filename)];
+    snprintf(filename, sizeof(filename), "%s_%05d%s",
+             m_recordBase.c_str(), m_recordFrame, m_recordExt.c_str());
+
+    // the frame number advances even for dropped frames, so the gaps in
+    // the sequence show where they were
+    ++m_recordFrame;
+    return readback(w, h, filename, m_recordPolicy, m_gif != NULL);
+}
+
+void FrameCapture::stopRecording()
+{
+    if (!m_recording)
+        return;
+    resolve();
+    finishRecording();
+}
+
+// Writes out every frame read back so far and finishes the GIF, if any
+void FrameCapture::finishRecording()
+{
+    m_recording = false;
+    flush();
+
+    if (m_gif)
+    {
+        if (m_gif->isOpen() && !m_gif->close())
+            fprintf(stderr, "Unable to finish %s%s\n", m_recordBase.c_str(), m_recordExt.c_str());
+        delete m_gif;
+        m_gif = NULL;
+    }
+}
+
+void FrameCapture::encoderLoop()
+{
+    ImageScratch scratch;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        // oldest queued frame first, so files land roughly in capture order
+        int next = -1;
+        for (size_t i = 0; i < m_slots.size(); ++i)
+        {
+            if (m_slots[i].m_state == SLOT_QUEUED &&
+                (next < 0 || m_slots[i].m_sequence < m_slots[next].m_sequence))
+                next = (int)i;
+        }
+
+        if (next < 0)
+        {
+            if (m_stop)
+                return;
+            m_queued.wait(lock);
+            continue;
+        }
+
+        Slot &slot = m_slots[next];
+        slot.m_state = SLOT_WRITING;
+        lock.unlock();
+
+        if (!writeImage(slot.m_format, slot.m_filename, slot.m_width, slot.m_height,
+                        &slot.m_pixels[0], scratch))
+            fprintf(stderr, "Unable to write %s\n", slot.m_filename);
+
+        lock.lock();
+        slot.m_state = SLOT_FREE;
+        ++m_framesWritten;
+        m_freed.notify_all();
+    }
+}
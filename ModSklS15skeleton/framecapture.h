@@ -0,0 +1,128 @@
+// framecapture.h
+
+// Asynchronous capture of the modeler view to image files.
+//
+// Frames are read back into a small ring of reusable buffers.  When the
+// driver has GL_ARB_pixel_buffer_object, glReadPixels() targets a PBO and
+// returns immediately; the PBO is mapped one capture later, once the copy
+// has had a frame to finish.  Without PBOs the ring buffers are read into
+// directly.  Either way the image is encoded and written by a small pool
+// of background threads, so saving never blocks the UI on disk I/O and
+// steady-state recording allocates nothing.
+//
+// The ring is also the queue between the renderer and the encoders, so it
+// is bounded.  When every buffer is busy, a capture either waits for an
+// encoder (CAPTURE_BLOCK: the animation slows down, no frame is lost) or
+// skips the frame (CAPTURE_DROP: the animation keeps its rate).
+//
+// Recording to a .gif streams the frames into one animated GIF instead of
+// numbered files; the GifWriter has its own pool and bounded queue.
+
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include "imagewriter.h"
+#include "gifwriter.h"
+
+#include <FL/gl.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CapturePolicy_t
+{ CAPTURE_BLOCK=0, CAPTURE_DROP, };
+
+class FrameCapture
+{
+public:
+    // numBuffers is clamped to at least 2 (one in flight, one writing);
+    // numEncoders <= 0 picks one per spare core, up to four
+    FrameCapture(int numBuffers = 6, int numEncoders = 0);
+    ~FrameCapture();
+
+    // Reads back the w x h back buffer and queues it to be written to
+    // filename; the extension picks BMP, PPM or PNG.  The GL context must
+    // be current.  Returns false if the frame was dropped.
+    bool capture(int w, int h, const char filename[],
+                 CapturePolicy_t policy = CAPTURE_BLOCK);
+
+    // Completes a readback still in flight.  The GL context must be current.
+    void resolve();
+
+    // Blocks until every resolved frame has been written
+    void flush();
+
+    // Image sequence recording.  Frames are named after pattern with a
+    // five digit frame number before the extension, so "walk.png" gives
+    // walk_00000.png, walk_00001.png, ...; "walk.gif" gives one animated
+    // GIF with each frame shown for frameSeconds.
+    void startRecording(const char pattern[], CapturePolicy_t policy,
+                        double frameSeconds = 0.025);
+    bool recordFrame(int w, int h);
+    // Resolves and flushes; the GL context must be current
+    void stopRecording();
+    bool isRecording() const { return m_recording; }
+    int  framesRecorded() const { return m_recordFrame; }
+
+    bool usingPixelBuffers() const { return m_usePBO; }
+    int  numEncoders() const { return (int)m_encoders.size(); }
+    int  framesWritten();
+    int  framesDropped();
+
+private:
+    FrameCapture(const FrameCapture &) {}
+    FrameCapture& operator=(const FrameCapture &) { return *this; }
+
+    enum SlotState_t { SLOT_FREE, SLOT_READING, SLOT_QUEUED, SLOT_WRITING, };
+
+    struct Slot
+    {
+        SlotState_t                m_state;
+        unsigned                   m_sequence;
+        int                        m_width;
+        int                        m_height;
+        GLuint                     m_pbo;
+        int                        m_pboBytes;
+        std::vector<unsigned char> m_pixels;
+        ImageFormat_t              m_format;
+        bool                       m_animation;  // goes to m_gif, not a file
+        char                       m_filename[260];
+    };
+
+    void initGL();
+    bool readback(int w, int h, const char filename[], CapturePolicy_t policy,
+                  bool animation);
+    int  acquireSlot(CapturePolicy_t policy);
+    void resolveSlot(int index);
+    void queueSlot(int index);
+    void finishRecording();
+    void encoderLoop();
+
+    std::vector<Slot>       m_slots;
+    int                     m_inFlight;
+    unsigned                m_nextSequence;
+    int                     m_framesWritten;
+    int                     m_framesDropped;
+
+    bool                    m_recording;
+    CapturePolicy_t         m_recordPolicy;
+    int                     m_recordFrame;
+    std::string             m_recordBase;
+    std::string             m_recordExt;
+    double                  m_recordSeconds;
+    GifWriter              *m_gif;
+
+    bool                    m_glReady;
+    bool                    m_usePBO;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_queued;
+    std::condition_variable m_freed;
+    bool                    m_stop;
+    std::vector<std::thread> m_encoders;
+};
+
+#endif
@@ -0,0 +1,201 @@
+// frametable.cpp
+
+#include "frametable.h"
+#include "modelerapp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char         kMagic[4] = { 'M', 'F', 'T', 'B' };
+static const unsigned int kVersion  = 1;
+static const double       kLevels   = 65535;
+
+// Rows start on 8 byte boundaries
+static unsigned int _stride(int numChannels)
+{
+    return (unsigned int)(numChannels * 2 + 7) & ~7u;
+}
+
+FrameTable::FrameTable()
+    : m_header(NULL), m_ranges(NULL), m_frames(NULL)
+{
+}
+
+void FrameTable::clear()
+{
+    m_header = NULL;
+    m_ranges = NULL;
+    m_frames = NULL;
+    m_built.clear();
+    m_file.close();
+}
+
+// ****************************************************************************
+// Building
+// ****************************************************************************
+
+void FrameTable::build(const double *values, int numChannels, int numFrames,
+                       double firstTick, double tickStep)
+{
+    clear();
+    if (numChannels <= 0 || numFrames <= 0 || tickStep <= 0)
+        return;
+
+    FrameTableHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, kMagic, sizeof(kMagic));
+    header.m_version     = kVersion;
+    header.m_numChannels = numChannels;
+    header.m_numFrames   = numFrames;
+    header.m_firstTick   = firstTick;
+    header.m_tickStep    = tickStep;
+    header.m_rangeOffset = sizeof(FrameTableHeader);
+    header.m_frameOffset = header.m_rangeOffset + numChannels * 2 * sizeof(double);
+    header.m_frameStride = _stride(numChannels);
+
+    size_t size = header.m_frameOffset + (size_t)numFrames * header.m_frameStride;
+    m_built.assign((size + sizeof(double) - 1) / sizeof(double), 0);
+    unsigned char *data = (unsigned char *)&m_built[0];
+    memcpy(data, &header, sizeof(header));
+
+    // Each channel's range over the whole bake
+    double *ranges = (double *)(data + header.m_rangeOffset);
+    for (int c = 0; c < numChannels; ++c)
+    {
+        double lo = values[c], hi = values[c];
+        for (int f = 1; f < numFrames; ++f)
+        {
+            lo = std::min(lo, values[(size_t)f * numChannels + c]);
+            hi = std::max(hi, values[(size_t)f * numChannels + c]);
+        }
+        ranges[2 * c]     = lo;
+        ranges[2 * c + 1] = (hi - lo) / kLevels;
+    }
+
+    for (int f = 0; f < numFrames; ++f)
+    {
+        const double *in = values + (size_t)f * numChannels;
+        unsigned short *row = (unsigned short *)(data + header.m_frameOffset +
+                                                 (size_t)f * header.m_frameStride);
+        for (int c = 0; c < numChannels; ++c)
+        {
+            double step = ranges[2 * c + 1];
+            double q = step > 0 ? floor((in[c] - ranges[2 * c]) / step + 0.5) : 0;
+            row[c] = (unsigned short)std::min(std::max(q, 0.0), kLevels);
+        }
+    }
+
+    attach(data, size);
+}
+
+bool FrameTable::save(const char *fname) const
+{
+    if (empty())
+        return false;
+
+    FILE *file = fopen(fname, "wb");
+    if (!file)
+        return false;
+    size_t size = m_header->m_frameOffset + (size_t)m_header->m_numFrames * m_header->m_frameStride;
+    bool ok = fwrite(m_header, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+// ****************************************************************************
+// Reading
+// ****************************************************************************
+
+bool FrameTable::open(const char *fname)
+{
+    clear();
+    if (!m_file.open(fname, false))
+        return false;
+    if (!attach(m_file.m_data, m_file.m_size))
+    {
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+// Points the accessors into data, if it holds a whole table
+bool FrameTable::attach(const unsigned char *data, size_t size)
+{
+    if (size < sizeof(FrameTableHeader))
+        return false;
+    const FrameTableHeader *header = (const FrameTableHeader *)data;
+    if (memcmp(header->m_magic, kMagic, sizeof(kMagic)) != 0 || header->m_version != kVersion ||
+        header->m_numChannels == 0 || header->m_numFrames == 0 || !(header->m_tickStep > 0) ||
+        header->m_rangeOffset % 8 != 0 || header->m_frameOffset % 2 != 0)
+        return false;
+
+    // Sizes in size_t, and each checked against what's left of the file
+    // before it's multiplied out, so a bad header can't wrap around
+    size_t numChannels = header->m_numChannels, numFrames = header->m_numFrames;
+    size_t stride = header->m_frameStride;
+    if (header->m_rangeOffset > size || header->m_frameOffset > size ||
+        numChannels > (size - header->m_rangeOffset) / (2 * sizeof(double)) ||
+        stride < numChannels * 2 || numFrames > (size - header->m_frameOffset) / stride)
+        return false;
+
+    m_header = header;
+    m_ranges = (const double *)(data + header->m_rangeOffset);
+    m_frames = data + header->m_frameOffset;
+    return true;
+}
+
+int FrameTable::frameAt(double tick) const
+{
+    if (empty())
+        return 0;
+    int n = (int)m_header->m_numFrames;
+    int i = (int)fmod(floor((tick - m_header->m_firstTick) / m_header->m_tickStep + 0.5), n);
+    return i < 0 ? i + n : i;
+}
+
+void FrameTable::frame(int i, double *values) const
+{
+    const unsigned short *row = (const unsigned short *)(m_frames + (size_t)i * m_header->m_frameStride);
+    int numChannels = (int)m_header->m_numChannels;
+    for (int c = 0; c < numChannels; ++c)
+        values[c] = m_ranges[2 * c] + row[c] * m_ranges[2 * c + 1];
+}
+
+double FrameTable::value(int i, int channel) const
+{
+    const unsigned short *row = (const unsigned short *)(m_frames + (size_t)i * m_header->m_frameStride);
+    return m_ranges[2 * channel] + row[channel] * m_ranges[2 * channel + 1];
+}
+
+// ****************************************************************************
+// Baking
+// ****************************************************************************
+
+bool bakeAnimation(ModelAt_f model, void *context, const double *controls, int numControls,
+                   double firstTick, int numFrames, FrameTable &table)
+{
+    table.clear();
+    if (numControls <= 0 || numFrames <= 0)
+        return false;
+
+    std::vector<double> current(controls, controls + numControls);
+    std::vector<double> values((size_t)numControls * numFrames);
+    DrawList list;
+
+    bool ok = true;
+    ModelerApplication::SetThreadControls(&current[0]);
+    for (int f = 0; f < numFrames && ok; ++f)
+    {
+        list.begin();
+        ok = model(context, firstTick + f);
+        list.end();
+        std::copy(current.begin(), current.end(), values.begin() + (size_t)f * numControls);
+    }
+    ModelerApplication::SetThreadControls(NULL);
+
+    if (ok)
+        table.build(&values[0], numControls, numFrames, firstTick);
+    return ok;
+}
@@ -0,0 +1,90 @@
+// frametable.h
+
+// An animation baked down to the control values of every frame, for
+// playing back, scrubbing and rendering without running the animation.
+//
+// The table is frame major: each frame is one fixed-size row holding a
+// 16-bit value per control, quantized against that control's own range
+// (min + q * step) so a control that barely moves keeps its precision.
+// Rows being fixed size, the header is the whole seek index: frame i is
+// at m_frameOffset + i * m_frameStride, and any frame is one row read
+// away.  The file is the in-memory layout, little endian, so open() maps
+// it and reads straight out of the mapping; a long bake costs nothing to
+// open and only the frames shown are ever paged in.
+
+#ifndef FRAMETABLE_H
+#define FRAMETABLE_H
+
+#include "drawlist.h"
+#include "mappedfile.h"
+
+#include <vector>
+
+struct FrameTableHeader
+{
+    char         m_magic[4];        // "MFTB"
+    unsigned int m_version;
+    unsigned int m_numChannels;
+    unsigned int m_numFrames;
+    double       m_firstTick;       // frame 0's tick
+    double       m_tickStep;        // ticks from one frame to the next
+    unsigned int m_rangeOffset;     // per channel: double min, double step
+    unsigned int m_frameOffset;     // frame 0
+    unsigned int m_frameStride;     // bytes per frame
+    unsigned int m_reserved;
+};
+
+class FrameTable
+{
+public:
+    FrameTable();
+
+    // Quantizes numFrames rows of numChannels values, frame i being the
+    // pose at firstTick + i * tickStep
+    void build(const double *values, int numChannels, int numFrames,
+               double firstTick, double tickStep = 1);
+
+    bool save(const char *fname) const;
+    // Maps a saved table; false (and empty) if fname isn't one
+    bool open(const char *fname);
+    void clear();
+
+    bool   empty() const { return m_header == NULL; }
+    int    numChannels() const { return empty() ? 0 : (int)m_header->m_numChannels; }
+    int    numFrames() const { return empty() ? 0 : (int)m_header->m_numFrames; }
+    double firstTick() const { return m_header->m_firstTick; }
+    double tickStep() const { return m_header->m_tickStep; }
+
+    // The frame to show at tick, the table playing as a loop
+    int frameAt(double tick) const;
+
+    // Frame i's values, into values[numChannels()]
+    void   frame(int i, double *values) const;
+    double value(int i, int channel) const;
+
+    // How far a channel's values may be from what was baked
+    double tolerance(int channel) const { return m_ranges[2 * channel + 1] / 2; }
+
+private:
+    bool attach(const unsigned char *data, size_t size);
+
+    const FrameTableHeader *m_header;
+    const double           *m_ranges;
+    const unsigned char    *m_frames;
+
+    std::vector<double>     m_built;    // a table from build(), doubles for alignment
+    MappedFile              m_file;     // or one from open()
+
+    FrameTable(const FrameTable &);
+    FrameTable &operator=(const FrameTable &);
+};
+
+// Runs model over numFrames ticks from firstTick, carrying the controls
+// from one frame to the next as the animation sets them, starting from
+// controls[numControls], and bakes what they come to into table.  The
+// model is drawn into a DrawList that is thrown away, so nothing reaches
+// GL; call it on the thread that owns the model.
+bool bakeAnimation(ModelAt_f model, void *context, const double *controls, int numControls,
+                   double firstTick, int numFrames, FrameTable &table);
+
+#endif
@@ -0,0 +1,721 @@
+// gifwriter.cpp
+
+#include "gifwriter.h"
+
+#include <cmath>
+#include <cstring>
+
+// ****************************************************************************
+// LZW
+// ****************************************************************************
+
+static const int kLzwMaxCode  = 4095;
+static const int kLzwHashBits = 13;
+static const int kLzwHashSize = 1 << kLzwHashBits;     // > 4096 codes
+
+struct _BlockWriter
+{
+    std::vector<unsigned char> &m_out;
+    unsigned                    m_bits;
+    int                         m_count;
+    unsigned char               m_block[255];
+    int                         m_blockLen;
+
+    _BlockWriter(std::vector<unsigned char> &out)
+        : m_out(out), m_bits(0), m_count(0), m_blockLen(0) {}
+
+    void byte(unsigned char b)
+    {
+        m_block[m_blockLen++] = b;
+        if (m_blockLen == 255)
+            flushBlock();
+    }
+
+    void flushBlock()
+    {
+        if (m_blockLen == 0)
+            return;
+        m_out.push_back((unsigned char)m_blockLen);
+        m_out.insert(m_out.end(), m_block, m_block + m_blockLen);
+        m_blockLen = 0;
+    }
+
+    void put(int code, int bits)
+    {
+        m_bits |= (unsigned)code << m_count;
+        m_count += bits;
+        while (m_count >= 8)
+        {
+            byte((unsigned char)m_bits);
+            m_bits >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    void finish()
+    {
+        if (m_count > 0)
+            byte((unsigned char)m_bits);
+        flushBlock();
+        m_out.push_back(0);     // block terminator
+    }
+};
+
+void gifEncodeLZW(const unsigned char *indices, size_t count, int minCodeSize,
+                  std::vector<int> &table, std::vector<unsigned char> &out)
+{
+    // table holds (prefix << 8 | byte) + 1 keys in the first half and the
+    // matching codes in the second; zero marks an empty bucket
+    table.assign(2 * kLzwHashSize, 0);
+    int *keys  = &table[0];
+    int *codes = &table[kLzwHashSize];
+
+    const int clearCode = 1 << minCodeSize;
+    const int endCode   = clearCode + 1;
+
+    out.push_back((unsigned char)minCodeSize);
+    _BlockWriter bw(out);
+
+    int codeSize = minCodeSize + 1;
+    int maxCode  = endCode;         // last code assigned
+    bw.put(clearCode, codeSize);
+
+    if (count == 0)
+    {
+        bw.put(endCode, codeSize);
+        bw.finish();
+        return;
+    }
+
+    int prefix = indices[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+        int c   = indices[i];
+        int key = ((prefix << 8) | c) + 1;
+        unsigned h = ((unsigned)key * 2654435761u) >> (32 - kLzwHashBits);
+
+        while (keys[h] && keys[h] != key)
+            h = (h + 1) & (kLzwHashSize - 1);
+
+        if (keys[h])
+        {
+            prefix = codes[h];
+            continue;
+        }
+
+        bw.put(prefix, codeSize);
+
+        if (++maxCode < kLzwMaxCode)
+        {
+            keys[h]  = key;
+            codes[h] = maxCode;
+            // the decoder adds each entry one code later than we do, so
+            // it widens exactly when this code no longer fits
+            if (maxCode >= (1 << codeSize))
+                ++codeSize;
+        }
+        else
+        {
+            // table full: start over rather than let compression decay
+            bw.put(clearCode, codeSize);
+            memset(keys, 0, kLzwHashSize * sizeof(int));
+            codeSize = minCodeSize + 1;
+            maxCode  = endCode;
+        }
+        prefix = c;
+    }
+
+    bw.put(prefix, codeSize);
+    // reading the final code gives the decoder its last entry, which may
+    // widen the end code
+    if (maxCode + 1 == (1 << codeSize) && codeSize < 12)
+        ++codeSize;
+    bw.put(endCode, codeSize);
+    bw.finish();
+}
+
+// ****************************************************************************
+// Octree quantizer
+// ****************************************************************************
+
+static const int kOctreeDepth = 6;      // 6 bits per channel is plenty for 255 colours
+
+struct _OctNode
+{
+    unsigned long long m_sum[3];
+    unsigned           m_count;
+    int                m_child[8];
+    int                m_next;          // next reducible node on the same level
+    int                m_index;         // palette index once built
+    bool               m_leaf;
+};
+
+struct _Octree
+{
+    std::vector<_OctNode> m_nodes;
+    int                   m_reducible[kOctreeDepth];
+    int                   m_leaves;
+
+    void reset()
+    {
+        m_nodes.clear();
+        for (int i = 0; i < kOctreeDepth; ++i)
+            m_reducible[i] = -1;
+        m_leaves = 0;
+        newNode(0);
+    }
+
+    int newNode(int level)
+    {
+        _OctNode n;
+        memset(&n, 0, sizeof(n));
+        for (int i = 0; i < 8; ++i)
+            n.m_child[i] = -1;
+        n.m_next = -1;
+        n.m_leaf = (level == kOctreeDepth);
+        m_nodes.push_back(n);
+
+        int id = (int)m_nodes.size() - 1;
+        if (n.m_leaf)
+            ++m_leaves;
+        else if (level > 0)
+        {
+            m_nodes[id].m_next = m_reducible[level];
+            m_reducible[level] = id;
+        }
+        return id;
+    }
+
+    static int branch(const unsigned char *rgb, int level)
+    {
+        int shift = 7 - level;
+        return (((rgb[0] >> shift) & 1) << 2) | (((rgb[1] >> shift) & 1) << 1) | ((rgb[2] >> shift) & 1);
+    }
+
+    void insert(const unsigned char *rgb)
+    {
+        int node = 0;
+        for (int level = 0; !m_nodes[node].m_leaf; ++level)
+        {
+            int b = branch(rgb, level);
+            int child = m_nodes[node].m_child[b];
+            if (child < 0)
+            {
+                child = newNode(level + 1);
+                m_nodes[node].m_child[b] = child;
+            }
+            node = child;
+        }
+        _OctNode &leaf = m_nodes[node];
+        leaf.m_sum[0] += rgb[0];
+        leaf.m_sum[1] += rgb[1];
+        leaf.m_sum[2] += rgb[2];
+        ++leaf.m_count;
+    }
+
+    // Folds the deepest reducible node's children into it.  Deeper levels
+    // are always emptied first, so those children are all leaves.
+    void reduce()
+    {
+        int level = kOctreeDepth - 1;
+        while (level > 0 && m_reducible[level] < 0)
+            --level;
+        int id = m_reducible[level];
+        if (id < 0)
+            return;
+        m_reducible[level] = m_nodes[id].m_next;
+
+        _OctNode &node = m_nodes[id];
+        int children = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            int c = node.m_child[i];
+            if (c < 0)
+                continue;
+            const _OctNode &child = m_nodes[c];
+            node.m_sum[0] += child.m_sum[0];
+            node.m_sum[1] += child.m_sum[1];
+            node.m_sum[2] += child.m_sum[2];
+            node.m_count  += child.m_count;
+            node.m_child[i] = -1;
+            ++children;
+        }
+        node.m_leaf = true;
+        m_leaves -= children - 1;
+    }
+
+    // Assigns palette indices to the leaves and fills palette; returns the
+    // number of colours
+    int build(unsigned char *palette)
+    {
+        int count = 0;
+        assign(0, palette, count);
+        return count;
+    }
+
+    void assign(int id, unsigned char *palette, int &count)
+    {
+        _OctNode &node = m_nodes[id];
+        if (node.m_leaf)
+        {
+            node.m_index = count;
+            unsigned n = node.m_count ? node.m_count : 1;
+            palette[count * 3 + 0] = (unsigned char)(node.m_sum[0] / n);
+            palette[count * 3 + 1] = (unsigned char)(node.m_sum[1] / n);
+            palette[count * 3 + 2] = (unsigned char)(node.m_sum[2] / n);
+            ++count;
+            return;
+        }
+        for (int i = 0; i < 8; ++i)
+            if (node.m_child[i] >= 0)
+                assign(node.m_child[i], palette, count);
+    }
+
+    // Only valid for colours that were inserted
+    int lookup(const unsigned char *rgb) const
+    {
+        int node = 0;
+        for (int level = 0; !m_nodes[node].m_leaf; ++level)
+            node = m_nodes[node].m_child[branch(rgb, level)];
+        return m_nodes[node].m_index;
+    }
+};
+
+static int _palette_bits(int colors)
+{
+    int bits = 1;
+    while ((1 << bits) < colors)
+        ++bits;
+    return bits;
+}
+
+static void _put_le16(std::vector<unsigned char> &out, int v)
+{
+    out.push_back((unsigned char)(v & 0xFF));
+    out.push_back((unsigned char)((v >> 8) & 0xFF));
+}
+
+// ****************************************************************************
+// GifWriter
+// ****************************************************************************
+
+// Per-thread scratch, reused from frame to frame
+struct GifWriter::Worker
+{
+    _Octree                    m_octree;
+    std::vector<unsigned char> m_changed;    // 1 where the pixel differs from the last frame
+    std::vector<unsigned char> m_indices;
+    std::vector<int>           m_lzwTable;
+    unsigned char              m_palette[256 * 3];
+};
+
+GifWriter::GifWriter()
+    : m_file(NULL), m_width(0), m_height(0), m_paletteMode(GIF_PALETTE_LOCAL),
+      m_frameSeconds(0), m_clock(0), m_clockCs(0), m_globalBits(8),
+      m_numAdded(0), m_numStarted(0), m_numWritten(0),
+      m_writing(false), m_failed(false), m_stop(false), m_bytes(0)
+{
+}
+
+GifWriter::~GifWriter()
+{
+    if (m_file)
+        close();
+}
+
+bool GifWriter::open(const char fname[], int w, int h, double frameSeconds,
+                     GifPalette_t palette, int numThreads)
+{
+    if (m_file || w <= 0 || h <= 0 || w > 65535 || h > 65535)
+        return false;
+
+    m_file = fopen(fname, "wb");
+    if (m_file == NULL)
+        return false;
+
+    m_width        = w;
+    m_height       = h;
+    m_paletteMode  = palette;
+    m_frameSeconds = frameSeconds;
+    m_clock        = 0;
+    m_clockCs      = 0;
+    m_numAdded = m_numStarted = m_numWritten = 0;
+    m_writing = m_failed = m_stop = false;
+    m_bytes = 0;
+
+    if (numThreads <= 0)
+    {
+        numThreads = (int)std::thread::hardware_concurrency();
+        if (numThreads < 1) numThreads = 1;
+        if (numThreads > 8) numThreads = 8;
+    }
+
+    // two frames per worker keeps everyone busy while the oldest is written
+    m_jobs.resize(2 * numThreads);
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+        m_jobs[i].m_done = false;
+    m_sources.resize(m_jobs.size() + 1);
+    for (size_t i = 0; i < m_sources.size(); ++i)
+        m_sources[i].resize((size_t)w * h * 3);
+
+    for (int i = 0; i < numThreads; ++i)
+        m_workers.push_back(new Worker);
+    for (int i = 0; i < numThreads; ++i)
+        m_threads.push_back(std::thread(&GifWriter::workerLoop, this, i));
+    return true;
+}
+
+bool GifWriter::addFrame(const unsigned char *rgb, bool block)
+{
+    if (m_file == NULL)
+        return false;
+
+    // keep the animation's timing when frames are dropped; the next frame
+    // shown absorbs the time
+    m_clock += m_frameSeconds;
+
+    int frame;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_numAdded - m_numWritten >= (int)m_jobs.size())
+        {
+            if (!block)
+                return false;
+            m_progress.wait(lock);
+        }
+        frame = m_numAdded;
+    }
+
+    // Nobody touches this frame's buffers until it is published below
+    memcpy(&m_sources[frame % m_sources.size()][0], rgb, (size_t)m_width * m_height * 3);
+
+    int cs = (int)floor(m_clock * 100 + 0.5);
+    m_jobs[frame % m_jobs.size()].m_delay = cs - m_clockCs;
+    m_clockCs = cs;
+
+    // The header goes out before any worker can write a frame
+    if (frame == 0)
+        writeHeader();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_numAdded;
+    }
+    m_added.notify_one();
+    return true;
+}
+
+// Needs the first frame in m_sources[0] for the global palette
+void GifWriter::writeHeader()
+{
+    std::vector<unsigned char> header;
+    const char *magic = "GIF89a";
+    header.insert(header.end(), magic, magic + 6);
+    _put_le16(header, m_width);
+    _put_le16(header, m_height);
+
+    if (m_paletteMode == GIF_PALETTE_GLOBAL)
+    {
+        // Index 255 is kept for transparency.  The workers are idle until
+        // the first frame is published, so the first one's tree is free.
+        _Octree &tree = m_workers[0]->m_octree;
+        const unsigned char *src = &m_sources[0][0];
+        size_t pixels = (size_t)m_width * m_height;
+        tree.reset();
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            tree.insert(src + i * 3);
+            while (tree.m_leaves > 255)
+                tree.reduce();
+        }
+        m_globalPalette.assign(256 * 3, 0);
+        int colors = tree.build(&m_globalPalette[0]);
+
+        // Later frames hold colours the first one didn't, so they map
+        // through a nearest-colour table on 5 bits per channel
+        m_globalLookup.resize(32768);
+        for (int c = 0; c < 32768; ++c)
+        {
+            int r = ((c >> 10) & 31) * 255 / 31;
+            int g = ((c >> 5) & 31) * 255 / 31;
+            int b = (c & 31) * 255 / 31;
+            int best = 0, bestDist = 1 << 30;
+            for (int p = 0; p < colors; ++p)
+            {
+                int dr = r - m_globalPalette[p * 3 + 0];
+                int dg = g - m_globalPalette[p * 3 + 1];
+                int db = b - m_globalPalette[p * 3 + 2];
+                int d = 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+                if (d < bestDist)
+                {
+                    bestDist = d;
+                    best = p;
+                }
+            }
+            m_globalLookup[c] = (unsigned char)best;
+        }
+        m_globalBits = 8;
+
+        header.push_back(0xF7);     // global table, 8 bit colour, 256 entries
+        header.push_back(0);        // background
+        header.push_back(0);        // aspect
+        header.insert(header.end(), m_globalPalette.begin(), m_globalPalette.end());
+    }
+    else
+    {
+        header.push_back(0x70);     // no global table, 8 bit colour
+        header.push_back(0);
+        header.push_back(0);
+    }
+
+    // NETSCAPE2.0: loop forever
+    static const unsigned char loop[19] = {
+        0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+        0x03, 0x01, 0x00, 0x00, 0x00 };
+    header.insert(header.end(), loop, loop + sizeof(loop));
+
+    if (fwrite(&header[0], 1, header.size(), m_file) != header.size())
+        m_failed = true;
+    m_bytes += (long)header.size();
+}
+
+bool GifWriter::close()
+{
+    if (m_file == NULL)
+        return false;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_numWritten < m_numAdded)
+            m_progress.wait(lock);
+    }
+    stopWorkers();
+
+    // an animation with no frames isn't a valid file
+    bool ok = m_numAdded > 0 && !m_failed;
+    fputc(0x3B, m_file);    // trailer
+    ++m_bytes;
+    if (ferror(m_file))
+        ok = false;
+    if (fclose(m_file) != 0)
+        ok = false;
+    m_file = NULL;
+    return ok;
+}
+
+void GifWriter::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_added.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+    m_threads.clear();
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        delete m_workers[i];
+    m_workers.clear();
+}
+
+int GifWriter::framesWritten()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numWritten;
+}
+
+long GifWriter::bytesWritten()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+void GifWriter::workerLoop(int index)
+{
+    Worker &worker = *m_workers[index];
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        if (m_numStarted == m_numAdded)
+        {
+            if (m_stop)
+                return;
+            m_added.wait(lock);
+            continue;
+        }
+
+        int frame = m_numStarted++;
+        lock.unlock();
+        encodeFrame(frame, worker);
+        lock.lock();
+
+        m_jobs[frame % m_jobs.size()].m_done = true;
+        writeFinished(lock);
+    }
+}
+
+// Writes finished frames in order; called with the lock held.  Only one
+// thread writes at a time, the others just leave their frames behind.
+void GifWriter::writeFinished(std::unique_lock<std::mutex> &lock)
+{
+    while (!m_writing && m_numWritten < m_numAdded)
+    {
+        Job &job = m_jobs[m_numWritten % m_jobs.size()];
+        if (!job.m_done)
+            break;
+
+        m_writing = true;
+        lock.unlock();
+        bool ok = fwrite(&job.m_encoded[0], 1, job.m_encoded.size(), m_file) == job.m_encoded.size();
+        lock.lock();
+
+        if (!ok)
+            m_failed = true;
+        m_bytes += (long)job.m_encoded.size();
+        job.m_done = false;
+        ++m_numWritten;
+        m_writing = false;
+        m_progress.notify_all();
+    }
+}
+
+void GifWriter::encodeFrame(int frame, Worker &worker)
+{
+    const int w = m_width, h = m_height;
+    const size_t stride = (size_t)w * 3;
+    const unsigned char *src  = &m_sources[frame % m_sources.size()][0];
+    const unsigned char *prev = frame > 0 ? &m_sources[(frame - 1) % m_sources.size()][0] : NULL;
+    Job &job = m_jobs[frame % m_jobs.size()];
+
+    // Rectangle that changed since the previous frame, in GL (bottom-up) rows
+    int x0 = 0, x1 = w - 1, y0 = 0, y1 = h - 1;
+    bool still = false;
+    if (prev)
+    {
+        x0 = w; x1 = -1; y0 = h; y1 = -1;
+        for (int y = 0; y < h; ++y)
+        {
+            const unsigned char *a = src + y * stride;
+            const unsigned char *b = prev + y * stride;
+            if (memcmp(a, b, stride) == 0)
+                continue;
+
+            int first = 0, last = w - 1;
+            while (memcmp(a + first * 3, b + first * 3, 3) == 0)
+                ++first;
+            while (memcmp(a + last * 3, b + last * 3, 3) == 0)
+                --last;
+            if (first < x0) x0 = first;
+            if (last > x1)  x1 = last;
+            if (y < y0)     y0 = y;
+            y1 = y;
+        }
+        if (x1 < 0)
+        {
+            // nothing changed; one transparent pixel carries the delay
+            x0 = x1 = y0 = y1 = 0;
+            still = true;
+        }
+    }
+    const int rw = x1 - x0 + 1, rh = y1 - y0 + 1;
+    const size_t count = (size_t)rw * rh;
+
+    // Pixels equal to the previous frame become transparent, which turns
+    // the still parts of a moving model into long LZW runs
+    worker.m_changed.resize(count);
+    for (int ry = 0; ry < rh; ++ry)
+    {
+        // GIF rows run top-down
+        int y = y1 - ry;
+        const unsigned char *a = src + y * stride + x0 * 3;
+        const unsigned char *b = prev ? prev + y * stride + x0 * 3 : NULL;
+        unsigned char *changed = &worker.m_changed[(size_t)ry * rw];
+        for (int x = 0; x < rw; ++x)
+            changed[x] = !still && (b == NULL || memcmp(a + x * 3, b + x * 3, 3) != 0);
+    }
+
+    int bits, transparent;
+    const unsigned char *palette;
+    worker.m_indices.resize(count);
+
+    if (m_paletteMode == GIF_PALETTE_GLOBAL)
+    {
+        bits        = m_globalBits;
+        transparent = 255;
+        palette     = NULL;
+        const unsigned char *lut = &m_globalLookup[0];
+        for (int ry = 0; ry < rh; ++ry)
+        {
+            const unsigned char *a = src + (y1 - ry) * stride + x0 * 3;
+            const unsigned char *changed = &worker.m_changed[(size_t)ry * rw];
+            unsigned char *out = &worker.m_indices[(size_t)ry * rw];
+            for (int x = 0; x < rw; ++x, a += 3)
+                out[x] = changed[x] ? lut[((a[0] >> 3) << 10) | ((a[1] >> 3) << 5) | (a[2] >> 3)]
+                                    : (unsigned char)transparent;
+        }
+    }
+    else
+    {
+        _Octree &tree = worker.m_octree;
+        tree.reset();
+        for (int ry = 0; ry < rh; ++ry)
+        {
+            const unsigned char *a = src + (y1 - ry) * stride + x0 * 3;
+            const unsigned char *changed = &worker.m_changed[(size_t)ry * rw];
+            for (int x = 0; x < rw; ++x, a += 3)
+            {
+                if (!changed[x])
+                    continue;
+                tree.insert(a);
+                while (tree.m_leaves > 255)
+                    tree.reduce();
+            }
+        }
+        int colors  = tree.build(worker.m_palette);
+        transparent = colors;
+        bits        = _palette_bits(colors + 1);
+        palette     = worker.m_palette;
+
+        for (int ry = 0; ry < rh; ++ry)
+        {
+            const unsigned char *a = src + (y1 - ry) * stride + x0 * 3;
+            const unsigned char *changed = &worker.m_changed[(size_t)ry * rw];
+            unsigned char *out = &worker.m_indices[(size_t)ry * rw];
+            for (int x = 0; x < rw; ++x, a += 3)
+                out[x] = changed[x] ? (unsigned char)tree.lookup(a) : (unsigned char)transparent;
+        }
+    }
+
+    std::vector<unsigned char> &out = job.m_encoded;
+    out.clear();
+
+    // Graphic control extension: leave the previous frame in place
+    // (disposal 1) and show this one for m_delay
+    out.push_back(0x21);
+    out.push_back(0xF9);
+    out.push_back(4);
+    out.push_back((1 << 2) | 1);
+    _put_le16(out, job.m_delay);
+    out.push_back((unsigned char)transparent);
+    out.push_back(0);
+
+    // Image descriptor; GIF's y runs down from the top
+    out.push_back(0x2C);
+    _put_le16(out, x0);
+    _put_le16(out, h - 1 - y1);
+    _put_le16(out, rw);
+    _put_le16(out, rh);
+    if (palette)
+    {
+        out.push_back((unsigned char)(0x80 | (bits - 1)));
+        size_t start = out.size();
+        out.resize(start + 3 * ((size_t)1 << bits), 0);
+        if (transparent > 0)
+            memcpy(&out[start], palette, transparent * 3);
+    }
+    else
+        out.push_back(0);
+
+    gifEncodeLZW(&worker.m_indices[0], count, bits < 2 ? 2 : bits, worker.m_lzwTable, out);
+}
@@ -0,0 +1,113 @@
+// gifwriter.h
+
+// Streaming animated GIF encoder.
+//
+// Frames are added in order and encoded on a pool of worker threads: each
+// worker crops the frame to the rectangle that changed since the previous
+// frame, quantizes it (an octree per frame, or one palette for the whole
+// animation), marks pixels that didn't change as transparent and LZW
+// encodes the result.  Finished frames are written to the file strictly in
+// order by whichever worker completes the oldest one.  The number of
+// frames in flight is bounded, so a long recording never holds more than
+// a handful of frames in memory.
+
+#ifndef GIFWRITER_H
+#define GIFWRITER_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum GifPalette_t
+{ GIF_PALETTE_LOCAL=0, GIF_PALETTE_GLOBAL, };
+
+class GifWriter
+{
+public:
+    GifWriter();
+    ~GifWriter();
+
+    // Starts a looping animation of w x h frames, each shown for
+    // frameSeconds.  GIF_PALETTE_GLOBAL builds one palette from the first
+    // frame; GIF_PALETTE_LOCAL gives every frame its own.  numThreads <= 0
+    // picks one per core, up to eight.
+    bool open(const char fname[], int w, int h, double frameSeconds,
+              GifPalette_t palette = GIF_PALETTE_LOCAL, int numThreads = 0);
+
+    // Queues one bottom-up RGB frame (as read by glReadPixels).  The data
+    // is copied before returning.  When every frame buffer is busy the
+    // call waits, unless block is false, in which case the frame is
+    // dropped and false is returned.
+    bool addFrame(const unsigned char *rgb, bool block = true);
+
+    // Waits for every queued frame, writes the trailer and closes the
+    // file.  Returns false if any write failed.
+    bool close();
+
+    bool isOpen() const { return m_file != NULL; }
+    int  width() const  { return m_width; }
+    int  height() const { return m_height; }
+    int  framesWritten();
+    long bytesWritten();
+
+private:
+    GifWriter(const GifWriter &) {}
+    GifWriter& operator=(const GifWriter &) { return *this; }
+
+    struct Job
+    {
+        bool                       m_done;
+        int                        m_delay;      // hundredths of a second
+        std::vector<unsigned char> m_encoded;
+    };
+
+    struct Worker;
+
+    void writeHeader();
+    void workerLoop(int index);
+    void encodeFrame(int frame, Worker &worker);
+    void writeFinished(std::unique_lock<std::mutex> &lock);
+    void stopWorkers();
+
+    FILE                      *m_file;
+    int                        m_width;
+    int                        m_height;
+    GifPalette_t               m_paletteMode;
+    double                     m_frameSeconds;
+    double                     m_clock;          // seconds of animation queued
+    int                        m_clockCs;        // ... rounded, as written
+
+    // Ring of source frames; frame n lives in m_sources[n % size] and is
+    // compared against frame n-1, so one more buffer than jobs in flight
+    std::vector<std::vector<unsigned char> > m_sources;
+    std::vector<Job>           m_jobs;
+
+    // Global palette and its 15-bit RGB lookup
+    std::vector<unsigned char> m_globalPalette;
+    std::vector<unsigned char> m_globalLookup;
+    int                        m_globalBits;
+
+    std::vector<Worker *>      m_workers;
+    std::vector<std::thread>   m_threads;
+
+    std::mutex                 m_mutex;
+    std::condition_variable    m_added;
+    std::condition_variable    m_progress;
+    int                        m_numAdded;
+    int                        m_numStarted;
+    int                        m_numWritten;
+    bool                       m_writing;
+    bool                       m_failed;
+    bool                       m_stop;
+    long                       m_bytes;
+};
+
+// Encodes indices (each < 2^minCodeSize) as GIF LZW data sub-blocks,
+// including the minimum code size byte and the block terminator.  table
+// is the caller's reusable hash table.
+void gifEncodeLZW(const unsigned char *indices, size_t count, int minCodeSize,
+                  std::vector<int> &table, std::vector<unsigned char> &out);
+
+#endif
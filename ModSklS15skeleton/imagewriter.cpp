@@ -0,0 +1,393 @@
+// imagewriter.cpp
+
+#include "imagewriter.h"
+#include "bitmap.h"
+#include "gifwriter.h"
+
+#include <cstdio>
+#include <cstring>
+
+// ****************************************************************************
+// Format selection
+// ****************************************************************************
+
+ImageFormat_t imageFormatFromName(const char fname[])
+{
+    const char *dot = strrchr(fname, '.');
+    if (dot == NULL)
+        return IMAGE_BMP;
+
+    char ext[8];
+    int i;
+    for (i = 0; i < 7 && dot[i+1]; ++i)
+        ext[i] = (char)(dot[i+1] | 0x20);   // ASCII lower case
+    ext[i] = '\0';
+
+    if (!strcmp(ext, "ppm"))
+        return IMAGE_PPM;
+    if (!strcmp(ext, "png"))
+        return IMAGE_PNG;
+    if (!strcmp(ext, "gif"))
+        return IMAGE_GIF;
+    return IMAGE_BMP;
+}
+
+bool writeImage(ImageFormat_t format, const char fname[], int w, int h,
+                const unsigned char *data, ImageScratch &scratch)
+{
+    switch (format)
+    {
+    case IMAGE_PPM:
+        return writePPM(fname, w, h, data);
+    case IMAGE_PNG:
+        return writePNG(fname, w, h, data, scratch);
+    case IMAGE_GIF:
+    {
+        GifWriter gif;
+        return gif.open(fname, w, h, 0, GIF_PALETTE_LOCAL, 1) && gif.addFrame(data) && gif.close();
+    }
+    default:
+        if ((int)scratch.m_row.size() < ((w * 3 + 3) & ~3))
+            scratch.m_row.resize((w * 3 + 3) & ~3);
+        return writeBMP(fname, w, h, data, &scratch.m_row[0]);
+    }
+}
+
+// ****************************************************************************
+// PPM
+// ****************************************************************************
+
+bool writePPM(const char fname[], int w, int h, const unsigned char *data)
+{
+    FILE *file = fopen(fname, "wb");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "P6\n%d %d\n255\n", w, h);
+
+    // PPM is top-down, the GL rows are bottom-up
+    for (int y = h - 1; y >= 0; --y)
+        fwrite(data + (size_t)y * w * 3, 3, w, file);
+
+    fclose(file);
+    return true;
+}
+
+// ****************************************************************************
+// Deflate (RFC 1951, fixed Huffman codes only) and zlib framing
+// ****************************************************************************
+
+static const int kWindowSize = 32768;
+static const int kHashBits   = 15;
+static const int kMinMatch   = 3;
+static const int kMaxMatch   = 258;
+static const int kMaxChain   = 32;
+
+static const unsigned short kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char  kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short kDistBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char  kDistExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct _FixedTables
+{
+    unsigned short m_litCode[288];     // bit-reversed, ready to emit LSB first
+    unsigned char  m_litBits[288];
+    unsigned char  m_distCode[30];
+    unsigned char  m_lengthSymbol[259];
+
+    static unsigned reverse(unsigned code, int bits)
+    {
+        unsigned r = 0;
+        for (int i = 0; i < bits; ++i, code >>= 1)
+            r = (r << 1) | (code & 1);
+        return r;
+    }
+
+    _FixedTables()
+    {
+        for (int i = 0; i < 288; ++i)
+        {
+            unsigned code;
+            int bits;
+            if (i < 144)      { code = 0x30 + i;          bits = 8; }
+            else if (i < 256) { code = 0x190 + (i - 144); bits = 9; }
+            else if (i < 280) { code = i - 256;           bits = 7; }
+            else              { code = 0xC0 + (i - 280);  bits = 8; }
+            m_litCode[i] = (unsigned short)reverse(code, bits);
+            m_litBits[i] = (unsigned char)bits;
+        }
+        for (int i = 0; i < 30; ++i)
+            m_distCode[i] = (unsigned char)reverse(i, 5);
+
+        int symbol = 0;
+        for (int len = kMinMatch; len <= kMaxMatch; ++len)
+        {
+            while (symbol < 28 && len >= kLengthBase[symbol+1])
+                ++symbol;
+            m_lengthSymbol[len] = (unsigned char)symbol;
+        }
+    }
+};
+
+static const _FixedTables s_fixed;
+
+struct _BitWriter
+{
+    std::vector<unsigned char> &m_out;
+    unsigned long long          m_bits;
+    int                         m_count;
+
+    _BitWriter(std::vector<unsigned char> &out) : m_out(out), m_bits(0), m_count(0) {}
+
+    void put(unsigned value, int bits)
+    {
+        m_bits |= (unsigned long long)value << m_count;
+        m_count += bits;
+        while (m_count >= 8)
+        {
+            m_out.push_back((unsigned char)m_bits);
+            m_bits >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    void finish()
+    {
+        if (m_count > 0)
+            m_out.push_back((unsigned char)m_bits);
+        m_bits = 0;
+        m_count = 0;
+    }
+};
+
+static inline void _emit_literal(_BitWriter &bw, int lit)
+{
+    bw.put(s_fixed.m_litCode[lit], s_fixed.m_litBits[lit]);
+}
+
+static inline void _emit_match(_BitWriter &bw, int len, int dist)
+{
+    int ls = s_fixed.m_lengthSymbol[len];
+    _emit_literal(bw, 257 + ls);
+    if (kLengthExtra[ls])
+        bw.put(len - kLengthBase[ls], kLengthExtra[ls]);
+
+    int ds = 29;
+    while (kDistBase[ds] > dist)
+        --ds;
+    bw.put(s_fixed.m_distCode[ds], 5);
+    if (kDistExtra[ds])
+        bw.put(dist - kDistBase[ds], kDistExtra[ds]);
+}
+
+static inline unsigned _hash3(const unsigned char *p)
+{
+    unsigned v = (p[0] << 16) | (p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+void zlibCompress(const unsigned char *data, size_t len, ImageScratch &scratch,
+                  std::vector<unsigned char> &out)
+{
+    // zlib header: deflate, 32K window, fastest
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    _BitWriter bw(out);
+    bw.put(1, 1);      // BFINAL
+    bw.put(1, 2);      // BTYPE = fixed Huffman
+
+    scratch.m_head.assign(1 << kHashBits, -1);
+    if ((int)scratch.m_prev.size() != kWindowSize)
+        scratch.m_prev.resize(kWindowSize);
+    int *head = &scratch.m_head[0];
+    int *prev = &scratch.m_prev[0];
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        int bestLen = 0, bestDist = 0;
+
+        if (pos + kMinMatch <= len)
+        {
+            unsigned h = _hash3(data + pos);
+            int candidate = head[h];
+            int maxLen = (int)((len - pos) < (size_t)kMaxMatch ? (len - pos) : kMaxMatch);
+
+            for (int chain = 0; candidate >= 0 && chain < kMaxChain; ++chain)
+            {
+                int dist = (int)(pos - candidate);
+                if (dist > kWindowSize - 1)
+                    break;
+
+                const unsigned char *a = data + candidate;
+                const unsigned char *b = data + pos;
+                if (a[bestLen] == b[bestLen])
+                {
+                    int n = 0;
+                    while (n < maxLen && a[n] == b[n])
+                        ++n;
+                    if (n > bestLen)
+                    {
+                        bestLen = n;
+                        bestDist = dist;
+                        if (n == maxLen)
+                            break;
+                    }
+                }
+                candidate = prev[candidate & (kWindowSize - 1)];
+            }
+
+            prev[pos & (kWindowSize - 1)] = head[h];
+            head[h] = (int)pos;
+        }
+
+        if (bestLen >= kMinMatch)
+        {
+            _emit_match(bw, bestLen, bestDist);
+
+            // keep the hash chains complete across the match
+            size_t end = pos + bestLen;
+            for (++pos; pos < end; ++pos)
+            {
+                if (pos + kMinMatch <= len)
+                {
+                    unsigned h = _hash3(data + pos);
+                    prev[pos & (kWindowSize - 1)] = head[h];
+                    head[h] = (int)pos;
+                }
+            }
+        }
+        else
+        {
+            _emit_literal(bw, data[pos]);
+            ++pos;
+        }
+    }
+
+    _emit_literal(bw, 256);    // end of block
+    bw.finish();
+
+    // Adler-32 of the uncompressed data, big-endian
+    unsigned a = 1, b = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        size_t chunk = (len - i) < 5552 ? (len - i) : 5552;
+        for (size_t k = 0; k < chunk; ++k)
+        {
+            a += data[i + k];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        i += chunk;
+    }
+    unsigned adler = (b << 16) | a;
+    out.push_back((unsigned char)(adler >> 24));
+    out.push_back((unsigned char)(adler >> 16));
+    out.push_back((unsigned char)(adler >> 8));
+    out.push_back((unsigned char)adler);
+}
+
+// ****************************************************************************
+// PNG
+// ****************************************************************************
+
+static unsigned int s_crcTable[256];
+
+static bool _init_crc_table()
+{
+    for (unsigned n = 0; n < 256; ++n)
+    {
+        unsigned c = n;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        s_crcTable[n] = c;
+    }
+    return true;
+}
+
+static const bool s_crcReady = _init_crc_table();
+
+static unsigned _crc32(unsigned crc, const unsigned char *data, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i)
+        crc = s_crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void _put_be32(unsigned char *p, unsigned v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void _write_chunk(FILE *file, const char type[4], const unsigned char *data, size_t len)
+{
+    unsigned char buf[8];
+    _put_be32(buf, (unsigned)len);
+    memcpy(buf + 4, type, 4);
+    fwrite(buf, 1, 8, file);
+    if (len)
+        fwrite(data, 1, len, file);
+
+    unsigned crc = _crc32(0, (const unsigned char *)type, 4);
+    crc = _crc32(crc, data, len);
+    _put_be32(buf, crc);
+    fwrite(buf, 1, 4, file);
+}
+
+bool writePNG(const char fname[], int w, int h, const unsigned char *data, ImageScratch &scratch)
+{
+    FILE *file = fopen(fname, "wb");
+    if (file == NULL)
+        return false;
+
+    // Sub-filter every row: flat backgrounds and shading gradients turn
+    // into long runs of small values that LZ77 eats for breakfast
+    size_t stride = (size_t)w * 3;
+    scratch.m_filtered.resize((stride + 1) * h);
+    unsigned char *dst = &scratch.m_filtered[0];
+    for (int y = 0; y < h; ++y)
+    {
+        const unsigned char *src = data + (size_t)(h - 1 - y) * stride;
+        *dst++ = 1;
+        for (size_t i = 0; i < 3 && i < stride; ++i)
+            *dst++ = src[i];
+        for (size_t i = 3; i < stride; ++i)
+            *dst++ = (unsigned char)(src[i] - src[i - 3]);
+    }
+
+    scratch.m_out.clear();
+    zlibCompress(&scratch.m_filtered[0], scratch.m_filtered.size(), scratch, scratch.m_out);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, file);
+
+    unsigned char ihdr[13];
+    _put_be32(ihdr, w);
+    _put_be32(ihdr + 4, h);
+    ihdr[8]  = 8;   // bit depth
+    ihdr[9]  = 2;   // truecolour
+    ihdr[10] = 0;   // deflate
+    ihdr[11] = 0;   // adaptive filtering
+    ihdr[12] = 0;   // no interlace
+    _write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+    _write_chunk(file, "IDAT", &scratch.m_out[0], scratch.m_out.size());
+    _write_chunk(file, "IEND", NULL, 0);
+
+    fclose(file);
+    return true;
+}
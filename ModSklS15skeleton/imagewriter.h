@@ -0,0 +1,47 @@
+// imagewriter.h
+
+// Image encoders used by the capture pipeline.  All of them take the
+// bottom-up RGB rows that glReadPixels() produces, so captured frames can
+// be handed over without flipping or converting them first.
+//
+// The PNG encoder is self-contained (fixed-Huffman deflate with an LZ77
+// hash chain); the FLTK png/zlib libraries under local/lib ship without
+// headers, and rendered frames compress well enough without dynamic
+// Huffman tables.
+
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <cstddef>
+#include <vector>
+
+enum ImageFormat_t
+{ IMAGE_BMP=0, IMAGE_PPM, IMAGE_PNG, IMAGE_GIF, };
+
+// Picks a format from a file name's extension; anything unknown is BMP
+ImageFormat_t imageFormatFromName(const char fname[]);
+
+// Scratch memory for one encoder thread.  Reused from frame to frame so
+// that steady-state encoding doesn't allocate.
+struct ImageScratch
+{
+    std::vector<unsigned char> m_row;
+    std::vector<unsigned char> m_filtered;
+    std::vector<unsigned char> m_out;
+    std::vector<int>           m_head;
+    std::vector<int>           m_prev;
+};
+
+bool writePPM(const char fname[], int w, int h, const unsigned char *data);
+bool writePNG(const char fname[], int w, int h, const unsigned char *data, ImageScratch &scratch);
+
+// Dispatches on format.  A GIF written this way is a single frame; see
+// GifWriter for animations.
+bool writeImage(ImageFormat_t format, const char fname[], int w, int h,
+                const unsigned char *data, ImageScratch &scratch);
+
+// Appends a zlib stream (fixed-Huffman deflate) of data to out
+void zlibCompress(const unsigned char *data, size_t len, ImageScratch &scratch,
+                  std::vector<unsigned char> &out);
+
+#endif
@@ -0,0 +1,116 @@
+// mappedfile.cpp
+
+#include "mappedfile.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : m_data(NULL), m_size(0)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE), m_map(NULL)
+#else
+    , m_mapped(false)
+#endif
+{
+}
+
+bool MappedFile::open(const char *fname, bool sequential)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS,
+                              NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (map)
+        {
+            m_data = (const unsigned char *)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+            if (m_data)
+            {
+                m_file = file;
+                m_map  = map;
+                m_size = (size_t)size.QuadPart;
+                return true;
+            }
+            CloseHandle(map);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = ::open(fname, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            ::close(fd);
+            madvise(p, (size_t)st.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+            m_data   = (const unsigned char *)p;
+            m_size   = (size_t)st.st_size;
+            m_mapped = true;
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    return readAll(fname);
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_map)
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_map);
+        CloseHandle(m_file);
+        m_map  = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_mapped)
+        munmap((void *)m_data, m_size);
+    m_mapped = false;
+#endif
+    m_data = NULL;
+    m_size = 0;
+    m_copy.clear();
+}
+
+bool MappedFile::readAll(const char *fname)
+{
+    FILE *file = fopen(fname, "rb");
+    if (file == NULL)
+        return false;
+
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        m_copy.insert(m_copy.end(), buf, buf + n);
+    fclose(file);
+
+    if (m_copy.empty())
+        return false;
+    m_data = &m_copy[0];
+    m_size = m_copy.size();
+    return true;
+}
@@ -0,0 +1,43 @@
+// mappedfile.h
+
+// A read-only view of a whole file.  The file is memory-mapped when the OS
+// allows, so only the pages actually touched are ever read, and read into
+// memory otherwise; either way m_data holds all m_size bytes until close().
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <vector>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile() { close(); }
+
+    // sequential hints that the file will be read front to back, once;
+    // leave it off for random access.  False if the file can't be read or
+    // is empty.
+    bool open(const char *fname, bool sequential = true);
+    void close();
+
+    const unsigned char *m_data;
+    size_t               m_size;
+
+private:
+    bool readAll(const char *fname);
+
+#ifdef _WIN32
+    void  *m_file;      // HANDLEs
+    void  *m_map;
+#else
+    bool   m_mapped;
+#endif
+    std::vector<unsigned char> m_copy;
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+#endif
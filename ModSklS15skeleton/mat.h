@@ -1,6 +1,18 @@
 #ifndef __MATRIX_HEADER__
 #define __MATRIX_HEADER__
 
+#include <cstring>
+
+#include "vec.h"
+#include "cpufeatures.h"
+
+#if defined(MODELER_X86)
+#include <emmintrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#endif
+
 //==========[ Forward References ]=============================================
 
 template <class T> class Vec;
@@ -54,7 +66,7 @@ public:
 
 	//---[ Ordering Methods ]------------------------------
 
-	Mat3<T> transpose() const { return Mat3<T>(n[0],n[3],n[6],n[1],n[4],n[7],n[2],n[5],n[8]) }
+	Mat3<T> transpose() const { return Mat3<T>(n[0],n[3],n[6],n[1],n[4],n[7],n[2],n[5],n[8]); }
 	double trace() const { return n[0]+n[4]+n[8]; }
 	
 	//---[ GL Matrix ]-------------------------------------
@@ -73,7 +85,7 @@ public:
 
 	//---[ Friend Methods ]--------------------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
         template <class U> friend Mat3<U> operator -( const Mat3<U>& a );
 	template <class U> friend Mat3<U> operator +( const Mat3<U>& a, const Mat3<U>& b );
@@ -114,6 +126,10 @@ class Mat4 {
 		// matrix elements in row-major order
 	T		n[16];
 
+		// for results about to be overwritten whole
+	struct NoInit {};
+	explicit Mat4( NoInit ) {}
+
 public:
 
 	bool isZero() { return n[0]==0&&n[1]==0&&n[2]==0&&n[3]==0&&n[4]==0&&n[5]==0&&n[6]==0&&n[7]==0&&n[8]==0&&n[9]==0&&n[10]==0&&n[11]==0&&n[12]==0&&n[13]==0&&n[14]==0&&n[15]==0; }
@@ -176,6 +192,9 @@ public:
 	double trace() const { return n[0]+n[5]+n[10]+n[15]; }
 
 	Mat4<T> inverse() const {
+		if( n[12] == 0 && n[13] == 0 && n[14] == 0 && n[15] == 1 )
+			return affineInverse();
+
 		Mat4<T>		a(*this);
 		Mat4<T>		b;
 
@@ -216,6 +235,27 @@ public:
 		return b;
 	}
 
+		// inverse of a matrix whose bottom row is 0 0 0 1: the 3x3 part by
+		// cofactors, the translation carried back through it
+	Mat4<T> affineInverse() const {
+		T c0[3] = { n[5]*n[10]-n[6]*n[9], n[6]*n[8]-n[4]*n[10], n[4]*n[9]-n[5]*n[8] };
+		T c1[3] = { n[9]*n[2]-n[10]*n[1], n[10]*n[0]-n[8]*n[2], n[8]*n[1]-n[9]*n[0] };
+		T c2[3] = { n[1]*n[6]-n[2]*n[5], n[2]*n[4]-n[0]*n[6], n[0]*n[5]-n[1]*n[4] };
+
+		T det = n[0]*c0[0] + n[1]*c0[1] + n[2]*c0[2];
+		if( det == 0 )
+			return Mat4<T>();
+
+		Mat4<T>		b;
+		for( int i=0;i<3;i++ ) {
+			b.n[i*4+0] = c0[i] / det;
+			b.n[i*4+1] = c1[i] / det;
+			b.n[i*4+2] = c2[i] / det;
+			b.n[i*4+3] = -( b.n[i*4+0]*n[3] + b.n[i*4+1]*n[7] + b.n[i*4+2]*n[11] );
+		}
+		return b;
+	}
+
 	void swapRows(int a, int b) {
 		T		temp;
 
@@ -243,7 +283,7 @@ public:
 	
 	//---[ Friend Methods ]--------------------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template <class U> friend Mat4<U> operator -( const Mat4<U>& a );
 	template <class U> friend Mat4<U> operator +( const Mat4<U>& a, const Mat4<U>& b );
@@ -252,6 +292,8 @@ public:
 	template <class U> friend Mat4<U> operator *( const Mat4<U>& a, const double d );
 	template <class U> friend Mat4<U> operator *( const double d, const Mat4<U>& a );
 	template <class U> friend Vec3<U> operator *( const Mat4<U>& a, const Vec3<U>& b );
+	template <class U> friend Vec4<U> operator *( const Mat4<U>& a, const Vec4<U>& v );
+	template <class U> friend Vec4<U> operator *( const Vec4<U>& v, const Mat4<U>& a );
 	template <class U> friend Mat4<U> operator /( const Mat4<U>& a, const double d );
 	template <class U> friend bool operator ==( const Mat4<U>& a, const Mat4<U>& b );
 	template <class U> friend bool operator !=( const Mat4<U>& a, const Mat4<U>& b );
@@ -265,6 +307,8 @@ public:
 	friend Mat4<T> operator *( const Mat4<T>& a, const double d );
 	friend Mat4<T> operator *( const double d, const Mat4<T>& a );
 	friend Vec3<T> operator *( const Mat4<T>& a, const Vec3<T>& b );
+	friend Vec4<T> operator *( const Mat4<T>& a, const Vec4<T>& v );
+	friend Vec4<T> operator *( const Vec4<T>& v, const Mat4<T>& a );
 	friend Mat4<T> operator /( const Mat4<T>& a, const double d );
 	friend bool operator ==( const Mat4<T>& a, const Mat4<T>& b );
 	friend bool operator !=( const Mat4<T>& a, const Mat4<T>& b );
@@ -318,14 +362,14 @@ template <class T>
 inline Mat3<T> operator +( const Mat3<T>& a, const Mat3<T>& b ) {
 	return Mat3<T>( a.n[0]+b.n[0], a.n[1]+b.n[1], a.n[2]+b.n[2],
 					a.n[3]+b.n[3], a.n[4]+b.n[4], a.n[5]+b.n[5],
-					a.n[6]+b.n[6], a.n[7]+b.n[7], a.n[8]+b.n[8],);
+					a.n[6]+b.n[6], a.n[7]+b.n[7], a.n[8]+b.n[8] );
 }
 
 template <class T>
 inline Mat3<T> operator -( const Mat3<T>& a, const Mat3<T>& b) {
 	return Mat3<T>( a.n[0]-b.n[0], a.n[1]-b.n[1], a.n[2]-b.n[2],
 					a.n[3]-b.n[3], a.n[4]-b.n[4], a.n[5]-b.n[5],
-					a.n[6]-b.n[6], a.n[7]-b.n[7], a.n[8]-b.n[8],);
+					a.n[6]-b.n[6], a.n[7]-b.n[7], a.n[8]-b.n[8] );
 }
 
 template <class T>
@@ -485,4 +529,162 @@ inline bool operator !=( const Mat4<T>& a, const Mat4<T>& b ) {
 	return memcmp(a.n,b.n,16*sizeof(T));
 }
 
-#endif
\ No newline at end of file
+//==========[ SSE Specializations (float) ]====================================
+//
+// Mat4f and Vec4f are what the camera and the CPU transform code run on, so
+// their hot operations get SSE versions; the row-major float[16] maps
+// straight onto four __m128 rows.  Builds with AVX enabled multiply two rows
+// at a time.  Other element types, and non-x86 builds, keep the generic
+// templates above.
+
+#if defined(MODELER_X86)
+
+	// a.x*b[0] + a.y*b[1] + a.z*b[2] + a.w*b[3]
+inline __m128 _mat4f_combine( __m128 a, const __m128 b[4] ) {
+	__m128 r = _mm_mul_ps( _mm_shuffle_ps(a,a,0x00), b[0] );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps(a,a,0x55), b[1] ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps(a,a,0xAA), b[2] ) );
+	return _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps(a,a,0xFF), b[3] ) );
+}
+
+	// the four row dot products of m with v
+inline __m128 _mat4f_transform( const float* m, __m128 v ) {
+	__m128 r0 = _mm_mul_ps( _mm_loadu_ps(m+ 0), v );
+	__m128 r1 = _mm_mul_ps( _mm_loadu_ps(m+ 4), v );
+	__m128 r2 = _mm_mul_ps( _mm_loadu_ps(m+ 8), v );
+	__m128 r3 = _mm_mul_ps( _mm_loadu_ps(m+12), v );
+	_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+	return _mm_add_ps( _mm_add_ps(r0,r1), _mm_add_ps(r2,r3) );
+}
+
+	// a.yzx
+inline __m128 _mat4f_yzx( __m128 a ) {
+	return _mm_shuffle_ps( a, a, _MM_SHUFFLE(3,0,2,1) );
+}
+
+	// xyz cross product; w comes out as 0 for finite input
+inline __m128 _mat4f_cross( __m128 a, __m128 b ) {
+	__m128 c = _mm_sub_ps( _mm_mul_ps( a, _mat4f_yzx(b) ), _mm_mul_ps( _mat4f_yzx(a), b ) );
+	return _mat4f_yzx( c );
+}
+
+template <>
+inline Mat4<float> Mat4<float>::affineInverse() const {
+	__m128 r0 = _mm_loadu_ps(n+0), r1 = _mm_loadu_ps(n+4), r2 = _mm_loadu_ps(n+8);
+	__m128 mask = _mm_castsi128_ps( _mm_setr_epi32(-1,-1,-1,0) );
+	__m128 t = _mm_setr_ps( n[3], n[7], n[11], 0.0f );
+	r0 = _mm_and_ps( r0, mask );
+	r1 = _mm_and_ps( r1, mask );
+	r2 = _mm_and_ps( r2, mask );
+
+		// the columns of the adjugate
+	__m128 c0 = _mat4f_cross( r1, r2 );
+	__m128 c1 = _mat4f_cross( r2, r0 );
+	__m128 c2 = _mat4f_cross( r0, r1 );
+
+	__m128 d = _mm_mul_ps( r0, c0 );
+	float det = _mm_cvtss_f32( _mm_add_ss( _mm_add_ss( d, _mm_shuffle_ps(d,d,0x55) ),
+										   _mm_shuffle_ps(d,d,0xAA) ) );
+	if( det == 0 )
+		return Mat4<float>();
+
+	__m128 inv = _mm_set1_ps( 1.0f / det );
+	c0 = _mm_mul_ps( c0, inv );
+	c1 = _mm_mul_ps( c1, inv );
+	c2 = _mm_mul_ps( c2, inv );
+	__m128 c3 = _mm_mul_ps( c0, _mm_shuffle_ps(t,t,0x00) );
+	c3 = _mm_add_ps( c3, _mm_mul_ps( c1, _mm_shuffle_ps(t,t,0x55) ) );
+	c3 = _mm_add_ps( c3, _mm_mul_ps( c2, _mm_shuffle_ps(t,t,0xAA) ) );
+	c3 = _mm_sub_ps( _mm_setzero_ps(), c3 );
+
+	_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+	Mat4<float> b( (Mat4<float>::NoInit()) );
+	_mm_storeu_ps( b.n+ 0, c0 );
+	_mm_storeu_ps( b.n+ 4, c1 );
+	_mm_storeu_ps( b.n+ 8, c2 );
+	_mm_storeu_ps( b.n+12, _mm_setr_ps( 0.0f, 0.0f, 0.0f, 1.0f ) );
+	return b;
+}
+
+template <>
+inline Mat4<float> operator *( const Mat4<float>& a, const Mat4<float>& b ) {
+	Mat4<float> c;
+	const float* an = a[0];
+	const float* bn = b[0];
+	float* cn = c[0];
+#if defined(__AVX__)
+	__m256 b0 = _mm256_broadcast_ps( (const __m128*)(bn+ 0) );
+	__m256 b1 = _mm256_broadcast_ps( (const __m128*)(bn+ 4) );
+	__m256 b2 = _mm256_broadcast_ps( (const __m128*)(bn+ 8) );
+	__m256 b3 = _mm256_broadcast_ps( (const __m128*)(bn+12) );
+	for( int i=0;i<16;i+=8 ) {
+		__m256 r = _mm256_loadu_ps( an+i );
+		__m256 s = _mm256_mul_ps( _mm256_shuffle_ps(r,r,0x00), b0 );
+		s = _mm256_add_ps( s, _mm256_mul_ps( _mm256_shuffle_ps(r,r,0x55), b1 ) );
+		s = _mm256_add_ps( s, _mm256_mul_ps( _mm256_shuffle_ps(r,r,0xAA), b2 ) );
+		s = _mm256_add_ps( s, _mm256_mul_ps( _mm256_shuffle_ps(r,r,0xFF), b3 ) );
+		_mm256_storeu_ps( cn+i, s );
+	}
+#else
+	__m128 rows[4] = { _mm_loadu_ps(bn+0), _mm_loadu_ps(bn+4),
+					   _mm_loadu_ps(bn+8), _mm_loadu_ps(bn+12) };
+	for( int i=0;i<16;i+=4 )
+		_mm_storeu_ps( cn+i, _mat4f_combine( _mm_loadu_ps(an+i), rows ) );
+#endif
+	return c;
+}
+
+template <>
+inline Vec4<float> operator *( const Mat4<float>& a, const Vec4<float>& v ) {
+	Vec4<float> r;
+	_mm_storeu_ps( &r[0], _mat4f_transform( a[0], _mm_setr_ps( v[0], v[1], v[2], v[3] ) ) );
+	return r;
+}
+
+template <>
+inline Vec4<float> operator *( const Vec4<float>& v, const Mat4<float>& a ) {
+	const float* an = a[0];
+	__m128 rows[4] = { _mm_loadu_ps(an+0), _mm_loadu_ps(an+4),
+					   _mm_loadu_ps(an+8), _mm_loadu_ps(an+12) };
+	Vec4<float> r;
+	_mm_storeu_ps( &r[0], _mat4f_combine( _mm_setr_ps( v[0], v[1], v[2], v[3] ), rows ) );
+	return r;
+}
+
+	// points: w is taken as 1 and not divided out, as in the generic version
+template <>
+inline Vec3<float> operator *( const Mat4<float>& a, const Vec3<float>& v ) {
+	float r[4];
+	_mm_storeu_ps( r, _mat4f_transform( a[0], _mm_setr_ps( v[0], v[1], v[2], 1.0f ) ) );
+	return Vec3<float>( r[0], r[1], r[2] );
+}
+
+template <>
+inline Vec4<float>& Vec4<float>::operator +=( const Vec4<float>& v ) {
+	_mm_storeu_ps( n, _mm_add_ps( _mm_loadu_ps(n), _mm_loadu_ps(v.n) ) );
+	return *this;
+}
+
+template <>
+inline Vec4<float>& Vec4<float>::operator -=( const Vec4<float>& v ) {
+	_mm_storeu_ps( n, _mm_sub_ps( _mm_loadu_ps(n), _mm_loadu_ps(v.n) ) );
+	return *this;
+}
+
+template <>
+inline Vec4<float>& Vec4<float>::operator *=( const float d ) {
+	_mm_storeu_ps( n, _mm_mul_ps( _mm_loadu_ps(n), _mm_set1_ps(d) ) );
+	return *this;
+}
+
+template <>
+inline Vec4<float> prod( const Vec4<float>& a, const Vec4<float>& b ) {
+	Vec4<float> r;
+	_mm_storeu_ps( &r[0], _mm_mul_ps( _mm_setr_ps( a[0], a[1], a[2], a[3] ),
+									  _mm_setr_ps( b[0], b[1], b[2], b[3] ) ) );
+	return r;
+}
+
+#endif // MODELER_X86
+
+#endif
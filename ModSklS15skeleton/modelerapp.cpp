@@ -1,13 +1,25 @@
 #include "modelerapp.h"
+#include "poselibrary.h"
+#include "drivencontrols.h"
+#include "controlgraph.h"
 #include "modelerview.h"
 #include "modelerui.h"
+#include "controlpanel.h"
+#include "framecapture.h"
+#include "modelerbatch.h"
+#include "modelerbench.h"
 
-#include <FL/Fl_Value_Slider.H>
-#include <FL/Fl_Box.H>
-
+#include <cctype>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#endif
 
 // CLASS ModelerControl METHODS
 
@@ -42,6 +54,25 @@ void ModelerControl::SetVals(const char* name, float minimum, float maximum, flo
 }
 
 
+// ****************************************************************************
+
+// CLASS ModelerModel METHODS
+
+ModelerModel::ModelerModel(const char *name, ModelerSetup_f setup, bool isDefault)
+	: m_name(name), m_setup(setup), m_default(isDefault)
+{
+	All().push_back(this);
+}
+
+std::vector<ModelerModel *> &ModelerModel::All()
+{
+	// made on first use, as the models list themselves during static
+	// initialization
+	static std::vector<ModelerModel *> models;
+	return models;
+}
+
+
 // ****************************************************************************
 
 
@@ -65,46 +96,52 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
 	m_animating   = false;
 	m_numControls = numControls;
 
+	m_frameCapture = new FrameCapture();
+	m_poseLibrary  = new PoseLibrary(numControls);
+
+	// LEFT_EAR_SHIFT for "    Left Ear Shift"
+	m_drivenControls = new DrivenControls();
+	for (i = 0; i < m_numControls; i++)
+	{
+		std::string name;
+		for (const char *c = controls[i].m_name; *c; c++)
+		{
+			if (isalnum((unsigned char)*c))
+				name += (char)toupper((unsigned char)*c);
+			else if (!name.empty() && name[name.size() - 1] != '_')
+				name += '_';
+		}
+		while (!name.empty() && name[name.size() - 1] == '_')
+			name.erase(name.size() - 1);
+		if (!name.empty())
+			m_drivenControls->setName(i, name.c_str());
+	}
+
     // ********************************************************
     // Create the FLTK user interface
     // ********************************************************
     
+    m_controlValues = new double[numControls];
+    for (i=0; i<m_numControls; i++)
+        m_controlValues[i] = controls[i].m_value;
+
+    // A batch job only draws the model through drawModelAt(), so the view
+    // is never shown and no window is made
+    if (m_batch)
+    {
+        m_view = createView(0, 0, 640, 480, NULL);
+        return;
+    }
+
     m_ui = new ModelerUserInterface();
-    
-    // Store pointers to the controls for manipulation
-    m_controlLabelBoxes   = new Fl_Box*[numControls];
-    m_controlValueSliders = new Fl_Value_Slider*[numControls];
-    
-    // Constants for user interface setup
-    const int textHeight    = 20;
-    const int sliderHeight  = 20;
-    const int packWidth     = m_ui->m_controlsPack->w();
 
-	m_ui->m_controlsPack->begin();
-    // For each control, add appropriate objects to the user interface
+    // Add the entries to the selection box
     for (i=0; i<m_numControls; i++)
-    {
-        // Add the entry to the selection box
         m_ui->m_controlsBrowser->add(controls[i].m_name);
 
-        // Add the label (but make it invisible for now)
-        Fl_Box *box = new Fl_Box(0, 0, packWidth, textHeight, controls[i].m_name);
-		box->labelsize(10);
-		box->hide();
-		box->box(FL_FLAT_BOX); // otherwise, Fl_Scroll messes up (ehsu)
-        m_controlLabelBoxes[i] = box;
-
-        // Add the slider (but make it invisible for now)
-        Fl_Value_Slider *slider = new Fl_Value_Slider(0, 0, packWidth, sliderHeight,0);
-        slider->type(1);
-        slider->range(controls[i].m_minimum, controls[i].m_maximum);
-        slider->step(controls[i].m_stepsize);
-        slider->value(controls[i].m_value);
-        slider->hide(); 
-        m_controlValueSliders[i] = slider;
-        slider->callback((Fl_Callback*)ModelerApplication::SliderCallback);
-    }
-    m_ui->m_controlsPack->end();
+    // The panel makes sliders only for the controls picked and in view
+    m_ui->m_controlsPanel->setControls(controls, numControls, m_controlValues,
+                                       ModelerApplication::SliderCallback);
 
 	// Make sure that we remove the view from the
 	// Fl_Group, otherwise, it'll blow up 
@@ -116,14 +153,94 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
 	m_ui->m_modelerView = createView(0, 0, m_ui->m_modelerWindow->w(), m_ui->m_modelerWindow->h() ,NULL);
 	Fl_Group::current()->resizable(m_ui->m_modelerView);
 	m_ui->m_modelerWindow->end();
+	m_view = m_ui->m_modelerView;
 }
 
 ModelerApplication::~ModelerApplication()
 {
-    // FLTK handles widget deletion
-    delete m_ui;
-    delete [] m_controlLabelBoxes;
-    delete [] m_controlValueSliders;
+    // FLTK handles widget deletion, but a batch job's view is in no window
+    if (m_ui)
+        delete m_ui;
+    else
+        delete m_view;
+    delete [] m_controlValues;
+    delete m_frameCapture;
+    delete m_poseLibrary;
+    delete m_drivenControls;
+}
+
+// The Release build is a Windows-subsystem program, which starts with no
+// console: output from the command line modes goes to the console it was
+// run from.  Output that's been redirected already is left where it is.
+static void _attachConsole()
+{
+#ifdef _WIN32
+	if (_fileno(stdout) >= 0 && _fileno(stderr) >= 0)
+		return;
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		return;
+	if (_fileno(stdout) < 0)
+		freopen("CONOUT$", "w", stdout);
+	if (_fileno(stderr) < 0)
+		freopen("CONOUT$", "w", stderr);
+#endif
+}
+
+int ModelerApplication::Main(int argc, char **argv)
+{
+	BatchOptions options;
+	std::string error;
+	bool parsed = parseBatchOptions(argc, argv, options, error);
+	if (!parsed || options.m_help || options.m_listModels || options.m_listBenchmarks ||
+		!options.m_benchmarks.empty() || options.hasJob())
+		_attachConsole();
+
+	if (!parsed)
+	{
+		fprintf(stderr, "%s\n\n", error.c_str());
+		printBatchUsage(stderr);
+		return 2;
+	}
+
+	if (options.m_help)
+	{
+		printBatchUsage(stdout);
+		return 0;
+	}
+	if (options.m_listModels)
+	{
+		const std::vector<ModelerModel *> &models = ModelerModel::All();
+		for (size_t i = 0; i < models.size(); ++i)
+			printf("%s%s\n", models[i]->m_name, models[i]->m_default ? " (default)" : "");
+		return 0;
+	}
+	if (options.m_listBenchmarks)
+	{
+		listBenchmarks();
+		return 0;
+	}
+	// the benchmarks bring their own models
+	if (!options.m_benchmarks.empty() && !options.hasJob())
+		return runBenchmarks(options.m_benchmarks == "all" ? NULL : options.m_benchmarks.c_str(),
+		                     options.m_benchmarkScale) > 0 ? 0 : 1;
+
+	ModelerModel *model = NULL;
+	const std::vector<ModelerModel *> &models = ModelerModel::All();
+	for (size_t i = 0; i < models.size(); ++i)
+		if (options.m_model.empty() ? models[i]->m_default
+		                            : options.m_model == models[i]->m_name)
+			model = models[i];
+	if (!model)
+	{
+		fprintf(stderr, "No model called \"%s\" (--list-models lists them)\n",
+		        options.m_model.c_str());
+		return 2;
+	}
+
+	ModelerApplication *app = Instance();
+	app->m_batch = options.hasJob();
+	model->m_setup();
+	return app->m_batch ? runBatch(options) : app->Run();
 }
 
 int ModelerApplication::Run()
@@ -136,40 +253,98 @@ int ModelerApplication::Run()
 
     // Just tell FLTK to go for it.
    	Fl::visual( FL_RGB | FL_DOUBLE );
+	// lets the evaluation thread wake this one with Fl::awake()
+	Fl::lock();
 	m_ui->show();
 	Fl::add_timeout(0, ModelerApplication::RedrawLoop, NULL);
 
-	return Fl::run();
+	int result = Fl::run();
+
+	// the evaluation thread mustn't outlive the model it poses
+	m_ui->m_modelerView->stopEvaluation();
+
+	// don't lose frames that are still being written out
+	m_frameCapture->flush();
+
+	return result;
 }
 
+// Per-thread overrides of the slider values (see SetThreadControls)
+static thread_local double *s_threadControls = NULL;
+
 double ModelerApplication::GetControlValue(int controlNumber)
 {
-    return m_controlValueSliders[controlNumber]->value();
+    if (s_threadControls)
+    {
+        ControlGraph::noteRead(controlNumber);
+        return s_threadControls[controlNumber];
+    }
+    return m_controlValues[controlNumber];
 }
 
 void ModelerApplication::SetControlValue(int controlNumber, double value)
 {
-    m_controlValueSliders[controlNumber]->value(value);
+    if (s_threadControls)
+    {
+        s_threadControls[controlNumber] = value;
+        return;
+    }
+
+    m_controlValues[controlNumber] = value;
+    if (!m_ui)
+        return;
+    m_ui->m_controlsPanel->refresh(controlNumber);
+    m_ui->m_modelerView->postCommand(ModelerCommand(CMD_SET_CONTROL, controlNumber, value));
+}
+
+void ModelerApplication::SetThreadControls(double *values)
+{
+    s_threadControls = values;
+}
+
+void ModelerApplication::DriveControls(double time)
+{
+    if (!m_drivenControls->numDriven())
+        return;
+
+    static thread_local std::vector<double> registers;
+    if (s_threadControls)
+    {
+        m_drivenControls->evaluate(time, s_threadControls, registers);
+        return;
+    }
+
+    // on the sliders, each driven value passed on as a command
+    static std::vector<double> values;
+    values.resize(m_numControls);
+    GetControlValues(&values[0]);
+    m_drivenControls->evaluate(time, &values[0], registers);
+    for (int i = 0; i < m_drivenControls->numDriven(); ++i)
+    {
+        int control = m_drivenControls->drivenControl(i);
+        SetControlValue(control, values[control]);
+    }
 }
 
-void ModelerApplication::ShowControl(int controlNumber)
+void ModelerApplication::GetControlValues(double values[])
 {
-    m_controlLabelBoxes[controlNumber]->show();
-	m_controlValueSliders[controlNumber]->precision(2); //set number precision to two decimal places
-    m_controlValueSliders[controlNumber]->show();
-    m_ui->m_controlsWindow->redraw();
+    for (int i = 0; i < m_numControls; ++i)
+        values[i] = m_controlValues[i];
 }
 
-void ModelerApplication::HideControl(int controlNumber)
+void ModelerApplication::ShowControlValues(const double values[])
 {
-    m_controlLabelBoxes[controlNumber]->hide();
-    m_controlValueSliders[controlNumber]->hide();
-    m_ui->m_controlsWindow->redraw();
+    for (int i = 0; i < m_numControls; ++i)
+        m_controlValues[i] = values[i];
+    if (m_ui)
+        m_ui->m_controlsPanel->refresh();
 }
 
-void ModelerApplication::SliderCallback(Fl_Slider *, void *)
+void ModelerApplication::SliderCallback(int controlNumber, double value)
 {
-    ModelerApplication::Instance()->m_ui->m_modelerView->redraw();
+    ModelerView *view = ModelerApplication::Instance()->m_ui->m_modelerView;
+    view->postCommand(ModelerCommand(CMD_SET_CONTROL, controlNumber, value));
+    view->redraw();
 }
 
 bool ModelerApplication::IsAnimated()
@@ -179,8 +354,21 @@ bool ModelerApplication::IsAnimated()
 
 void ModelerApplication::RedrawLoop(void*)
 {
-	if (ModelerApplication::Instance()->m_animating)
-		ModelerApplication::Instance()->m_ui->m_modelerView->redraw();
+	ModelerApplication *app = ModelerApplication::Instance();
+	if (app->m_animating)
+	{
+		if (app->m_frameCapture->isRecording())
+		{
+			// draw synchronously so exactly one frame is captured per tick
+			ModelerView *view = app->m_ui->m_modelerView;
+			view->make_current();
+			view->draw();
+			app->m_frameCapture->recordFrame(view->w(), view->h());
+			view->swap_buffers();
+		}
+		else
+			app->m_ui->m_modelerView->redraw();
+	}
 
 	// 1/50 second update is good enough
 	Fl::add_timeout(0.025, ModelerApplication::RedrawLoop, NULL);
@@ -7,6 +7,8 @@
 
 #include "modelerview.h"
 
+#include <vector>
+
 struct ModelerControl
 {
 	ModelerControl();
@@ -22,12 +24,31 @@ struct ModelerControl
 	float m_value;
 };
 
+// Sets up a model to run: makes its controls and passes them, with the
+// model's creator, to ModelerApplication::Init()
+typedef void (*ModelerSetup_f)();
+
+// Lists a model for main() to run, by the name given to --model, e.g.
+//     static ModelerModel s_sampleModel("sample", setupSampleModel);
+// The default model runs when none is named.
+struct ModelerModel
+{
+	ModelerModel(const char *name, ModelerSetup_f setup, bool isDefault = false);
+
+	const char     *m_name;
+	ModelerSetup_f  m_setup;
+	bool            m_default;
+
+	// Every model listed, in no particular order
+	static std::vector<ModelerModel *> &All();
+};
+
 // Forward declarations for ModelerApplication
 class ModelerView;
 class ModelerUserInterface;
-class Fl_Box;
-class Fl_Slider;
-class Fl_Value_Slider;
+class FrameCapture;
+class PoseLibrary;
+class DrivenControls;
 
 // The ModelerApplication is implemented as a "singleton" design pattern,
 // the purpose of which is to only allow one instance of it.
@@ -47,15 +68,59 @@ public:
     // Starts the application, returns when application is closed
 	int  Run();
 
-    // Get and set slider values.
+    // For main(): sets up the model named on the command line and runs it,
+    // in its windows, or as a batch job without any when the command line
+    // asks for images, scenes or timings (see modelerbatch.h).  Returns
+    // the exit code.
+    static int Main(int argc, char **argv);
+
+    // Running without windows: there are no sliders, and models are only
+    // drawn through drawModelAt() with thread controls (SetThreadControls)
+    bool IsBatch() const { return m_batch; }
+    ModelerView* GetView() { return m_view; }
+
+    // Get and set control values (what the sliders show).  Setting one also
+    // passes it on to the thread that owns evaluation (see
+    // ModelerView::postCommand).
     double GetControlValue(int controlNumber);
     void   SetControlValue(int controlNumber, double value);
 
+    // Gives the calling thread its own set of control values: until it's
+    // set back to NULL, Get/SetControlValue on that thread use values[]
+    // instead of the sliders.  Lets model code run off the UI thread, and
+    // many copies of it each with their own pose.
+    static void SetThreadControls(double *values);
+
+    int  NumControls() const { return m_numControls; }
+    // Copies every control's value into values[NumControls()]
+    void GetControlValues(double values[]);
+    // Sets the controls, and the sliders in view, to values[NumControls()]
+    // without passing them on as commands, for values the evaluation
+    // thread already has
+    void ShowControlValues(const double values[]);
+
     bool IsAnimated();
 
+    // Background image writer shared by the bitmap save and recording paths
+    FrameCapture* GetFrameCapture() { return m_frameCapture; }
+
+    // Named poses of this model's controls; see poselibrary.h
+    PoseLibrary* GetPoseLibrary() { return m_poseLibrary; }
+
+    // Controls set from expressions over the others (see drivencontrols.h).
+    // Each control can be named by its label in upper case, with
+    // underscores for anything but letters and digits.
+    DrivenControls* GetDrivenControls() { return m_drivenControls; }
+    // Sets the driven controls for the tick time, in whichever controls the
+    // calling thread uses.  Models call this as they animate, after their
+    // own channels.
+    void DriveControls(double time);
+
 private:
 	// Private for singleton
-	ModelerApplication() : m_numControls(-1) {}
+	ModelerApplication() : m_ui(NULL), m_view(NULL), m_numControls(-1), m_controlValues(NULL),
+	                       m_frameCapture(NULL), m_poseLibrary(NULL), m_drivenControls(NULL),
+	                       m_batch(false) {}
 	ModelerApplication(const ModelerApplication&) {}
 	ModelerApplication& operator=(const ModelerApplication&) {}
 	
@@ -65,20 +130,23 @@ private:
 	// I'll let my friend touch my private parts
 	friend class ModelerUserInterface;
 
-    void    ShowControl(int controlNumber);
-    void    HideControl(int controlNumber);
-
 	ModelerUserInterface *m_ui;
+	ModelerView          *m_view;
 	int					  m_numControls;
 
-    Fl_Box               **m_controlLabelBoxes;
-    Fl_Value_Slider      **m_controlValueSliders;
+    // the sliders are only made for the controls in view (see controlpanel.h)
+    double                *m_controlValues;
+
+    FrameCapture          *m_frameCapture;
+    PoseLibrary           *m_poseLibrary;
+    DrivenControls        *m_drivenControls;
 
-    static void SliderCallback(Fl_Slider *, void*);
+    static void SliderCallback(int controlNumber, double value);
 	static void RedrawLoop(void*);
 
 	// Just a flag for updates
 	bool m_animating;
+	bool m_batch;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,446 @@
+// modelerbatch.cpp
+
+#include "modelerbatch.h"
+#include "modelerapp.h"
+#include "modelerbench.h"
+#include "modelerdraw.h"
+#include "camera.h"
+#include "drawlist.h"
+#include "drivencontrols.h"
+#include "evalthread.h"
+#include "frametable.h"
+#include "gifwriter.h"
+#include "imagewriter.h"
+#include "poselibrary.h"
+#include "softrender.h"
+#include "workpool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+static double _now()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double> >(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+BatchOptions::BatchOptions()
+    : m_animate(false), m_firstFrame(0), m_lastFrame(0), m_width(640), m_height(480),
+      m_quality(-1), m_threads(0), m_benchmarkScale(1),
+      m_help(false), m_listModels(false), m_listBenchmarks(false)
+{
+}
+
+// ****************************************************************************
+// The command line
+// ****************************************************************************
+
+void printBatchUsage(FILE *out)
+{
+    fputs("usage: modeler [options]\n"
+          "\n"
+          "  --model NAME         run the model called NAME (--list-models lists them)\n"
+          "  --pose FILE          start from a .pos file, or LIBRARY.mpl:NAME for a pose\n"
+          "                       from a pose library\n"
+          "  --set CONTROL=VALUE  set a control, by number or as drive expressions name it\n"
+          "                       (LEFT_EAR_SHIFT); may be given more than once\n"
+          "  --frames A-B         animate ticks A to B rather than one still pose\n"
+          "\n"
+          "Given any of these, nothing is shown and the run is a batch job:\n"
+          "  --render FILE        draw on the CPU into FILE (.bmp .ppm .png, or .gif for\n"
+          "                       one animation); frames are numbered FILE_00000.ext\n"
+          "  --ray FILE           write .ray scenes, numbered the same way\n"
+          "  --bake FILE          bake the frames into FILE (.mft); needs --frames\n"
+          "  --size WxH           image size for --render (640x480)\n"
+          "  --quality Q          high, medium, low or poor\n"
+          "  --threads N          threads to draw with (one per core)\n"
+          "\n"
+          "  --bench FILTER       run the benchmarks whose names contain FILTER (all)\n"
+          "  --scale N            multiply the benchmarks' problem sizes by N\n"
+          "  --list-models, --list-benchmarks, --help\n"
+          "\n"
+          "With no job the model runs in its windows.\n", out);
+}
+
+bool parseBatchOptions(int argc, char **argv, BatchOptions &options, std::string &error)
+{
+    static const char *qualities[] = { "high", "medium", "low", "poor" };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--help" || option == "-h")
+        {
+            options.m_help = true;
+            continue;
+        }
+        if (option == "--list-models")
+        {
+            options.m_listModels = true;
+            continue;
+        }
+        if (option == "--list-benchmarks")
+        {
+            options.m_listBenchmarks = true;
+            continue;
+        }
+
+        if (i + 1 >= argc || option.compare(0, 2, "--") != 0)
+        {
+            error = option.compare(0, 2, "--") == 0 ? option + " needs a value"
+                                                    : "Don't know what to do with " + option;
+            return false;
+        }
+        const char *value = argv[++i];
+
+        if (option == "--model")
+            options.m_model = value;
+        else if (option == "--pose")
+            options.m_pose = value;
+        else if (option == "--set")
+        {
+            const char *equals = strchr(value, '=');
+            char *end = NULL;
+            double number = equals ? strtod(equals + 1, &end) : 0;
+            if (!equals || equals == value || end == equals + 1 || *end)
+            {
+                error = std::string("--set wants CONTROL=VALUE, not ") + value;
+                return false;
+            }
+            options.m_sets.push_back(std::make_pair(std::string(value, equals), number));
+        }
+        else if (option == "--frames")
+        {
+            int first, last;
+            int n = sscanf(value, "%d-%d", &first, &last);
+            if (n == 1)
+                last = first;
+            if (n < 1 || first < 0 || last < first)
+            {
+                error = std::string("--frames wants A-B with 0 <= A <= B, not ") + value;
+                return false;
+            }
+            options.m_animate    = true;
+            options.m_firstFrame = first;
+            options.m_lastFrame  = last;
+        }
+        else if (option == "--render")
+            options.m_render = value;
+        else if (option == "--ray")
+            options.m_ray = value;
+        else if (option == "--bake")
+            options.m_bake = value;
+        else if (option == "--size")
+        {
+            if (sscanf(value, "%dx%d", &options.m_width, &options.m_height) != 2 ||
+                options.m_width <= 0 || options.m_height <= 0)
+            {
+                error = std::string("--size wants WxH, not ") + value;
+                return false;
+            }
+        }
+        else if (option == "--quality")
+        {
+            options.m_quality = -1;
+            for (int q = 0; q < 4; ++q)
+                if (strcmp(value, qualities[q]) == 0)
+                    options.m_quality = q;
+            if (options.m_quality < 0)
+            {
+                error = std::string("--quality wants high, medium, low or poor, not ") + value;
+                return false;
+            }
+        }
+        else if (option == "--threads")
+            options.m_threads = atoi(value);
+        else if (option == "--bench")
+            options.m_benchmarks = value;
+        else if (option == "--scale")
+            options.m_benchmarkScale = std::max(1, atoi(value));
+        else
+        {
+            error = "Unknown option " + option;
+            return false;
+        }
+    }
+
+    if (!options.m_bake.empty() && !options.m_animate)
+    {
+        error = "--bake needs --frames";
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Posing
+// ****************************************************************************
+
+static bool _modelAt(void *view, double time)
+{
+    return ((ModelerView *)view)->drawModelAt(time);
+}
+
+// The camera and controls of a .pos file, as File > Open Position File
+// reads it
+static bool _loadPosFile(const std::string &fname, ModelerView *view,
+                         std::vector<double> &controls)
+{
+    std::ifstream ifs(fname.c_str());
+    float elevation, azimuth, dolly, twist, x, y, z;
+    if (!(ifs >> elevation >> azimuth >> dolly >> twist >> x >> y >> z))
+    {
+        fprintf(stderr, "Couldn't read position file %s\n", fname.c_str());
+        return false;
+    }
+
+    view->m_camera->setElevation(elevation);
+    view->m_camera->setAzimuth(azimuth);
+    view->m_camera->setDolly(dolly);
+    view->m_camera->setTwist(twist);
+    view->m_camera->setLookAt(Vec3f(x, y, z));
+
+    int control;
+    float value;
+    while (ifs >> control >> value)
+    {
+        if (control < 0 || control >= (int)controls.size())
+            break;
+        controls[control] = value;
+    }
+    return true;
+}
+
+static bool _loadPose(const std::string &pose, ModelerView *view, std::vector<double> &controls)
+{
+    if (pose.empty())
+        return true;
+
+    std::string extension = pose.size() > 4 ? pose.substr(pose.size() - 4) : "";
+    for (size_t i = 0; i < extension.size(); ++i)
+        extension[i] = (char)tolower((unsigned char)extension[i]);
+    if (extension == ".pos")
+        return _loadPosFile(pose, view, controls);
+
+    // library.mpl:name; the last colon, as a Windows path has one too
+    size_t colon = pose.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == pose.size())
+    {
+        fprintf(stderr, "--pose wants a .pos file or LIBRARY.mpl:NAME, not %s\n", pose.c_str());
+        return false;
+    }
+    std::string fname = pose.substr(0, colon), name = pose.substr(colon + 1);
+
+    PoseLibrary library;
+    if (!library.open(fname.c_str()))
+    {
+        fprintf(stderr, "Couldn't open pose library %s\n", fname.c_str());
+        return false;
+    }
+    if (library.numControls() != (int)controls.size())
+    {
+        fprintf(stderr, "%s holds poses of a model with %d controls, not %d\n", fname.c_str(),
+                library.numControls(), (int)controls.size());
+        return false;
+    }
+    int index = library.find(name.c_str());
+    if (index < 0)
+    {
+        fprintf(stderr, "%s has no pose called %s\n", fname.c_str(), name.c_str());
+        return false;
+    }
+    const double *values = library.values(index);
+    controls.assign(values, values + controls.size());
+    return true;
+}
+
+static bool _setControls(const BatchOptions &options, std::vector<double> &controls)
+{
+    DrivenControls *names = ModelerApplication::Instance()->GetDrivenControls();
+    for (size_t i = 0; i < options.m_sets.size(); ++i)
+    {
+        const std::string &name = options.m_sets[i].first;
+        char *end = NULL;
+        long number = strtol(name.c_str(), &end, 10);
+        int control = *end ? names->control(name.c_str()) : (int)number;
+        if (control < 0 || control >= (int)controls.size())
+        {
+            fprintf(stderr, "No control called %s\n", name.c_str());
+            return false;
+        }
+        controls[control] = options.m_sets[i].second;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Writing
+// ****************************************************************************
+
+// pattern with the tick before its extension, as FrameCapture numbers a
+// recording
+static std::string _frameName(const std::string &pattern, int tick)
+{
+    size_t dot   = pattern.rfind('.');
+    size_t slash = pattern.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = pattern.size();
+
+    char number[16];
+    snprintf(number, sizeof(number), "_%05d", tick);
+    return pattern.substr(0, dot) + number + pattern.substr(dot);
+}
+
+// Poses, draws and writes out each frame
+static bool _writeFrames(const BatchOptions &options, ModelerView *view,
+                         const std::vector<double> &controls)
+{
+    ModelerApplication *app = ModelerApplication::Instance();
+    QualitySetting_t quality = ModelerDrawState::Instance()->m_quality;
+    Mat4f camera = view->m_camera->getViewingTransform();
+
+    bool render = !options.m_render.empty();
+    bool gif = render && imageFormatFromName(options.m_render.c_str()) == IMAGE_GIF;
+    int  frames = options.m_animate ? options.m_lastFrame - options.m_firstFrame + 1 : 1;
+
+    WorkPool     pool(options.m_threads);
+    SoftRenderer renderer(render ? options.m_width : 1, render ? options.m_height : 1);
+    ImageScratch scratch;
+    GifWriter    gifWriter;
+    if (gif && !gifWriter.open(options.m_render.c_str(), options.m_width, options.m_height,
+                               EvalThread::kTickSeconds, GIF_PALETTE_LOCAL, options.m_threads))
+    {
+        fprintf(stderr, "Couldn't write %s\n", options.m_render.c_str());
+        return false;
+    }
+
+    std::vector<double> current(controls);
+    DrawList list;
+    double poseTime = 0, drawTime = 0, writeTime = 0;
+    long   triangles = 0;
+    bool   ok = true;
+
+    // the animation carries on from frame to frame, as when baking
+    ModelerApplication::SetThreadControls(current.empty() ? NULL : &current[0]);
+    for (int f = 0; f < frames && ok; ++f)
+    {
+        int tick = options.m_firstFrame + f;
+        double start = _now();
+        list.begin();
+        bool posed = view->drawModelAt(options.m_animate ? tick : -1);
+        list.end();
+        double mark = _now();
+        poseTime += mark - start;
+        if (!posed)
+        {
+            fprintf(stderr, "This model can only be drawn in its window\n");
+            ok = false;
+            break;
+        }
+
+        if (render)
+        {
+            renderer.render(list, camera, quality, &pool);
+            start = mark;
+            mark = _now();
+            drawTime += mark - start;
+            triangles += renderer.triangleCount();
+
+            std::string fname = options.m_animate ? _frameName(options.m_render, tick)
+                                                  : options.m_render;
+            if (gif)
+                gifWriter.addFrame(renderer.pixels());
+            else if (!writeImage(imageFormatFromName(fname.c_str()), fname.c_str(),
+                                 renderer.width(), renderer.height(), renderer.pixels(), scratch))
+            {
+                fprintf(stderr, "Couldn't write %s\n", fname.c_str());
+                ok = false;
+            }
+        }
+
+        if (!options.m_ray.empty())
+        {
+            std::string fname = options.m_animate ? _frameName(options.m_ray, tick) : options.m_ray;
+            if (!list.saveRay(fname.c_str(), camera))
+            {
+                fprintf(stderr, "Couldn't write %s\n", fname.c_str());
+                ok = false;
+            }
+        }
+        writeTime += _now() - mark;
+    }
+    ModelerApplication::SetThreadControls(NULL);
+
+    if (gif && !gifWriter.close())
+    {
+        fprintf(stderr, "Couldn't write %s\n", options.m_render.c_str());
+        ok = false;
+    }
+    if (!ok)
+        return false;
+
+    printf("%d frame%s of %d controls: posing %.3f ms", frames, frames == 1 ? "" : "s",
+           app->NumControls(), poseTime * 1e3 / frames);
+    if (render)
+        printf(", drawing %.3f ms (%ld triangles at %dx%d on %d threads)",
+               drawTime * 1e3 / frames, triangles / frames, options.m_width, options.m_height,
+               pool.threadCount());
+    printf(", writing %.3f ms per frame\n", writeTime * 1e3 / frames);
+    return true;
+}
+
+// ****************************************************************************
+// The job
+// ****************************************************************************
+
+int runBatch(const BatchOptions &options)
+{
+    ModelerApplication *app = ModelerApplication::Instance();
+    ModelerView *view = app->GetView();
+
+    std::vector<double> controls(app->NumControls());
+    if (!controls.empty())
+        app->GetControlValues(&controls[0]);
+    if (!_loadPose(options.m_pose, view, controls) || !_setControls(options, controls))
+        return 1;
+
+    if (options.m_quality >= 0)
+        ModelerDrawState::Instance()->m_quality = (QualitySetting_t)options.m_quality;
+
+    bool ok = true;
+    if (!options.m_bake.empty())
+    {
+        int frames = options.m_lastFrame - options.m_firstFrame + 1;
+        double start = _now();
+        FrameTable table;
+        if (controls.empty() ||
+            !bakeAnimation(_modelAt, view, &controls[0], (int)controls.size(),
+                           options.m_firstFrame, frames, table))
+        {
+            fprintf(stderr, "This model can only be drawn in its window\n");
+            ok = false;
+        }
+        else if (!table.save(options.m_bake.c_str()))
+        {
+            fprintf(stderr, "Couldn't write %s\n", options.m_bake.c_str());
+            ok = false;
+        }
+        else
+            printf("%s: %d frames baked in %.3f ms each\n", options.m_bake.c_str(), frames,
+                   (_now() - start) * 1e3 / frames);
+    }
+
+    if (ok && (!options.m_render.empty() || !options.m_ray.empty()))
+        ok = _writeFrames(options, view, controls);
+
+    if (ok && !options.m_benchmarks.empty())
+        runBenchmarks(options.m_benchmarks == "all" ? NULL : options.m_benchmarks.c_str(),
+                      options.m_benchmarkScale);
+
+    return ok ? 0 : 1;
+}
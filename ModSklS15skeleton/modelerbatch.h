@@ -0,0 +1,76 @@
+// modelerbatch.h
+
+// The modeler's command line, and the batch jobs it can run without any
+// window, e.g. on render farm machines with no display:
+//
+//     modeler --model rkalpha --pose smile.pos --frames 0-239
+//             --render out/idle.png --size 1280x720
+//
+// A job poses the model through drawModelAt() on a DrawList, one frame at
+// a time, and then for each frame
+//
+//   --render  draws it on the CPU (softrender.h) into an image; a .gif
+//             collects the frames into one animation
+//   --ray     writes it out as a .ray scene
+//
+// and --bake stores the range as a baked animation (frametable.h), the
+// binary form the modeler opens with Animate > Open Baked Animation.  With
+// --frames A-B each tick from A to B is posed through the model's
+// animation, and files are numbered with the tick ("idle.png" gives
+// idle_00000.png, ...); without, the one still pose is written under the
+// name given.  The time each stage took is printed at the end.
+//
+// --bench runs the modelerbench.h benchmarks instead.  With no job on the
+// command line, the model runs in its windows as it always has.
+
+#ifndef MODELERBATCH_H
+#define MODELERBATCH_H
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BatchOptions
+{
+    BatchOptions();
+
+    std::string m_model;            // empty for the default
+    std::string m_pose;             // a .pos file, or library.mpl:name
+    std::vector<std::pair<std::string, double> > m_sets;   // --set NAME=value, in order
+
+    bool        m_animate;          // --frames given
+    int         m_firstFrame;       // ticks, inclusive
+    int         m_lastFrame;
+
+    std::string m_render;           // image file (pattern with --frames)
+    std::string m_ray;              // .ray file (pattern with --frames)
+    std::string m_bake;             // .mft file
+    int         m_width;
+    int         m_height;
+    int         m_quality;          // QualitySetting_t, or -1 to leave it
+    int         m_threads;          // <= 0 for one per core
+
+    std::string m_benchmarks;       // a filter, "all", or empty for none
+    int         m_benchmarkScale;
+
+    bool        m_help;
+    bool        m_listModels;
+    bool        m_listBenchmarks;
+
+    // Something to write, which makes the run a batch job
+    bool hasJob() const { return !m_render.empty() || !m_ray.empty() || !m_bake.empty(); }
+};
+
+// Reads the command line into options.  Returns false, with the reason in
+// error, if it can't.
+bool parseBatchOptions(int argc, char **argv, BatchOptions &options, std::string &error);
+
+void printBatchUsage(FILE *out);
+
+// Runs the job in options on the model ModelerApplication::Init() set up,
+// then the benchmarks if asked for.  Returns the exit code: 0 if it all
+// went, 1 if anything failed.
+int runBatch(const BatchOptions &options);
+
+#endif
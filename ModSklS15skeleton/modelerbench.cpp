@@ -0,0 +1,1415 @@
+// modelerbench.cpp
+
+#include "modelerbench.h"
+#include "rayparser.h"
+#include "bitmap.h"
+#include "imagewriter.h"
+#include "gifwriter.h"
+#include "texturecache.h"
+#include "mat.h"
+#include "transformbatch.h"
+#include "vecexpr.h"
+#include "transformstack.h"
+#include "tessellation.h"
+#include "cpufeatures.h"
+#include "crowd.h"
+#include "animchannels.h"
+#include "frametable.h"
+#include "framecache.h"
+#include "poselibrary.h"
+#include "drivencontrols.h"
+#include "controlgraph.h"
+#include "modelerdraw.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ****************************************************************************
+// Support
+// ****************************************************************************
+
+typedef void (*ModelerBenchmark_f)(int scale);
+
+static double _now()
+{
+    using namespace std::chrono;
+    return duration<double>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// Small deterministic generator so runs are comparable across machines
+static unsigned int s_seed = 12345;
+
+static double _random(double lo, double hi)
+{
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * ((s_seed >> 8) / 16777216.0);
+}
+
+// ****************************************************************************
+// .ray parsing
+// ****************************************************************************
+
+// Builds a scene that looks like the exporter's output for a large model
+static void _generate_ray_scene(RayScene &scene, int numObjects)
+{
+    scene.m_objects.resize(numObjects);
+    scene.m_numLights = 1;
+
+    for (int i = 0; i < numObjects; ++i)
+    {
+        RayObject &obj = scene.m_objects[i];
+        obj.m_type = (RayPrimitive_t)(i % 4);
+
+        RayWrapper xform;
+        xform.m_type = RAY_TRANSFORM;
+        for (int k = 0; k < 16; ++k)
+            xform.m_values[k] = _random(-10, 10);
+        obj.m_wrappers.assign(1, xform);
+
+        RayWrapper w;
+        memset(&w, 0, sizeof(w));
+        switch (obj.m_type)
+        {
+        case RAY_SPHERE:
+            w.m_type = RAY_SCALE;
+            w.m_values[0] = w.m_values[1] = w.m_values[2] = _random(0.1, 2);
+            obj.m_wrappers.push_back(w);
+            break;
+        case RAY_BOX:
+            w.m_type = RAY_SCALE;
+            w.m_values[0] = _random(0.1, 4); w.m_values[1] = _random(0.1, 4); w.m_values[2] = _random(0.1, 4);
+            obj.m_wrappers.push_back(w);
+            w.m_type = RAY_TRANSLATE;
+            w.m_values[0] = w.m_values[1] = w.m_values[2] = 0.5;
+            obj.m_wrappers.push_back(w);
+            break;
+        case RAY_CONE:
+            obj.m_height = _random(0.1, 4);
+            obj.m_bottomRadius = _random(0, 1);
+            obj.m_topRadius = _random(0, 1);
+            break;
+        case RAY_POLYMESH:
+            obj.m_points.resize(9);
+            for (int k = 0; k < 9; ++k)
+                obj.m_points[k] = _random(-3, 3);
+            obj.m_faces.resize(3);
+            obj.m_faces[0] = 0; obj.m_faces[1] = 1; obj.m_faces[2] = 2;
+            break;
+        }
+
+        for (int k = 0; k < 3; ++k)
+            obj.m_material.m_diffuse[k] = obj.m_material.m_ambient[k] = _random(0, 1);
+    }
+}
+
+static void benchRayParse(int scale)
+{
+    RayScene scene;
+    _generate_ray_scene(scene, 50000 * scale);
+
+    std::string text;
+    writeRayScene(scene, text);
+
+    const int repeats = 5;
+    double best = 1e30;
+    RayScene parsed;
+    std::string error;
+
+    for (int r = 0; r < repeats; ++r)
+    {
+        double start = _now();
+        if (!parseRayScene(text.data(), text.size(), parsed, error))
+        {
+            printf("rayparse: FAILED %s\n", error.c_str());
+            return;
+        }
+        double elapsed = _now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    std::string again;
+    writeRayScene(parsed, again);
+
+    printf("rayparse: %d objects, %.1f MB, best of %d: %.3f s, %.1f MB/s, round-trip %s\n",
+           (int)parsed.m_objects.size(), text.size() / 1048576.0, repeats, best,
+           text.size() / 1048576.0 / best, again == text ? "exact" : "MISMATCH");
+}
+
+// ****************************************************************************
+// BMP I/O
+// ****************************************************************************
+
+static void benchBmpIO(int scale)
+{
+    const int w = 8192, h = 2048 * scale;
+    const size_t pixels = (size_t)w * h;
+    const double gb = pixels * 3 / 1073741824.0;
+    const char *fname = "modelerbench.bmp";
+
+    std::vector<unsigned char> rgb(pixels * 3), bgr(pixels * 3), rgba(pixels * 4);
+    for (size_t i = 0; i < rgb.size(); ++i)
+        rgb[i] = (unsigned char)(i * 7 + (i >> 12));
+
+    // Swizzles alone, best of a few passes over the whole image
+    double best24 = 1e30, best32 = 1e30;
+    for (int r = 0; r < 5; ++r)
+    {
+        double start = _now();
+        bmpSwapRB24(&bgr[0], &rgb[0], (int)pixels);
+        double mid = _now();
+        bmpBGRToRGBA(&rgba[0], &bgr[0], (int)pixels);
+        double end = _now();
+        if (mid - start < best24) best24 = mid - start;
+        if (end - mid < best32)   best32 = end - mid;
+    }
+    printf("bmpio: %dx%d, swap RGB<->BGR %.2f GB/s, BGR->RGBA %.2f GB/s\n",
+           w, h, gb / best24, gb / best32);
+
+    // Whole files; the read includes mapping and the flip to RGB
+    double start = _now();
+    bool ok = writeBMP(fname, w, h, &rgb[0], &bgr[0]);
+    double writeTime = _now() - start;
+
+    int rw = 0, rh = 0;
+    start = _now();
+    unsigned char *back = readBMP(fname, rw, rh);
+    double readTime = _now() - start;
+
+    ok = ok && back && rw == w && rh == h && memcmp(back, &rgb[0], rgb.size()) == 0;
+    delete [] back;
+
+    start = _now();
+    BmpRowWriter rows;
+    ok = ok && rows.open(fname, w, h);
+    for (int y = 0; y < h && ok; y += 64)
+        ok = rows.writeRows(&rgb[(size_t)y * w * 3], h - y < 64 ? h - y : 64);
+    ok = rows.close() && ok;
+    double streamTime = _now() - start;
+    remove(fname);
+
+    printf("bmpio: file write %.2f GB/s, read %.2f GB/s, row writer %.2f GB/s, round-trip %s\n",
+           gb / writeTime, gb / readTime, gb / streamTime, ok ? "exact" : "FAILED");
+}
+
+// ****************************************************************************
+// Image encoding
+// ****************************************************************************
+
+// Something like a rendered frame: a flat background with a few shaded,
+// slightly noisy blobs, so the encoders see realistic runs and gradients
+static void _generate_frame(std::vector<unsigned char> &rgb, int w, int h, double t)
+{
+    rgb.resize((size_t)w * h * 3);
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            unsigned char *p = &rgb[((size_t)y * w + x) * 3];
+            p[0] = p[1] = p[2] = 0;
+            for (int b = 0; b < 4; ++b)
+            {
+                double cx = w * (0.2 + 0.2 * b) + 40 * t * (b + 1);
+                double cy = h * 0.5 + 30 * b * t;
+                double dx = (x - cx) / (h * 0.2), dy = (y - cy) / (h * 0.2);
+                double d2 = dx * dx + dy * dy;
+                if (d2 < 1)
+                {
+                    double shade = 1 - d2 + _random(0, 0.02);
+                    p[0] = (unsigned char)(200 * shade);
+                    p[1] = (unsigned char)(60 * b * shade);
+                    p[2] = (unsigned char)(120 * shade);
+                }
+            }
+        }
+    }
+}
+
+static void benchImageEncode(int scale)
+{
+    const int w = 640, h = 480;
+    std::vector<unsigned char> frame;
+    _generate_frame(frame, w, h, 0);
+
+    ImageScratch scratch;
+    std::vector<unsigned char> out;
+    const int frames = 10 * scale;
+
+    // Same Sub filter writePNG applies
+    size_t stride = (size_t)w * 3;
+    std::vector<unsigned char> filtered((stride + 1) * h);
+    double start = _now();
+    for (int f = 0; f < frames; ++f)
+    {
+        unsigned char *dst = &filtered[0];
+        for (int y = 0; y < h; ++y)
+        {
+            const unsigned char *src = &frame[(size_t)y * stride];
+            *dst++ = 1;
+            for (size_t i = 0; i < stride; ++i)
+                *dst++ = (unsigned char)(src[i] - (i >= 3 ? src[i - 3] : 0));
+        }
+        out.clear();
+        zlibCompress(&filtered[0], filtered.size(), scratch, out);
+    }
+    double elapsed = _now() - start;
+
+    printf("imageencode: %dx%d png deflate, %d frames, %.1f frames/s, %.1f MB/s, %.1f%% of raw\n",
+           w, h, frames, frames / elapsed, frames * frame.size() / 1048576.0 / elapsed,
+           100.0 * out.size() / frame.size());
+}
+
+static void benchGifEncode(int scale)
+{
+    const int w = 640, h = 480;
+    const int frames = 40 * scale;
+    const char *fname = "modelerbench.gif";
+
+    // render the animation up front so only the encoder is timed
+    std::vector<std::vector<unsigned char> > anim(frames);
+    for (int f = 0; f < frames; ++f)
+        _generate_frame(anim[f], w, h, f * 0.05);
+
+    for (int mode = GIF_PALETTE_LOCAL; mode <= GIF_PALETTE_GLOBAL; ++mode)
+    {
+        GifWriter gif;
+        double start = _now();
+        if (!gif.open(fname, w, h, 0.025, (GifPalette_t)mode))
+        {
+            printf("gifencode: FAILED to open %s\n", fname);
+            return;
+        }
+        for (int f = 0; f < frames; ++f)
+            gif.addFrame(&anim[f][0]);
+        bool ok = gif.close();
+        double elapsed = _now() - start;
+
+        printf("gifencode: %dx%d, %d frames, %s palette, %.1f frames/s, %.1f KB (%.1f KB/frame)%s\n",
+               w, h, frames, mode == GIF_PALETTE_LOCAL ? "local" : "global", frames / elapsed,
+               gif.bytesWritten() / 1024.0, gif.bytesWritten() / 1024.0 / frames, ok ? "" : ", FAILED");
+    }
+    remove(fname);
+}
+
+// ****************************************************************************
+// Texture mips
+// ****************************************************************************
+
+static void benchMipmap(int scale)
+{
+    const int w = 4096, h = 4096;
+    const double gb = (double)w * h * 4 / 1073741824.0;
+
+    std::vector<unsigned char> rgba((size_t)w * h * 4);
+    for (size_t i = 0; i < rgba.size(); ++i)
+        rgba[i] = (unsigned char)_random(0, 256);
+
+    // One level down, best of a few passes, checked against a plain average
+    std::vector<unsigned char> half((size_t)w / 2 * h / 2 * 4);
+    double best = 1e30;
+    for (int r = 0; r < 5 * scale; ++r)
+    {
+        double start = _now();
+        mipBoxFilter(&half[0], &rgba[0], w, h);
+        double elapsed = _now() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    bool exact = true;
+    for (int y = 0; y < h / 2 && exact; ++y)
+        for (int x = 0; x < w / 2 * 4; ++x)
+        {
+            const unsigned char *s = &rgba[(size_t)2 * y * w * 4 + (x / 4) * 8 + x % 4];
+            int avg = (s[0] + s[4] + s[w * 4] + s[w * 4 + 4] + 2) >> 2;
+            if (half[(size_t)y * w / 2 * 4 + x] != avg) { exact = false; break; }
+        }
+
+    std::vector<std::vector<unsigned char> > levels;
+    double start = _now();
+    buildMipPyramid(&rgba[0], w, h, levels);
+    double pyramid = _now() - start;
+
+    printf("mipmap: %dx%d RGBA, box filter %.2f GB/s%s, whole pyramid (%d levels) %.1f ms\n",
+           w, h, gb / best, exact ? "" : " (MISMATCH)", (int)levels.size(), pyramid * 1000);
+}
+
+// ****************************************************************************
+// Vector math
+// ****************************************************************************
+
+// The generic Mat4<T> code spelled out on plain floats, for the SSE
+// specializations of Mat4f to race against
+static void _scalar_multiply(float *c, const float *a, const float *b)
+{
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            c[i * 4 + j] = a[i * 4] * b[j] + a[i * 4 + 1] * b[4 + j] +
+                           a[i * 4 + 2] * b[8 + j] + a[i * 4 + 3] * b[12 + j];
+}
+
+static void _scalar_transform(float *r, const float *m, const float *v)
+{
+    for (int i = 0; i < 4; ++i)
+        r[i] = m[i * 4] * v[0] + m[i * 4 + 1] * v[1] + m[i * 4 + 2] * v[2] + m[i * 4 + 3] * v[3];
+}
+
+static void _scalar_affine_inverse(float *b, const float *n)
+{
+    float c0[3] = { n[5]*n[10]-n[6]*n[9], n[6]*n[8]-n[4]*n[10], n[4]*n[9]-n[5]*n[8] };
+    float c1[3] = { n[9]*n[2]-n[10]*n[1], n[10]*n[0]-n[8]*n[2], n[8]*n[1]-n[9]*n[0] };
+    float c2[3] = { n[1]*n[6]-n[2]*n[5], n[2]*n[4]-n[0]*n[6], n[0]*n[5]-n[1]*n[4] };
+    float det = n[0] * c0[0] + n[1] * c0[1] + n[2] * c0[2];
+    for (int i = 0; i < 3; ++i)
+    {
+        b[i * 4 + 0] = c0[i] / det;
+        b[i * 4 + 1] = c1[i] / det;
+        b[i * 4 + 2] = c2[i] / det;
+        b[i * 4 + 3] = -(b[i * 4] * n[3] + b[i * 4 + 1] * n[7] + b[i * 4 + 2] * n[11]);
+    }
+    b[12] = b[13] = b[14] = 0;
+    b[15] = 1;
+}
+
+// A rotation about y then x plus a translation, like the camera builds
+static Mat4f _random_rigid()
+{
+    double a = _random(0, 6.28), e = _random(0, 6.28);
+    float ca = (float)cos(a), sa = (float)sin(a), ce = (float)cos(e), se = (float)sin(e);
+    return Mat4f(ca,       0,   sa,      (float)_random(-5, 5),
+                 se * sa,  ce, -se * ca, (float)_random(-5, 5),
+                 -ce * sa, se,  ce * ca, (float)_random(-5, 5),
+                 0,        0,   0,       1);
+}
+
+static void _report_mat4(const char *op, double scalar, double simd, int count)
+{
+    printf("mat4: %-16s scalar %6.2f ns, SSE %6.2f ns, %.1fx\n",
+           op, scalar * 1e9 / count, simd * 1e9 / count, scalar / simd);
+}
+
+static void benchMat4(int scale)
+{
+    const int count = 4096, passes = 200 * scale;
+    std::vector<Mat4f> mats(count), out(count);
+    std::vector<Vec4f> vecs(count), vout(count);
+    for (int i = 0; i < count; ++i)
+    {
+        mats[i] = _random_rigid();
+        vecs[i] = Vec4f((float)_random(-1, 1), (float)_random(-1, 1), (float)_random(-1, 1), 1);
+    }
+
+    float worst = 0;
+    auto check = [&worst](const float *a, const float *b, int n) {
+        for (int i = 0; i < n; ++i)
+            worst = fabs(a[i] - b[i]) > worst ? (float)fabs(a[i] - b[i]) : worst;
+    };
+    float ref[16];
+
+    // multiply, as in the chain of xforms the camera composes
+    double start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            _scalar_multiply(out[i][0], mats[i][0], mats[(i + p) & (count - 1)][0]);
+    double scalar = _now() - start;
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            out[i] = mats[i] * mats[(i + p) & (count - 1)];
+    _report_mat4("multiply", scalar, _now() - start, passes * count);
+    _scalar_multiply(ref, mats[0][0], mats[(passes - 1) & (count - 1)][0]);
+    check(ref, out[0][0], 16);
+
+    // transform
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            _scalar_transform(&vout[i][0], mats[p & (count - 1)][0], &vecs[i][0]);
+    scalar = _now() - start;
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            vout[i] = mats[p & (count - 1)] * vecs[i];
+    _report_mat4("transform", scalar, _now() - start, passes * count);
+    _scalar_transform(ref, mats[(passes - 1) & (count - 1)][0], &vecs[0][0]);
+    check(ref, &vout[0][0], 4);
+
+    // affine inverse, and what inverse() cost before the fast path
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            _scalar_affine_inverse(out[i][0], mats[(i + p) & (count - 1)][0]);
+    scalar = _now() - start;
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            out[i] = mats[(i + p) & (count - 1)].affineInverse();
+    _report_mat4("affine inverse", scalar, _now() - start, passes * count);
+    _scalar_affine_inverse(ref, mats[(passes - 1) & (count - 1)][0]);
+    check(ref, out[0][0], 16);
+
+    Mat4f projective = mats[0];
+    projective[3][2] = 0.001f;
+    start = _now();
+    for (int i = 0; i < count; ++i)
+        out[i] = projective.inverse();
+    printf("mat4: %-16s %6.2f ns; max difference from scalar %g\n",
+           "gauss-jordan", (_now() - start) * 1e9 / count, worst);
+}
+
+// ****************************************************************************
+// Batch transforms
+// ****************************************************************************
+
+static void benchBatchTransform(int scale)
+{
+    const int count = 1 << 20, passes = 20 * scale;
+    std::vector<float> x(count), y(count), z(count), ox(count), oy(count), oz(count);
+    std::vector<Vec3f> aos(count), aosOut(count);
+    for (int i = 0; i < count; ++i)
+    {
+        x[i] = (float)_random(-10, 10);
+        y[i] = (float)_random(-10, 10);
+        z[i] = (float)_random(-10, 10);
+        aos[i] = Vec3f(x[i], y[i], z[i]);
+    }
+    Mat4f m = _random_rigid() * Mat4f(2, 0, 0, 0,  0, 0.5f, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1);
+    const double points = (double)count * passes / 1e6;
+
+    // one Vec3f at a time, the way the model code transforms today
+    double start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            aosOut[i] = m * aos[i];
+    double aosTime = _now() - start;
+
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        transformPoints(m, &x[0], &y[0], &z[0], &ox[0], &oy[0], &oz[0], count);
+    double batchTime = _now() - start;
+
+    float worst = 0;
+    for (int i = 0; i < count; ++i)
+        for (int c = 0; c < 3; ++c)
+        {
+            float d = (float)fabs(aosOut[i][c] - (c == 0 ? ox[i] : c == 1 ? oy[i] : oz[i]));
+            worst = d > worst ? d : worst;
+        }
+
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        transformNormals(m, &x[0], &y[0], &z[0], &ox[0], &oy[0], &oz[0], count);
+    double normalTime = _now() - start;
+
+    float lo[3], hi[3];
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        transformedBounds(m, &x[0], &y[0], &z[0], count, lo, hi);
+    double boundsTime = _now() - start;
+
+    printf("batchxform: %d points, %s; Vec3f loop %.0f Mpts/s, batch points %.0f Mpts/s (%.1fx), "
+           "normals %.0f Mpts/s, bounds %.0f Mpts/s; max difference %g\n",
+           count, cpuHasAVX() ? "AVX" : "SSE2", points / aosTime, points / batchTime,
+           aosTime / batchTime, points / normalTime, points / boundsTime, worst);
+}
+
+// ****************************************************************************
+// Expression templates
+// ****************************************************************************
+
+static void benchVecExpr(int scale)
+{
+    const int count = 4096, passes = 500 * scale;
+    std::vector<Vec3f> a(count), b(count), c(count), out(count), lazyOut(count);
+    std::vector<Mat4f> xforms(count);
+    for (int i = 0; i < count; ++i)
+    {
+        a[i] = Vec3f((float)_random(-1, 1), (float)_random(-1, 1), (float)_random(-1, 1));
+        b[i] = Vec3f((float)_random(-1, 1), (float)_random(-1, 1), (float)_random(-1, 1));
+        c[i] = Vec3f((float)_random(-1, 1), (float)_random(-1, 1), (float)_random(-1, 1));
+        xforms[i] = _random_rigid();
+    }
+    double x = 0.25, y = -0.5;
+
+    // the camera's pan: look-at + x axis * dx + y axis * dy
+    double start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            out[i] = a[i] + b[i] * x + c[(i + p) & (count - 1)] * y;
+    double eager = _now() - start;
+    start = _now();
+    for (int p = 0; p < passes; ++p)
+        for (int i = 0; i < count; ++i)
+            lazyOut[i] = lazy(a[i]) + lazy(b[i]) * x + lazy(c[(i + p) & (count - 1)]) * y;
+    double fused = _now() - start;
+
+    bool same = true;
+    for (int i = 0; i < count; ++i)
+        same = same && out[i] == lazyOut[i];
+    printf("vecexpr: %-24s eager %6.2f ns, lazy %6.2f ns, %.1fx%s\n", "pan a + b*x + c*y",
+           eager * 1e9 / (passes * count), fused * 1e9 / (passes * count), eager / fused,
+           same ? "" : " (MISMATCH)");
+
+    // four levels of a model hierarchy applied to a point, written the
+    // natural way round
+    const int chains = passes * count / 4;
+    start = _now();
+    for (int k = 0; k < chains; ++k)
+    {
+        int i = k & (count - 1);
+        out[i] = xforms[i] * xforms[(i + 1) & (count - 1)] * xforms[(i + 2) & (count - 1)] *
+                 xforms[(i + 3) & (count - 1)] * a[i];
+    }
+    eager = _now() - start;
+    start = _now();
+    for (int k = 0; k < chains; ++k)
+    {
+        int i = k & (count - 1);
+        lazyOut[i] = lazy(xforms[i]) * xforms[(i + 1) & (count - 1)] * xforms[(i + 2) & (count - 1)] *
+                     xforms[(i + 3) & (count - 1)] * a[i];
+    }
+    fused = _now() - start;
+
+    float worst = 0;
+    for (int i = 0; i < count; ++i)
+        for (int j = 0; j < 3; ++j)
+            worst = (float)fabs(out[i][j] - lazyOut[i][j]) > worst ? (float)fabs(out[i][j] - lazyOut[i][j]) : worst;
+    printf("vecexpr: %-24s eager %6.2f ns, lazy %6.2f ns, %.1fx, max difference %g\n", "A*B*C*D*p",
+           eager * 1e9 / chains, fused * 1e9 / chains, eager / fused, worst);
+}
+
+// ****************************************************************************
+// Quaternion hierarchies
+// ****************************************************************************
+
+// What glRotated multiplies onto the stack
+static Mat4f _rotation_matrix(float degrees, float x, float y, float z)
+{
+    float len = sqrtf(x * x + y * y + z * z);
+    x /= len; y /= len; z /= len;
+    float a = degrees * 3.14159265f / 180, c = cosf(a), s = sinf(a), t = 1 - c;
+    return Mat4f(t*x*x + c,   t*x*y - s*z, t*x*z + s*y, 0,
+                 t*x*y + s*z, t*y*y + c,   t*y*z - s*x, 0,
+                 t*x*z - s*y, t*y*z + s*x, t*z*z + c,   0,
+                 0, 0, 0, 1);
+}
+
+static void benchQuat(int scale)
+{
+    // A model-sized hierarchy: every part translates, rotates about its
+    // joint and pushes its children, eight levels deep
+    const int depth = 8, walks = 20000 * scale;
+    std::vector<float> angles(depth * 4), offsets(depth * 3);
+    for (size_t i = 0; i < angles.size(); ++i)
+        angles[i] = (float)_random(-1, 1);
+    for (size_t i = 0; i < offsets.size(); ++i)
+        offsets[i] = (float)_random(-2, 2);
+
+    Vec3f tip, quatTip;
+    std::vector<Mat4f> matrixStack;
+    matrixStack.reserve(depth + 1);
+    double start = _now();
+    for (int w = 0; w < walks; ++w)
+    {
+        matrixStack.assign(1, Mat4f());
+        for (int d = 0; d < depth; ++d)
+        {
+            matrixStack.push_back(matrixStack.back());
+            Mat4f &m = matrixStack.back();
+            m = m * Mat4f(1, 0, 0, offsets[d * 3], 0, 1, 0, offsets[d * 3 + 1],
+                          0, 0, 1, offsets[d * 3 + 2], 0, 0, 0, 1);
+            m = m * _rotation_matrix(w * 0.01f + angles[d * 4] * 90, angles[d * 4 + 1],
+                                     angles[d * 4 + 2], angles[d * 4 + 3]);
+        }
+        tip = matrixStack.back() * Vec3f(0, 0, 0);
+    }
+    double matrices = _now() - start;
+
+    TransformStack stack;
+    start = _now();
+    for (int w = 0; w < walks; ++w)
+    {
+        while (stack.depth() > 1)
+            stack.pop();
+        stack.loadIdentity();
+        for (int d = 0; d < depth; ++d)
+        {
+            stack.push();
+            stack.translate(offsets[d * 3], offsets[d * 3 + 1], offsets[d * 3 + 2]);
+            stack.rotate(w * 0.01f + angles[d * 4] * 90, angles[d * 4 + 1],
+                         angles[d * 4 + 2], angles[d * 4 + 3]);
+        }
+        quatTip = stack.transformPoint(Vec3f(0, 0, 0));
+    }
+    double quats = _now() - start;
+
+    float err = 0;
+    for (int c = 0; c < 3; ++c)
+        err = (float)fabs(tip[c] - quatTip[c]) > err ? (float)fabs(tip[c] - quatTip[c]) : err;
+    printf("quat: %d-level hierarchy walk, Mat4f stack %.0f ns, dual quaternion stack %.0f ns, %.1fx, "
+           "difference %g\n", depth, matrices * 1e9 / walks, quats * 1e9 / walks, matrices / quats, err);
+
+    // The same walk with the rotations built beforehand, so only the
+    // composition is timed, not the trig
+    std::vector<Mat4f> rotations(depth);
+    std::vector<Quatf> quatRotations(depth);
+    for (int d = 0; d < depth; ++d)
+    {
+        rotations[d] = _rotation_matrix(angles[d * 4] * 90, angles[d * 4 + 1], angles[d * 4 + 2], angles[d * 4 + 3]);
+        quatRotations[d] = Quatf::rotation(angles[d * 4] * 90, angles[d * 4 + 1], angles[d * 4 + 2], angles[d * 4 + 3]);
+    }
+    start = _now();
+    for (int w = 0; w < walks; ++w)
+    {
+        matrixStack.assign(1, Mat4f());
+        for (int d = 0; d < depth; ++d)
+        {
+            matrixStack.push_back(matrixStack.back());
+            Mat4f &m = matrixStack.back();
+            m = m * Mat4f(1, 0, 0, offsets[d * 3], 0, 1, 0, offsets[d * 3 + 1],
+                          0, 0, 1, offsets[d * 3 + 2], 0, 0, 0, 1);
+            m = m * rotations[d];
+        }
+        tip = matrixStack.back() * Vec3f(0, 0, 0);
+    }
+    matrices = _now() - start;
+    start = _now();
+    for (int w = 0; w < walks; ++w)
+    {
+        while (stack.depth() > 1)
+            stack.pop();
+        stack.loadIdentity();
+        for (int d = 0; d < depth; ++d)
+        {
+            stack.push();
+            stack.translate(offsets[d * 3], offsets[d * 3 + 1], offsets[d * 3 + 2]);
+            stack.rotate(quatRotations[d]);
+        }
+        quatTip = stack.transformPoint(Vec3f(0, 0, 0));
+    }
+    quats = _now() - start;
+    printf("quat: composition only, Mat4f stack %.0f ns, dual quaternion stack %.0f ns, %.1fx\n",
+           matrices * 1e9 / walks, quats * 1e9 / walks, matrices / quats);
+
+    // EULER_ROT: three rotation matrices versus one quaternion
+    const int count = 200000 * scale;
+    float sum = 0, quatSum = 0;
+    start = _now();
+    for (int i = 0; i < count; ++i)
+    {
+        float a = i * 0.001f;
+        Mat4f m = _rotation_matrix(a, 0, 0, 1) * _rotation_matrix(a * 2, 1, 0, 0) *
+                  _rotation_matrix(a * 3, 0, 1, 0);
+        sum += m[0][1];
+    }
+    double euler = _now() - start;
+    start = _now();
+    for (int i = 0; i < count; ++i)
+    {
+        float a = i * 0.001f;
+        Mat4f m = (Quatf::rotation(a, 0, 0, 1) * Quatf::rotation(a * 2, 1, 0, 0) *
+                   Quatf::rotation(a * 3, 0, 1, 0)).toMat4();
+        quatSum += m[0][1];
+    }
+    double quatEuler = _now() - start;
+
+    Quatf q(1, 2, 3, 4), r(4, 3, 2, 1);
+    start = _now();
+    for (int i = 0; i < count; ++i)
+    {
+        q = slerp(q, r, 0.01);
+        r = nlerp(r, q, 0.02);
+    }
+    double blend = _now() - start;
+
+    printf("quat: euler rotation as matrices %.1f ns, as quaternions %.1f ns, %.1fx (checksums %g, %g); "
+           "slerp+nlerp %.1f ns\n", euler * 1e9 / count, quatEuler * 1e9 / count, euler / quatEuler,
+           sum, quatSum, blend * 1e9 / count);
+}
+
+// ****************************************************************************
+// Tessellation tables
+// ****************************************************************************
+
+static void benchTessellation(int scale)
+{
+    const double pi = 3.14159265358979323846;
+
+    // Table accuracy against the library trig
+    double worst = 0;
+    for (int q = HIGH; q <= POOR; ++q)
+    {
+        const CircleTable &circle = unitCircle((QualitySetting_t)q);
+        for (int i = 0; i <= 2 * circle.divisions; ++i)
+        {
+            double a = pi * i / circle.divisions;
+            worst = std::max(worst, fabs(circle.cosines[i] - cos(a)));
+            worst = std::max(worst, fabs(circle.sines[i] - sin(a)));
+        }
+    }
+
+    // One frame's worth of eye fans (scalera, iris and pupil for both eyes)
+    // at high quality: the old per-frame trig against the table
+    const CircleTable &circle = unitCircle(HIGH);
+    const int fidelity = circle.divisions, frames = 20000 * scale;
+    double sum = 0, tableSum = 0;
+
+    double start = _now();
+    for (int f = 0; f < frames; ++f)
+        for (int fan = 0; fan < 6; ++fan)
+            for (int i = 0; i < fidelity; ++i)
+            {
+                double x1 = -cos(pi / fidelity * i), y1 = -sin(pi / fidelity * i);
+                double x2 = -cos(pi / fidelity * (i + 1)), y2 = -sin(pi / fidelity * (i + 1));
+                sum += x1 * y2 - x2 * y1 + f;
+            }
+    double trig = _now() - start;
+
+    start = _now();
+    for (int f = 0; f < frames; ++f)
+        for (int fan = 0; fan < 6; ++fan)
+            for (int i = 0; i < fidelity; ++i)
+            {
+                double x1 = -circle.cosines[i], y1 = -circle.sines[i];
+                double x2 = -circle.cosines[i + 1], y2 = -circle.sines[i + 1];
+                tableSum += x1 * y2 - x2 * y1 + f;
+            }
+    double table = _now() - start;
+
+    // What gluSphere works out on every call before drawing anything
+    const SphereTable &sphere = unitSphere(HIGH);
+    const int n = sphere.divisions, spheres = 2000 * scale;
+    std::vector<float> vertices(sphere.vertexCount * 8);
+    start = _now();
+    for (int c = 0; c < spheres; ++c)
+        for (int j = 0; j <= n; ++j)
+            for (int k = 0; k <= n; ++k)
+            {
+                double polar = pi * j / n, slice = 2 * pi * k / n;
+                float *v = &vertices[(j * (n + 1) + k) * 8];
+                v[5] = (float)(sin(polar) * sin(slice));
+                v[6] = (float)(sin(polar) * cos(slice));
+                v[7] = (float)cos(polar);
+            }
+    double gluSphere = _now() - start;
+
+    double sphereWorst = 0;
+    for (int i = 0; i < sphere.vertexCount; ++i)
+        for (int c = 5; c < 8; ++c)
+            sphereWorst = std::max(sphereWorst, (double)fabs(vertices[i * 8 + c] - sphere.vertices[i * 8 + c]));
+
+    printf("tessellation: eye fans %.2f us/frame with trig, %.3f us/frame from the table, %.0fx "
+           "(checksums %.6g, %.6g)\n", trig * 1e6 / frames, table * 1e6 / frames, trig / table, sum, tableSum);
+    printf("tessellation: %d-division sphere vertices %.1f us per call with trig, none from the table; "
+           "table error %g (circle), %g (sphere)\n", n, gluSphere * 1e6 / spheres, worst, sphereWorst);
+}
+
+// ****************************************************************************
+// Crowd evaluation
+// ****************************************************************************
+
+// A stand-in for a model's draw: a head with ears, eyes and a jaw of
+// teeth, about as many parts and matrix operations as RkAlphaModel,
+// animated the same way
+static bool _bench_creature(void *, double time)
+{
+    const double pi = 3.14159265358979323846;
+    double s = sin(pi * time / 120);
+
+    pushMatrix();
+    rotate(-s * 60, 0, 1, 0);
+    rotate(-s * s * 2.5 - 10, 1, 0, 0);
+    rotateEuler(-s * s * 15, s * 22.5, -s * 15);
+    drawSphere(1.3);
+
+    for (int side = -1; side <= 1; side += 2)
+    {
+        pushMatrix();
+        translate(side * 1.3, 0, -0.6 + s * 0.2 * side);
+        rotate(side * 20, 0, 0, 1);
+        drawBox(1, 1.5, 0.2);
+        drawCylinder(0.5, 0.2, 0.2);
+        popMatrix();
+
+        pushMatrix();
+        rotate(s * 15 + side * 35, 0, 1, 0);
+        translate(0, 0.3, 1.3);
+        drawBox(0.6, 0.1, 0.1);
+        drawSphere(0.2);
+        drawSphere(0.1);
+        popMatrix();
+    }
+
+    pushMatrix();
+    translate(0, -0.5, 0.8);
+    rotate(s > 0 ? s * 15 : 0, 1, 0, 0);
+    drawBox(1.6, 0.3, 1.2);
+    for (int tooth = 0; tooth < 12; ++tooth)
+    {
+        pushMatrix();
+        translate(-0.7 + tooth * 0.13, 0.3, 1.0);
+        scale(0.1, 0.2, 0.1);
+        drawBox(1, 1, 1);
+        popMatrix();
+    }
+    popMatrix();
+
+    popMatrix();
+    return true;
+}
+
+static void benchCrowd(int scale)
+{
+    const int members[] = { 16, 256, 1024 };
+    const int frames = 20 * scale;
+
+    for (int m = 0; m < 3; ++m)
+    {
+        Crowd serial(members[m], 1), parallel(members[m]);
+
+        double start = _now();
+        for (int f = 0; f < frames; ++f)
+            serial.evaluate(_bench_creature, NULL, f, NULL, 0);
+        double serialTime = _now() - start;
+
+        start = _now();
+        for (int f = 0; f < frames; ++f)
+            parallel.evaluate(_bench_creature, NULL, f, NULL, 0);
+        double parallelTime = _now() - start;
+
+        long triangles = parallel.triangleCount();
+
+        printf("crowd: %4d members, evaluate %.3f ms/frame on 1 thread, %.3f ms/frame on %d, "
+               "%.1fx; %ld tris/frame, %.1f Mtris/s evaluated\n",
+               members[m], serialTime * 1e3 / frames, parallelTime * 1e3 / frames,
+               parallel.threadCount(), serialTime / parallelTime, triangles,
+               triangles * frames / parallelTime / 1e6);
+    }
+}
+
+// ****************************************************************************
+// Animation channels
+// ****************************************************************************
+
+static void benchAnimChannels(int scale)
+{
+    const int numChannels = 4096, numKeys = 16, frames = 500 * scale;
+    const double step = 0.25, length = numKeys * 10.0;
+
+    AnimChannels channels;
+    for (int c = 0; c < numChannels; ++c)
+    {
+        int channel = channels.addChannel();
+        for (int k = 0; k < numKeys; ++k)
+            channels.setKey(channel, Keyframe(k * 10 + _random(0, 5), _random(-1, 1),
+                                              (Interpolation_t)(k % 3), (TangentMode_t)(c % 3),
+                                              _random(-1, 1), _random(-1, 1)));
+    }
+    channels.bake();
+
+    // playing straight through, as the animation does
+    AnimPlayhead playhead;
+    double start = _now();
+    for (int f = 0; f < frames; ++f)
+        channels.evaluate(fmod(f * step, length), playhead);
+    double playTime = _now() - start;
+    long playSeeks = playhead.seeks();
+
+    // jumping a few keys every frame, so every channel has to search
+    AnimPlayhead jumping;
+    start = _now();
+    for (int f = 0; f < frames; ++f)
+        channels.evaluate(fmod(f * 37.3, length), jumping);
+    double seekTime = _now() - start;
+    long seeks = jumping.seeks();
+
+    // both ways must land on the same values
+    double worst = 0;
+    for (int f = 0; f < 200; ++f)
+    {
+        double time = _random(-10, length + 10);
+        AnimPlayhead seek;
+        channels.evaluate(time, seek);
+        channels.evaluate(time, playhead);
+        for (int c = 0; c < numChannels; ++c)
+            worst = std::max(worst, fabs(seek.value(c) - playhead.value(c)));
+    }
+
+    double evaluations = (double)numChannels * frames / 1e6;
+    printf("animchannels: %d channels x %d keys, %s; playback %.1f us/frame (%.0f Mch/s, "
+           "%.2f seeks/frame), seeking %.1f us/frame (%.0f Mch/s, %.0f seeks/frame); max difference %g\n",
+           numChannels, numKeys, cpuHasAVX() ? "AVX" : "SSE2", playTime * 1e6 / frames,
+           evaluations / playTime, (double)playSeeks / frames, seekTime * 1e6 / frames,
+           evaluations / seekTime, (double)seeks / frames, worst);
+}
+
+// ****************************************************************************
+// Baked frame tables
+// ****************************************************************************
+
+static void benchFrameTable(int scale)
+{
+    const int numChannels = 32, numKeys = 16, numFrames = 20000, lookups = 200000 * scale;
+    const double length = numFrames;
+
+    AnimChannels channels;
+    for (int c = 0; c < numChannels; ++c)
+    {
+        int channel = channels.addChannel();
+        for (int k = 0; k <= numKeys; ++k)
+            channels.setKey(channel, Keyframe(k * length / numKeys, _random(-180, 180)));
+    }
+    channels.bake();
+
+    AnimPlayhead playhead;
+    std::vector<double> baked((size_t)numFrames * numChannels);
+    double start = _now();
+    for (int f = 0; f < numFrames; ++f)
+    {
+        channels.evaluate(f, playhead);
+        std::copy(playhead.values(), playhead.values() + numChannels,
+                  baked.begin() + (size_t)f * numChannels);
+    }
+    FrameTable table;
+    table.build(&baked[0], numChannels, numFrames, 0);
+    double buildTime = _now() - start;
+
+    const char *fname = "_bench_frametable.mft";
+    bool saved = table.save(fname);
+    FrameTable mapped;
+    start = _now();
+    bool opened = saved && mapped.open(fname);
+    double openTime = _now() - start;
+
+    // scrubbing: frames in no order, from the curves and from the table
+    std::vector<int> frames(lookups);
+    for (int i = 0; i < lookups; ++i)
+        frames[i] = (int)_random(0, numFrames);
+    std::vector<double> values(numChannels);
+
+    AnimPlayhead scrub;
+    start = _now();
+    for (int i = 0; i < lookups; ++i)
+        channels.evaluate(frames[i], scrub);
+    double curveTime = _now() - start;
+
+    const FrameTable &read = opened ? mapped : table;
+    start = _now();
+    for (int i = 0; i < lookups; ++i)
+        read.frame(read.frameAt(frames[i]), &values[0]);
+    double tableTime = _now() - start;
+
+    // every value within its channel's tolerance of what was baked
+    double worst = 0;
+    bool within = true;
+    for (int f = 0; f < numFrames; ++f)
+        for (int c = 0; c < numChannels; ++c)
+        {
+            double d = fabs(read.value(f, c) - baked[(size_t)f * numChannels + c]);
+            worst = std::max(worst, d);
+            within = within && d <= read.tolerance(c) * 1.0001;
+        }
+    remove(fname);
+
+    printf("frametable: %d frames x %d channels, %d bytes/frame%s; bake %.1f ms, open %.3f ms; "
+           "random frames from curves %.2f us, from table %.3f us (%.0fx); max error %g (%s)\n",
+           numFrames, numChannels, numChannels * 2, opened ? ", mapped" : ", in memory",
+           buildTime * 1e3, openTime * 1e3, curveTime * 1e6 / lookups, tableTime * 1e6 / lookups,
+           curveTime / tableTime, worst, within ? "within tolerance" : "OUT OF TOLERANCE");
+}
+
+// ****************************************************************************
+// Rendered frame cache
+// ****************************************************************************
+
+static void benchFrameCache(int scale)
+{
+    const int width = 640, height = 480, poses = 120, passes = 10 * scale, numControls = 32;
+    const size_t frameBytes = (size_t)width * height * 3;
+    const size_t budgets[] = { frameBytes * poses * 2, frameBytes * poses / 2 };
+
+    for (int b = 0; b < 2; ++b)
+    {
+        FrameCache cache(budgets[b]);
+        std::vector<double> key(numControls + 11);
+        std::vector<unsigned char> rgb;
+
+        // scrubbing back and forth over the same stretch of poses
+        double start = _now();
+        for (int p = 0; p < passes; ++p)
+            for (int i = 0; i < poses; ++i)
+            {
+                int pose = (p & 1) ? poses - 1 - i : i;
+                for (int c = 0; c < numControls; ++c)
+                    key[c] = pose * 0.25 + c;
+                if (!cache.find(key))
+                {
+                    rgb.assign(frameBytes, (unsigned char)pose);
+                    cache.insert(key, width, height, rgb);
+                }
+            }
+        double time = _now() - start;
+
+        FrameCacheStats stats = cache.stats();
+        printf("framecache: %dx%d frames, budget %.0f MB; %d held in %.0f MB, %.0f%% hit, "
+               "%ld evicted, %.2f us per lookup and fill\n",
+               width, height, budgets[b] / 1048576.0, stats.m_frames, stats.m_bytes / 1048576.0,
+               100.0 * stats.m_hits / (stats.m_hits + stats.m_misses), stats.m_evictions,
+               time * 1e6 / (passes * poses));
+    }
+}
+
+static void benchPoseLibrary(int scale)
+{
+    const int numControls = 64, numPoses = 1000, blends = 20000 * scale, perBlend = 8;
+
+    PoseLibrary library(numControls);
+    std::vector<double> pose(numControls);
+    char name[32];
+    double start = _now();
+    std::vector<std::vector<double> > all(numPoses);
+    for (int p = 0; p < numPoses; ++p)
+    {
+        for (int c = 0; c < numControls; ++c)
+            pose[c] = _random(-90, 90);
+        all[p] = pose;
+    }
+    // one at a time, the way the UI adds them
+    for (int p = 0; p < numPoses; ++p)
+    {
+        sprintf(name, "pose%d", p);
+        library.setPose(name, &all[p][0]);
+    }
+    double buildTime = _now() - start;
+
+    const char *fname = "_bench_poselibrary.mpl";
+    bool saved = library.save(fname);
+    PoseLibrary mapped;
+    start = _now();
+    bool opened = saved && mapped.open(fname);
+    double openTime = _now() - start;
+    const PoseLibrary &read = opened ? mapped : library;
+
+    // every pose found by name, with its values
+    bool correct = read.numPoses() == numPoses && read.numControls() == numControls &&
+                   read.find("nobody") < 0;
+    std::vector<int> found(numPoses);
+    start = _now();
+    for (int p = 0; p < numPoses; ++p)
+    {
+        sprintf(name, "pose%d", p);
+        found[p] = read.find(name);
+    }
+    double findTime = _now() - start;
+    for (int p = 0; p < numPoses && correct; ++p)
+        correct = found[p] >= 0 &&
+                  std::equal(all[p].begin(), all[p].end(), read.values(found[p]));
+
+    // blending perBlend poses into the controls, against the plain loop
+    std::vector<PoseWeight> weights((size_t)blends * perBlend);
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i].m_pose = (int)_random(0, numPoses);
+        weights[i].m_weight = _random(0, 1.0 / perBlend);
+    }
+    std::vector<double> controls(numControls, 0), plain(numControls, 0);
+
+    start = _now();
+    for (int b = 0; b < blends; ++b)
+    {
+        const PoseWeight *w = &weights[(size_t)b * perBlend];
+        double keep = 1;
+        for (int i = 0; i < perBlend; ++i)
+            keep -= w[i].m_weight;
+        for (int c = 0; c < numControls; ++c)
+        {
+            double v = plain[c] * keep;
+            for (int i = 0; i < perBlend; ++i)
+                v += w[i].m_weight * read.values(w[i].m_pose)[c];
+            plain[c] = v;
+        }
+    }
+    double plainTime = _now() - start;
+
+    start = _now();
+    for (int b = 0; b < blends; ++b)
+        read.blend(&weights[(size_t)b * perBlend], perBlend, &controls[0]);
+    double blendTime = _now() - start;
+    remove(fname);
+
+    double worst = 0;
+    for (int c = 0; c < numControls; ++c)
+        worst = std::max(worst, fabs(controls[c] - plain[c]));
+
+    printf("poselibrary: %d poses x %d controls%s; build %.1f ms, open %.3f ms, find %.3f us; "
+           "blend of %d poses %.3f us, plain loop %.3f us (%.1fx); max difference %g (%s)\n",
+           numPoses, numControls, opened ? ", mapped" : ", in memory", buildTime * 1e3,
+           openTime * 1e3, findTime * 1e6 / numPoses, perBlend, blendTime * 1e6 / blends,
+           plainTime * 1e6 / blends, plainTime / blendTime, worst,
+           correct && worst < 1e-9 ? "correct" : "WRONG");
+}
+
+static void benchDrivenControls(int scale)
+{
+    const int numControls = 2000, numDriven = 1000, frames = 2000 * scale;
+
+    DrivenControls driven;
+    char name[32], expression[128];
+    for (int c = 0; c < numControls; ++c)
+    {
+        sprintf(name, "C%d", c);
+        driven.setName(c, name);
+    }
+    // given last first, so they only run in the right order once sorted
+    double start = _now();
+    for (int d = numDriven - 1; d >= 0; --d)
+    {
+        int c = numControls - numDriven + d;
+        sprintf(expression, "max(0, sin(t / 20 + C%d)) * 0.5 + C%d * (1 - 0.25) - 2^-1", d,
+                c - 1);
+        driven.drive(c, expression);
+    }
+    // compiled once, when first needed
+    driven.numInstructions();
+    double compileTime = _now() - start;
+
+    std::string error;
+    bool rejects = !driven.drive(0, "C1999 + 1", &error) &&
+                   error.compare(0, 42, "controls would drive each other: C0 <- C19") == 0 &&
+                   !driven.drive(1, "sin(", &error) &&
+                   !driven.drive(1, "max(1, 2", &error) && error == "missing ')'" &&
+                   driven.numDriven() == numDriven;
+
+    // constants that fold to NaN or infinity still get registers of their own
+    DrivenControls odd;
+    odd.setName(0, "A");
+    odd.drive(1, "asin(2) + A");
+    odd.drive(2, "sqrt(-1) * A + 0/0");
+    odd.drive(3, "1/0 - A");
+    odd.drive(4, "-(1/0) + A * 2");
+    double oddControls[5] = { 0.5, 0, 0, 0, 0 };
+    std::vector<double> oddRegisters;
+    odd.evaluate(0, oddControls, oddRegisters);
+    bool nonFinite = oddControls[1] != oddControls[1] && oddControls[2] != oddControls[2] &&
+                     oddControls[3] > DBL_MAX && oddControls[4] < -DBL_MAX;
+
+    std::vector<double> controls(numControls), native(numControls), registers;
+    for (int c = 0; c < numControls; ++c)
+        controls[c] = native[c] = _random(-1, 1);
+
+    start = _now();
+    for (int f = 0; f < frames; ++f)
+        driven.evaluate(f, &controls[0], registers);
+    double vmTime = _now() - start;
+
+    start = _now();
+    for (int f = 0; f < frames; ++f)
+        for (int d = 0; d < numDriven; ++d)
+        {
+            int c = numControls - numDriven + d;
+            native[c] = std::max(0.0, sin(f / 20.0 + native[d])) * 0.5 + native[c - 1] * 0.75 - 0.5;
+        }
+    double nativeTime = _now() - start;
+
+    double worst = 0;
+    for (int c = 0; c < numControls; ++c)
+        worst = std::max(worst, fabs(controls[c] - native[c]));
+
+    printf("drivencontrols: %d driven of %d controls, %d instructions, compiled in %.1f ms; "
+           "%.2f us per frame, as C++ %.2f us (%.1fx); max difference %g (%s)\n",
+           numDriven, numControls, driven.numInstructions(), compileTime * 1e3,
+           vmTime * 1e6 / frames, nativeTime * 1e6 / frames, vmTime / nativeTime, worst,
+           rejects && nonFinite && worst < 1e-9 ? "correct" : "WRONG");
+}
+
+// A rig of limbs, each a scope reading two controls, turning as a whole
+static const double *s_rigControls = NULL;
+
+static double _rig_val(int control)
+{
+    // what GetControlValue does on a posing thread
+    ControlGraph::noteRead(control);
+    return s_rigControls[control];
+}
+
+// Claws at the end of each limb, drawn as instances
+static InstancedGeometry s_rigClaw;
+
+static void _rig_claw(void *)
+{
+    drawBox(0.05, 0.3, 0.05);
+}
+
+static void _rig_limb(int limb)
+{
+    ModelScope scope("limb");
+    if (!scope.evaluate())
+        return;
+
+    pushMatrix();
+    rotate(_rig_val(2 * limb), 0, 0, 1);
+    for (int segment = 0; segment < 16; ++segment)
+    {
+        translate(0, 0.5, 0);
+        rotate(_rig_val(2 * limb + 1) * sin(segment * 0.3), 1, 0, 0);
+        setDiffuseColor(segment / 16.0f, 0.5f, limb / 64.0f);
+        drawBox(0.2, 0.5, 0.2);
+        drawCylinder(0.5, 0.1, 0.1);
+    }
+    for (int claw = 0; claw < 3; ++claw)
+    {
+        pushMatrix();
+        rotate(claw * 120 + _rig_val(2 * limb + 1) * 10, 0, 1, 0);
+        translate(0.15, 0.5, 0);
+        s_rigClaw.addInstance();
+        popMatrix();
+    }
+    setDiffuseColor(0.8f, 0.8f, limb / 64.0f);
+    const double clawParams[] = { 0.3 };
+    s_rigClaw.draw(clawParams, 1, _rig_claw, NULL);
+    popMatrix();
+}
+
+static bool _bench_rig(void *, double time)
+{
+    pushMatrix();
+    rotate(time, 0, 1, 0);
+    for (int limb = 0; limb < 64; ++limb)
+    {
+        pushMatrix();
+        rotate(limb * 360.0 / 64, 0, 1, 0);
+        translate(0, 0, 2);
+        _rig_limb(limb);
+        popMatrix();
+    }
+    popMatrix();
+    return true;
+}
+
+static void benchControlGraph(int scale)
+{
+    const int numControls = 128, poses = 200 * scale;
+
+    std::vector<double> controls(numControls, 0);
+    s_rigControls = &controls[0];
+    ControlGraph graph;
+    DrawList full, partial;
+    double fullTime = 0, graphTime = 0, reuse = 0;
+
+    for (int p = 0; p < poses; ++p)
+    {
+        // a slider moves between poses
+        controls[(p * 7) % numControls] += 1;
+
+        double start = _now();
+        full.begin();
+        _bench_rig(NULL, p);
+        full.end();
+        fullTime += _now() - start;
+
+        start = _now();
+        partial.begin();
+        graph.begin(partial, &controls[0], numControls);
+        _bench_rig(NULL, p);
+        graph.end();
+        partial.end();
+        graphTime += _now() - start;
+        if (p > 0)
+            reuse += graph.stats().reuseRatio();
+    }
+    s_rigControls = NULL;
+
+    // the same items, where and as they'd be without the graph
+    bool same = full.itemCount() == partial.itemCount() &&
+                full.triangleCount() == partial.triangleCount();
+    double worst = 0;
+    for (int i = 0; same && i < full.itemCount(); ++i)
+    {
+        const DrawItem &a = full.item(i), &b = partial.item(i);
+        same = a.m_type == b.m_type && memcmp(a.m_params, b.m_params, sizeof(a.m_params)) == 0 &&
+               memcmp(&full.materialOf(a), &partial.materialOf(b), sizeof(DrawMaterial)) == 0;
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c)
+                worst = std::max(worst, (double)fabs(a.m_matrix[r][c] - b.m_matrix[r][c]));
+    }
+
+    // a model that opens no scopes, as its controls change
+    ControlGraph flatGraph;
+    DrawList flat;
+    for (int p = 0; p < 3; ++p)
+    {
+        controls[p] += 1;
+        flat.begin();
+        flatGraph.begin(flat, &controls[0], numControls);
+        _rig_claw(NULL);
+        flatGraph.end();
+        flat.end();
+    }
+    same = same && flat.itemCount() == 1;
+
+    printf("controlgraph: %d items from %d scopes, one control changed per pose; "
+           "%.1f us per pose in full, %.1f us through the graph (%.1fx), %.0f%% reused; "
+           "max matrix difference %g (%s)\n",
+           full.itemCount(), graph.numScopes(), fullTime * 1e6 / poses, graphTime * 1e6 / poses,
+           fullTime / graphTime, 100 * reuse / (poses - 1), worst,
+           same && worst < 1e-4 ? "correct" : "WRONG");
+}
+
+// ****************************************************************************
+// Registry
+// ****************************************************************************
+
+struct ModelerBenchmark
+{
+    const char         *m_name;
+    ModelerBenchmark_f  m_run;
+};
+
+static const ModelerBenchmark s_benchmarks[] = {
+    { "rayparse", benchRayParse },
+    { "bmpio", benchBmpIO },
+    { "imageencode", benchImageEncode },
+    { "gifencode", benchGifEncode },
+    { "mipmap", benchMipmap },
+    { "mat4", benchMat4 },
+    { "batchxform", benchBatchTransform },
+    { "vecexpr", benchVecExpr },
+    { "quat", benchQuat },
+    { "tessellation", benchTessellation },
+    { "crowd", benchCrowd },
+    { "animchannels", benchAnimChannels },
+    { "frametable", benchFrameTable },
+    { "framecache", benchFrameCache },
+    { "poselibrary", benchPoseLibrary },
+    { "drivencontrols", benchDrivenControls },
+    { "controlgraph", benchControlGraph },
+};
+
+static const int s_numBenchmarks = sizeof(s_benchmarks) / sizeof(s_benchmarks[0]);
+
+int runBenchmarks(const char *filter, int scale)
+{
+    int count = 0;
+    if (scale < 1)
+        scale = 1;
+
+    for (int i = 0; i < s_numBenchmarks; ++i)
+    {
+        if (filter && *filter && !strstr(s_benchmarks[i].m_name, filter))
+            continue;
+        s_benchmarks[i].m_run(scale);
+        fflush(stdout);
+        ++count;
+    }
+    return count;
+}
+
+void listBenchmarks()
+{
+    for (int i = 0; i < s_numBenchmarks; ++i)
+        printf("%s\n", s_benchmarks[i].m_name);
+}
@@ -0,0 +1,17 @@
+// modelerbench.h
+
+// Benchmarks for the modeler's hot paths.  Each benchmark prints one or
+// more result lines to stdout and is selected by name, so the same table
+// can be driven from a debugger, a menu or a batch job.
+
+#ifndef MODELERBENCH_H
+#define MODELERBENCH_H
+
+// Runs every benchmark whose name contains filter (NULL or "" runs all).
+// scale multiplies the default problem size.  Returns the number run.
+int runBenchmarks(const char *filter, int scale);
+
+// Prints the available benchmark names, one per line
+void listBenchmarks();
+
+#endif
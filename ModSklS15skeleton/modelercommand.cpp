@@ -0,0 +1,70 @@
+// modelercommand.cpp
+
+#include "modelercommand.h"
+#include "camera.h"
+
+bool applyCommand(const ModelerCommand &command, const CommandTarget &target)
+{
+    const double *v = command.m_value;
+
+    switch (command.m_type)
+    {
+    case CMD_SET_CONTROL:
+        if (!target.m_controls || command.m_index < 0 || command.m_index >= target.m_numControls)
+            return false;
+        target.m_controls[command.m_index] = v[0];
+        return true;
+
+    case CMD_SET_ANIMATING:
+        if (!target.m_animating)
+            return false;
+        *target.m_animating = command.m_index != 0;
+        return true;
+
+    case CMD_SET_DRAW_MODE:
+        if (!target.m_drawState)
+            return false;
+        target.m_drawState->m_drawMode = (DrawModeSetting_t)command.m_index;
+        return true;
+
+    case CMD_SET_QUALITY:
+        if (!target.m_drawState)
+            return false;
+        target.m_drawState->m_quality = (QualitySetting_t)command.m_index;
+        return true;
+
+    case CMD_CAMERA_CLICK:
+        if (!target.m_camera)
+            return false;
+        target.m_camera->clickMouse((MouseAction_t)command.m_index, (int)v[0], (int)v[1]);
+        return true;
+
+    case CMD_CAMERA_DRAG:
+        if (!target.m_camera)
+            return false;
+        target.m_camera->dragMouse((int)v[0], (int)v[1]);
+        return true;
+
+    case CMD_CAMERA_RELEASE:
+        if (!target.m_camera)
+            return false;
+        target.m_camera->releaseMouse((int)v[0], (int)v[1]);
+        return true;
+
+    case CMD_CAMERA_LOOK_AT:
+        if (!target.m_camera)
+            return false;
+        target.m_camera->setLookAt(Vec3f((float)v[0], (float)v[1], (float)v[2]));
+        return true;
+
+    case CMD_CAMERA_ORBIT:
+        if (!target.m_camera)
+            return false;
+        target.m_camera->setElevation((float)v[0]);
+        target.m_camera->setAzimuth((float)v[1]);
+        target.m_camera->setDolly((float)v[2]);
+        target.m_camera->setTwist((float)v[3]);
+        return true;
+    }
+    return false;
+}
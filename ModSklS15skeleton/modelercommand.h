@@ -0,0 +1,68 @@
+// modelercommand.h
+
+// Changes the UI asks for, as values that can be queued.
+//
+// Slider moves, draw mode and quality menu picks and camera drags don't
+// change the shared state themselves; they're posted to the view
+// (ModelerView::postCommand), which queues them for whichever thread owns
+// evaluation at the time.  That thread applies them all in one go before
+// its next pose, to its own copies of the state.
+
+#ifndef MODELERCOMMAND_H
+#define MODELERCOMMAND_H
+
+#include "modelerdraw.h"
+#include "spscqueue.h"
+
+class Camera;
+
+enum ModelerCommand_t
+{
+    CMD_SET_CONTROL,        // m_index = control, m_value[0] = value
+    CMD_SET_ANIMATING,      // m_index = 0 or 1
+    CMD_SET_DRAW_MODE,      // m_index = DrawModeSetting_t
+    CMD_SET_QUALITY,        // m_index = QualitySetting_t
+    CMD_CAMERA_CLICK,       // m_index = MouseAction_t, m_value = x, y
+    CMD_CAMERA_DRAG,        // m_value = x, y
+    CMD_CAMERA_RELEASE,     // m_value = x, y
+    CMD_CAMERA_LOOK_AT,     // m_value = x, y, z
+    CMD_CAMERA_ORBIT,       // m_value = elevation, azimuth, dolly, twist
+};
+
+struct ModelerCommand
+{
+    ModelerCommand() : m_type(CMD_SET_CONTROL), m_index(0) {}
+    ModelerCommand(ModelerCommand_t type, int index = 0,
+                   double x = 0, double y = 0, double z = 0, double w = 0)
+        : m_type(type), m_index(index)
+    {
+        m_value[0] = x;
+        m_value[1] = y;
+        m_value[2] = z;
+        m_value[3] = w;
+    }
+
+    ModelerCommand_t m_type;
+    int              m_index;
+    double           m_value[4];
+};
+
+// Enough for a burst of slider and mouse events between two poses; when
+// it fills up the view takes evaluation back and catches up itself
+typedef SpscQueue<ModelerCommand, 256> CommandQueue;
+
+// What a command thread's copy of the state is; any part may be NULL when
+// that thread has no copy of it
+struct CommandTarget
+{
+    double           *m_controls;
+    int               m_numControls;
+    bool             *m_animating;
+    ModelerDrawState *m_drawState;
+    Camera           *m_camera;
+};
+
+// Applies command to target, returning false if it touched nothing there
+bool applyCommand(const ModelerCommand &command, const CommandTarget &target);
+
+#endif
@@ -1,7 +1,12 @@
 #include "modelerdraw.h"
+#include "rayparser.h"
+#include "texturecache.h"
+#include "quat.h"
+#include "tessellation.h"
+#include "drawlist.h"
 #include <FL/gl.h>
-#include <GL/glu.h>
 #include <cstdio>
+#include <cstring>
 #include <math.h>
 
 // ********************************************************
@@ -19,8 +24,7 @@ void _dump_current_modelview( void )
     
     GLdouble mv[16];
     glGetDoublev( GL_MODELVIEW_MATRIX, mv );
-    fprintf( mds->m_rayFile, 
-        "transform(\n    (%f,%f,%f,%f),\n    (%f,%f,%f,%f),\n     (%f,%f,%f,%f),\n    (%f,%f,%f,%f),\n",
+    fprintf( mds->m_rayFile, RAY_FMT_TRANSFORM,
         mv[0], mv[4], mv[8], mv[12],
         mv[1], mv[5], mv[9], mv[13],
         mv[2], mv[6], mv[10], mv[14],
@@ -37,8 +41,7 @@ void _dump_current_material( void )
         exit(-1);
     }
     
-    fprintf( mds->m_rayFile, 
-        "material={\n    diffuse=(%f,%f,%f);\n    ambient=(%f,%f,%f);\n}\n",
+    fprintf( mds->m_rayFile, RAY_FMT_MATERIAL,
         mds->m_diffuseColor[0], mds->m_diffuseColor[1], mds->m_diffuseColor[2], 
         mds->m_diffuseColor[0], mds->m_diffuseColor[1], mds->m_diffuseColor[2]);
 }
@@ -59,17 +62,29 @@ ModelerDrawState::ModelerDrawState() : m_drawMode(NORMAL), m_quality(MEDIUM)
     memcpy(m_specularColor, white, 4 * sizeof(float));
     
     m_shininess = 0.5;
+    m_texture = 0;
     
     m_rayFile = NULL;
 }
 
+// Per-thread overrides of the singleton (see SetThreadState)
+static thread_local ModelerDrawState *s_threadState = NULL;
+
 // CLASS ModelerDrawState METHODS
 ModelerDrawState* ModelerDrawState::Instance()
 {
+    if (s_threadState)
+        return s_threadState;
+
     // Return the singleton if it exists, otherwise, create it
     return (m_instance) ? (m_instance) : m_instance = new ModelerDrawState();
 }
 
+void ModelerDrawState::SetThreadState(ModelerDrawState *state)
+{
+    s_threadState = state;
+}
+
 // ****************************************************************************
 // Modeler functions for your use
 // ****************************************************************************
@@ -78,6 +93,13 @@ ModelerDrawState* ModelerDrawState::Instance()
 void setAmbientColor(float r, float g, float b)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (DrawList *list = DrawList::current())
+    {
+        float *c = list->material().m_ambient;
+        c[0] = r; c[1] = g; c[2] = b;
+        return;
+    }
     
     mds->m_ambientColor[0] = (GLfloat)r;
     mds->m_ambientColor[1] = (GLfloat)g;
@@ -91,6 +113,13 @@ void setAmbientColor(float r, float g, float b)
 void setDiffuseColor(float r, float g, float b)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (DrawList *list = DrawList::current())
+    {
+        float *c = list->material().m_diffuse;
+        c[0] = r; c[1] = g; c[2] = b;
+        return;
+    }
     
     mds->m_diffuseColor[0] = (GLfloat)r;
     mds->m_diffuseColor[1] = (GLfloat)g;
@@ -106,6 +135,13 @@ void setDiffuseColor(float r, float g, float b)
 void setSpecularColor(float r, float g, float b)
 {	
     ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (DrawList *list = DrawList::current())
+    {
+        float *c = list->material().m_specular;
+        c[0] = r; c[1] = g; c[2] = b;
+        return;
+    }
     
     mds->m_specularColor[0] = (GLfloat)r;
     mds->m_specularColor[1] = (GLfloat)g;
@@ -119,6 +155,12 @@ void setSpecularColor(float r, float g, float b)
 void setShininess(float s)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (DrawList *list = DrawList::current())
+    {
+        list->material().m_shininess = s;
+        return;
+    }
     
     mds->m_shininess = (GLfloat)s;
     
@@ -136,6 +178,18 @@ void setQuality(QualitySetting_t quality)
     ModelerDrawState::Instance()->m_quality = quality;
 }
 
+void setTexture(const char bmpFileName[])
+{
+    if (DrawList *list = DrawList::current())
+    {
+        list->setTexture(bmpFileName);
+        return;
+    }
+
+    ModelerDrawState::Instance()->m_texture =
+        bmpFileName ? TextureCache::Instance()->get(bmpFileName) : 0;
+}
+
 bool openRayFile(const char rayFileName[])
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
@@ -152,10 +206,9 @@ bool openRayFile(const char rayFileName[])
     
     if (mds->m_rayFile != NULL) 
     {
-        fprintf( mds->m_rayFile, "SBT-raytracer 1.0\n\n" );
-        fprintf( mds->m_rayFile, "camera { fov=30; position=(0,0.8,5); direction=(0,-0.8,-5); }\n\n" );
-        fprintf( mds->m_rayFile, 
-            "directional_light { direction=(-1,-2,-1); color=(0.7,0.7,0.7); }\n\n" );
+        fputs( RAY_FMT_HEADER, mds->m_rayFile );
+        fputs( RAY_FMT_CAMERA, mds->m_rayFile );
+        fputs( RAY_FMT_LIGHT, mds->m_rayFile );
         return true;
     }
     else
@@ -184,6 +237,83 @@ void _setupOpenGl()
 
 }
 
+void rotateEuler(double x, double y, double z)
+{
+    Quatd q = Quatd::rotation(z, 0, 0, 1) * Quatd::rotation(x, 1, 0, 0) *
+              Quatd::rotation(y, 0, 1, 0);
+    if (DrawList *list = DrawList::current())
+    {
+        list->transforms().rotate(Quatf((float)q[0], (float)q[1], (float)q[2], (float)q[3]));
+        return;
+    }
+
+    GLdouble m[16];
+    q.toMat4().getGLMatrix(m);
+    glMultMatrixd(m);
+}
+
+void pushMatrix()
+{
+    if (DrawList *list = DrawList::current())
+        list->transforms().push();
+    else
+        glPushMatrix();
+}
+
+void popMatrix()
+{
+    if (DrawList *list = DrawList::current())
+        list->transforms().pop();
+    else
+        glPopMatrix();
+}
+
+void translate(double x, double y, double z)
+{
+    if (DrawList *list = DrawList::current())
+        list->transforms().translate((float)x, (float)y, (float)z);
+    else
+        glTranslated(x, y, z);
+}
+
+void rotate(double degrees, double x, double y, double z)
+{
+    if (DrawList *list = DrawList::current())
+        list->transforms().rotate((float)degrees, (float)x, (float)y, (float)z);
+    else
+        glRotated(degrees, x, y, z);
+}
+
+void scale(double x, double y, double z)
+{
+    if (DrawList *list = DrawList::current())
+        list->transforms().scale((float)x, (float)y, (float)z);
+    else
+        glScaled(x, y, z);
+}
+
+// Binds the current texture for a GL primitive; returns whether it did
+static bool _beginTexture()
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+    if (mds->m_texture == 0 || mds->m_drawMode == WIREFRAME)
+        return false;
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, mds->m_texture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    return true;
+}
+
+static void _endTexture(bool textured)
+{
+    if (textured)
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDisable(GL_TEXTURE_2D);
+    }
+}
+
 void closeRayFile()
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
@@ -198,42 +328,43 @@ void drawSphere(double r)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
 
+    if (DrawList *list = DrawList::current())
+    {
+        list->add(DRAW_SPHERE, &r, 1);
+        return;
+    }
+
 	_setupOpenGl();
     
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile, "scale(%f,%f,%f,sphere {\n", r, r, r );
+        fprintf(mds->m_rayFile, RAY_FMT_SPHERE, r, r, r );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "}))\n" );
+        fputs(RAY_FMT_CLOSE_SPHERE, mds->m_rayFile );
     }
     else
     {
-        int divisions; 
-        GLUquadricObj* gluq;
-        
-        switch(mds->m_quality)
-        {
-        case HIGH: 
-            divisions = 32; break;
-        case MEDIUM: 
-            divisions = 20; break;
-        case LOW:
-            divisions = 12; break;
-        case POOR:
-            divisions = 8; break;
-        }
-        
-        gluq = gluNewQuadric();
-        gluQuadricDrawStyle( gluq, GLU_FILL );
-        gluQuadricTexture( gluq, GL_TRUE );
-        gluSphere(gluq, r, divisions, divisions);
-        gluDeleteQuadric( gluq );
+        // The unit sphere from the tables, scaled; GL_NORMALIZE fixes up
+        // the normals
+        const SphereTable &sphere = unitSphere( mds->m_quality );
+        bool textured = _beginTexture();
+
+        glPushMatrix();
+        glScaled( r, r, r );
+        glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+        glInterleavedArrays( GL_T2F_N3F_V3F, 0, sphere.vertices );
+        glDrawElements( GL_TRIANGLES, sphere.indexCount, GL_UNSIGNED_SHORT, sphere.indices );
+        glPopClientAttrib();
+        glPopMatrix();
+
+        _endTexture( textured );
     }
 }
 
 
-void drawBox( double x, double y, double z )
+// Unit cube faces scaled to x,y,z; texture coordinates span each face
+static void _draw_box( double x, double y, double z, bool texCoords )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
 
@@ -242,13 +373,26 @@ void drawBox( double x, double y, double z )
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile,  
-            "scale(%f,%f,%f,translate(0.5,0.5,0.5,box {\n", x, y, z );
+        fprintf(mds->m_rayFile, RAY_FMT_BOX, x, y, z );
         _dump_current_material();
-        fprintf(mds->m_rayFile,  "})))\n" );
+        fputs(RAY_FMT_CLOSE_BOX, mds->m_rayFile );
     }
     else
     {
+        static const GLdouble normals[6][3] = {
+            { 0.0, 0.0, -1.0 }, { 0.0, -1.0, 0.0 }, { -1.0, 0.0, 0.0 },
+            { 0.0, 0.0, 1.0 },  { 0.0, 1.0, 0.0 },  { 1.0, 0.0, 0.0 } };
+        static const GLdouble corners[6][4][3] = {
+            { { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } },
+            { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 } },
+            { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 } },
+            { { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } },
+            { { 0, 1, 0 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 1, 0 } },
+            { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 1, 0, 1 } } };
+        static const GLdouble texCoord[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+        bool textured = texCoords && _beginTexture();
+
         /* remember which matrix mode OpenGL was in. */
         int savemode;
         glGetIntegerv( GL_MATRIX_MODE, &savemode );
@@ -259,122 +403,132 @@ void drawBox( double x, double y, double z )
         glScaled( x, y, z );
         
         glBegin( GL_QUADS );
-        
-        glNormal3d( 0.0, 0.0, -1.0 );
-        glVertex3d( 0.0, 0.0, 0.0 ); glVertex3d( 0.0, 1.0, 0.0 );
-        glVertex3d( 1.0, 1.0, 0.0 ); glVertex3d( 1.0, 0.0, 0.0 );
-        
-        glNormal3d( 0.0, -1.0, 0.0 );
-        glVertex3d( 0.0, 0.0, 0.0 ); glVertex3d( 1.0, 0.0, 0.0 );
-        glVertex3d( 1.0, 0.0, 1.0 ); glVertex3d( 0.0, 0.0, 1.0 );
-        
-        glNormal3d( -1.0, 0.0, 0.0 );
-        glVertex3d( 0.0, 0.0, 0.0 ); glVertex3d( 0.0, 0.0, 1.0 );
-        glVertex3d( 0.0, 1.0, 1.0 ); glVertex3d( 0.0, 1.0, 0.0 );
-        
-        glNormal3d( 0.0, 0.0, 1.0 );
-        glVertex3d( 0.0, 0.0, 1.0 ); glVertex3d( 1.0, 0.0, 1.0 );
-        glVertex3d( 1.0, 1.0, 1.0 ); glVertex3d( 0.0, 1.0, 1.0 );
-        
-        glNormal3d( 0.0, 1.0, 0.0 );
-        glVertex3d( 0.0, 1.0, 0.0 ); glVertex3d( 0.0, 1.0, 1.0 );
-        glVertex3d( 1.0, 1.0, 1.0 ); glVertex3d( 1.0, 1.0, 0.0 );
-        
-        glNormal3d( 1.0, 0.0, 0.0 );
-        glVertex3d( 1.0, 0.0, 0.0 ); glVertex3d( 1.0, 1.0, 0.0 );
-        glVertex3d( 1.0, 1.0, 1.0 ); glVertex3d( 1.0, 0.0, 1.0 );
-        
+        for ( int f = 0; f < 6; ++f )
+        {
+            glNormal3dv( normals[f] );
+            for ( int v = 0; v < 4; ++v )
+            {
+                if ( textured )
+                    glTexCoord2dv( texCoord[v] );
+                glVertex3dv( corners[f][v] );
+            }
+        }
         glEnd();
         
         /* restore the model matrix stack, and switch back to the matrix
         mode we were in. */
         glPopMatrix();
         glMatrixMode( savemode );
+
+        _endTexture( textured );
+    }
+}
+
+void drawBox( double x, double y, double z )
+{
+    if (DrawList *list = DrawList::current())
+    {
+        double p[3] = { x, y, z };
+        list->add(DRAW_BOX, p, 3);
+        return;
     }
+
+    _draw_box( x, y, z, false );
 }
 
 void drawTextureBox( double x, double y, double z )
 {
-    // NOT IMPLEMENTED, SORRY (ehsu)
+    if (DrawList *list = DrawList::current())
+    {
+        double p[3] = { x, y, z };
+        list->add(DRAW_TEXTURE_BOX, p, 3);
+        return;
+    }
+
+    _draw_box( x, y, z, true );
+}
+
+// A flat disk of radius r at height z, facing +z if up, -z if not; texture
+// coordinates as gluDisk gives them
+static void _draw_disk( const CircleTable &circle, double r, double z, bool up )
+{
+    int n = circle.divisions;
+
+    glBegin( GL_TRIANGLE_FAN );
+    glNormal3d( 0.0, 0.0, up ? 1.0 : -1.0 );
+    glTexCoord2d( 0.5, 0.5 );
+    glVertex3d( 0.0, 0.0, z );
+    for ( int i = 0; i <= n; ++i )
+    {
+        // slices run clockwise seen from +z, so go backwards to face up
+        int k = 2 * ( up ? n - i : i );
+        double x = circle.sines[k], y = circle.cosines[k];
+        glTexCoord2d( 0.5 + 0.5 * x, 0.5 + 0.5 * y );
+        glVertex3d( r * x, r * y, z );
+    }
+    glEnd();
 }
 
 void drawCylinder( double h, double r1, double r2 )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
-    int divisions;
 
-	_setupOpenGl();
-    
-    switch(mds->m_quality)
+    if (DrawList *list = DrawList::current())
     {
-    case HIGH: 
-        divisions = 32; break;
-    case MEDIUM: 
-        divisions = 20; break;
-    case LOW:
-        divisions = 12; break;
-    case POOR:
-        divisions = 8; break;
+        double p[3] = { h, r1, r2 };
+        list->add(DRAW_CYLINDER, p, 3);
+        return;
     }
+
+	_setupOpenGl();
     
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile, 
-            "cone { height=%f; bottom_radius=%f; top_radius=%f;\n", h, r1, r2 );
+        fprintf(mds->m_rayFile, RAY_FMT_CONE, h, r1, r2 );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "})\n" );
+        fputs(RAY_FMT_CLOSE_CONE, mds->m_rayFile );
     }
     else
     {
-        GLUquadricObj* gluq;
-        
-        /* GLU will again do the work.  draw the sides of the cylinder. */
-        gluq = gluNewQuadric();
-        gluQuadricDrawStyle( gluq, GLU_FILL );
-        gluQuadricTexture( gluq, GL_TRUE );
-        gluCylinder( gluq, r1, r2, h, divisions, divisions);
-        gluDeleteQuadric( gluq );
-        
-        if ( r1 > 0.0 )
+        // Cut as gluCylinder(r1, r2, h, divisions, divisions) cuts it, with
+        // the slice angles from the tables: slice i is at index 2i
+        const CircleTable &circle = unitCircle( mds->m_quality );
+        int n = circle.divisions;
+        bool textured = _beginTexture();
+
+        /* the sides all lean by the same amount. */
+        double length = sqrt( ( r1 - r2 ) * ( r1 - r2 ) + h * h );
+        double xyNormal = length > 0.0 ? h / length : 1.0;
+        double zNormal  = length > 0.0 ? ( r1 - r2 ) / length : 0.0;
+
+        for ( int j = 0; j < n; ++j )
         {
-        /* if the r1 end does not come to a point, draw a flat disk to
-            cover it up. */
-            
-            gluq = gluNewQuadric();
-            gluQuadricDrawStyle( gluq, GLU_FILL );
-            gluQuadricTexture( gluq, GL_TRUE );
-            gluQuadricOrientation( gluq, GLU_INSIDE );
-            gluDisk( gluq, 0.0, r1, divisions, divisions);
-            gluDeleteQuadric( gluq );
+            double zLow  = h * j / n, zHigh = h * ( j + 1 ) / n;
+            double rLow  = r1 + ( r2 - r1 ) * j / n;
+            double rHigh = r1 + ( r2 - r1 ) * ( j + 1 ) / n;
+
+            glBegin( GL_QUAD_STRIP );
+            for ( int i = 0; i <= n; ++i )
+            {
+                double x = circle.sines[2 * i], y = circle.cosines[2 * i];
+                double s = 1.0 - (double)i / n;
+                glNormal3d( x * xyNormal, y * xyNormal, zNormal );
+                glTexCoord2d( s, (double)j / n );
+                glVertex3d( rLow * x, rLow * y, zLow );
+                glTexCoord2d( s, (double)( j + 1 ) / n );
+                glVertex3d( rHigh * x, rHigh * y, zHigh );
+            }
+            glEnd();
         }
-        
+
+        /* if an end does not come to a point, cover it with a flat disk. */
+        if ( r1 > 0.0 )
+            _draw_disk( circle, r1, 0.0, false );
         if ( r2 > 0.0 )
-        {
-        /* if the r2 end does not come to a point, draw a flat disk to
-            cover it up. */
-            
-            /* save the current matrix mode. */	
-            int savemode;
-            glGetIntegerv( GL_MATRIX_MODE, &savemode );
-            
-            /* translate the origin to the other end of the cylinder. */
-            glMatrixMode( GL_MODELVIEW );
-            glPushMatrix();
-            glTranslated( 0.0, 0.0, h );
-            
-            /* draw a disk centered at the new origin. */
-            gluq = gluNewQuadric();
-            gluQuadricDrawStyle( gluq, GLU_FILL );
-            gluQuadricTexture( gluq, GL_TRUE );
-            gluQuadricOrientation( gluq, GLU_OUTSIDE );
-            gluDisk( gluq, 0.0, r2, divisions, divisions);
-            gluDeleteQuadric( gluq );
-            
-            /* restore the matrix stack and mode. */
-            glPopMatrix();
-            glMatrixMode( savemode );
-        }
+            _draw_disk( circle, r2, h, true );
+
+        _endTexture( textured );
     }
     
 }
@@ -384,15 +538,21 @@ void drawTriangle( double x1, double y1, double z1,
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
 
+    if (DrawList *list = DrawList::current())
+    {
+        double p[9] = { x1, y1, z1, x2, y2, z2, x3, y3, z3 };
+        list->add(DRAW_TRIANGLE, p, 9);
+        return;
+    }
+
 	_setupOpenGl();
 
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile, 
-            "polymesh { points=((%f,%f,%f),(%f,%f,%f),(%f,%f,%f)); faces=((0,1,2));\n", x1, y1, z1, x2, y2, z2, x3, y3, z3 );
+        fprintf(mds->m_rayFile, RAY_FMT_TRIANGLE, x1, y1, z1, x2, y2, z2, x3, y3, z3 );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "})\n" );
+        fputs(RAY_FMT_CLOSE_MESH, mds->m_rayFile );
     }
     else
     {
@@ -416,6 +576,254 @@ void drawTriangle( double x1, double y1, double z1,
     }
 }
 
+// ****************************************************************************
+// Triangle meshes
+// ****************************************************************************
+
+bool TriangleMesh::stale(const double params[], int count)
+{
+    if (m_built && (int)m_params.size() == count &&
+        (count == 0 || memcmp(&m_params[0], params, count * sizeof(double)) == 0))
+        return false;
+
+    m_params.assign(params, params + count);
+    m_built = true;
+    return true;
+}
+
+void TriangleMesh::clear()
+{
+    m_points.clear();
+    m_faces.clear();
+    m_glVertices.reset(new std::vector<GLfloat>);
+}
+
+int TriangleMesh::addVertex(double x, double y, double z)
+{
+    m_points.push_back(x);
+    m_points.push_back(y);
+    m_points.push_back(z);
+    return vertexCount() - 1;
+}
+
+void TriangleMesh::addTriangle(int a, int b, int c)
+{
+    m_faces.push_back(a);
+    m_faces.push_back(b);
+    m_faces.push_back(c);
+
+    // the same face normal drawTriangle works out
+    const double *p1 = &m_points[a * 3], *p2 = &m_points[b * 3], *p3 = &m_points[c * 3];
+    double ux = p2[0] - p1[0], uy = p2[1] - p1[1], uz = p2[2] - p1[2];
+    double vx = p3[0] - p1[0], vy = p3[1] - p1[1], vz = p3[2] - p1[2];
+    GLfloat n[3] = { (GLfloat)(uy * vz - uz * vy), (GLfloat)(uz * vx - ux * vz),
+                     (GLfloat)(ux * vy - uy * vx) };
+
+    const double *corners[3] = { p1, p2, p3 };
+    for (int i = 0; i < 3; ++i)
+    {
+        m_glVertices->insert(m_glVertices->end(), n, n + 3);
+        for (int j = 0; j < 3; ++j)
+            m_glVertices->push_back((GLfloat)corners[i][j]);
+    }
+}
+
+void drawTriangleMesh( const TriangleMesh &mesh )
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (mesh.triangleCount() == 0)
+        return;
+
+    if (DrawList *list = DrawList::current())
+    {
+        list->add(DRAW_MESH, NULL, 0, &mesh);
+        return;
+    }
+
+	_setupOpenGl();
+
+    if (mds->m_rayFile)
+    {
+        const std::vector<double> &p = mesh.points();
+        const std::vector<int> &f = mesh.faces();
+
+        _dump_current_modelview();
+        fputs( "polymesh { points=(", mds->m_rayFile );
+        for (size_t i = 0; i < p.size(); i += 3)
+            fprintf( mds->m_rayFile, "%s(%f,%f,%f)", i ? "," : "", p[i], p[i+1], p[i+2] );
+        fputs( "); faces=(", mds->m_rayFile );
+        for (size_t i = 0; i < f.size(); i += 3)
+            fprintf( mds->m_rayFile, "%s(%d,%d,%d)", i ? "," : "", f[i], f[i+1], f[i+2] );
+        fputs( ");\n", mds->m_rayFile );
+        _dump_current_material();
+        fputs( RAY_FMT_CLOSE_MESH, mds->m_rayFile );
+    }
+    else
+        drawTriangleArray( mesh.glVertices() );
+}
+
+void drawTriangleArray( const std::vector<GLfloat> &vertices )
+{
+    if (vertices.empty())
+        return;
+
+    _setupOpenGl();
+
+    glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+    glInterleavedArrays( GL_N3F_V3F, 0, &vertices[0] );
+    glDrawArrays( GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 6) );
+    glPopClientAttrib();
+}
+
+// ****************************************************************************
+// Instanced geometry
+// ****************************************************************************
+
+InstancedGeometry::~InstancedGeometry()
+{
+    if (m_list)
+        glDeleteLists(m_list, 1);
+}
+
+void InstancedGeometry::addInstance()
+{
+    if (DrawList *list = DrawList::current())
+    {
+        list->addInstance(this);
+        return;
+    }
+
+    Instance instance;
+    glGetDoublev(GL_MODELVIEW_MATRIX, instance.m_matrix);
+    instance.m_hasColor = false;
+    m_instances.push_back(instance);
+}
+
+void InstancedGeometry::addInstance(float r, float g, float b)
+{
+    GLfloat color[3] = { r, g, b };
+    if (DrawList *list = DrawList::current())
+    {
+        list->addInstance(this, color);
+        return;
+    }
+
+    addInstance();
+    Instance &instance = m_instances.back();
+    instance.m_hasColor = true;
+    memcpy(instance.m_color, color, sizeof(color));
+}
+
+void InstancedGeometry::draw(const double params[], int count, DrawFunc drawOne, void *context)
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    std::vector<double> key( params, params + count );
+    key.push_back( mds->m_drawMode );
+    key.push_back( mds->m_quality );
+
+    // Recording: the instances were queued on the list; drawOne is recorded
+    // once (again only when the key changes) and each copy refers to that
+    if (DrawList *list = DrawList::current())
+    {
+        std::vector<DrawInstance> instances;
+        list->takeInstances(this, instances);
+        if (instances.empty())
+            return;
+
+        std::shared_ptr<const DrawFragment> shape;
+        {
+            std::lock_guard<std::mutex> lock(m_shapeLock);
+            if (m_shape && key == m_shapeParams)
+                shape = m_shape;
+        }
+        if (!shape)
+        {
+            shape = list->recordShape(drawOne, context);
+            std::lock_guard<std::mutex> lock(m_shapeLock);
+            m_shape = shape;
+            m_shapeParams = key;
+        }
+        list->addInstances(this, shape, instances);
+        return;
+    }
+
+    if (m_instances.empty())
+        return;
+
+    glMatrixMode( GL_MODELVIEW );
+    glPushMatrix();
+
+    if (mds->m_rayFile)
+    {
+        // nothing to share in a .ray file: write every copy
+        for (size_t i = 0; i < m_instances.size(); ++i)
+        {
+            const Instance &instance = m_instances[i];
+            glLoadMatrixd( instance.m_matrix );
+            if (instance.m_hasColor)
+                setDiffuseColor( instance.m_color[0], instance.m_color[1], instance.m_color[2] );
+            drawOne( context );
+        }
+    }
+    else
+    {
+        // The list bakes in the draw state as well as the geometry
+        key.push_back( mds->m_texture );
+
+        if (!m_built || m_listShape || key != m_params)
+        {
+            if (!m_list)
+                m_list = glGenLists( 1 );
+            glNewList( m_list, GL_COMPILE );
+            drawOne( context );
+            glEndList();
+
+            m_params = key;
+            m_listShape.reset();
+            m_built = true;
+        }
+
+        for (size_t i = 0; i < m_instances.size(); ++i)
+        {
+            const Instance &instance = m_instances[i];
+            glLoadMatrixd( instance.m_matrix );
+            if (instance.m_hasColor)
+                setDiffuseColor( instance.m_color[0], instance.m_color[1], instance.m_color[2] );
+            glCallList( m_list );
+        }
+    }
+
+    glPopMatrix();
+    m_instances.clear();
+}
+
+void InstancedGeometry::callShape(const std::shared_ptr<const DrawFragment> &shape)
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    std::vector<double> key;
+    key.push_back( mds->m_drawMode );
+    key.push_back( mds->m_quality );
+    key.push_back( mds->m_texture );
+
+    if (!m_built || shape != m_listShape || key != m_params)
+    {
+        if (!m_list)
+            m_list = glGenLists( 1 );
+        glNewList( m_list, GL_COMPILE );
+        DrawList::replayShape( *shape );
+        glEndList();
+
+        m_params = key;
+        m_listShape = shape;
+        m_built = true;
+    }
+
+    glCallList( m_list );
+}
+
 
 
 
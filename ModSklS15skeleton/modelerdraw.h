@@ -7,6 +7,9 @@
 
 #include <FL/gl.h>
 #include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "modelerglobals.h"
 
@@ -25,6 +28,12 @@ public:
 
 	static ModelerDrawState* Instance();
 
+	// Gives the calling thread its own draw state: until it's set back to
+	// NULL, Instance() on that thread returns state instead of the shared
+	// one.  Copies of the shared state are made for this.
+	static void SetThreadState(ModelerDrawState *state);
+	ModelerDrawState(const ModelerDrawState &) = default;
+
 	FILE* m_rayFile;
 
 	DrawModeSetting_t m_drawMode;
@@ -35,9 +44,11 @@ public:
 	GLfloat m_specularColor[4];
 	GLfloat m_shininess;
 
+	// Current texture from setTexture(), 0 for none
+	GLuint m_texture;
+
 private:
 	ModelerDrawState();
-	ModelerDrawState(const ModelerDrawState &) {}
 	ModelerDrawState& operator=(const ModelerDrawState&) {}
 
 	static ModelerDrawState *m_instance;
@@ -68,6 +79,25 @@ void setDrawMode(DrawModeSetting_t drawMode);
 // Set the current quality mode (See QualityModeSetting_t for valid values
 void setQuality(QualitySetting_t quality);
 
+// Set the texture for drawTextureBox, drawSphere and drawCylinder from a
+// BMP file; NULL turns texturing off.  Each file is loaded only once, so
+// this is cheap to call every frame.
+void setTexture(const char bmpFileName[]);
+
+// Same as glRotated(z,0,0,1); glRotated(x,1,0,0); glRotated(y,0,1,0), but
+// composed as quaternions and applied as one matrix
+void rotateEuler(double x, double y, double z);
+
+// The same as glPushMatrix, glPopMatrix, glTranslated, glRotated and
+// glScaled, except that while a DrawList is recording on the calling thread
+// they work on its matrix stack instead (see drawlist.h).  Model code that
+// uses these can be drawn off the GL thread.
+void pushMatrix();
+void popMatrix();
+void translate(double x, double y, double z);
+void rotate(double degrees, double x, double y, double z);
+void scale(double x, double y, double z);
+
 // Opens a .ray file for writing, returns false on error
 bool openRayFile(const char rayFileName[]);
 // Closes the current .ray file if one exists
@@ -83,7 +113,8 @@ void drawSphere(double r);
 // Draw an axis-aligned box from origin to (x,y,z)
 void drawBox( double x, double y, double z );
 
-// Draw an axis-aligned texture box from origin to (x,y,z)
+// Draw an axis-aligned texture box from origin to (x,y,z), with the
+// current texture stretched over each face
 void drawTextureBox( double x, double y, double z );
 
 // Draw a cylinder from z=0 to z=h with radius r1 at origin and r2 at z=h
@@ -94,4 +125,113 @@ void drawTriangle( double x1, double y1, double z1,
 			       double x2, double y2, double z2,
 			       double x3, double y3, double z3 );
 
+// A fixed piece of triangle geometry, built once and drawn many times.
+// Triangles share their vertices, but each is flat shaded as drawTriangle
+// would shade it.
+class TriangleMesh
+{
+public:
+    TriangleMesh() : m_built(false), m_glVertices(new std::vector<GLfloat>) {}
+
+    // True if the mesh has to be (re)built because it wasn't last built from
+    // exactly these inputs; they're remembered for next time.  The caller
+    // then clear()s and refills it.
+    bool stale(const double params[], int count);
+
+    void clear();
+
+    // Returns the new vertex's index
+    int addVertex(double x, double y, double z);
+    // Vertex indices, counterclockwise as for drawTriangle
+    void addTriangle(int a, int b, int c);
+
+    int vertexCount() const   { return (int)m_points.size() / 3; }
+    int triangleCount() const { return (int)m_faces.size() / 3; }
+
+    const std::vector<double> &points() const { return m_points; }
+    const std::vector<int> &faces() const     { return m_faces; }
+
+    // Three vertices per triangle as nx, ny, nz, x, y, z (GL_N3F_V3F).
+    // clear() starts a new array rather than emptying this one, so a
+    // DrawList holding on to it can still replay it on another thread.
+    const std::vector<GLfloat> &glVertices() const { return *m_glVertices; }
+    std::shared_ptr<const std::vector<GLfloat> > sharedGLVertices() const { return m_glVertices; }
+
+private:
+    bool                 m_built;
+    std::vector<double>  m_params;
+    std::vector<double>  m_points;
+    std::vector<int>     m_faces;
+    std::shared_ptr<std::vector<GLfloat> > m_glVertices;
+};
+
+// Draw a mesh with one vertex array call, or write it to the .ray file as
+// a single polymesh
+void drawTriangleMesh( const TriangleMesh &mesh );
+// The GL half of drawTriangleMesh, for arrays laid out as glVertices()
+void drawTriangleArray( const std::vector<GLfloat> &vertices );
+
+struct DrawFragment;
+
+// A sub-assembly drawn several times a frame, the copies differing only in
+// where they are (and optionally their color).  Its draw calls are compiled
+// once into a GL display list and replayed for every instance, instead of
+// being issued primitive by primitive for each copy:
+//
+//     ears.addInstance();                         // at the current transform
+//     ...
+//     ears.draw(params, count, drawEar, model);   // every copy added so far
+//
+// Under a DrawList, drawOne is recorded once into a shape every copy's item
+// shares, and the display list is built from that shape when the list is
+// replayed.  The .ray format has nothing to share geometry between objects
+// with, so a .ray file gets each copy written out in full.
+class InstancedGeometry
+{
+public:
+    typedef void (*DrawFunc)(void *context);
+
+    InstancedGeometry() : m_built(false), m_list(0) {}
+    ~InstancedGeometry();
+
+    // Queues a copy at the current modelview matrix
+    void addInstance();
+    // Same, drawn in the given diffuse color; only useful for geometry that
+    // doesn't set colors of its own
+    void addInstance(float r, float g, float b);
+
+    int instanceCount() const { return (int)m_instances.size(); }
+
+    // Draws the queued copies and clears the queue.  drawOne draws a single
+    // copy at the origin; it's only called again when params (or the draw
+    // mode, quality or texture) differ from last time.
+    void draw(const double params[], int count, DrawFunc drawOne, void *context);
+
+    // For DrawList::replay: draws a shape recorded by draw() through the
+    // display list, building it again if it holds something else
+    void callShape(const std::shared_ptr<const DrawFragment> &shape);
+
+private:
+    struct Instance
+    {
+        GLdouble m_matrix[16];
+        bool     m_hasColor;
+        GLfloat  m_color[3];
+    };
+
+    bool                  m_built;
+    std::vector<double>   m_params;
+    GLuint                m_list;
+    std::vector<Instance> m_instances;
+
+    // The shape m_list was built from, if it was
+    std::shared_ptr<const DrawFragment> m_listShape;
+
+    // The shape last recorded, and the params it was recorded for; lists
+    // record on any thread
+    std::mutex                          m_shapeLock;
+    std::vector<double>                 m_shapeParams;
+    std::shared_ptr<const DrawFragment> m_shape;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+// modelermain.cpp
+
+// The program's entry point.  Each model lists itself with a ModelerModel,
+// and the command line picks which to run and how (see modelerbatch.h).
+
+#include "modelerapp.h"
+
+int main(int argc, char **argv)
+{
+	return ModelerApplication::Main(argc, argv);
+}
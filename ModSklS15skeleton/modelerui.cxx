@@ -1,24 +1,6 @@
 // generated by Fast Light User Interface Designer (fluid) version 1.00
-#pragma warning( disable : 4786 )
 
 #include "modelerui.h"
-#include "modelerapp.h"
-
-#include "camera.h"
-
-#if _MSC_VER >= 1300
-
-#include <iostream>
-
-#else //  _MSC_VER >= 1300
-
-#include <iostream.h>
-
-#endif // _MSC_VER >= 1300
-
-#include <string>
-#include <fstream>
-using namespace std;
 
 inline void ModelerUserInterface::cb_m_controlsWindow_i(Fl_Window*, void*) {
   0;;
@@ -28,154 +10,71 @@ void ModelerUserInterface::cb_m_controlsWindow(Fl_Window* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_Save_i(Fl_Menu_*, void*) {
-  char *filename = NULL;
-filename = fl_file_chooser("Save RAY File", "*.ray", NULL);
-if (filename)
-{
-	if (openRayFile(filename) == false)
-		fl_alert("Error opening file.");
-	else
-	{
-		m_modelerView->draw();
-		closeRayFile();
-	}
-};
+  saveRayFile();
 }
 void ModelerUserInterface::cb_Save(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Save_i(o,v);
 }
 
 inline void ModelerUserInterface::cb_Save1_i(Fl_Menu_*, void*) {
-  char *filename = NULL;
-filename = fl_file_chooser("Save BMP File", "*.bmp", NULL);
-if (filename)
-{
-	int x = m_modelerView->x();
-	int y = m_modelerView->y();
-	int w = m_modelerView->w();
-	int h = m_modelerView->h();
-
-	m_modelerWindow->show();
-//	do {Sleep(10); }
-//	while (!m_modelerWindow->shown());
-//	m_modelerView->draw();
-	m_modelerView->make_current();
-m_modelerView->draw();
-	
-		
-	unsigned char *imageBuffer = new unsigned char[3*w*h];
-
-        // Tell openGL to read from the front buffer when capturing
-        // out paint strokes
-        glReadBuffer(GL_BACK);
-
-        glPixelStorei( GL_PACK_ALIGNMENT, 1 );
-        glPixelStorei( GL_PACK_ROW_LENGTH, w );
-        
-        glReadPixels( 0, 0, w, h, 
-                GL_RGB, GL_UNSIGNED_BYTE, 
-                imageBuffer );
-
-
-	writeBMP(filename, w,h, imageBuffer);
-
-	delete [] imageBuffer;
-};
+  saveImageFile();
 }
 void ModelerUserInterface::cb_Save1(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Save1_i(o,v);
 }
 
-// IANLI
-// Implementation callback for saving the positions of the model into a file
-// The first line of the file contains the values for the position/orientation of
-// the camera. The values are ordered as the following:
-//		elevation azimuth dolly twist lookAtX lookAtY lookAtZ
-// The lines after correspond to the values of the controls. The following lines 
-// have this format:
-//		controlNumber controlValue
-inline void ModelerUserInterface::cb_SavePos_i(Fl_Menu_*, void*) {
-	char *filename = NULL;
-	filename = fl_file_chooser("Save .pos File", "*.pos", NULL);
-
-	if (filename)
-	{
-		FILE* m_posFile = fopen(filename, "w");
-
-		float elevation, azimuth, dolly, twist;
-		Vec3f lookAt;
-		elevation = m_modelerView->m_camera->getElevation();
-		dolly = m_modelerView->m_camera->getDolly();
-		azimuth = m_modelerView->m_camera->getAzimuth();
-		twist = m_modelerView->m_camera->getTwist();
-		lookAt = m_modelerView->m_camera->getLookAt();
-
-		fprintf(m_posFile, "%f %f %f %f %f %f %f\n", elevation, azimuth, dolly, twist, lookAt[0], lookAt[1], lookAt[2]);
-
-		double value;
-		for(int i = 0; i < NUMCONTROLS; i++)
-		{
-			value = ModelerApplication::Instance()->GetControlValue(i);
-
-			fprintf(m_posFile, "%d %f\n", i, value);
-		}
-
-		fclose(m_posFile);
-	};
-}
-void ModelerUserInterface::cb_SavePos(Fl_Menu_* o, void* v) {
-	((ModelerUserInterface*)(o->parent()->user_data()))->cb_SavePos_i(o,v);
-}
-
-inline void ModelerUserInterface::cb_OpenPos_i(Fl_Menu_*, void*) {
-	char *filename = NULL;
-	filename = fl_file_chooser("Open .pos File", "*.pos", NULL);
-
-	if (filename)
-	{
-		ifstream ifs( filename );
-		if( !ifs ) {
-			cerr << "Error: couldn't read position file " << filename << endl;
-			return;
-		}
-
-		float elevation, azimuth, dolly, twist, x, y, z;
-		ifs >> elevation >> azimuth >> dolly >> twist >> x >> y >> z;
-		
-		m_modelerView->m_camera->setElevation( elevation);
-		m_modelerView->m_camera->setAzimuth( azimuth );
-		m_modelerView->m_camera->setDolly( dolly );
-		m_modelerView->m_camera->setTwist( twist );
-		m_modelerView->m_camera->setLookAt( Vec3f(x, y, z) );
-		
-		int controlNum; 
-		float value;
-		while( ifs >> controlNum >> value )
-		{
-			if( controlNum >= NUMCONTROLS ) {
-				break;
-			}
-			
-			ModelerApplication::Instance()->SetControlValue(controlNum, value);
-		}
-
-		m_modelerView->redraw();
-	};
-}
-void ModelerUserInterface::cb_OpenPos(Fl_Menu_* o, void* v) {
-	((ModelerUserInterface*)(o->parent()->user_data()))->cb_OpenPos_i(o,v);
+inline void ModelerUserInterface::cb_Save2_i(Fl_Menu_*, void*) {
+  savePoster();
+}
+void ModelerUserInterface::cb_Save2(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Save2_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Open_i(Fl_Menu_*, void*) {
+  openPositionFile();
+}
+void ModelerUserInterface::cb_Open(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Open_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Save3_i(Fl_Menu_*, void*) {
+  savePositionFile();
+}
+void ModelerUserInterface::cb_Save3(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Save3_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Open1_i(Fl_Menu_*, void*) {
+  openPoseLibrary();
+}
+void ModelerUserInterface::cb_Open1(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Open1_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Add_i(Fl_Menu_*, void*) {
+  addPose();
+}
+void ModelerUserInterface::cb_Add(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Add_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Blend_i(Fl_Menu_*, void*) {
+  blendPoses();
+}
+void ModelerUserInterface::cb_Blend(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Blend_i(o,v);
 }
 
 inline void ModelerUserInterface::cb_Exit_i(Fl_Menu_*, void*) {
   m_controlsWindow->hide();
 m_modelerWindow->hide();
-}  
+}
 void ModelerUserInterface::cb_Exit(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Exit_i(o,v);
 }
 
 inline void ModelerUserInterface::cb_Normal_i(Fl_Menu_*, void*) {
-  setDrawMode(NORMAL);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_DRAW_MODE, NORMAL));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Normal(Fl_Menu_* o, void* v) {
@@ -183,7 +82,7 @@ void ModelerUserInterface::cb_Normal(Fl_Menu_* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_Flat_i(Fl_Menu_*, void*) {
-  setDrawMode(FLATSHADE);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_DRAW_MODE, FLATSHADE));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Flat(Fl_Menu_* o, void* v) {
@@ -191,7 +90,7 @@ void ModelerUserInterface::cb_Flat(Fl_Menu_* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_Wireframe_i(Fl_Menu_*, void*) {
-  setDrawMode(WIREFRAME);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_DRAW_MODE, WIREFRAME));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Wireframe(Fl_Menu_* o, void* v) {
@@ -199,7 +98,7 @@ void ModelerUserInterface::cb_Wireframe(Fl_Menu_* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_High_i(Fl_Menu_*, void*) {
-  setQuality(HIGH);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_QUALITY, HIGH));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_High(Fl_Menu_* o, void* v) {
@@ -207,7 +106,7 @@ void ModelerUserInterface::cb_High(Fl_Menu_* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_Medium_i(Fl_Menu_*, void*) {
-  setQuality(MEDIUM);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_QUALITY, MEDIUM));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Medium(Fl_Menu_* o, void* v) {
@@ -215,7 +114,7 @@ void ModelerUserInterface::cb_Medium(Fl_Menu_* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_Low_i(Fl_Menu_*, void*) {
-  setQuality(LOW);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_QUALITY, LOW));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Low(Fl_Menu_* o, void* v) {
@@ -223,35 +122,102 @@ void ModelerUserInterface::cb_Low(Fl_Menu_* o, void* v) {
 }
 
 inline void ModelerUserInterface::cb_Poor_i(Fl_Menu_*, void*) {
-  setQuality(POOR);
+  m_modelerView->postCommand(ModelerCommand(CMD_SET_QUALITY, POOR));
 m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Poor(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Poor_i(o,v);
 }
 
-// Callback function to look at origin again.
 inline void ModelerUserInterface::cb_Focus_i(Fl_Menu_*, void*) {
-	m_modelerView->m_camera->setLookAt( Vec3f(0, 0, 0) );
-	m_modelerView->redraw();
+  m_modelerView->postCommand(ModelerCommand(CMD_CAMERA_LOOK_AT, 0, 0, 0, 0));
+m_modelerView->redraw();
 }
 void ModelerUserInterface::cb_Focus(Fl_Menu_* o, void* v) {
-	((ModelerUserInterface*)(o->parent()->user_data()))->cb_Focus_i(o,v);
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Focus_i(o,v);
 }
 
 inline void ModelerUserInterface::cb_m_controlsAnimOnMenu_i(Fl_Menu_*, void*) {
   ModelerApplication::Instance()->m_animating = (m_controlsAnimOnMenu->value() == 0) ? false : true;
+m_modelerView->postCommand(ModelerCommand(CMD_SET_ANIMATING, ModelerApplication::Instance()->m_animating));
 }
 void ModelerUserInterface::cb_m_controlsAnimOnMenu(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_m_controlsAnimOnMenu_i(o,v);
 }
 
+inline void ModelerUserInterface::cb_Record_i(Fl_Menu_*, void*) {
+  recordFrames();
+}
+void ModelerUserInterface::cb_Record(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Record_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Stop_i(Fl_Menu_*, void*) {
+  stopRecording();
+}
+void ModelerUserInterface::cb_Stop(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Stop_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Crowd_i(Fl_Menu_*, void*) {
+  setCrowdSize();
+}
+void ModelerUserInterface::cb_Crowd(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Crowd_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Bake_i(Fl_Menu_*, void*) {
+  bakeAnimation();
+}
+void ModelerUserInterface::cb_Bake(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Bake_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Open2_i(Fl_Menu_*, void*) {
+  openBakedAnimation();
+}
+void ModelerUserInterface::cb_Open2(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Open2_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Close_i(Fl_Menu_*, void*) {
+  m_modelerView->setFrameTable(NULL);
+}
+void ModelerUserInterface::cb_Close(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Close_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Frame_i(Fl_Menu_*, void*) {
+  setFrameCacheBudget();
+}
+void ModelerUserInterface::cb_Frame(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Frame_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Drive_i(Fl_Menu_*, void*) {
+  driveControl();
+}
+void ModelerUserInterface::cb_Drive(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Drive_i(o,v);
+}
+
+inline void ModelerUserInterface::cb_Evaluation_i(Fl_Menu_*, void*) {
+  showEvaluationStats();
+}
+void ModelerUserInterface::cb_Evaluation(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Evaluation_i(o,v);
+}
+
 Fl_Menu_Item ModelerUserInterface::menu_m_controlsMenuBar[] = {
  {"File", 0,  0, 0, 64, 0, 0, 14, 0},
  {"Save Raytracer File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save, 0, 0, 0, 0, 14, 0},
- {"Save Bitmap File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save1, 0, 128, 0, 0, 14, 0},
- {"Open Position File", 0, (Fl_Callback*)ModelerUserInterface::cb_OpenPos, 0, 0, 0, 0, 14, 0},
- {"Save Position File", 0, (Fl_Callback*)ModelerUserInterface::cb_SavePos, 0, 128, 0, 0, 14, 0},
+ {"Save Image File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save1, 0, 0, 0, 0, 14, 0},
+ {"Save Poster...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save2, 0, 128, 0, 0, 14, 0},
+ {"Open Position File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Open, 0, 0, 0, 0, 14, 0},
+ {"Save Position File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save3, 0, 128, 0, 0, 14, 0},
+ {"Open Pose Library...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Open1, 0, 0, 0, 0, 14, 0},
+ {"Add Pose to Library...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Add, 0, 0, 0, 0, 14, 0},
+ {"Blend Library Poses...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Blend, 0, 128, 0, 0, 14, 0},
  {"Exit", 0,  (Fl_Callback*)ModelerUserInterface::cb_Exit, 0, 0, 0, 0, 14, 0},
  {0},
  {"View", 0,  0, 0, 64, 0, 0, 14, 0},
@@ -265,20 +231,23 @@ Fl_Menu_Item ModelerUserInterface::menu_m_controlsMenuBar[] = {
  {"Focus on Origin", 0,  (Fl_Callback*)ModelerUserInterface::cb_Focus, 0, 0, 0, 0, 14, 0},
  {0},
  {"Animate", 0,  0, 0, 64, 0, 0, 14, 0},
- {"Enable", 0,  (Fl_Callback*)ModelerUserInterface::cb_m_controlsAnimOnMenu, 0, 2, 0, 0, 14, 0},
+ {"Enable", 0,  (Fl_Callback*)ModelerUserInterface::cb_m_controlsAnimOnMenu, 0, 130, 0, 0, 14, 0},
+ {"Record Frames...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Record, 0, 0, 0, 0, 14, 0},
+ {"Stop Recording", 0,  (Fl_Callback*)ModelerUserInterface::cb_Stop, 0, 128, 0, 0, 14, 0},
+ {"Crowd Mode...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Crowd, 0, 128, 0, 0, 14, 0},
+ {"Bake Animation...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Bake, 0, 0, 0, 0, 14, 0},
+ {"Open Baked Animation...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Open2, 0, 0, 0, 0, 14, 0},
+ {"Close Baked Animation", 0,  (Fl_Callback*)ModelerUserInterface::cb_Close, 0, 128, 0, 0, 14, 0},
+ {"Frame Cache...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Frame, 0, 128, 0, 0, 14, 0},
+ {"Drive Control...", 0,  (Fl_Callback*)ModelerUserInterface::cb_Drive, 0, 0, 0, 0, 14, 0},
+ {"Evaluation Stats", 0,  (Fl_Callback*)ModelerUserInterface::cb_Evaluation, 0, 0, 0, 0, 14, 0},
  {0},
  {0}
 };
-// 11-01-2001: fixed bug that caused animation problems
-Fl_Menu_Item* ModelerUserInterface::m_controlsAnimOnMenu = ModelerUserInterface::menu_m_controlsMenuBar + 18;
+Fl_Menu_Item* ModelerUserInterface::m_controlsAnimOnMenu = ModelerUserInterface::menu_m_controlsMenuBar + 22;
 
 inline void ModelerUserInterface::cb_m_controlsBrowser_i(Fl_Browser*, void*) {
-  for (int i=0; i<ModelerApplication::Instance()->m_numControls; i++) {
-	if (m_controlsBrowser->selected(i+1))
-		ModelerApplication::Instance()->ShowControl(i);
-	else
-		ModelerApplication::Instance()->HideControl(i);
-};
+  showSelectedControls();
 }
 void ModelerUserInterface::cb_m_controlsBrowser(Fl_Browser* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_m_controlsBrowser_i(o,v);
@@ -293,7 +262,7 @@ void ModelerUserInterface::cb_m_modelerWindow(Fl_Window* o, void* v) {
 
 ModelerUserInterface::ModelerUserInterface() {
   Fl_Window* w;
-  { Fl_Window* o = m_controlsWindow = new Fl_Window(395, 326, "Modeler");
+  { Fl_Window* o = m_controlsWindow = new Fl_Window(395, 326, "CS 341 Modeler (SP02)");
     w = o;
     o->callback((Fl_Callback*)cb_m_controlsWindow, (void*)(this));
     o->when(FL_WHEN_NEVER);
@@ -306,12 +275,7 @@ ModelerUserInterface::ModelerUserInterface() {
       o->callback((Fl_Callback*)cb_m_controlsBrowser);
       Fl_Group::current()->resizable(o);
     }
-    { Fl_Scroll* o = m_controlsScroll = new Fl_Scroll(145, 25, 250, 300);
-      o->type(6);
-      o->when(FL_WHEN_CHANGED);
-      { Fl_Pack* o = m_controlsPack = new Fl_Pack(145, 25, 225, 300);
-        o->end();
-      }
+    { ControlPanel* o = m_controlsPanel = new ControlPanel(145, 25, 250, 300);
       o->end();
     }
     o->end();
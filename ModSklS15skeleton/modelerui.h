@@ -11,8 +11,7 @@
 #include "bitmap.h"
 #include "modelerdraw.h"
 #include <FL/Fl_Browser.H>
-#include <FL/Fl_Scroll.H>
-#include <FL/Fl_Pack.H>
+#include "controlpanel.h"
 #include "modelerapp.h"
 
 class ModelerUserInterface {
@@ -30,13 +29,18 @@ private:
   static void cb_Save(Fl_Menu_*, void*);
   inline void cb_Save1_i(Fl_Menu_*, void*);
   static void cb_Save1(Fl_Menu_*, void*);
-// IANLI - 10/9/2001
-// callback functions for saving the position of the model.
-  inline void cb_SavePos_i(Fl_Menu_*, void*);
-  static void cb_SavePos(Fl_Menu_*, void*);
-  inline void cb_OpenPos_i(Fl_Menu_*, void*);
-  static void cb_OpenPos(Fl_Menu_*, void*);
-
+  inline void cb_Save2_i(Fl_Menu_*, void*);
+  static void cb_Save2(Fl_Menu_*, void*);
+  inline void cb_Open_i(Fl_Menu_*, void*);
+  static void cb_Open(Fl_Menu_*, void*);
+  inline void cb_Save3_i(Fl_Menu_*, void*);
+  static void cb_Save3(Fl_Menu_*, void*);
+  inline void cb_Open1_i(Fl_Menu_*, void*);
+  static void cb_Open1(Fl_Menu_*, void*);
+  inline void cb_Add_i(Fl_Menu_*, void*);
+  static void cb_Add(Fl_Menu_*, void*);
+  inline void cb_Blend_i(Fl_Menu_*, void*);
+  static void cb_Blend(Fl_Menu_*, void*);
   inline void cb_Exit_i(Fl_Menu_*, void*);
   static void cb_Exit(Fl_Menu_*, void*);
   inline void cb_Normal_i(Fl_Menu_*, void*);
@@ -53,7 +57,6 @@ private:
   static void cb_Low(Fl_Menu_*, void*);
   inline void cb_Poor_i(Fl_Menu_*, void*);
   static void cb_Poor(Fl_Menu_*, void*);
-private:
   inline void cb_Focus_i(Fl_Menu_*, void*);
   static void cb_Focus(Fl_Menu_*, void*);
 public:
@@ -61,14 +64,31 @@ public:
 private:
   inline void cb_m_controlsAnimOnMenu_i(Fl_Menu_*, void*);
   static void cb_m_controlsAnimOnMenu(Fl_Menu_*, void*);
+  inline void cb_Record_i(Fl_Menu_*, void*);
+  static void cb_Record(Fl_Menu_*, void*);
+  inline void cb_Stop_i(Fl_Menu_*, void*);
+  static void cb_Stop(Fl_Menu_*, void*);
+  inline void cb_Crowd_i(Fl_Menu_*, void*);
+  static void cb_Crowd(Fl_Menu_*, void*);
+  inline void cb_Bake_i(Fl_Menu_*, void*);
+  static void cb_Bake(Fl_Menu_*, void*);
+  inline void cb_Open2_i(Fl_Menu_*, void*);
+  static void cb_Open2(Fl_Menu_*, void*);
+  inline void cb_Close_i(Fl_Menu_*, void*);
+  static void cb_Close(Fl_Menu_*, void*);
+  inline void cb_Frame_i(Fl_Menu_*, void*);
+  static void cb_Frame(Fl_Menu_*, void*);
+  inline void cb_Drive_i(Fl_Menu_*, void*);
+  static void cb_Drive(Fl_Menu_*, void*);
+  inline void cb_Evaluation_i(Fl_Menu_*, void*);
+  static void cb_Evaluation(Fl_Menu_*, void*);
 public:
   Fl_Browser *m_controlsBrowser;
 private:
   inline void cb_m_controlsBrowser_i(Fl_Browser*, void*);
   static void cb_m_controlsBrowser(Fl_Browser*, void*);
 public:
-  Fl_Scroll *m_controlsScroll;
-  Fl_Pack *m_controlsPack;
+  ControlPanel *m_controlsPanel;
   Fl_Window *m_modelerWindow;
 private:
   inline void cb_m_modelerWindow_i(Fl_Window*, void*);
@@ -76,5 +96,22 @@ private:
 public:
   ModelerView *m_modelerView;
   void show();
+  void saveRayFile();
+  void saveImageFile();
+  void savePoster();
+  void openPositionFile();
+  void savePositionFile();
+  void openPoseLibrary();
+  void addPose();
+  void blendPoses();
+  void showSelectedControls();
+  void recordFrames();
+  void stopRecording();
+  void setCrowdSize();
+  void bakeAnimation();
+  void openBakedAnimation();
+  void setFrameCacheBudget();
+  void driveControl();
+  void showEvaluationStats();
 };
 #endif
@@ -0,0 +1,514 @@
+// modeleruiactions.cpp
+
+// The bodies of the modelerui.fl callbacks that are more than a line or
+// two.  The .fl declares these methods and calls them, so regenerating
+// modelerui.cxx/.h from it keeps them.
+
+#include "modelerui.h"
+#include "modelerapp.h"
+
+#include "camera.h"
+#include "rayparser.h"
+#include "framecache.h"
+#include "framecapture.h"
+#include "frametable.h"
+#include "poselibrary.h"
+#include "drivencontrols.h"
+#include "controlgraph.h"
+#include "crowd.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+using namespace std;
+
+// ****************************************************************************
+// File
+// ****************************************************************************
+
+// Records a frame of the model into a .ray file and reads it back, to make
+// sure the exporter wrote something the raytracer (and we) can parse
+void ModelerUserInterface::saveRayFile()
+{
+	char *filename = fl_file_chooser("Save RAY File", "*.ray", NULL);
+	if (!filename)
+		return;
+
+	if (openRayFile(filename) == false)
+	{
+		fl_alert("Error opening file.");
+		return;
+	}
+	m_modelerView->draw();
+	closeRayFile();
+
+	std::string report;
+	if (!validateRayFile(filename, report))
+		fl_alert("Ray file failed validation: %s", report.c_str());
+}
+
+// Reads the view back into one of the capture ring's buffers; the image is
+// encoded and written on the capture threads
+void ModelerUserInterface::saveImageFile()
+{
+	char *filename = fl_file_chooser("Save Image File", "*.{bmp,ppm,png,gif}", NULL);
+	if (!filename)
+		return;
+
+	int w = m_modelerView->w();
+	int h = m_modelerView->h();
+
+	m_modelerWindow->show();
+	m_modelerView->make_current();
+	m_modelerView->draw();
+
+	FrameCapture *capture = ModelerApplication::Instance()->GetFrameCapture();
+	capture->capture(w, h, filename);
+	capture->resolve();
+}
+
+// Renders the view at any size, a window-sized tile at a time
+void ModelerUserInterface::savePoster()
+{
+	char *filename = fl_file_chooser("Save Poster", "*.bmp", NULL);
+	if (!filename)
+		return;
+
+	// fl_file_chooser's buffer is reused by fl_input
+	std::string name(filename);
+	const char *size = fl_input("Poster size (width x height):", "4096x4096");
+	int width = 0, height = 0;
+	if (!size || sscanf(size, "%d x %d", &width, &height) != 2 || width <= 0 || height <= 0)
+		return;
+
+	m_modelerWindow->show();
+	if (!m_modelerView->savePoster(name.c_str(), width, height))
+		fl_alert("Unable to write poster %s", name.c_str());
+}
+
+// IANLI
+// Implementation callback for saving the positions of the model into a file
+// The first line of the file contains the values for the position/orientation of
+// the camera. The values are ordered as the following:
+//		elevation azimuth dolly twist lookAtX lookAtY lookAtZ
+// The lines after correspond to the values of the controls. The following lines 
+// have this format:
+//		controlNumber controlValue
+void ModelerUserInterface::savePositionFile()
+{
+	char *filename = NULL;
+	filename = fl_file_chooser("Save .pos File", "*.pos", NULL);
+
+	if (filename)
+	{
+		FILE* m_posFile = fopen(filename, "w");
+
+		float elevation, azimuth, dolly, twist;
+		Vec3f lookAt;
+		elevation = m_modelerView->m_camera->getElevation();
+		dolly = m_modelerView->m_camera->getDolly();
+		azimuth = m_modelerView->m_camera->getAzimuth();
+		twist = m_modelerView->m_camera->getTwist();
+		lookAt = m_modelerView->m_camera->getLookAt();
+
+		fprintf(m_posFile, "%f %f %f %f %f %f %f\n", elevation, azimuth, dolly, twist, lookAt[0], lookAt[1], lookAt[2]);
+
+		double value;
+		for(int i = 0; i < ModelerApplication::Instance()->NumControls(); i++)
+		{
+			value = ModelerApplication::Instance()->GetControlValue(i);
+
+			fprintf(m_posFile, "%d %f\n", i, value);
+		}
+
+		fclose(m_posFile);
+	}
+}
+
+void ModelerUserInterface::openPositionFile()
+{
+	char *filename = NULL;
+	filename = fl_file_chooser("Open .pos File", "*.pos", NULL);
+
+	if (filename)
+	{
+		ifstream ifs( filename );
+		if( !ifs ) {
+			cerr << "Error: couldn't read position file " << filename << endl;
+			return;
+		}
+
+		float elevation, azimuth, dolly, twist, x, y, z;
+		ifs >> elevation >> azimuth >> dolly >> twist >> x >> y >> z;
+		
+		m_modelerView->postCommand(ModelerCommand(CMD_CAMERA_ORBIT, 0, elevation, azimuth, dolly, twist));
+		m_modelerView->postCommand(ModelerCommand(CMD_CAMERA_LOOK_AT, 0, x, y, z));
+		
+		int controlNum; 
+		float value;
+		while( ifs >> controlNum >> value )
+		{
+			if( controlNum < 0 || controlNum >= ModelerApplication::Instance()->NumControls() ) {
+				break;
+			}
+			
+			ModelerApplication::Instance()->SetControlValue(controlNum, value);
+		}
+
+		m_modelerView->redraw();
+	}
+}
+
+// The pose library the pose menu items work on is kept in this file
+static string s_poseLibraryFile;
+
+void ModelerUserInterface::openPoseLibrary()
+{
+	char *filename = fl_file_chooser("Open Pose Library (or name a new one)", "*.mpl", NULL);
+	if (!filename)
+		return;
+
+	PoseLibrary *library = ModelerApplication::Instance()->GetPoseLibrary();
+	int numControls = ModelerApplication::Instance()->NumControls();
+	FILE *exists = fopen(filename, "rb");
+	if (exists)
+	{
+		fclose(exists);
+		if (!library->open(filename))
+		{
+			fl_alert("%s isn't a pose library.", filename);
+			return;
+		}
+		if (library->numControls() != numControls)
+		{
+			fl_alert("%s holds poses of a model with %d controls, not %d.", filename,
+				library->numControls(), numControls);
+			library->clear(numControls);
+			return;
+		}
+	}
+	else
+		library->clear(numControls);
+	s_poseLibraryFile = filename;
+}
+
+// Stores the current controls in the library under a name and writes the
+// library back out
+void ModelerUserInterface::addPose()
+{
+	if (s_poseLibraryFile.empty())
+	{
+		openPoseLibrary();
+		if (s_poseLibraryFile.empty())
+			return;
+	}
+
+	const char *name = fl_input("Pose name:", "");
+	if (!name || !*name)
+		return;
+
+	ModelerApplication *app = ModelerApplication::Instance();
+	PoseLibrary *library = app->GetPoseLibrary();
+	double *values = new double[app->NumControls()];
+	app->GetControlValues(values);
+	library->setPose(name, values);
+	delete [] values;
+
+	if (!library->save(s_poseLibraryFile.c_str()))
+		fl_alert("Unable to write %s", s_poseLibraryFile.c_str());
+}
+
+// Blends library poses into the current controls, given as
+// "name[:weight] name[:weight] ..."; a pose without a weight gets an equal
+// share of whatever the weighted ones leave
+void ModelerUserInterface::blendPoses()
+{
+	ModelerApplication *app = ModelerApplication::Instance();
+	PoseLibrary *library = app->GetPoseLibrary();
+	if (library->numPoses() == 0)
+	{
+		fl_alert("The pose library is empty.");
+		return;
+	}
+
+	const char *text = fl_input("Poses to blend (name[:weight] ...):", "");
+	if (!text)
+		return;
+
+	vector<PoseWeight> poses;
+	vector<bool> weighted;
+	double given = 0;
+	char token[256];
+	int length;
+	for (const char *at = text; sscanf(at, " %255s%n", token, &length) == 1; at += length)
+	{
+		char *colon = strrchr(token, ':');
+		PoseWeight pose;
+		pose.m_weight = 0;
+		if (colon)
+		{
+			*colon = 0;
+			pose.m_weight = atof(colon + 1);
+			given += pose.m_weight;
+		}
+		pose.m_pose = library->find(token);
+		if (pose.m_pose < 0)
+		{
+			fl_alert("There's no pose called %s.", token);
+			return;
+		}
+		poses.push_back(pose);
+		weighted.push_back(colon != NULL);
+	}
+	if (poses.empty())
+		return;
+
+	int shares = 0;
+	for (size_t i = 0; i < poses.size(); ++i)
+		shares += weighted[i] ? 0 : 1;
+	for (size_t i = 0; i < poses.size(); ++i)
+		if (!weighted[i])
+			poses[i].m_weight = given < 1 ? (1 - given) / shares : 0;
+
+	int numControls = app->NumControls();
+	double *values = new double[numControls];
+	app->GetControlValues(values);
+	library->blend(&poses[0], (int)poses.size(), values);
+	for (int i = 0; i < numControls; ++i)
+		app->SetControlValue(i, values[i]);
+	delete [] values;
+
+	m_modelerView->redraw();
+}
+
+// ****************************************************************************
+// Controls
+// ****************************************************************************
+
+// Shows and hides just the controls whose selection in the browser
+// changed, then lays the panel out once
+void ModelerUserInterface::showSelectedControls()
+{
+	for (int i = 0; i < ModelerApplication::Instance()->m_numControls; i++)
+	{
+		bool selected = m_controlsBrowser->selected(i+1) != 0;
+		if (selected == m_controlsPanel->isShown(i))
+			continue;
+		if (selected)
+			m_controlsPanel->showControl(i);
+		else
+			m_controlsPanel->hideControl(i);
+	}
+	m_controlsPanel->update();
+}
+
+// ****************************************************************************
+// Animate
+// ****************************************************************************
+
+// Records every animation tick as a numbered image file until stopped.
+// Recording turns animation on, since there is nothing to record otherwise.
+void ModelerUserInterface::recordFrames()
+{
+	FrameCapture *capture = ModelerApplication::Instance()->GetFrameCapture();
+	if (capture->isRecording())
+		return;
+
+	char *filename = fl_file_chooser("Record Frames", "*.{bmp,ppm,png,gif}", NULL);
+	if (filename)
+	{
+		int choice = fl_choice("When encoding falls behind the animation:",
+			"Slow Down", "Drop Frames", NULL);
+		capture->startRecording(filename, choice == 1 ? CAPTURE_DROP : CAPTURE_BLOCK);
+
+		m_controlsAnimOnMenu->set();
+		ModelerApplication::Instance()->m_animating = true;
+		m_modelerView->postCommand(ModelerCommand(CMD_SET_ANIMATING, 1));
+	}
+}
+
+void ModelerUserInterface::stopRecording()
+{
+	FrameCapture *capture = ModelerApplication::Instance()->GetFrameCapture();
+	if (!capture->isRecording())
+		return;
+
+	m_modelerView->make_current();
+	capture->stopRecording();
+	fl_message("Recorded %d frames (%d dropped) on %d encoder threads.",
+		capture->framesRecorded(), capture->framesDropped(), capture->numEncoders());
+}
+
+// Draws many copies of the model, each at its own point in the animation.
+// The prompt says how long the crowd has been taking to draw.
+void ModelerUserInterface::setCrowdSize()
+{
+	char current[16];
+	sprintf(current, "%d", m_modelerView->crowdSize());
+	CrowdStats s;
+	const char *size;
+	if (m_modelerView->crowdStats(s) && s.m_frames > 0)
+		size = fl_input("Crowd: %d members on %d threads: evaluate %.2f ms, submit %.2f ms, "
+			"frame %.2f ms, %ld tris/frame, %.2f Mtris/s, %d stolen/frame\n\n"
+			"Crowd size (0 for off):", current, s.m_members, s.m_threads, s.m_evaluateMs,
+			s.m_submitMs, s.m_frameMs, s.m_triangles, s.m_trianglesPerSecond / 1e6, s.m_stolen);
+	else
+		size = fl_input("Crowd size (0 for off):", current);
+	int count = 0;
+	if (!size || sscanf(size, "%d", &count) != 1 || count < 0)
+		return;
+
+	m_modelerView->setCrowd(count);
+}
+
+// Bakes the model's animation into a frame table file and plays it back
+// from there, so the animation code doesn't run again
+void ModelerUserInterface::bakeAnimation()
+{
+	char *filename = fl_file_chooser("Bake Animation", "*.mft", NULL);
+	if (!filename)
+		return;
+
+	// fl_file_chooser's buffer is reused by fl_input
+	std::string name(filename);
+	const char *length = fl_input("Frames to bake:", "240");
+	int frames = 0;
+	if (!length || sscanf(length, "%d", &frames) != 1 || frames <= 0)
+		return;
+
+	FrameTable *table = m_modelerView->bakeAnimation(frames);
+	if (!table)
+	{
+		fl_alert("This model's animation can't be baked.");
+		return;
+	}
+	if (!table->save(name.c_str()))
+		fl_alert("Unable to write %s", name.c_str());
+	m_modelerView->setFrameTable(table);
+}
+
+void ModelerUserInterface::openBakedAnimation()
+{
+	char *filename = fl_file_chooser("Open Baked Animation", "*.mft", NULL);
+	if (!filename)
+		return;
+
+	FrameTable *table = new FrameTable;
+	if (!table->open(filename))
+		fl_alert("%s isn't a baked animation.", filename);
+	else if (table->numChannels() != ModelerApplication::Instance()->NumControls())
+		fl_alert("%s was baked from a model with %d controls, not %d.", filename,
+			table->numChannels(), ModelerApplication::Instance()->NumControls());
+	else
+	{
+		m_modelerView->setFrameTable(table);
+		return;
+	}
+	delete table;
+}
+
+// Reports how the cache of still frames has done so far and sets its
+// memory budget
+void ModelerUserInterface::setFrameCacheBudget()
+{
+	FrameCache *cache = m_modelerView->frameCache();
+	FrameCacheStats stats = cache->stats();
+	long lookups = stats.m_hits + stats.m_misses;
+
+	// the stats head the prompt, as the driven controls do Drive Control's
+	char current[16];
+	sprintf(current, "%d", (int)(cache->budget() >> 20));
+	const char *budget = fl_input("Frame cache: %d frames in %.1f MB, %ld hits, %ld misses "
+		"(%.0f%% hit), %ld evicted\n\nFrame cache budget in MB (0 for off):", current,
+		stats.m_frames, stats.m_bytes / 1048576.0, stats.m_hits, stats.m_misses,
+		lookups ? 100.0 * stats.m_hits / lookups : 0.0, stats.m_evictions);
+	int megabytes = 0;
+	if (!budget || sscanf(budget, "%d", &megabytes) != 1 || megabytes < 0)
+		return;
+
+	cache->setBudget((size_t)megabytes << 20);
+	cache->resetStats();
+}
+
+// Drives a control from an expression given as "CONTROL = expression", or
+// frees it given just "CONTROL =".  The prompt lists the driven controls.
+void ModelerUserInterface::driveControl()
+{
+	const int kMaxListed = 20;
+
+	DrivenControls *driven = ModelerApplication::Instance()->GetDrivenControls();
+	string prompt;
+	if (driven->numDriven() > 0)
+	{
+		char line[64];
+		sprintf(line, "Driven controls (%d instructions):\n", driven->numInstructions());
+		prompt = line;
+	}
+	for (int i = 0; i < driven->numDriven() && i < kMaxListed; i++)
+	{
+		int control = driven->drivenControl(i);
+		const char *label = m_controlsBrowser->text(control + 1);
+		while (*label == ' ')
+			label++;
+		prompt = prompt + "    " + label + " = " + driven->expression(control) + "\n";
+	}
+	if (driven->numDriven() > kMaxListed)
+	{
+		char line[64];
+		sprintf(line, "    and %d more\n", driven->numDriven() - kMaxListed);
+		prompt += line;
+	}
+	if (!prompt.empty())
+		prompt += "\n";
+	prompt += "Drive a control (CONTROL = expression):";
+
+	// the prompt is a format; the expressions may hold '%'
+	const char *text = fl_input("%s", "", prompt.c_str());
+	if (!text)
+		return;
+	const char *equals = strchr(text, '=');
+	if (!equals)
+	{
+		fl_alert("Give the control, then =, then the expression.");
+		return;
+	}
+
+	string name(text, equals);
+	while (!name.empty() && isspace((unsigned char)name[name.size() - 1]))
+		name.erase(name.size() - 1);
+	while (!name.empty() && isspace((unsigned char)name[0]))
+		name.erase(0, 1);
+	int control = driven->control(name.c_str());
+	if (control < 0)
+	{
+		fl_alert("There's no control called %s.", name.c_str());
+		return;
+	}
+
+	// the evaluation thread runs the compiled expressions
+	m_modelerView->stopEvaluation();
+
+	string expression(equals + 1);
+	string error;
+	if (expression.find_first_not_of(" \t") == string::npos)
+		driven->undrive(control);
+	else if (!driven->drive(control, expression.c_str(), &error))
+		fl_alert("%s", error.c_str());
+	m_modelerView->redraw();
+}
+
+// Reports how much of the last pose was reused rather than evaluated again
+void ModelerUserInterface::showEvaluationStats()
+{
+	ControlGraphStats stats;
+	if (!m_modelerView->evaluationStats(stats))
+	{
+		fl_message("The model isn't being posed off the UI thread.");
+		return;
+	}
+	fl_message("Last pose: %d of %d scopes reused, %ld of %ld items (%.0f%% reused).",
+		stats.m_reused, stats.m_scopes, stats.m_reusedItems, stats.m_items,
+		100.0 * stats.reuseRatio());
+}
@@ -1,25 +1,44 @@
 #include "modelerview.h"
+#include "modelerapp.h"
+#include "modelerdraw.h"
 #include "camera.h"
+#include "crowd.h"
+#include "evalthread.h"
+#include "framecache.h"
+#include "framecapture.h"
+#include "frametable.h"
+#include "posterrender.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Gl_Window.h>
 #include <FL/gl.h>
 #include <GL/glu.h>
+#include <algorithm>
 #include <cstdio>
+#include <vector>
 
 static const int	kMouseRotationButton			= FL_LEFT_MOUSE;
 static const int	kMouseTranslationButton			= FL_MIDDLE_MOUSE;
 static const int	kMouseZoomButton				= FL_RIGHT_MOUSE;
 
+static const double	kFieldOfView					= 30.0;
+static const double	kNearPlane						= 1.0;
+static const double	kFarPlane						= 100.0;
+
 ModelerView::ModelerView(int x, int y, int w, int h, char *label)
-: Fl_Gl_Window(x,y,w,h,label)
+: Fl_Gl_Window(x,y,w,h,label), m_tile(NULL), m_crowd(NULL), m_eval(NULL), m_frames(NULL), m_tick(0)
 {
     m_camera = new Camera();
+	m_frameCache = new FrameCache();
 }
 
 ModelerView::~ModelerView()
 {
+	stopEvaluation();
 	delete m_camera;
+	delete m_crowd;
+	delete m_frames;
+	delete m_frameCache;
 }
 int ModelerView::handle(int event)
 {
@@ -35,13 +54,13 @@ int ModelerView::handle(int event)
 			switch(eventButton)
 			{
 			case kMouseRotationButton:
-				m_camera->clickMouse(kActionRotate, eventCoordX, eventCoordY );
+				postCommand(ModelerCommand(CMD_CAMERA_CLICK, kActionRotate, eventCoordX, eventCoordY));
 				break;
 			case kMouseTranslationButton:
-				m_camera->clickMouse(kActionTranslate, eventCoordX, eventCoordY );
+				postCommand(ModelerCommand(CMD_CAMERA_CLICK, kActionTranslate, eventCoordX, eventCoordY));
 				break;
 			case kMouseZoomButton:
-				m_camera->clickMouse(kActionZoom, eventCoordX, eventCoordY );
+				postCommand(ModelerCommand(CMD_CAMERA_CLICK, kActionZoom, eventCoordX, eventCoordY));
 				break;
 			}
            // printf("push %d %d\n", eventCoordX, eventCoordY);
@@ -49,10 +68,25 @@ int ModelerView::handle(int event)
 		break;
 	case FL_DRAG:
 		{
-			m_camera->dragMouse(eventCoordX, eventCoordY);
+			postCommand(ModelerCommand(CMD_CAMERA_DRAG, 0, eventCoordX, eventCoordY));
             //printf("drag %d %d\n", eventCoordX, eventCoordY);
 		}
 		break;
+	case FL_FOCUS:
+	case FL_UNFOCUS:
+		// so the arrow keys come here
+		return 1;
+	case FL_KEYBOARD:
+		{
+			// Left and right step through the animation while it's
+			// stopped, ten ticks at a time with shift
+			int key = Fl::event_key();
+			if ((key != FL_Left && key != FL_Right) || ModelerApplication::Instance()->IsAnimated())
+				return 0;
+			double step = (eventState & FL_SHIFT) ? 10 : 1;
+			scrubTo(m_tick + (key == FL_Left ? -step : step));
+		}
+		return 1;
 	case FL_RELEASE:
 		{
 			switch(eventButton)
@@ -60,7 +94,7 @@ int ModelerView::handle(int event)
 			case kMouseRotationButton:
 			case kMouseTranslationButton:
 			case kMouseZoomButton:
-				m_camera->releaseMouse(eventCoordX, eventCoordY );
+				postCommand(ModelerCommand(CMD_CAMERA_RELEASE, 0, eventCoordX, eventCoordY));
 				break;
 			}
           //  printf("release %d %d\n", eventCoordX, eventCoordY);
@@ -82,6 +116,8 @@ static GLfloat lightDiffuse1[]  = { 1, 1, 1, 1 };
 
 void ModelerView::draw()
 {
+    applyCommands();
+
     if (!valid())
     {
         glShadeModel( GL_SMOOTH );
@@ -92,10 +128,20 @@ void ModelerView::draw()
 		glEnable( GL_NORMALIZE );
     }
 
-  	glViewport( 0, 0, w(), h() );
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	gluPerspective(30.0,float(w())/float(h()),1.0,100.0);
+	if (m_tile)
+	{
+		double bounds[4];
+		posterTileFrustum(*m_tile, kFieldOfView, kNearPlane, bounds);
+		glViewport( 0, 0, m_tile->m_width, m_tile->m_height );
+		glFrustum(bounds[0], bounds[1], bounds[2], bounds[3], kNearPlane, kFarPlane);
+	}
+	else
+	{
+		glViewport( 0, 0, w(), h() );
+		gluPerspective(kFieldOfView,float(w())/float(h()),kNearPlane,kFarPlane);
+	}
 				
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
@@ -106,4 +152,411 @@ void ModelerView::draw()
     glLightfv( GL_LIGHT0, GL_DIFFUSE, lightDiffuse0 );
     glLightfv( GL_LIGHT1, GL_POSITION, lightPosition1 );
     glLightfv( GL_LIGHT1, GL_DIFFUSE, lightDiffuse1 );
-}
\ No newline at end of file
+}
+
+bool ModelerView::savePoster(const char fname[], int width, int height)
+{
+	make_current();
+	bool ok = renderPoster(fname, width, height, w(), h(), renderPosterTile, this);
+	m_tile = NULL;
+	redraw();
+	return ok;
+}
+
+bool ModelerView::renderPosterTile(void *view, const PosterTile &tile,
+								   unsigned char *pixels, int stride)
+{
+	ModelerView *self = (ModelerView *)view;
+
+	// every tile is the same frame: the animation clock doesn't move on
+	// until the poster is done
+	double tick = self->m_tick;
+	self->m_tile = &tile;
+	self->draw();
+	self->m_tile = NULL;
+	self->m_tick = tick;
+
+	// only errors from the readback itself should fail the poster
+	while (glGetError() != GL_NO_ERROR)
+		;
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ROW_LENGTH, stride / 3);
+	glReadPixels(0, 0, tile.m_width, tile.m_height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+// ****************************************************************************
+// Drawing the model
+// ****************************************************************************
+
+bool ModelerView::drawModelAtThread(void *view, double time)
+{
+	return ((ModelerView *)view)->poseModelAt(time);
+}
+
+bool ModelerView::animateModelAtThread(void *view, double time)
+{
+	return ((ModelerView *)view)->drawModelAt(time);
+}
+
+// drawModelAt(), with a baked animation standing in for the model's own
+bool ModelerView::poseModelAt(double time)
+{
+	if (m_frames && time >= 0)
+	{
+		ModelerApplication *app = ModelerApplication::Instance();
+		static thread_local std::vector<double> values;
+		values.resize(m_frames->numChannels());
+		m_frames->frame(m_frames->frameAt(time), &values[0]);
+
+		int n = std::min((int)values.size(), app->NumControls());
+		for (int i = 0; i < n; i++)
+			app->SetControlValue(i, values[i]);
+		time = -1;
+	}
+	return drawModelAt(time);
+}
+
+bool ModelerView::drawModel()
+{
+	if (drawCrowd())
+		return true;
+
+	// A still frame that's been drawn before goes straight back up
+	std::vector<double> key;
+	bool still = stillFrameKey(key);
+	if (still && drawCachedFrame(key))
+		return true;
+
+	if (drawPose())
+	{
+		// only once the pose shown is the one the key describes
+		const Pose *pose = m_eval ? m_eval->currentPose() : NULL;
+		if (still && pose && pose->m_tick < 0 && pose->m_controls.size() <= key.size() &&
+			std::equal(pose->m_controls.begin(), pose->m_controls.end(), key.begin()))
+			cacheFrame(key);
+		return true;
+	}
+
+	// Directly, on this thread: the evaluation thread mustn't be posing the
+	// model at the same time
+	stopEvaluation();
+
+	ModelerApplication *app = ModelerApplication::Instance();
+	bool animated = app->IsAnimated();
+	if (!poseModelAt(animated ? m_tick : -1))
+		return false;
+	if (still)
+		cacheFrame(key);
+
+	if (animated)
+		m_tick += 1;
+
+	// The model's caches are built now, so later frames can be posed off
+	// this thread, unless this draw is one that has to be done here
+	if (!m_crowd && !ModelerDrawState::Instance()->m_rayFile && !m_tile &&
+		!app->GetFrameCapture()->isRecording())
+	{
+		std::vector<double> controls(app->NumControls());
+		if (!controls.empty())
+			app->GetControlValues(&controls[0]);
+		m_eval = new EvalThread(drawModelAtThread, posePublished, this, m_commands,
+								controls.empty() ? NULL : &controls[0], (int)controls.size(),
+								animated, *m_camera, m_tick);
+	}
+	return true;
+}
+
+// The newest pose from the evaluation thread, for an ordinary frame on
+// screen.  Files (a .ray, a poster, a recording) need the model posed for
+// exactly that frame, so they're drawn directly.
+bool ModelerView::drawPose()
+{
+	ModelerApplication *app = ModelerApplication::Instance();
+	if (!m_eval || ModelerDrawState::Instance()->m_rayFile || m_tile ||
+		app->GetFrameCapture()->isRecording())
+		return false;
+
+	// applyCommands() picked it up.  Until the first one is ready the
+	// model is drawn directly, rather than leaving the frame blank.
+	const Pose *pose = m_eval->currentPose();
+	if (!pose)
+		return false;
+	if (!pose->m_ok)
+	{
+		stopEvaluation();
+		return false;
+	}
+
+	pose->m_list.replay();
+
+	// what the animation set, for the sliders to show
+	if (pose->m_tick >= 0 && !pose->m_controls.empty())
+		app->ShowControlValues(&pose->m_controls[0]);
+	return true;
+}
+
+void ModelerView::posePublished(void *view)
+{
+	// on the evaluation thread: have the UI thread redraw
+	Fl::awake(redrawView, view);
+}
+
+void ModelerView::redrawView(void *view)
+{
+	((ModelerView *)view)->redraw();
+}
+
+void ModelerView::stopEvaluation()
+{
+	if (!m_eval)
+		return;
+
+	// Once it's stopped the commands come back to this thread: start from
+	// what its last pose came to, then apply whatever it didn't get to
+	m_eval->stop();
+	m_tick = m_eval->tick();
+	applyCommands();
+	delete m_eval;
+	m_eval = NULL;
+	applyCommands();
+}
+
+// ****************************************************************************
+// Commands
+// ****************************************************************************
+
+void ModelerView::postCommand(const ModelerCommand &command)
+{
+	if (!(m_eval ? m_eval->post(command) : m_commands.push(command)))
+	{
+		// The evaluation thread has fallen behind; take its work back,
+		// which empties the queue
+		stopEvaluation();
+		applyCommands();
+		m_commands.push(command);
+	}
+}
+
+// Brings this thread's state (the shared draw state and the camera) up to
+// date with the commands posted so far
+void ModelerView::applyCommands()
+{
+	ModelerDrawState *mds = ModelerDrawState::Instance();
+
+	if (m_eval)
+	{
+		// The evaluation thread applied them; take what they came to
+		const Pose *pose = m_eval->latestPose();
+		if (pose)
+		{
+			*m_camera = pose->m_camera;
+			mds->m_drawMode = pose->m_drawMode;
+			mds->m_quality = pose->m_quality;
+		}
+		return;
+	}
+
+	// The sliders already show the controls the commands carry
+	CommandTarget target = { NULL, 0, NULL, mds, m_camera };
+	ModelerCommand command;
+	while (m_commands.pop(command))
+		applyCommand(command, target);
+}
+
+// ****************************************************************************
+// Baked animation
+// ****************************************************************************
+
+FrameTable *ModelerView::bakeAnimation(int numFrames)
+{
+	// the bake poses the model on this thread
+	stopEvaluation();
+
+	ModelerApplication *app = ModelerApplication::Instance();
+	std::vector<double> controls(app->NumControls());
+	if (controls.empty())
+		return NULL;
+	app->GetControlValues(&controls[0]);
+
+	FrameTable *table = new FrameTable;
+	if (!::bakeAnimation(animateModelAtThread, this, &controls[0], (int)controls.size(),
+						 0, numFrames, *table))
+	{
+		delete table;
+		return NULL;
+	}
+	return table;
+}
+
+bool ModelerView::evaluationStats(ControlGraphStats &stats) const
+{
+	const Pose *pose = m_eval ? m_eval->currentPose() : NULL;
+	if (!pose)
+		return false;
+	stats = pose->m_graphStats;
+	return true;
+}
+
+void ModelerView::setFrameTable(FrameTable *table)
+{
+	// the evaluation thread and the crowd read it while they pose
+	stopEvaluation();
+
+	delete m_frames;
+	m_frames = table;
+	redraw();
+}
+
+void ModelerView::scrubTo(double tick)
+{
+	// the pose is worked out here, then drawn as a still frame
+	stopEvaluation();
+	m_tick = tick > 0 ? tick : 0;
+
+	ModelerApplication *app = ModelerApplication::Instance();
+	std::vector<double> controls(app->NumControls());
+	if (controls.empty())
+		return;
+	app->GetControlValues(&controls[0]);
+
+	FrameTable frame;
+	const FrameTable *table = m_frames;
+	int i = m_frames ? m_frames->frameAt(m_tick) : 0;
+	if (!table)
+	{
+		// one frame of the model's own animation, drawn nowhere
+		if (!::bakeAnimation(animateModelAtThread, this, &controls[0], (int)controls.size(),
+							 m_tick, 1, frame))
+			return;
+		table = &frame;
+	}
+
+	int n = std::min(table->numChannels(), (int)controls.size());
+	for (int c = 0; c < n; c++)
+		app->SetControlValue(c, table->value(i, c));
+	redraw();
+}
+
+// ****************************************************************************
+// Frame cache
+// ****************************************************************************
+
+// Everything a still frame on screen depends on, if this draw is one
+bool ModelerView::stillFrameKey(std::vector<double> &key)
+{
+	ModelerApplication *app = ModelerApplication::Instance();
+	ModelerDrawState *mds = ModelerDrawState::Instance();
+	if (!m_frameCache->budget() || app->IsAnimated() || mds->m_rayFile || m_tile ||
+		app->GetFrameCapture()->isRecording())
+		return false;
+
+	key.resize(app->NumControls());
+	if (!key.empty())
+		app->GetControlValues(&key[0]);
+
+	Vec3f lookAt = m_camera->getLookAt();
+	double view[] = { m_camera->getElevation(), m_camera->getAzimuth(), m_camera->getDolly(),
+					  m_camera->getTwist(), lookAt[0], lookAt[1], lookAt[2],
+					  (double)mds->m_drawMode, (double)mds->m_quality, (double)w(), (double)h() };
+	key.insert(key.end(), view, view + sizeof(view) / sizeof(view[0]));
+	return true;
+}
+
+bool ModelerView::drawCachedFrame(const std::vector<double> &key)
+{
+	const CachedFrame *frame = m_frameCache->find(key);
+	if (!frame)
+		return false;
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glPushAttrib(GL_ENABLE_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+
+	glRasterPos2i(-1, -1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glDrawPixels(frame->m_width, frame->m_height, GL_RGB, GL_UNSIGNED_BYTE, &frame->m_rgb[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glPopAttrib();
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	return true;
+}
+
+// Keeps what was just drawn into the back buffer under key
+void ModelerView::cacheFrame(const std::vector<double> &key)
+{
+	std::vector<unsigned char> rgb((size_t)w() * h() * 3);
+	if (rgb.empty())
+		return;
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, w(), h(), GL_RGB, GL_UNSIGNED_BYTE, &rgb[0]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	m_frameCache->insert(key, w(), h(), rgb);
+}
+
+// ****************************************************************************
+// Crowd mode
+// ****************************************************************************
+
+void ModelerView::setCrowd(int count)
+{
+	// the crowd poses the model on its own threads
+	stopEvaluation();
+
+	delete m_crowd;
+	m_crowd = count > 0 ? new Crowd(count) : NULL;
+	redraw();
+}
+
+int ModelerView::crowdSize() const
+{
+	return m_crowd ? m_crowd->members() : 0;
+}
+
+bool ModelerView::crowdStats(CrowdStats &stats)
+{
+	if (!m_crowd)
+		return false;
+	stats = m_crowd->stats();
+	return true;
+}
+
+bool ModelerView::drawCrowd()
+{
+	// a .ray file gets the single model
+	if (!m_crowd || ModelerDrawState::Instance()->m_rayFile)
+		return false;
+
+	ModelerApplication *app = ModelerApplication::Instance();
+	std::vector<double> controls(app->NumControls());
+	if (!controls.empty())
+		app->GetControlValues(&controls[0]);
+
+	if (!m_crowd->draw(drawModelAtThread, this, m_tick,
+					   controls.empty() ? NULL : &controls[0], (int)controls.size()))
+	{
+		fprintf(stderr, "This model can't be drawn as a crowd.\n");
+		delete m_crowd;
+		m_crowd = NULL;
+		return false;
+	}
+
+	if (app->IsAnimated())
+		m_tick += 1;
+	return true;
+}
@@ -11,8 +11,19 @@
 
 #include <FL/Fl_Gl_Window.H>
 
+#include "modelercommand.h"
+
+#include <vector>
+
 class Camera;
+struct ControlGraphStats;
+class Crowd;
+struct CrowdStats;
+class EvalThread;
+class FrameCache;
+class FrameTable;
 class ModelerView;
+struct PosterTile;
 typedef ModelerView* (*ModelerViewCreator_f)(int x, int y, int w, int h, char *label);
 
 class ModelerView : public Fl_Gl_Window
@@ -24,7 +35,95 @@ public:
     virtual int handle(int event);
     virtual void draw();
 
+    // Renders the view at width x height into a BMP, in window-sized
+    // tiles, so the poster can be far larger than the screen.  Keep the
+    // window uncovered while it runs; the tiles are read back from it.
+    bool savePoster(const char fname[], int width, int height);
+
+    // Draws the model alone, under whatever matrix is current, posed as
+    // its animation has it at time (in ticks), or as the controls have it
+    // when time < 0.  Crowd mode draws its copies through this, several at
+    // once on worker threads, so it must only use the modelerdraw.h
+    // functions and Get/SetControlValue.  Models that can be drawn this
+    // way override it to return true.
+    virtual bool drawModelAt(double) { return false; }
+
+    // Crowd mode: count copies of the model on a grid, each at its own
+    // point in the animation; 0 turns it off
+    void setCrowd(int count);
+    int  crowdSize() const;
+    // How the crowd has drawn since the last call; false if there's none
+    bool crowdStats(CrowdStats &stats);
+
+    // Bakes numFrames ticks of the model's own animation, from tick 0 and
+    // the current controls, into a new table (see frametable.h); NULL if
+    // the model doesn't implement drawModelAt()
+    FrameTable *bakeAnimation(int numFrames);
+
+    // Plays table in place of the model's animation, taking ownership of
+    // it; NULL goes back to the model's own
+    void setFrameTable(FrameTable *table);
+    const FrameTable *frameTable() const { return m_frames; }
+
+    // Shows the pose at tick (from the baked table if there is one) as a
+    // still frame: the sliders move to it and the animation stays stopped.
+    // The arrow keys step through ticks this way.
+    void scrubTo(double tick);
+
+    // Still frames are kept here once drawn (see framecache.h), so poses
+    // that come round again while scrubbing are shown without drawing
+    FrameCache *frameCache() { return m_frameCache; }
+
+    // How much of the pose on screen was reused from the one before (see
+    // controlgraph.h); false if it didn't come from the evaluation thread
+    bool evaluationStats(ControlGraphStats &stats) const;
+
+    // Queues a change to the controls, the draw state or the camera for
+    // whichever thread owns evaluation; see modelercommand.h.  UI thread
+    // only.  Doesn't redraw.
+    void postCommand(const ModelerCommand &command);
+
+    // Stops posing the model on the evaluation thread; the next draw
+    // starts it again.  Must be called before the model is destroyed.
+    void stopEvaluation();
+
+    // Read it freely on the UI thread, but change it with commands
     Camera *m_camera;
+
+protected:
+    // For a model's draw(), after ModelerView::draw(): draws the model
+    // through drawModelAt() by whichever route is current (the crowd, the
+    // latest pose from the evaluation thread, or directly), advancing the
+    // animation.  Returns false if the model doesn't implement drawModelAt().
+    // A still frame may be put up from the frame cache instead, so draw
+    // nothing after it.
+    bool drawModel();
+
+private:
+    static bool drawModelAtThread(void *view, double time);
+    static bool animateModelAtThread(void *view, double time);
+    bool poseModelAt(double time);
+    static void posePublished(void *view);
+    static void redrawView(void *view);
+    void applyCommands();
+    bool drawCrowd();
+    bool drawPose();
+    bool stillFrameKey(std::vector<double> &key);
+    bool drawCachedFrame(const std::vector<double> &key);
+    void cacheFrame(const std::vector<double> &key);
+    static bool renderPosterTile(void *view, const PosterTile &tile,
+                                 unsigned char *pixels, int stride);
+
+    // While set, draw() renders only this tile's slice of the frustum
+    const PosterTile *m_tile;
+
+    CommandQueue  m_commands;
+
+    Crowd        *m_crowd;
+    EvalThread   *m_eval;
+    FrameTable   *m_frames; // baked animation, if any
+    FrameCache   *m_frameCache;
+    double        m_tick;   // animation clock while it isn't on m_eval
 };
 
 
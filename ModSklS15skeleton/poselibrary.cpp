@@ -0,0 +1,331 @@
+// poselibrary.cpp
+
+#include "poselibrary.h"
+#include "cpufeatures.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(MODELER_X86)
+#include <immintrin.h>
+#endif
+
+static const char         kMagic[4] = { 'M', 'P', 'L', 'B' };
+static const unsigned int kVersion  = 1;
+
+// Poses blended in one pass; more are taken a group at a time
+static const int kBlendGroup = 32;
+
+// FNV-1a
+static unsigned int _hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+    for (; *name; ++name)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static unsigned int _align8(size_t n)
+{
+    return (unsigned int)((n + 7) & ~(size_t)7);
+}
+
+PoseLibrary::PoseLibrary(int numControls)
+    : m_header(NULL), m_slots(NULL), m_records(NULL), m_values(NULL), m_names(NULL)
+{
+    clear(numControls);
+}
+
+void PoseLibrary::clear(int numControls)
+{
+    rebuild(numControls > 0 ? numControls : 0, std::vector<std::string>(), std::vector<double>());
+}
+
+// ****************************************************************************
+// Building
+// ****************************************************************************
+
+// Lays names[i] with values[i * numControls...] out as a library image
+void PoseLibrary::rebuild(unsigned int numControls, const std::vector<std::string> &names,
+                          const std::vector<double> &values)
+{
+    unsigned int numPoses = (unsigned int)names.size();
+    unsigned int numSlots = 4;
+    while (numSlots < numPoses * 2)
+        numSlots *= 2;
+
+    size_t nameBytes = 0;
+    for (unsigned int p = 0; p < numPoses; ++p)
+        nameBytes += names[p].size() + 1;
+
+    PoseLibraryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, kMagic, sizeof(kMagic));
+    header.m_version      = kVersion;
+    header.m_numControls  = numControls;
+    header.m_numPoses     = numPoses;
+    header.m_numSlots     = numSlots;
+    header.m_indexOffset  = _align8(sizeof(PoseLibraryHeader));
+    header.m_recordOffset = _align8(header.m_indexOffset + numSlots * sizeof(PoseSlot));
+    header.m_valueOffset  = _align8(header.m_recordOffset + numPoses * sizeof(PoseRecord));
+    header.m_nameOffset   = header.m_valueOffset +
+                            (unsigned int)(numPoses * numControls * sizeof(double));
+    header.m_size         = header.m_nameOffset + (unsigned int)nameBytes;
+
+    std::vector<double> built((header.m_size + sizeof(double) - 1) / sizeof(double), 0);
+    unsigned char *data = (unsigned char *)&built[0];
+    PoseSlot *slots = (PoseSlot *)(data + header.m_indexOffset);
+    PoseRecord *records = (PoseRecord *)(data + header.m_recordOffset);
+    char *text = (char *)(data + header.m_nameOffset);
+
+    unsigned int at = 0;
+    for (unsigned int p = 0; p < numPoses; ++p)
+    {
+        records[p].m_name = at;
+        records[p].m_nameLength = (unsigned int)names[p].size();
+        memcpy(text + at, names[p].c_str(), names[p].size() + 1);
+        at += (unsigned int)names[p].size() + 1;
+
+        unsigned int h = _hash(names[p].c_str());
+        unsigned int s = h & (numSlots - 1);
+        while (slots[s].m_pose)
+            s = (s + 1) & (numSlots - 1);
+        slots[s].m_hash = h;
+        slots[s].m_pose = p + 1;
+    }
+    if (numPoses > 0 && numControls > 0)
+        memcpy(data + header.m_valueOffset, &values[0], numPoses * numControls * sizeof(double));
+    memcpy(data, &header, sizeof(header));
+
+    m_file.close();
+    m_built.swap(built);
+    attach((const unsigned char *)&m_built[0], header.m_size);
+}
+
+void PoseLibrary::setPose(const char *name, const double *values)
+{
+    int numControls = this->numControls();
+    std::vector<std::string> names;
+    std::vector<double> all;
+    int replace = find(name);
+    for (int p = 0; p < numPoses(); ++p)
+    {
+        names.push_back(this->name(p));
+        const double *from = p == replace ? values : this->values(p);
+        all.insert(all.end(), from, from + numControls);
+    }
+    if (replace < 0)
+    {
+        names.push_back(name);
+        all.insert(all.end(), values, values + numControls);
+    }
+    rebuild(numControls, names, all);
+}
+
+bool PoseLibrary::removePose(const char *name)
+{
+    int remove = find(name);
+    if (remove < 0)
+        return false;
+
+    int numControls = this->numControls();
+    std::vector<std::string> names;
+    std::vector<double> all;
+    for (int p = 0; p < numPoses(); ++p)
+        if (p != remove)
+        {
+            names.push_back(this->name(p));
+            all.insert(all.end(), values(p), values(p) + numControls);
+        }
+    rebuild(numControls, names, all);
+    return true;
+}
+
+bool PoseLibrary::save(const char *fname) const
+{
+    FILE *file = fopen(fname, "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(m_header, 1, m_header->m_size, file) == m_header->m_size;
+    return fclose(file) == 0 && ok;
+}
+
+// ****************************************************************************
+// Reading
+// ****************************************************************************
+
+bool PoseLibrary::open(const char *fname)
+{
+    int numControls = this->numControls();
+    if (m_file.open(fname, false) && attach(m_file.m_data, m_file.m_size))
+    {
+        m_built.clear();
+        return true;
+    }
+    clear(numControls);
+    return false;
+}
+
+// True if a * b items of each bytes, starting at offset, end by end.  Done
+// by division, so counts from a bad file can't wrap the product around.
+static bool _fits(size_t offset, size_t a, size_t b, size_t each, size_t end)
+{
+    if (offset > end)
+        return false;
+    size_t room = (end - offset) / each;
+    return a == 0 || b <= room / a;
+}
+
+// Points the accessors into data, if it holds a whole library
+bool PoseLibrary::attach(const unsigned char *data, size_t size)
+{
+    if (size < sizeof(PoseLibraryHeader))
+        return false;
+    const PoseLibraryHeader *header = (const PoseLibraryHeader *)data;
+    if (memcmp(header->m_magic, kMagic, sizeof(kMagic)) != 0 || header->m_version != kVersion ||
+        header->m_size > size || header->m_numSlots == 0 ||
+        (header->m_numSlots & (header->m_numSlots - 1)) != 0 ||
+        header->m_numPoses > header->m_numSlots / 2 ||
+        header->m_indexOffset % 8 || header->m_recordOffset % 8 || header->m_valueOffset % 8 ||
+        header->m_indexOffset < sizeof(PoseLibraryHeader) ||
+        !_fits(header->m_indexOffset, header->m_numSlots, 1, sizeof(PoseSlot), header->m_recordOffset) ||
+        !_fits(header->m_recordOffset, header->m_numPoses, 1, sizeof(PoseRecord), header->m_valueOffset) ||
+        !_fits(header->m_valueOffset, header->m_numPoses, header->m_numControls, sizeof(double),
+               header->m_nameOffset) ||
+        header->m_nameOffset > header->m_size)
+        return false;
+
+    // every name inside the file and terminated
+    const PoseRecord *records = (const PoseRecord *)(data + header->m_recordOffset);
+    size_t nameBytes = header->m_size - header->m_nameOffset;
+    const char *names = (const char *)(data + header->m_nameOffset);
+    for (unsigned int p = 0; p < header->m_numPoses; ++p)
+        if ((size_t)records[p].m_name + records[p].m_nameLength >= nameBytes ||
+            names[records[p].m_name + records[p].m_nameLength] != 0)
+            return false;
+
+    m_header  = header;
+    m_slots   = (const PoseSlot *)(data + header->m_indexOffset);
+    m_records = records;
+    m_values  = (const double *)(data + header->m_valueOffset);
+    m_names   = names;
+    return true;
+}
+
+int PoseLibrary::find(const char *name) const
+{
+    unsigned int h = _hash(name), mask = m_header->m_numSlots - 1;
+    unsigned int s = h & mask;
+    for (unsigned int probes = 0; probes <= mask && m_slots[s].m_pose; ++probes, s = (s + 1) & mask)
+    {
+        int pose = (int)m_slots[s].m_pose - 1;
+        if (m_slots[s].m_hash == h && pose < numPoses() && strcmp(this->name(pose), name) == 0)
+            return pose;
+    }
+    return -1;
+}
+
+const char *PoseLibrary::name(int pose) const
+{
+    return m_names + m_records[pose].m_name;
+}
+
+// ****************************************************************************
+// Blending
+// ****************************************************************************
+
+// controls[c] = controls[c] * keep + sum of weights[i] * poses[i][c]
+static void _blend_scalar(const double *const *poses, const double *weights, int count,
+                          double keep, double *controls, int begin, int end)
+{
+    for (int c = begin; c < end; ++c)
+    {
+        double v = controls[c] * keep;
+        for (int i = 0; i < count; ++i)
+            v += weights[i] * poses[i][c];
+        controls[c] = v;
+    }
+}
+
+#if defined(MODELER_X86)
+
+// 2 controls at a time
+static int _blend_sse2(const double *const *poses, const double *weights, int count,
+                       double keep, double *controls, int numControls)
+{
+    const __m128d k = _mm_set1_pd(keep);
+
+    int c = 0;
+    for (; c + 2 <= numControls; c += 2)
+    {
+        __m128d v = _mm_mul_pd(_mm_loadu_pd(controls + c), k);
+        for (int i = 0; i < count; ++i)
+            v = _mm_add_pd(v, _mm_mul_pd(_mm_set1_pd(weights[i]), _mm_loadu_pd(poses[i] + c)));
+        _mm_storeu_pd(controls + c, v);
+    }
+    return c;
+}
+
+// 4 controls at a time
+MODELER_TARGET("avx")
+static int _blend_avx(const double *const *poses, const double *weights, int count,
+                      double keep, double *controls, int numControls)
+{
+    const __m256d k = _mm256_set1_pd(keep);
+
+    int c = 0;
+    for (; c + 4 <= numControls; c += 4)
+    {
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(controls + c), k);
+        for (int i = 0; i < count; ++i)
+            v = _mm256_add_pd(v, _mm256_mul_pd(_mm256_set1_pd(weights[i]),
+                                               _mm256_loadu_pd(poses[i] + c)));
+        _mm256_storeu_pd(controls + c, v);
+    }
+    _mm256_zeroupper();
+    return c;
+}
+
+#endif
+
+bool PoseLibrary::blend(const PoseWeight *poses, int count, double *controls) const
+{
+    for (int i = 0; i < count; ++i)
+        if (poses[i].m_pose < 0 || poses[i].m_pose >= numPoses())
+            return false;
+
+    double keep = 1;
+    for (int i = 0; i < count; ++i)
+        keep -= poses[i].m_weight;
+
+    int numControls = this->numControls();
+    const double *values[kBlendGroup];
+    double weights[kBlendGroup];
+    int first = 0;
+    do
+    {
+        // the first group scales the controls, the rest only add to them
+        int group = count - first < kBlendGroup ? count - first : kBlendGroup;
+        for (int i = 0; i < group; ++i)
+        {
+            values[i]  = this->values(poses[first + i].m_pose);
+            weights[i] = poses[first + i].m_weight;
+        }
+
+        int done = 0;
+#if defined(MODELER_X86)
+        if (cpuHasAVX())
+            done = _blend_avx(values, weights, group, keep, controls, numControls);
+        else
+            done = _blend_sse2(values, weights, group, keep, controls, numControls);
+#endif
+        _blend_scalar(values, weights, group, keep, controls, done, numControls);
+
+        keep = 1;
+        first += group;
+    } while (first < count);
+    return true;
+}
@@ -0,0 +1,109 @@
+// poselibrary.h
+
+// Named poses of a model's controls, many to a file.
+//
+// The file is the in-memory layout, little endian, and is opened by
+// mapping it: a header, a hash index of the names, a record per pose, the
+// values (pose major, one double per control) and the names themselves.
+// The index is open addressing over a power-of-two table at most half
+// full, so finding a pose by name hashes it once and probes a slot or two
+// however many poses the library holds.
+//
+// blend() mixes any number of weighted poses into a set of control values
+// in one pass over the controls, vectorized, so driving the model from
+// poses every frame costs about as much as copying the controls.
+
+#ifndef POSELIBRARY_H
+#define POSELIBRARY_H
+
+#include "mappedfile.h"
+
+#include <string>
+#include <vector>
+
+struct PoseLibraryHeader
+{
+    char         m_magic[4];        // "MPLB"
+    unsigned int m_version;
+    unsigned int m_numControls;
+    unsigned int m_numPoses;
+    unsigned int m_numSlots;        // index size, a power of two
+    unsigned int m_indexOffset;     // m_numSlots PoseSlots
+    unsigned int m_recordOffset;    // m_numPoses PoseRecords
+    unsigned int m_valueOffset;     // m_numPoses * m_numControls doubles
+    unsigned int m_nameOffset;      // the names, each NUL terminated
+    unsigned int m_size;            // of the whole file
+};
+
+struct PoseSlot
+{
+    unsigned int m_hash;
+    unsigned int m_pose;            // index + 1, or 0 for an empty slot
+};
+
+struct PoseRecord
+{
+    unsigned int m_name;            // offset from m_nameOffset
+    unsigned int m_nameLength;
+};
+
+// One pose in a blend
+struct PoseWeight
+{
+    int    m_pose;
+    double m_weight;
+};
+
+class PoseLibrary
+{
+public:
+    // An empty library for a model with numControls controls
+    explicit PoseLibrary(int numControls = 0);
+
+    // Maps a saved library; false (and empty) if fname isn't one
+    bool open(const char *fname);
+    bool save(const char *fname) const;
+    void clear(int numControls);
+
+    int numControls() const { return (int)m_header->m_numControls; }
+    int numPoses() const { return (int)m_header->m_numPoses; }
+
+    // The pose called name, or -1
+    int find(const char *name) const;
+    const char *name(int pose) const;
+    const double *values(int pose) const
+    {
+        return m_values + (size_t)pose * m_header->m_numControls;
+    }
+
+    // Adds a pose of values[numControls()], replacing any of the same name.
+    // This rebuilds the library in memory, so it's for editing, not for
+    // every frame.
+    void setPose(const char *name, const double *values);
+    bool removePose(const char *name);
+
+    // controls = controls * (1 - the sum of the weights) + the sum of
+    // weight * pose, over numControls() controls: weights adding up to 1
+    // replace the controls, smaller ones lean them toward the poses.
+    // Returns false, leaving controls alone, if any pose is out of range.
+    bool blend(const PoseWeight *poses, int count, double *controls) const;
+
+private:
+    bool attach(const unsigned char *data, size_t size);
+    void rebuild(unsigned int numControls, const std::vector<std::string> &names,
+                 const std::vector<double> &values);
+
+    const PoseLibraryHeader *m_header;
+    const PoseSlot          *m_slots;
+    const PoseRecord        *m_records;
+    const double            *m_values;
+    const char              *m_names;
+
+    std::vector<double>      m_built;   // a library made here, doubles for alignment
+    MappedFile               m_file;    // or one from open()
+
+    PoseLibrary(const PoseLibrary &);
+    PoseLibrary &operator=(const PoseLibrary &);
+};
+
+#endif
@@ -0,0 +1,111 @@
+// posterrender.cpp
+
+#include "posterrender.h"
+#include "bitmap.h"
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+void posterTileFrustum(const PosterTile &tile, double fovy, double zNear,
+                       double bounds[4])
+{
+    // Same volume gluPerspective builds for the whole poster...
+    double top   = zNear * tan(fovy * 3.14159265358979323846 / 360.0);
+    double right = top * tile.m_posterWidth / tile.m_posterHeight;
+
+    // ...cut down to the tile's share of it
+    double sx = 2 * right / tile.m_posterWidth;
+    double sy = 2 * top / tile.m_posterHeight;
+    bounds[0] = -right + sx * tile.m_x;
+    bounds[1] = -right + sx * (tile.m_x + tile.m_width);
+    bounds[2] = -top + sy * tile.m_y;
+    bounds[3] = -top + sy * (tile.m_y + tile.m_height);
+}
+
+// Renders every tile of band y0 into band, across numThreads threads
+static bool _render_band(int width, int height, int y0, int bandHeight,
+                         int tileWidth, PosterTile_f renderTile, void *context,
+                         int numThreads, unsigned char *band)
+{
+    int numTiles = (width + tileWidth - 1) / tileWidth;
+    int stride = width * 3;
+
+    std::atomic<int>  next(0);
+    std::atomic<bool> ok(true);
+
+    auto work = [&]() {
+        for (int t = next++; t < numTiles && ok; t = next++)
+        {
+            PosterTile tile;
+            tile.m_posterWidth  = width;
+            tile.m_posterHeight = height;
+            tile.m_x      = t * tileWidth;
+            tile.m_y      = y0;
+            tile.m_width  = width - tile.m_x < tileWidth ? width - tile.m_x : tileWidth;
+            tile.m_height = bandHeight;
+            if (!renderTile(context, tile, band + tile.m_x * 3, stride))
+                ok = false;
+        }
+    };
+
+    if (numThreads > numTiles)
+        numThreads = numTiles;
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < numThreads; ++i)
+        helpers.push_back(std::thread(work));
+    work();
+    for (size_t i = 0; i < helpers.size(); ++i)
+        helpers[i].join();
+
+    return ok;
+}
+
+bool renderPoster(const char fname[], int width, int height,
+                  int tileWidth, int tileHeight,
+                  PosterTile_f renderTile, void *context, int numThreads)
+{
+    if (width <= 0 || height <= 0 || tileWidth <= 0 || tileHeight <= 0)
+        return false;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    BmpRowWriter writer;
+    if (!writer.open(fname, width, height))
+        return false;
+
+    // One band renders while the previous one is written out
+    size_t bandBytes = (size_t)width * 3 * tileHeight;
+    std::vector<unsigned char> bands[2];
+    bands[0].resize(bandBytes);
+    bands[1].resize(bandBytes);
+
+    std::thread writing;
+    bool written = true;
+    bool ok = true;
+
+    // BMP rows go bottom-up, and so do GL's
+    for (int y = 0, b = 0; y < height && ok; y += tileHeight, b ^= 1)
+    {
+        int bandHeight = height - y < tileHeight ? height - y : tileHeight;
+        unsigned char *band = &bands[b][0];
+
+        ok = _render_band(width, height, y, bandHeight, tileWidth,
+                          renderTile, context, numThreads, band);
+
+        if (writing.joinable())
+            writing.join();
+        if (!written)
+            ok = false;
+        if (ok)
+            writing = std::thread([&writer, &written, band, bandHeight]() {
+                written = writer.writeRows(band, bandHeight);
+            });
+    }
+
+    if (writing.joinable())
+        writing.join();
+    return writer.close() && ok && written;
+}
@@ -0,0 +1,44 @@
+// posterrender.h
+
+// Renders images far larger than the window, e.g. 16k x 16k posters.
+//
+// The poster is cut into a grid of tiles, each rendered through its own
+// slice of the view frustum.  Tiles are gathered a band (one row of
+// tiles) at a time and every finished band goes straight to a BmpRowWriter,
+// so memory stays at two bands however large the poster is: one being
+// rendered, one being written out on a background thread.
+
+#ifndef POSTERRENDER_H
+#define POSTERRENDER_H
+
+// One tile of the poster, in poster pixels with y running up like GL
+struct PosterTile
+{
+    int m_posterWidth;
+    int m_posterHeight;
+    int m_x;
+    int m_y;
+    int m_width;
+    int m_height;
+};
+
+// Renders tile into pixels, bottom-up RGB rows stride bytes apart.
+// Returns false to abandon the poster.
+typedef bool (*PosterTile_f)(void *context, const PosterTile &tile,
+                             unsigned char *pixels, int stride);
+
+// Renders a width x height poster in tiles of at most tileWidth x
+// tileHeight and writes it to fname as a BMP.  With numThreads > 1 the
+// tiles of a band render concurrently, which suits CPU renderers; the
+// callback must then be thread-safe.  GL renderers share one context and
+// should leave it at 1.
+bool renderPoster(const char fname[], int width, int height,
+                  int tileWidth, int tileHeight,
+                  PosterTile_f renderTile, void *context, int numThreads = 1);
+
+// The glFrustum bounds of tile's slice of gluPerspective(fovy, aspect of
+// the whole poster, zNear, ...): left, right, bottom, top
+void posterTileFrustum(const PosterTile &tile, double fovy, double zNear,
+                       double bounds[4]);
+
+#endif
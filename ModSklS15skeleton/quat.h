@@ -0,0 +1,255 @@
+#ifndef __QUATERNION_HEADER__
+#define __QUATERNION_HEADER__
+
+// Quaternions for rotations, and dual quaternions for rigid transforms
+// (rotation plus translation in 8 numbers instead of a Mat4's 16).  Both
+// compose more cheaply than matrices and interpolate cleanly, so hierarchy
+// code can carry them around and only turn them into a Mat4 for GL.
+//
+// Angles are in degrees and axes needn't be unit length, as with glRotated.
+
+#include "vec.h"
+#include "mat.h"
+
+#if defined(MODELER_X86)
+#include <emmintrin.h>
+#endif
+
+#pragma warning(push)
+#pragma warning(disable : 4244)
+
+//==========[ class Quat ]=================================
+
+template <class T>
+class Quat {
+
+	//---[ Private Variable Declarations ]-------
+
+		// x, y, z (the vector part), w
+	T		n[4];
+
+public:
+
+	//---[ Constructors ]------------------------
+
+	Quat() { n[0] = 0; n[1] = 0; n[2] = 0; n[3] = 1; }
+	Quat( const T x, const T y, const T z, const T w )
+		{ n[0] = x; n[1] = y; n[2] = z; n[3] = w; }
+
+		// the rotation glRotated(degrees, x, y, z) makes
+	static Quat<T> rotation( double degrees, double x, double y, double z ) {
+		double len = sqrt( x*x + y*y + z*z );
+		if( len == 0 )
+			return Quat<T>();
+		double half = degrees * 3.14159265358979323846 / 360.0;
+		double s = sin( half ) / len;
+		return Quat<T>( (T)(x*s), (T)(y*s), (T)(z*s), (T)cos( half ) );
+	}
+
+	//---[ Access Operators ]--------------------
+
+	T& operator []( int i )
+		{ return n[i]; }
+	T operator []( int i ) const
+		{ return n[i]; }
+
+	//---[ Arithmetic ]--------------------------
+
+	Quat<T> conjugate() const { return Quat<T>( -n[0], -n[1], -n[2], n[3] ); }
+	T dot( const Quat<T>& q ) const
+		{ return n[0]*q.n[0] + n[1]*q.n[1] + n[2]*q.n[2] + n[3]*q.n[3]; }
+	double length2() const { return dot( *this ); }
+
+	void normalize() {
+		double len = sqrt( length2() );
+		n[0] /= len; n[1] /= len; n[2] /= len; n[3] /= len;
+	}
+
+		// v rotated by this (unit) quaternion
+	Vec3<T> rotate( const Vec3<T>& v ) const {
+			// v + 2w(u x v) + 2u x (u x v), with u the vector part
+		T tx = 2 * (n[1]*v[2] - n[2]*v[1]);
+		T ty = 2 * (n[2]*v[0] - n[0]*v[2]);
+		T tz = 2 * (n[0]*v[1] - n[1]*v[0]);
+		return Vec3<T>( v[0] + n[3]*tx + n[1]*tz - n[2]*ty,
+						v[1] + n[3]*ty + n[2]*tx - n[0]*tz,
+						v[2] + n[3]*tz + n[0]*ty - n[1]*tx );
+	}
+
+	//---[ Matrix Conversion ]-------------------
+
+	Mat4<T> toMat4() const {
+		T x = n[0], y = n[1], z = n[2], w = n[3];
+		return Mat4<T>( 1-2*(y*y+z*z),   2*(x*y-w*z),   2*(x*z+w*y), 0,
+						  2*(x*y+w*z), 1-2*(x*x+z*z),   2*(y*z-w*x), 0,
+						  2*(x*z-w*y),   2*(y*z+w*x), 1-2*(x*x+y*y), 0,
+						0,             0,             0,             1 );
+	}
+
+	//---[ Friend Methods ]----------------------
+
+	template <class U> friend Quat<U> operator *( const Quat<U>& a, const Quat<U>& b );
+	template <class U> friend Quat<U> operator +( const Quat<U>& a, const Quat<U>& b );
+	template <class U> friend Quat<U> operator *( const Quat<U>& a, const double d );
+};
+
+typedef Quat<float> Quatf;
+typedef Quat<double> Quatd;
+
+//==========[ class DualQuat ]=============================
+
+	// a rigid transform: rotate by real, then translate by t where
+	// dual = t * real / 2 (t as a pure quaternion)
+template <class T>
+class DualQuat {
+
+	//---[ Private Variable Declarations ]-------
+
+	Quat<T>		r;
+	Quat<T>		d;
+
+public:
+
+	//---[ Constructors ]------------------------
+
+	DualQuat() : r(), d( 0, 0, 0, 0 ) {}
+	DualQuat( const Quat<T>& real, const Quat<T>& dual ) : r( real ), d( dual ) {}
+	DualQuat( const Quat<T>& rotation, T tx, T ty, T tz )
+		: r( rotation ), d( Quat<T>( tx, ty, tz, 0 ) * rotation * 0.5 ) {}
+
+	static DualQuat<T> translation( T x, T y, T z )
+		{ return DualQuat<T>( Quat<T>( 0, 0, 0, 1 ), Quat<T>( x/2, y/2, z/2, 0 ) ); }
+	static DualQuat<T> rotation( double degrees, double x, double y, double z )
+		{ return DualQuat<T>( Quat<T>::rotation( degrees, x, y, z ), Quat<T>( 0, 0, 0, 0 ) ); }
+
+	//---[ Access ]------------------------------
+
+	const Quat<T>& real() const { return r; }
+	const Quat<T>& dual() const { return d; }
+
+	Vec3<T> getTranslation() const {
+		Quat<T> t = d * r.conjugate();
+		return Vec3<T>( 2*t[0], 2*t[1], 2*t[2] );
+	}
+
+	//---[ Arithmetic ]--------------------------
+
+		// rescales to a unit real part; blending and long chains drift
+	void normalize() {
+		double len = sqrt( r.length2() );
+		r = r * (1.0 / len);
+		d = d * (1.0 / len);
+	}
+
+	Vec3<T> transformPoint( const Vec3<T>& p ) const {
+		Vec3<T> q = r.rotate( p );
+		Vec3<T> t = getTranslation();
+		return Vec3<T>( q[0]+t[0], q[1]+t[1], q[2]+t[2] );
+	}
+	Vec3<T> transformVector( const Vec3<T>& v ) const { return r.rotate( v ); }
+
+	//---[ Matrix Conversion ]-------------------
+
+	Mat4<T> toMat4() const {
+		Mat4<T> m = r.toMat4();
+		Vec3<T> t = getTranslation();
+		m[0][3] = t[0]; m[1][3] = t[1]; m[2][3] = t[2];
+		return m;
+	}
+
+	//---[ Friend Methods ]----------------------
+
+	template <class U> friend DualQuat<U> operator *( const DualQuat<U>& a, const DualQuat<U>& b );
+};
+
+typedef DualQuat<float> DualQuatf;
+typedef DualQuat<double> DualQuatd;
+
+//==========[ Inline Method Definitions ]==================
+
+	// a then b applied to a vector means b first, as with matrices
+template <class T>
+inline Quat<T> operator *( const Quat<T>& a, const Quat<T>& b ) {
+	return Quat<T>( a.n[3]*b.n[0] + a.n[0]*b.n[3] + a.n[1]*b.n[2] - a.n[2]*b.n[1],
+					a.n[3]*b.n[1] - a.n[0]*b.n[2] + a.n[1]*b.n[3] + a.n[2]*b.n[0],
+					a.n[3]*b.n[2] + a.n[0]*b.n[1] - a.n[1]*b.n[0] + a.n[2]*b.n[3],
+					a.n[3]*b.n[3] - a.n[0]*b.n[0] - a.n[1]*b.n[1] - a.n[2]*b.n[2] );
+}
+
+template <class T>
+inline Quat<T> operator +( const Quat<T>& a, const Quat<T>& b ) {
+	return Quat<T>( a.n[0]+b.n[0], a.n[1]+b.n[1], a.n[2]+b.n[2], a.n[3]+b.n[3] );
+}
+
+template <class T>
+inline Quat<T> operator *( const Quat<T>& a, const double d ) {
+	return Quat<T>( a.n[0]*d, a.n[1]*d, a.n[2]*d, a.n[3]*d );
+}
+
+template <class T>
+inline DualQuat<T> operator *( const DualQuat<T>& a, const DualQuat<T>& b ) {
+	return DualQuat<T>( a.r * b.r, a.r * b.d + a.d * b.r );
+}
+
+	// normalized linear blend along the shorter arc; cheap, and close to
+	// slerp for the small steps animation takes
+template <class T>
+inline Quat<T> nlerp( const Quat<T>& a, const Quat<T>& b, double t ) {
+	double sb = a.dot( b ) < 0 ? -t : t;
+	Quat<T> q = a * (1 - t) + b * sb;
+	q.normalize();
+	return q;
+}
+
+	// constant angular speed along the shorter arc
+template <class T>
+inline Quat<T> slerp( const Quat<T>& a, const Quat<T>& b, double t ) {
+	double c = a.dot( b );
+	double sign = c < 0 ? -1 : 1;
+	c *= sign;
+	if( c > 0.9995 )
+		return nlerp( a, b, t );
+
+	double angle = acos( c );
+	double s = sin( angle );
+	return a * (sin( (1-t) * angle ) / s) + b * (sign * sin( t * angle ) / s);
+}
+
+	// dual quaternion linear blending: a rigid transform between a and b
+template <class T>
+inline DualQuat<T> nlerp( const DualQuat<T>& a, const DualQuat<T>& b, double t ) {
+	double sb = a.real().dot( b.real() ) < 0 ? -t : t;
+	DualQuat<T> q( a.real() * (1 - t) + b.real() * sb, a.dual() * (1 - t) + b.dual() * sb );
+	q.normalize();
+	return q;
+}
+
+//==========[ SSE Specializations (float) ]================
+
+#if defined(MODELER_X86)
+
+template <>
+inline void Quat<float>::normalize() {
+	__m128 q = _mm_loadu_ps( n );
+	__m128 s = _mm_mul_ps( q, q );
+	s = _mm_add_ps( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE(2,3,0,1) ) );
+	s = _mm_add_ps( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE(1,0,3,2) ) );
+	_mm_storeu_ps( n, _mm_div_ps( q, _mm_sqrt_ps( s ) ) );
+}
+
+template <>
+inline void DualQuat<float>::normalize() {
+	__m128 q = _mm_loadu_ps( &r[0] );
+	__m128 s = _mm_mul_ps( q, q );
+	s = _mm_add_ps( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE(2,3,0,1) ) );
+	s = _mm_add_ps( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE(1,0,3,2) ) );
+	s = _mm_sqrt_ps( s );
+	_mm_storeu_ps( &r[0], _mm_div_ps( q, s ) );
+	_mm_storeu_ps( &d[0], _mm_div_ps( _mm_loadu_ps( &d[0] ), s ) );
+}
+
+#endif // MODELER_X86
+
+#pragma warning(pop)
+
+#endif
@@ -0,0 +1,754 @@
+// rayparser.cpp
+
+// Hand-rolled recursive descent parser for the exporter's .ray subset.
+// Scenes written by the modeler are large and entirely machine generated,
+// so the tokenizer works directly on the file buffer and never copies
+// strings or goes through iostreams/sscanf.
+
+#include "rayparser.h"
+
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+// ****************************************************************************
+// Cursor and lexing helpers
+// ****************************************************************************
+
+struct RayCursor
+{
+    const char *p;
+    const char *end;
+    int         line;
+    std::string error;
+};
+
+static bool _fail(RayCursor &c, const char *what)
+{
+    if (c.error.empty())
+    {
+        char buf[256];
+        sprintf(buf, "line %d: %s", c.line, what);
+        c.error = buf;
+    }
+    return false;
+}
+
+static void _skip_ws(RayCursor &c)
+{
+    while (c.p < c.end)
+    {
+        char ch = *c.p;
+        if (ch == '\n')
+        {
+            ++c.line; ++c.p;
+        }
+        else if (ch == ' ' || ch == '\t' || ch == '\r')
+            ++c.p;
+        else if (ch == '/' && c.p + 1 < c.end && c.p[1] == '/')
+        {
+            while (c.p < c.end && *c.p != '\n')
+                ++c.p;
+        }
+        else
+            break;
+    }
+}
+
+static bool _accept(RayCursor &c, char ch)
+{
+    _skip_ws(c);
+    if (c.p < c.end && *c.p == ch)
+    {
+        ++c.p;
+        return true;
+    }
+    return false;
+}
+
+static bool _expect(RayCursor &c, char ch)
+{
+    if (_accept(c, ch))
+        return true;
+
+    char msg[32];
+    sprintf(msg, "expected '%c'", ch);
+    return _fail(c, msg);
+}
+
+static inline bool _is_ident(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+           (ch >= '0' && ch <= '9') || ch == '_' || ch == '-' || ch == '.';
+}
+
+static inline bool _is_number_start(char ch)
+{
+    return (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.';
+}
+
+// Reads an identifier; returns a pointer into the buffer and its length
+static bool _ident(RayCursor &c, const char *&word, int &len)
+{
+    _skip_ws(c);
+    word = c.p;
+    while (c.p < c.end && _is_ident(*c.p))
+        ++c.p;
+    len = (int)(c.p - word);
+    return len > 0 ? true : _fail(c, "expected identifier");
+}
+
+static inline bool _is_word(const char *word, int len, const char *lit)
+{
+    return (int)strlen(lit) == len && !memcmp(word, lit, len);
+}
+
+// Exact powers of ten; everything up to 1e22 is representable in a double,
+// so mantissa/10^k is correctly rounded as long as the mantissa fits 2^53
+static const double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool _number(RayCursor &c, double &value)
+{
+    _skip_ws(c);
+    const char *start = c.p;
+    const char *p = c.p;
+
+    bool negative = false;
+    if (p < c.end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    unsigned long long mantissa = 0;
+    int digits = 0, fracDigits = 0;
+
+    while (p < c.end && *p >= '0' && *p <= '9')
+    {
+        mantissa = mantissa * 10 + (*p++ - '0');
+        ++digits;
+    }
+    if (p < c.end && *p == '.')
+    {
+        ++p;
+        while (p < c.end && *p >= '0' && *p <= '9')
+        {
+            mantissa = mantissa * 10 + (*p++ - '0');
+            ++digits; ++fracDigits;
+        }
+    }
+    if (digits == 0)
+        return _fail(c, "expected number");
+
+    bool hasExponent = (p < c.end && (*p == 'e' || *p == 'E'));
+
+    if (!hasExponent && digits <= 15 && fracDigits <= 22)
+    {
+        // %f output always takes this path
+        value = (double)mantissa / kPow10[fracDigits];
+        if (negative)
+            value = -value;
+        c.p = p;
+        return true;
+    }
+
+    // rare: exponents or very long mantissas, hand off to the C library
+    char buf[64];
+    size_t n = 0;
+    while (start + n < c.end && n < sizeof(buf) - 1 &&
+           (_is_number_start(start[n]) || start[n] == 'e' || start[n] == 'E'))
+    {
+        buf[n] = start[n];
+        ++n;
+    }
+    buf[n] = '\0';
+
+    char *stop;
+    value = strtod(buf, &stop);
+    if (stop == buf)
+        return _fail(c, "malformed number");
+    c.p = start + (stop - buf);
+    return true;
+}
+
+static bool _tuple(RayCursor &c, double *out, int n)
+{
+    if (!_expect(c, '('))
+        return false;
+    for (int i = 0; i < n; ++i)
+    {
+        if (i > 0 && !_expect(c, ','))
+            return false;
+        if (!_number(c, out[i]))
+            return false;
+    }
+    return _expect(c, ')');
+}
+
+// ****************************************************************************
+// Grammar
+// ****************************************************************************
+
+static void _mult_row_major(double *m, const double *w)
+{
+    double r[16];
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            r[i*4+j] = m[i*4+0]*w[0*4+j] + m[i*4+1]*w[1*4+j] +
+                       m[i*4+2]*w[2*4+j] + m[i*4+3]*w[3*4+j];
+    memcpy(m, r, sizeof(r));
+}
+
+static void _wrapper_matrix(const RayWrapper &w, double *m)
+{
+    static const double identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    memcpy(m, identity, sizeof(identity));
+
+    switch (w.m_type)
+    {
+    case RAY_TRANSFORM:
+        memcpy(m, w.m_values, 16 * sizeof(double));
+        break;
+    case RAY_SCALE:
+        m[0] = w.m_values[0]; m[5] = w.m_values[1]; m[10] = w.m_values[2];
+        break;
+    case RAY_TRANSLATE:
+        m[3] = w.m_values[0]; m[7] = w.m_values[1]; m[11] = w.m_values[2];
+        break;
+    }
+}
+
+// Skips a value we do not care about: number, identifier, tuple or block
+static bool _skip_value(RayCursor &c)
+{
+    _skip_ws(c);
+    if (c.p >= c.end)
+        return _fail(c, "unexpected end of file");
+
+    char ch = *c.p;
+    if (ch == '(' || ch == '{')
+    {
+        char close = (ch == '(') ? ')' : '}';
+        int depth = 0;
+        while (c.p < c.end)
+        {
+            if (*c.p == '\n') ++c.line;
+            if (*c.p == ch) ++depth;
+            else if (*c.p == close && --depth == 0)
+            {
+                ++c.p;
+                return true;
+            }
+            ++c.p;
+        }
+        return _fail(c, "unbalanced brackets");
+    }
+
+    const char *word;
+    int len;
+    return _ident(c, word, len);
+}
+
+static bool _material(RayCursor &c, RayMaterial &mat)
+{
+    if (!_expect(c, '{'))
+        return false;
+
+    while (!_accept(c, '}'))
+    {
+        const char *word;
+        int len;
+        if (!_ident(c, word, len) || !_expect(c, '='))
+            return false;
+
+        if (_is_word(word, len, "diffuse"))
+        {
+            if (!_tuple(c, mat.m_diffuse, 3))
+                return false;
+        }
+        else if (_is_word(word, len, "ambient"))
+        {
+            if (!_tuple(c, mat.m_ambient, 3))
+                return false;
+        }
+        else if (!_skip_value(c))
+            return false;
+
+        _accept(c, ';');
+    }
+    return true;
+}
+
+// points=((x,y,z),...) or faces=((a,b,c),...)
+static bool _tuple_list(RayCursor &c, std::vector<double> &out)
+{
+    if (!_expect(c, '('))
+        return false;
+    do
+    {
+        double v[3];
+        if (!_tuple(c, v, 3))
+            return false;
+        out.push_back(v[0]); out.push_back(v[1]); out.push_back(v[2]);
+    }
+    while (_accept(c, ','));
+    return _expect(c, ')');
+}
+
+static bool _primitive_body(RayCursor &c, RayObject &obj)
+{
+    if (!_expect(c, '{'))
+        return false;
+
+    while (!_accept(c, '}'))
+    {
+        const char *word;
+        int len;
+        if (!_ident(c, word, len) || !_expect(c, '='))
+            return false;
+
+        bool ok;
+        if (_is_word(word, len, "material"))
+        {
+            _skip_ws(c);
+            ok = (c.p < c.end && *c.p == '{') ? _material(c, obj.m_material)
+                                              : _skip_value(c);
+        }
+        else if (_is_word(word, len, "height"))
+            ok = _number(c, obj.m_height);
+        else if (_is_word(word, len, "bottom_radius"))
+            ok = _number(c, obj.m_bottomRadius);
+        else if (_is_word(word, len, "top_radius"))
+            ok = _number(c, obj.m_topRadius);
+        else if (_is_word(word, len, "points"))
+            ok = _tuple_list(c, obj.m_points);
+        else if (_is_word(word, len, "faces"))
+        {
+            std::vector<double> faces;
+            ok = _tuple_list(c, faces);
+            for (size_t i = 0; i < faces.size(); ++i)
+                obj.m_faces.push_back((int)faces[i]);
+        }
+        else
+            ok = _skip_value(c);
+
+        if (!ok)
+            return false;
+        _accept(c, ';');
+    }
+    return true;
+}
+
+static bool _node(RayCursor &c, RayObject &obj)
+{
+    const char *word;
+    int len;
+    if (!_ident(c, word, len))
+        return false;
+
+    RayWrapper w;
+    memset(&w, 0, sizeof(w));
+
+    if (_is_word(word, len, "transform"))
+    {
+        w.m_type = RAY_TRANSFORM;
+        if (!_expect(c, '('))
+            return false;
+        for (int row = 0; row < 4; ++row)
+            if (!_tuple(c, &w.m_values[row*4], 4) || !_expect(c, ','))
+                return false;
+    }
+    else if (_is_word(word, len, "scale") || _is_word(word, len, "translate"))
+    {
+        w.m_type = (word[0] == 's') ? RAY_SCALE : RAY_TRANSLATE;
+        if (!_expect(c, '(') || !_number(c, w.m_values[0]) || !_expect(c, ','))
+            return false;
+
+        // scale(s, obj) is shorthand for scale(s,s,s, obj)
+        _skip_ws(c);
+        if (c.p < c.end && _is_number_start(*c.p))
+        {
+            if (!_number(c, w.m_values[1]) || !_expect(c, ',') ||
+                !_number(c, w.m_values[2]) || !_expect(c, ','))
+                return false;
+        }
+        else if (w.m_type == RAY_SCALE)
+            w.m_values[1] = w.m_values[2] = w.m_values[0];
+        else
+            return _fail(c, "translate needs three components");
+    }
+    else
+    {
+        if (_is_word(word, len, "sphere"))
+            obj.m_type = RAY_SPHERE;
+        else if (_is_word(word, len, "box"))
+            obj.m_type = RAY_BOX;
+        else if (_is_word(word, len, "cone"))
+            obj.m_type = RAY_CONE;
+        else if (_is_word(word, len, "polymesh"))
+            obj.m_type = RAY_POLYMESH;
+        else
+            return _fail(c, "unsupported primitive");
+
+        return _primitive_body(c, obj);
+    }
+
+    obj.m_wrappers.push_back(w);
+
+    double m[16];
+    _wrapper_matrix(w, m);
+    _mult_row_major(obj.m_xform, m);
+
+    return _node(c, obj) && _expect(c, ')');
+}
+
+static void _init_object(RayObject &obj)
+{
+    static const double identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+
+    obj.m_type = RAY_SPHERE;
+    obj.m_wrappers.clear();
+    memset(&obj.m_material, 0, sizeof(obj.m_material));
+    memcpy(obj.m_xform, identity, sizeof(identity));
+    obj.m_height = obj.m_bottomRadius = obj.m_topRadius = 0.0;
+    obj.m_points.clear();
+    obj.m_faces.clear();
+}
+
+bool parseRayScene(const char *text, size_t len, RayScene &scene, std::string &error)
+{
+    RayCursor c;
+    c.p    = text;
+    c.end  = text + len;
+    c.line = 1;
+
+    scene.m_objects.clear();
+    scene.m_numLights = 0;
+
+    const char *word;
+    int wordLen;
+    double version;
+
+    if (!_ident(c, word, wordLen) || !_is_word(word, wordLen, "SBT-raytracer") ||
+        !_number(c, version))
+    {
+        error = c.error.empty() ? "missing SBT-raytracer header" : c.error;
+        return false;
+    }
+
+    for (;;)
+    {
+        _skip_ws(c);
+        if (c.p >= c.end)
+            break;
+
+        // peek the leading keyword without consuming it
+        const char *save = c.p;
+        int saveLine = c.line;
+        if (!_ident(c, word, wordLen))
+            break;
+
+        if (_is_word(word, wordLen, "camera") || _is_word(word, wordLen, "ambient_light") ||
+            _is_word(word, wordLen, "directional_light") || _is_word(word, wordLen, "point_light"))
+        {
+            if (word[0] != 'c')
+                ++scene.m_numLights;
+            if (!_skip_value(c))
+                break;
+            continue;
+        }
+
+        c.p = save;
+        c.line = saveLine;
+
+        scene.m_objects.push_back(RayObject());
+        RayObject &obj = scene.m_objects.back();
+        _init_object(obj);
+        if (!_node(c, obj))
+            break;
+    }
+
+    error = c.error;
+    return error.empty();
+}
+
+bool loadRayScene(const char fname[], RayScene &scene, std::string &error)
+{
+    FILE *file = fopen(fname, "rb");
+    if (file == NULL)
+    {
+        error = std::string("couldn't open ") + fname;
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    std::string text(size > 0 ? size : 0, '\0');
+    size_t got = size > 0 ? fread(&text[0], 1, size, file) : 0;
+    fclose(file);
+
+    return parseRayScene(text.data(), got, scene, error);
+}
+
+// ****************************************************************************
+// Writer
+// ****************************************************************************
+
+static void _appendf(std::string &out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0)
+        out.append(buf, n < (int)sizeof(buf) ? n : (int)sizeof(buf) - 1);
+}
+
+static void _write_transform(std::string &out, const double *m)
+{
+    _appendf(out, RAY_FMT_TRANSFORM,
+        m[ 0], m[ 1], m[ 2], m[ 3],
+        m[ 4], m[ 5], m[ 6], m[ 7],
+        m[ 8], m[ 9], m[10], m[11],
+        m[12], m[13], m[14], m[15]);
+}
+
+// True if obj has exactly the wrapper chain modelerdraw.cpp emits for it
+static bool _is_canonical(const RayObject &obj)
+{
+    const std::vector<RayWrapper> &w = obj.m_wrappers;
+    if (w.empty() || w[0].m_type != RAY_TRANSFORM)
+        return false;
+
+    switch (obj.m_type)
+    {
+    case RAY_SPHERE:
+        return w.size() == 2 && w[1].m_type == RAY_SCALE;
+    case RAY_BOX:
+        return w.size() == 3 && w[1].m_type == RAY_SCALE && w[2].m_type == RAY_TRANSLATE &&
+               w[2].m_values[0] == 0.5 && w[2].m_values[1] == 0.5 && w[2].m_values[2] == 0.5;
+    case RAY_CONE:
+        return w.size() == 1;
+    case RAY_POLYMESH:
+        return w.size() == 1 && obj.m_points.size() == 9 && obj.m_faces.size() == 3 &&
+               obj.m_faces[0] == 0 && obj.m_faces[1] == 1 && obj.m_faces[2] == 2;
+    }
+    return false;
+}
+
+static void _write_object(std::string &out, const RayObject &obj)
+{
+    const RayMaterial &mat = obj.m_material;
+    const std::vector<RayWrapper> &w = obj.m_wrappers;
+
+    if (_is_canonical(obj))
+    {
+        _write_transform(out, w[0].m_values);
+        switch (obj.m_type)
+        {
+        case RAY_SPHERE:
+            _appendf(out, RAY_FMT_SPHERE, w[1].m_values[0], w[1].m_values[1], w[1].m_values[2]);
+            break;
+        case RAY_BOX:
+            _appendf(out, RAY_FMT_BOX, w[1].m_values[0], w[1].m_values[1], w[1].m_values[2]);
+            break;
+        case RAY_CONE:
+            _appendf(out, RAY_FMT_CONE, obj.m_height, obj.m_bottomRadius, obj.m_topRadius);
+            break;
+        case RAY_POLYMESH:
+        {
+            const double *p = &obj.m_points[0];
+            _appendf(out, RAY_FMT_TRIANGLE, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+            break;
+        }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < w.size(); ++i)
+        {
+            const double *v = w[i].m_values;
+            if (w[i].m_type == RAY_TRANSFORM)
+                _write_transform(out, v);
+            else
+                _appendf(out, "%s(%f,%f,%f,",
+                         w[i].m_type == RAY_SCALE ? "scale" : "translate", v[0], v[1], v[2]);
+        }
+
+        switch (obj.m_type)
+        {
+        case RAY_SPHERE:
+            out += "sphere {\n";
+            break;
+        case RAY_BOX:
+            out += "box {\n";
+            break;
+        case RAY_CONE:
+            _appendf(out, RAY_FMT_CONE, obj.m_height, obj.m_bottomRadius, obj.m_topRadius);
+            break;
+        case RAY_POLYMESH:
+            out += "polymesh { points=(";
+            for (size_t i = 0; i + 2 < obj.m_points.size(); i += 3)
+                _appendf(out, "%s(%f,%f,%f)", i ? "," : "",
+                         obj.m_points[i], obj.m_points[i+1], obj.m_points[i+2]);
+            out += "); faces=(";
+            for (size_t i = 0; i + 2 < obj.m_faces.size(); i += 3)
+                _appendf(out, "%s(%d,%d,%d)", i ? "," : "",
+                         obj.m_faces[i], obj.m_faces[i+1], obj.m_faces[i+2]);
+            out += ");\n";
+            break;
+        }
+    }
+
+    _appendf(out, RAY_FMT_MATERIAL,
+             mat.m_diffuse[0], mat.m_diffuse[1], mat.m_diffuse[2],
+             mat.m_ambient[0], mat.m_ambient[1], mat.m_ambient[2]);
+
+    out += '}';
+    out.append(w.size(), ')');
+    out += '\n';
+}
+
+void writeRayScene(const RayScene &scene, std::string &out)
+{
+    out += RAY_FMT_HEADER;
+    out += RAY_FMT_CAMERA;
+    out += RAY_FMT_LIGHT;
+
+    for (size_t i = 0; i < scene.m_objects.size(); ++i)
+        _write_object(out, scene.m_objects[i]);
+}
+
+// ****************************************************************************
+// Validation
+// ****************************************************************************
+
+static const char *_primitive_name(RayPrimitive_t type)
+{
+    static const char *names[] = { "sphere", "box", "cone", "polymesh" };
+    return names[type];
+}
+
+static bool _close(const double *a, const double *b, int n, double tolerance, int &where)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        if (fabs(a[i] - b[i]) > tolerance)
+        {
+            where = i;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool compareRayScenes(const RayScene &a, const RayScene &b,
+                      double tolerance, std::string &report)
+{
+    char buf[256];
+
+    if (a.m_objects.size() != b.m_objects.size())
+    {
+        sprintf(buf, "object count differs: %d vs %d",
+                (int)a.m_objects.size(), (int)b.m_objects.size());
+        report = buf;
+        return false;
+    }
+
+    for (size_t i = 0; i < a.m_objects.size(); ++i)
+    {
+        const RayObject &oa = a.m_objects[i];
+        const RayObject &ob = b.m_objects[i];
+        const char *name = _primitive_name(oa.m_type);
+        int k;
+
+        if (oa.m_type != ob.m_type)
+        {
+            sprintf(buf, "object %d: %s vs %s", (int)i, name, _primitive_name(ob.m_type));
+            report = buf;
+            return false;
+        }
+        if (!_close(oa.m_xform, ob.m_xform, 16, tolerance, k))
+        {
+            sprintf(buf, "object %d (%s): transform[%d] %f vs %f",
+                    (int)i, name, k, oa.m_xform[k], ob.m_xform[k]);
+            report = buf;
+            return false;
+        }
+        if (!_close(oa.m_material.m_diffuse, ob.m_material.m_diffuse, 3, tolerance, k) ||
+            !_close(oa.m_material.m_ambient, ob.m_material.m_ambient, 3, tolerance, k))
+        {
+            sprintf(buf, "object %d (%s): material differs", (int)i, name);
+            report = buf;
+            return false;
+        }
+
+        double ca[3] = { oa.m_height, oa.m_bottomRadius, oa.m_topRadius };
+        double cb[3] = { ob.m_height, ob.m_bottomRadius, ob.m_topRadius };
+        if (!_close(ca, cb, 3, tolerance, k))
+        {
+            sprintf(buf, "object %d (%s): cone parameter %d %f vs %f", (int)i, name, k, ca[k], cb[k]);
+            report = buf;
+            return false;
+        }
+
+        if (oa.m_points.size() != ob.m_points.size() || oa.m_faces != ob.m_faces ||
+            (!oa.m_points.empty() &&
+             !_close(&oa.m_points[0], &ob.m_points[0], (int)oa.m_points.size(), tolerance, k)))
+        {
+            sprintf(buf, "object %d (%s): mesh differs", (int)i, name);
+            report = buf;
+            return false;
+        }
+    }
+
+    sprintf(buf, "%d objects match", (int)a.m_objects.size());
+    report = buf;
+    return true;
+}
+
+bool validateRayFile(const char fname[], std::string &report)
+{
+    FILE *file = fopen(fname, "rb");
+    if (file == NULL)
+    {
+        report = std::string("couldn't open ") + fname;
+        return false;
+    }
+
+    std::string original;
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        original.append(chunk, n);
+    fclose(file);
+
+    RayScene scene;
+    if (!parseRayScene(original.data(), original.size(), scene, report))
+        return false;
+
+    std::string rendered;
+    writeRayScene(scene, rendered);
+
+    char buf[128];
+    if (rendered == original)
+    {
+        sprintf(buf, "%d objects, round-trip is byte-exact", (int)scene.m_objects.size());
+        report = buf;
+        return true;
+    }
+
+    RayScene again;
+    if (!parseRayScene(rendered.data(), rendered.size(), again, report))
+    {
+        report = "re-rendered scene does not parse: " + report;
+        return false;
+    }
+
+    // %f keeps six decimals, so anything beyond half an ulp of that is real
+    return compareRayScenes(scene, again, 0.5e-6, report);
+}
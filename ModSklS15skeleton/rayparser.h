@@ -0,0 +1,118 @@
+// rayparser.h
+
+// Reader for the subset of the SBT .ray format that modelerdraw.cpp
+// writes out: transform/scale/translate wrappers around sphere, box,
+// cone and polymesh primitives, each carrying an inline material.
+//
+// The format strings used by the exporter live here as well, so the
+// parser's writer and openRayFile()/drawXXX() can never drift apart.
+// That is what makes the round-trip check meaningful: a recording that
+// was produced by the modeler must come back out byte-for-byte.
+
+#ifndef RAYPARSER_H
+#define RAYPARSER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ****************************************************************************
+// Exporter format strings (shared with modelerdraw.cpp)
+// ****************************************************************************
+
+#define RAY_FMT_HEADER   "SBT-raytracer 1.0\n\n"
+#define RAY_FMT_CAMERA   "camera { fov=30; position=(0,0.8,5); direction=(0,-0.8,-5); }\n\n"
+#define RAY_FMT_LIGHT    "directional_light { direction=(-1,-2,-1); color=(0.7,0.7,0.7); }\n\n"
+
+// Row-major 4x4, the caller passes the GL (column-major) matrix transposed
+#define RAY_FMT_TRANSFORM \
+    "transform(\n    (%f,%f,%f,%f),\n    (%f,%f,%f,%f),\n     (%f,%f,%f,%f),\n    (%f,%f,%f,%f),\n"
+#define RAY_FMT_MATERIAL \
+    "material={\n    diffuse=(%f,%f,%f);\n    ambient=(%f,%f,%f);\n}\n"
+
+#define RAY_FMT_SPHERE   "scale(%f,%f,%f,sphere {\n"
+#define RAY_FMT_BOX      "scale(%f,%f,%f,translate(0.5,0.5,0.5,box {\n"
+#define RAY_FMT_CONE     "cone { height=%f; bottom_radius=%f; top_radius=%f;\n"
+#define RAY_FMT_TRIANGLE \
+    "polymesh { points=((%f,%f,%f),(%f,%f,%f),(%f,%f,%f)); faces=((0,1,2));\n"
+
+#define RAY_FMT_CLOSE_SPHERE "}))\n"
+#define RAY_FMT_CLOSE_BOX    "})))\n"
+#define RAY_FMT_CLOSE_CONE   "})\n"
+#define RAY_FMT_CLOSE_MESH   "})\n"
+
+// ****************************************************************************
+// Parsed scene
+// ****************************************************************************
+
+enum RayPrimitive_t
+{ RAY_SPHERE=0, RAY_BOX, RAY_CONE, RAY_POLYMESH, };
+
+enum RayWrapper_t
+{ RAY_TRANSFORM=0, RAY_SCALE, RAY_TRANSLATE, };
+
+// One transform(...)/scale(...)/translate(...) around a primitive,
+// kept in file order so a scene can be written back out unchanged
+struct RayWrapper
+{
+    RayWrapper_t m_type;
+    double       m_values[16];   // transform: row-major 4x4, else x,y,z
+};
+
+struct RayMaterial
+{
+    double m_diffuse[3];
+    double m_ambient[3];
+};
+
+struct RayObject
+{
+    RayPrimitive_t          m_type;
+    std::vector<RayWrapper> m_wrappers;
+    RayMaterial             m_material;
+
+    // accumulated object-to-world transform, row-major
+    double m_xform[16];
+
+    // cone only
+    double m_height;
+    double m_bottomRadius;
+    double m_topRadius;
+
+    // polymesh only
+    std::vector<double> m_points;
+    std::vector<int>    m_faces;
+};
+
+struct RayScene
+{
+    std::vector<RayObject> m_objects;
+    int                    m_numLights;
+};
+
+// ****************************************************************************
+// Parsing, writing and validation
+// ****************************************************************************
+
+// Parses len bytes of .ray text.  Returns false and fills in error
+// (with a line number) if the text is not in the exporter's subset.
+bool parseRayScene(const char *text, size_t len, RayScene &scene, std::string &error);
+
+// Reads and parses a whole .ray file
+bool loadRayScene(const char fname[], RayScene &scene, std::string &error);
+
+// Writes a scene back out exactly as modelerdraw.cpp would have
+void writeRayScene(const RayScene &scene, std::string &out);
+
+// Compares two scenes object by object; tolerance is absolute.
+// On mismatch, describes the first difference in report.
+bool compareRayScenes(const RayScene &a, const RayScene &b,
+                      double tolerance, std::string &report);
+
+// Round-trip validation of a recording: parse it, re-render the parsed
+// scene through the exporter's format, and check the result against the
+// original bytes.  If the bytes differ (e.g. hand-edited whitespace), the
+// re-rendered text is parsed again and compared structurally instead.
+bool validateRayFile(const char fname[], std::string &report);
+
+#endif
@@ -81,9 +81,8 @@ void SampleModel::draw()
   glPopMatrix();
 }
 
-/*
-// DISABLE FOR OTHER MAIN
-int main()
+// Makes the controls and starts the model; run it with --model sample
+static void setupSampleModel()
 {
   // Initialize the controls
   // Constructor is ModelerControl(name, minimumvalue, maximumvalue, 
@@ -97,6 +96,6 @@ int main()
   controls[BULLET_SCALE] = ModelerControl("Bullet Scale", 1.0f, 2.0f, 0.1f, 1.0f);
 
   ModelerApplication::Instance()->Init(&createSampleModel, controls, NUMCONTROLS);
-  return ModelerApplication::Instance()->Run();
 }
-*/
+
+static ModelerModel s_sampleModel("sample", setupSampleModel);
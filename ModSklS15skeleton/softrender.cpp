@@ -0,0 +1,410 @@
+// softrender.cpp
+
+#include "softrender.h"
+#include "tessellation.h"
+#include "workpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// The view's projection and lights (modelerview.cpp).  The lights are
+// directional and set after the viewing transform, so they're fixed in the
+// world; both are white, and GL adds a fifth of the ambient colour.
+static const double kFieldOfView = 30.0;
+static const double kNearPlane   = 1.0;
+static const double kFarPlane    = 100.0;
+static const float  kLights[2][3] = { { 4, 2, -4 }, { -2, 1, 5 } };
+static const float  kAmbientLight = 0.2f;
+
+// Rows filled by one task
+static const int kBandRows = 16;
+
+SoftRenderer::SoftRenderer(int width, int height)
+    : m_width(std::max(1, width)), m_height(std::max(1, height)),
+      m_pixels((size_t)m_width * m_height * 3), m_depth((size_t)m_width * m_height),
+      m_material(NULL)
+{
+}
+
+void SoftRenderer::render(const DrawList &list, const Mat4f &view, QualitySetting_t quality,
+                          WorkPool *pool)
+{
+    // gluPerspective's matrix
+    double f = 1.0 / tan(kFieldOfView * 3.14159265358979323846 / 360.0);
+    double aspect = (double)m_width / m_height;
+    Mat4f projection((float)(f / aspect), 0, 0, 0,
+                     0, (float)f, 0, 0,
+                     0, 0, (float)((kFarPlane + kNearPlane) / (kNearPlane - kFarPlane)),
+                     (float)(2 * kFarPlane * kNearPlane / (kNearPlane - kFarPlane)),
+                     0, 0, -1, 0);
+    Mat4f camera = projection * view;
+
+    m_triangles.clear();
+    for (int i = 0; i < list.itemCount(); ++i)
+    {
+        const DrawItem &item = list.item(i);
+        addItem(item, list.materialOf(item), camera, quality);
+    }
+
+    int bands = (m_height + kBandRows - 1) / kBandRows;
+    if (pool)
+        pool->parallelFor(bands, _fillBand, this);
+    else
+        for (int band = 0; band < bands; ++band)
+            fillBand(band);
+}
+
+// ****************************************************************************
+// Cutting the items into triangles
+// ****************************************************************************
+
+// camera is the projection times the viewing transform
+void SoftRenderer::addItem(const DrawItem &item, const DrawMaterial &material,
+                           const Mat4f &camera, QualitySetting_t quality)
+{
+    if (item.m_type == DRAW_INSTANCE)
+    {
+        const std::vector<DrawItem> &items = item.m_shape->m_items;
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            DrawItem part = items[i];
+            part.m_matrix = item.m_matrix * part.m_matrix;
+            addItem(part, DrawList::shapeMaterial(item, (int)i, material), camera, quality);
+        }
+        return;
+    }
+
+    Mat4f transform = camera * item.m_matrix;
+    Mat4f normals = item.m_matrix.affineInverse().transpose();
+    for (int r = 0; r < 4; ++r)
+        for (int c = 0; c < 4; ++c)
+            m_transform[r * 4 + c] = transform[r][c];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 3; ++c)
+            m_normalMatrix[r * 3 + c] = normals[r][c];
+    m_material = &material;
+
+    const double *p = item.m_params;
+    float corners[9], facing[9];
+
+    switch (item.m_type)
+    {
+    case DRAW_SPHERE:
+    {
+        const SphereTable &sphere = unitSphere(quality);
+        for (int i = 0; i < sphere.indexCount; i += 3)
+        {
+            for (int v = 0; v < 3; ++v)
+            {
+                const float *vertex = sphere.vertices + 8 * sphere.indices[i + v];
+                for (int k = 0; k < 3; ++k)
+                {
+                    facing[v * 3 + k]  = vertex[2 + k];
+                    corners[v * 3 + k] = (float)(vertex[5 + k] * p[0]);
+                }
+            }
+            addTriangle(corners, facing);
+        }
+        break;
+    }
+
+    case DRAW_BOX:
+    case DRAW_TEXTURE_BOX:
+    {
+        // the faces _draw_box draws, two triangles each
+        static const float normals[6][3] = {
+            { 0, 0, -1 }, { 0, -1, 0 }, { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 }, { 1, 0, 0 } };
+        static const float quads[6][4][3] = {
+            { { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } },
+            { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 } },
+            { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 } },
+            { { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } },
+            { { 0, 1, 0 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 1, 0 } },
+            { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 1, 0, 1 } } };
+        static const int halves[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+
+        for (int face = 0; face < 6; ++face)
+            for (int half = 0; half < 2; ++half)
+            {
+                for (int v = 0; v < 3; ++v)
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        corners[v * 3 + k] = (float)(quads[face][halves[half][v]][k] * p[k]);
+                        facing[v * 3 + k]  = normals[face][k];
+                    }
+                addTriangle(corners, facing);
+            }
+        break;
+    }
+
+    case DRAW_CYLINDER:
+    {
+        // as drawCylinder cuts it: n stacks of n slices, then the ends
+        const CircleTable &circle = unitCircle(quality);
+        int n = circle.divisions;
+        double h = p[0], r1 = p[1], r2 = p[2];
+        double length = sqrt((r1 - r2) * (r1 - r2) + h * h);
+        float xyNormal = (float)(length > 0.0 ? h / length : 1.0);
+        float zNormal  = (float)(length > 0.0 ? (r1 - r2) / length : 0.0);
+
+        for (int j = 0; j < n; ++j)
+        {
+            float z[2] = { (float)(h * j / n), (float)(h * (j + 1) / n) };
+            float r[2] = { (float)(r1 + (r2 - r1) * j / n), (float)(r1 + (r2 - r1) * (j + 1) / n) };
+            for (int i = 0; i < n; ++i)
+            {
+                // low i, high i, high i+1, low i+1
+                static const int slice[4] = { 0, 0, 1, 1 }, stack[4] = { 0, 1, 1, 0 };
+                float quad[4][3], quadNormals[4][3];
+                for (int v = 0; v < 4; ++v)
+                {
+                    float x = circle.sines[2 * (i + slice[v])], y = circle.cosines[2 * (i + slice[v])];
+                    quad[v][0] = r[stack[v]] * x;
+                    quad[v][1] = r[stack[v]] * y;
+                    quad[v][2] = z[stack[v]];
+                    quadNormals[v][0] = x * xyNormal;
+                    quadNormals[v][1] = y * xyNormal;
+                    quadNormals[v][2] = zNormal;
+                }
+                static const int halves[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+                for (int half = 0; half < 2; ++half)
+                {
+                    for (int v = 0; v < 3; ++v)
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            corners[v * 3 + k] = quad[halves[half][v]][k];
+                            facing[v * 3 + k]  = quadNormals[halves[half][v]][k];
+                        }
+                    addTriangle(corners, facing);
+                }
+            }
+        }
+
+        for (int end = 0; end < 2; ++end)
+        {
+            double radius = end ? r2 : r1;
+            if (radius <= 0.0)
+                continue;
+            float height = end ? (float)h : 0.0f;
+            for (int v = 0; v < 3; ++v)
+            {
+                facing[v * 3]     = 0;
+                facing[v * 3 + 1] = 0;
+                facing[v * 3 + 2] = end ? 1.0f : -1.0f;
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                // a fan from the middle, wound as _draw_disk winds it
+                int k0 = 2 * (end ? n - i : i), k1 = 2 * (end ? n - i - 1 : i + 1);
+                float fan[9] = { 0, 0, height,
+                                 (float)(radius * circle.sines[k0]), (float)(radius * circle.cosines[k0]), height,
+                                 (float)(radius * circle.sines[k1]), (float)(radius * circle.cosines[k1]), height };
+                addTriangle(fan, facing);
+            }
+        }
+        break;
+    }
+
+    case DRAW_TRIANGLE:
+    {
+        for (int k = 0; k < 9; ++k)
+            corners[k] = (float)p[k];
+        float a[3] = { corners[3] - corners[0], corners[4] - corners[1], corners[5] - corners[2] };
+        float b[3] = { corners[6] - corners[0], corners[7] - corners[1], corners[8] - corners[2] };
+        float n[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        for (int v = 0; v < 3; ++v)
+            for (int k = 0; k < 3; ++k)
+                facing[v * 3 + k] = n[k];
+        addTriangle(corners, facing);
+        break;
+    }
+
+    case DRAW_MESH:
+    {
+        // normal, point per vertex; a triangle each three
+        const std::vector<GLfloat> &v = *item.m_vertices;
+        for (size_t i = 0; i + 18 <= v.size(); i += 18)
+        {
+            for (int c = 0; c < 3; ++c)
+                for (int k = 0; k < 3; ++k)
+                {
+                    facing[c * 3 + k]  = v[i + c * 6 + k];
+                    corners[c * 3 + k] = v[i + c * 6 + 3 + k];
+                }
+            addTriangle(corners, facing);
+        }
+        break;
+    }
+    case DRAW_INSTANCE:
+        break;
+    }
+}
+
+// Takes a triangle of the current item through the projection and lights
+// its corners
+void SoftRenderer::addTriangle(const float *corners, const float *normals)
+{
+    const float *t = m_transform, *nm = m_normalMatrix;
+    ClipVertex v[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const float *p = corners + 3 * i, *n = normals + 3 * i;
+        for (int r = 0; r < 4; ++r)
+            v[i].m_position[r] = t[r * 4] * p[0] + t[r * 4 + 1] * p[1] + t[r * 4 + 2] * p[2] + t[r * 4 + 3];
+
+        // GL_NORMALIZE
+        float world[3];
+        for (int r = 0; r < 3; ++r)
+            world[r] = nm[r * 3] * n[0] + nm[r * 3 + 1] * n[1] + nm[r * 3 + 2] * n[2];
+        float length = sqrtf(world[0] * world[0] + world[1] * world[1] + world[2] * world[2]);
+        if (length > 0)
+            for (int r = 0; r < 3; ++r)
+                world[r] /= length;
+
+        float diffuse = 0;
+        for (int l = 0; l < 2; ++l)
+        {
+            const float *light = kLights[l];
+            float d = (world[0] * light[0] + world[1] * light[1] + world[2] * light[2]) /
+                      sqrtf(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+            diffuse += std::max(0.0f, d);
+        }
+        for (int c = 0; c < 3; ++c)
+            v[i].m_color[c] = std::min(1.0f, kAmbientLight * m_material->m_ambient[c] +
+                                             diffuse * m_material->m_diffuse[c]);
+    }
+
+    // wholly outside one side of the view, or the far plane
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int below = 0, above = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            below += v[i].m_position[axis] < -v[i].m_position[3];
+            above += v[i].m_position[axis] > v[i].m_position[3];
+        }
+        if (below == 3 || above == 3)
+            return;
+    }
+
+    // Cut off what's in front of the near plane (z < -w)
+    ClipVertex kept[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        const ClipVertex &a = v[i], &b = v[(i + 1) % 3];
+        float da = a.m_position[2] + a.m_position[3];
+        float db = b.m_position[2] + b.m_position[3];
+        if (da >= 0)
+            kept[count++] = a;
+        if ((da >= 0) != (db >= 0))
+        {
+            float s = da / (da - db);
+            ClipVertex &c = kept[count++];
+            for (int k = 0; k < 4; ++k)
+                c.m_position[k] = a.m_position[k] + s * (b.m_position[k] - a.m_position[k]);
+            for (int k = 0; k < 3; ++k)
+                c.m_color[k] = a.m_color[k] + s * (b.m_color[k] - a.m_color[k]);
+        }
+    }
+    for (int i = 1; i + 1 < count; ++i)
+        addClipped(kept[0], kept[i], kept[i + 1]);
+}
+
+void SoftRenderer::addClipped(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c)
+{
+    ScreenTriangle t;
+    const ClipVertex *v[3] = { &a, &b, &c };
+    float top = 1e30f, bottom = -1e30f;
+    for (int i = 0; i < 3; ++i)
+    {
+        float w = 1.0f / v[i]->m_position[3];
+        t.m_x[i] = (v[i]->m_position[0] * w * 0.5f + 0.5f) * m_width;
+        t.m_y[i] = (v[i]->m_position[1] * w * 0.5f + 0.5f) * m_height;
+        t.m_z[i] = v[i]->m_position[2] * w * 0.5f + 0.5f;
+        for (int k = 0; k < 3; ++k)
+            t.m_color[i][k] = v[i]->m_color[k];
+        top    = std::min(top, t.m_y[i]);
+        bottom = std::max(bottom, t.m_y[i]);
+    }
+
+    // the rows whose centres it may cover
+    t.m_top    = std::max(0, (int)ceilf(top - 0.5f));
+    t.m_bottom = std::min(m_height - 1, (int)floorf(bottom - 0.5f));
+    if (t.m_top <= t.m_bottom)
+        m_triangles.push_back(t);
+}
+
+// ****************************************************************************
+// Filling
+// ****************************************************************************
+
+void SoftRenderer::_fillBand(void *renderer, int band, int)
+{
+    ((SoftRenderer *)renderer)->fillBand(band);
+}
+
+void SoftRenderer::fillBand(int band)
+{
+    int first = band * kBandRows, last = std::min(m_height, first + kBandRows) - 1;
+
+    std::fill(m_pixels.begin() + (size_t)first * m_width * 3,
+              m_pixels.begin() + (size_t)(last + 1) * m_width * 3, 0);
+    std::fill(m_depth.begin() + (size_t)first * m_width,
+              m_depth.begin() + (size_t)(last + 1) * m_width, 1.0f);
+
+    // in the order drawn, so ties in depth go to the first, as in GL
+    for (size_t i = 0; i < m_triangles.size(); ++i)
+    {
+        const ScreenTriangle &t = m_triangles[i];
+        if (t.m_bottom < first || t.m_top > last)
+            continue;
+
+        const float *x = t.m_x, *y = t.m_y;
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0)
+            continue;
+
+        float left  = std::min(x[0], std::min(x[1], x[2]));
+        float right = std::max(x[0], std::max(x[1], x[2]));
+        int x0 = std::max(0, (int)ceilf(left - 0.5f));
+        int x1 = std::min(m_width - 1, (int)floorf(right - 0.5f));
+        if (x0 > x1)
+            continue;
+
+        // each corner's weight at a pixel centre, and how it steps along a row
+        float step[3] = { -(y[2] - y[1]) / area, -(y[0] - y[2]) / area, -(y[1] - y[0]) / area };
+        int top = std::max(first, t.m_top), bottom = std::min(last, t.m_bottom);
+        for (int row = top; row <= bottom; ++row)
+        {
+            float px = x0 + 0.5f, py = row + 0.5f;
+            float b[3] = { ((x[2] - x[1]) * (py - y[1]) - (y[2] - y[1]) * (px - x[1])) / area,
+                           ((x[0] - x[2]) * (py - y[2]) - (y[0] - y[2]) * (px - x[2])) / area,
+                           ((x[1] - x[0]) * (py - y[0]) - (y[1] - y[0]) * (px - x[0])) / area };
+
+            size_t at = (size_t)row * m_width + x0;
+            for (int column = x0; column <= x1; ++column, ++at)
+            {
+                if (b[0] >= 0 && b[1] >= 0 && b[2] >= 0)
+                {
+                    float z = b[0] * t.m_z[0] + b[1] * t.m_z[1] + b[2] * t.m_z[2];
+                    if (z >= 0 && z <= 1 && z < m_depth[at])
+                    {
+                        m_depth[at] = z;
+                        unsigned char *pixel = &m_pixels[at * 3];
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            float c = b[0] * t.m_color[0][k] + b[1] * t.m_color[1][k] +
+                                      b[2] * t.m_color[2][k];
+                            pixel[k] = (unsigned char)(std::max(0.0f, std::min(1.0f, c)) * 255 + 0.5f);
+                        }
+                    }
+                }
+                b[0] += step[0];
+                b[1] += step[1];
+                b[2] += step[2];
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+// softrender.h
+
+// Draws a DrawList into an image on the CPU, for rendering where there's no
+// window or GL context to draw with (batch jobs on machines without a
+// display).
+//
+// The items are cut into triangles as the GL path cuts them, from the same
+// sphere and circle tables at the quality given, then seen through the
+// view's projection and lit per vertex by its two lights, as GL_SMOOTH
+// lights them.  Only the ambient and diffuse colours are used: textures and
+// specular highlights are left out.  The triangles are then filled into a
+// depth buffer one band of rows at a time, the bands spread over a
+// WorkPool.
+//
+// The image is bottom-up RGB rows, as glReadPixels() gives them, so it can
+// go straight to the imagewriter.h and gifwriter.h encoders.
+
+#ifndef SOFTRENDER_H
+#define SOFTRENDER_H
+
+#include "drawlist.h"
+
+#include <vector>
+
+class WorkPool;
+
+class SoftRenderer
+{
+public:
+    SoftRenderer(int width, int height);
+
+    // Draws list, under view (the camera's viewing transform), over a
+    // black background.  pool, if given, fills the bands in parallel.
+    void render(const DrawList &list, const Mat4f &view, QualitySetting_t quality,
+                WorkPool *pool = NULL);
+
+    int width() const  { return m_width; }
+    int height() const { return m_height; }
+    const unsigned char *pixels() const { return &m_pixels[0]; }
+    // Triangles drawn by the last render(), after clipping
+    int triangleCount() const { return (int)m_triangles.size(); }
+
+private:
+    // A vertex seen through the projection, before the divide, and lit
+    struct ClipVertex
+    {
+        float m_position[4];
+        float m_color[3];
+    };
+
+    // A triangle in window coordinates, ready to fill
+    struct ScreenTriangle
+    {
+        float m_x[3], m_y[3], m_z[3];
+        float m_color[3][3];
+        int   m_top, m_bottom;      // rows, inclusive
+    };
+
+    void addItem(const DrawItem &item, const DrawMaterial &material, const Mat4f &camera,
+                 QualitySetting_t quality);
+    void addTriangle(const float *corners, const float *normals);
+    void addClipped(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c);
+    void fillBand(int band);
+    static void _fillBand(void *renderer, int band, int thread);
+
+    int                         m_width;
+    int                         m_height;
+    std::vector<unsigned char>  m_pixels;
+    std::vector<float>          m_depth;
+    std::vector<ScreenTriangle> m_triangles;
+
+    // the item being cut up
+    float                       m_transform[16];    // object to clip, row major
+    float                       m_normalMatrix[9];  // object to world
+    const DrawMaterial         *m_material;
+
+    SoftRenderer(const SoftRenderer &);
+    SoftRenderer &operator=(const SoftRenderer &);
+};
+
+#endif
@@ -0,0 +1,68 @@
+// spscqueue.h
+
+// A bounded first-in first-out queue between exactly one producer thread
+// and one consumer thread, with no locks.
+//
+// The items live in a ring of Capacity slots (a power of two).  The
+// producer only ever writes m_tail and the consumer only m_head, each
+// publishing its side with a release store the other picks up with an
+// acquire load, so neither waits on the other: push() fails when the ring
+// is full, pop() when it's empty, and each side decides what to do then.
+// Either end may change threads as long as the hand-over itself is
+// synchronized (say, by joining the old thread).
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+template <class T, unsigned Capacity>
+class SpscQueue
+{
+public:
+    SpscQueue() : m_head(0), m_tail(0) {}
+
+    // Producer side: false if the queue is full
+    bool push(const T &item)
+    {
+        unsigned tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: false if the queue is empty
+    bool pop(T &item)
+    {
+        unsigned head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+    T                     m_items[Capacity];
+
+    // Padded onto separate cache lines, so each side's stores don't slow
+    // the other down
+    char                  m_pad0[64];
+    std::atomic<unsigned> m_head;       // next to pop
+    char                  m_pad1[64];
+    std::atomic<unsigned> m_tail;       // next to push
+
+    SpscQueue(const SpscQueue &);
+    SpscQueue &operator=(const SpscQueue &);
+};
+
+#endif
@@ -0,0 +1,157 @@
+// tessellation.cpp
+
+#include "tessellation.h"
+
+// ****************************************************************************
+// Compile-time trig
+// ****************************************************************************
+
+static constexpr double _pi = 3.14159265358979323846;
+
+// Taylor series, good to double precision for 0 <= a < pi/2
+static constexpr double _sin_quarter(double a)
+{
+    double term = a, sum = a;
+    for (int n = 1; n < 12; ++n)
+    {
+        term *= -a * a / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr double _cos_quarter(double a)
+{
+    double term = 1, sum = 1;
+    for (int n = 1; n < 12; ++n)
+    {
+        term *= -a * a / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+// The angle pi * i / divisions, for an even number of divisions.  Working
+// from the index keeps the quarter points exact: cos(pi/2) comes out 0, not
+// 6e-17.
+static constexpr double _circle_cos(int i, int divisions)
+{
+    int quarter = divisions / 2;
+    int q = (i / quarter) % 4, r = i % quarter;
+    double a = _pi * r / divisions;
+    return q == 0 ? _cos_quarter(a) : q == 1 ? -_sin_quarter(a) :
+           q == 2 ? -_cos_quarter(a) : _sin_quarter(a);
+}
+
+static constexpr double _circle_sin(int i, int divisions)
+{
+    int quarter = divisions / 2;
+    int q = (i / quarter) % 4, r = i % quarter;
+    double a = _pi * r / divisions;
+    return q == 0 ? _sin_quarter(a) : q == 1 ? _cos_quarter(a) :
+           q == 2 ? -_sin_quarter(a) : -_cos_quarter(a);
+}
+
+// ****************************************************************************
+// Tables
+// ****************************************************************************
+
+template <int N>
+struct _CircleData
+{
+    float c[2 * N + 1];
+    float s[2 * N + 1];
+
+    constexpr _CircleData() : c(), s()
+    {
+        for (int i = 0; i <= 2 * N; ++i)
+        {
+            c[i] = (float)_circle_cos(i, N);
+            s[i] = (float)_circle_sin(i, N);
+        }
+    }
+};
+
+template <int N>
+struct _SphereData
+{
+    enum { Vertices = (N + 1) * (N + 1), Indices = 6 * N * N };
+
+    float          v[Vertices * 8];
+    unsigned short i[Indices];
+
+    constexpr _SphereData() : v(), i()
+    {
+        // As gluSphere: stack j is at polar angle pi * j / N from +z, slice k
+        // at 2 * pi * k / N, with x = sin(polar) sin(slice), y = sin(polar)
+        // cos(slice)
+        for (int j = 0; j <= N; ++j)
+            for (int k = 0; k <= N; ++k)
+            {
+                double sp = _circle_sin(j, N), cp = _circle_cos(j, N);
+                double x = sp * _circle_sin(2 * k, N), y = sp * _circle_cos(2 * k, N);
+                float *out = v + (j * (N + 1) + k) * 8;
+                out[0] = 1.0f - (float)k / N;
+                out[1] = 1.0f - (float)j / N;
+                out[2] = out[5] = (float)x;
+                out[3] = out[6] = (float)y;
+                out[4] = out[7] = (float)cp;
+            }
+
+        // Each band between stacks j and j + 1 as the quad strip gluSphere
+        // draws, lower stack first, split into triangles
+        int n = 0;
+        for (int j = 0; j < N; ++j)
+            for (int k = 0; k < N; ++k)
+            {
+                unsigned short a0 = (unsigned short)((j + 1) * (N + 1) + k), b0 = (unsigned short)(j * (N + 1) + k);
+                unsigned short a1 = (unsigned short)(a0 + 1), b1 = (unsigned short)(b0 + 1);
+                i[n++] = a0; i[n++] = b0; i[n++] = a1;
+                i[n++] = a1; i[n++] = b0; i[n++] = b1;
+            }
+    }
+};
+
+static constexpr _CircleData<32> s_circle32;
+static constexpr _CircleData<20> s_circle20;
+static constexpr _CircleData<12> s_circle12;
+static constexpr _CircleData<8>  s_circle8;
+
+static constexpr _SphereData<32> s_sphere32;
+static constexpr _SphereData<20> s_sphere20;
+static constexpr _SphereData<12> s_sphere12;
+static constexpr _SphereData<8>  s_sphere8;
+
+// Indexed by QualitySetting_t
+static const CircleTable s_circles[] = {
+    { 32, s_circle32.c, s_circle32.s },
+    { 20, s_circle20.c, s_circle20.s },
+    { 12, s_circle12.c, s_circle12.s },
+    { 8,  s_circle8.c,  s_circle8.s },
+};
+
+#define SPHERE_TABLE(N) \
+    { N, s_sphere##N.v, _SphereData<N>::Vertices, s_sphere##N.i, _SphereData<N>::Indices }
+
+static const SphereTable s_spheres[] = {
+    SPHERE_TABLE(32), SPHERE_TABLE(20), SPHERE_TABLE(12), SPHERE_TABLE(8),
+};
+
+#undef SPHERE_TABLE
+
+// ****************************************************************************
+
+int qualityDivisions(QualitySetting_t quality)
+{
+    return s_circles[quality].divisions;
+}
+
+const CircleTable &unitCircle(QualitySetting_t quality)
+{
+    return s_circles[quality];
+}
+
+const SphereTable &unitSphere(QualitySetting_t quality)
+{
+    return s_spheres[quality];
+}
@@ -0,0 +1,42 @@
+// tessellation.h
+
+// Unit circle and unit sphere vertex tables, one per quality level, worked
+// out by the compiler and baked into the binary.  The procedural shapes
+// (drawSphere, drawCylinder, the eyes) index these instead of calling
+// sin/cos or GLU every frame.
+
+#ifndef TESSELLATION_H
+#define TESSELLATION_H
+
+#include "modelerdraw.h"
+
+// 2 * divisions + 1 points around the unit circle, pi / divisions apart,
+// starting at angle 0; the last point repeats the first.  The first
+// divisions + 1 points make a half circle, and every other point makes a
+// full circle cut into divisions slices.
+struct CircleTable
+{
+    int          divisions;
+    const float *cosines;
+    const float *sines;
+};
+
+// A unit sphere cut the way gluSphere(divisions, divisions) cuts it.
+// Vertices run slice-fastest from the +z pole, as s, t, nx, ny, nz, x, y, z
+// (GL_T2F_N3F_V3F); the indices make GL_TRIANGLES facing outward.
+struct SphereTable
+{
+    int                   divisions;
+    const float          *vertices;
+    int                   vertexCount;
+    const unsigned short *indices;
+    int                   indexCount;
+};
+
+// How finely each quality level cuts curves: 32, 20, 12 or 8
+int qualityDivisions(QualitySetting_t quality);
+
+const CircleTable &unitCircle(QualitySetting_t quality);
+const SphereTable &unitSphere(QualitySetting_t quality);
+
+#endif
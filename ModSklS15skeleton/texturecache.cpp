@@ -0,0 +1,186 @@
+// texturecache.cpp
+
+#include "texturecache.h"
+#include "bitmap.h"
+#include "cpufeatures.h"
+
+#include <GL/glu.h>
+#include <cstdio>
+#include <cstring>
+
+#if defined(MODELER_X86)
+#include <emmintrin.h>
+#endif
+
+// ****************************************************************************
+// Mip pyramid
+// ****************************************************************************
+
+#if defined(MODELER_X86)
+
+// Averages four pixels from each of two rows into two output pixels
+static inline __m128i _box4(const unsigned char *r0, const unsigned char *r1)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i *)r0);
+    __m128i b = _mm_loadu_si128((const __m128i *)r1);
+
+    // vertical sums, 16 bits per channel: pixels 0,1 and pixels 2,3
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+    // horizontal: (0 + 1), (2 + 3), rounded
+    __m128i even = _mm_unpacklo_epi64(lo, hi);
+    __m128i odd  = _mm_unpackhi_epi64(lo, hi);
+    __m128i sum  = _mm_add_epi16(_mm_add_epi16(even, odd), _mm_set1_epi16(2));
+    return _mm_srli_epi16(sum, 2);
+}
+
+static int _box_row_sse2(unsigned char *dst, const unsigned char *r0, const unsigned char *r1, int pairs)
+{
+    int x = 0;
+    for (; x + 4 <= pairs; x += 4)
+    {
+        __m128i a = _box4(r0 + x * 8,      r1 + x * 8);
+        __m128i b = _box4(r0 + x * 8 + 16, r1 + x * 8 + 16);
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_packus_epi16(a, b));
+    }
+    return x;
+}
+
+#endif
+
+void mipBoxFilter(unsigned char *dst, const unsigned char *src, int w, int h)
+{
+    int dw = (w + 1) / 2, dh = (h + 1) / 2;
+    size_t stride = (size_t)w * 4;
+
+    for (int y = 0; y < dh; ++y)
+    {
+        const unsigned char *r0 = src + stride * (2 * y);
+        const unsigned char *r1 = 2 * y + 1 < h ? r0 + stride : r0;
+        unsigned char *out = dst + (size_t)dw * 4 * y;
+
+        // whole 2x2 blocks first, then a leftover odd column
+        int pairs = w / 2;
+        int x = 0;
+#if defined(MODELER_X86)
+        x = _box_row_sse2(out, r0, r1, pairs);
+#endif
+        for (; x < dw; ++x)
+        {
+            int x0 = 2 * x, x1 = 2 * x + 1 < w ? 2 * x + 1 : 2 * x;
+            for (int c = 0; c < 4; ++c)
+                out[x * 4 + c] = (unsigned char)((r0[x0 * 4 + c] + r0[x1 * 4 + c] +
+                                                  r1[x0 * 4 + c] + r1[x1 * 4 + c] + 2) >> 2);
+        }
+    }
+}
+
+void buildMipPyramid(const unsigned char *rgba, int w, int h,
+                     std::vector<std::vector<unsigned char> > &levels)
+{
+    levels.clear();
+    levels.push_back(std::vector<unsigned char>(rgba, rgba + (size_t)w * h * 4));
+
+    while (w > 1 || h > 1)
+    {
+        int dw = (w + 1) / 2, dh = (h + 1) / 2;
+        levels.push_back(std::vector<unsigned char>((size_t)dw * dh * 4));
+        mipBoxFilter(&levels.back()[0], &levels[levels.size() - 2][0], w, h);
+        w = dw;
+        h = dh;
+    }
+}
+
+// ****************************************************************************
+// TextureCache
+// ****************************************************************************
+
+TextureCache* TextureCache::m_instance = NULL;
+
+TextureCache* TextureCache::Instance()
+{
+    // Return the singleton if it exists, otherwise, create it
+    return (m_instance) ? (m_instance) : m_instance = new TextureCache();
+}
+
+GLuint TextureCache::get(const char path[])
+{
+    std::map<std::string, GLuint>::iterator it = m_textures.find(path);
+    if (it != m_textures.end())
+        return it->second;
+
+    GLuint texture = load(path);
+    m_textures[path] = texture;
+    return texture;
+}
+
+void TextureCache::clear()
+{
+    for (std::map<std::string, GLuint>::iterator it = m_textures.begin(); it != m_textures.end(); ++it)
+        if (it->second)
+            glDeleteTextures(1, &it->second);
+    m_textures.clear();
+}
+
+static int _power_of_two_at_most(int n, int limit)
+{
+    int p = 1;
+    while (p * 2 <= n && p * 2 <= limit)
+        p *= 2;
+    return p;
+}
+
+GLuint TextureCache::load(const char path[])
+{
+    int w, h;
+    unsigned char *image = readBMPAlpha(path, w, h);
+    if (image == NULL)
+    {
+        fprintf(stderr, "Unable to load texture %s\n", path);
+        return 0;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // GL 1.1 wants power of two sizes
+    GLint maxSize = 64;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    int pw = _power_of_two_at_most(w, maxSize);
+    int ph = _power_of_two_at_most(h, maxSize);
+
+    std::vector<unsigned char> base;
+    const unsigned char *pixels = image;
+    if (pw != w || ph != h)
+    {
+        base.resize((size_t)pw * ph * 4);
+        gluScaleImage(GL_RGBA, w, h, GL_UNSIGNED_BYTE, image,
+                      pw, ph, GL_UNSIGNED_BYTE, &base[0]);
+        pixels = &base[0];
+    }
+
+    std::vector<std::vector<unsigned char> > levels;
+    buildMipPyramid(pixels, pw, ph, levels);
+    delete [] image;
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    int lw = pw, lh = ph;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, lw, lh, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, &levels[i][0]);
+        lw = lw > 1 ? lw / 2 : 1;
+        lh = lh > 1 ? lh / 2 : 1;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
@@ -0,0 +1,53 @@
+// texturecache.h
+
+// Textures loaded from BMP files, shared by every primitive that uses
+// them.  Each file is read, scaled to a power of two and turned into a
+// box-filtered mip pyramid once; after that the texture is just bound.
+// The cache lives with the modeler's one GL context.
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <FL/gl.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class TextureCache
+{
+public:
+    static TextureCache* Instance();
+
+    // GL texture for the BMP at path, loading it on first use; 0 if the
+    // file can't be read.  Failures are remembered too, so a bad path
+    // doesn't hit the disk every frame.  The GL context must be current.
+    GLuint get(const char path[]);
+
+    // Deletes every texture; the context must be current
+    void clear();
+
+    int size() const { return (int)m_textures.size(); }
+
+private:
+    TextureCache() {}
+    TextureCache(const TextureCache &) {}
+    TextureCache& operator=(const TextureCache &) { return *this; }
+
+    GLuint load(const char path[]);
+
+    std::map<std::string, GLuint> m_textures;
+
+    static TextureCache *m_instance;
+};
+
+// Halves a w x h RGBA image into dst ((w+1)/2 x (h+1)/2), averaging each
+// 2x2 block; a dimension of 1 is only halved along the other.  SSE2.
+void mipBoxFilter(unsigned char *dst, const unsigned char *src, int w, int h);
+
+// Every level of the mip pyramid of a w x h RGBA image, level 0 first
+// (a copy of the image) down to 1x1
+void buildMipPyramid(const unsigned char *rgba, int w, int h,
+                     std::vector<std::vector<unsigned char> > &levels);
+
+#endif
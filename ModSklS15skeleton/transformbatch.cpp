@@ -0,0 +1,298 @@
+// transformbatch.cpp
+
+#include "transformbatch.h"
+#include "cpufeatures.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(MODELER_X86)
+#include <immintrin.h>
+#endif
+
+// Everything below works on the top three rows of a matrix, a[12] row
+// major: out = a * (x, y, z, 1).  Normals pass the normal matrix with a
+// zero translation column.
+
+// Keeps a zero-length normal at zero instead of dividing by it
+static const float kMinLength2 = 1e-30f;
+
+// ****************************************************************************
+// Scalar
+// ****************************************************************************
+
+static void _affine_scalar(const float *a, const float *x, const float *y, const float *z,
+                           float *ox, float *oy, float *oz, int begin, int end, bool normalize)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        float px = x[i], py = y[i], pz = z[i];
+        float rx = a[0] * px + a[1] * py + a[ 2] * pz + a[ 3];
+        float ry = a[4] * px + a[5] * py + a[ 6] * pz + a[ 7];
+        float rz = a[8] * px + a[9] * py + a[10] * pz + a[11];
+        if (normalize)
+        {
+            float len2 = rx * rx + ry * ry + rz * rz;
+            float s = 1.0f / sqrtf(len2 > kMinLength2 ? len2 : kMinLength2);
+            rx *= s; ry *= s; rz *= s;
+        }
+        ox[i] = rx;
+        oy[i] = ry;
+        oz[i] = rz;
+    }
+}
+
+static void _bounds_scalar(const float *a, const float *x, const float *y, const float *z,
+                           int begin, int end, float lo[3], float hi[3])
+{
+    for (int i = begin; i < end; ++i)
+    {
+        float p[3];
+        p[0] = a[0] * x[i] + a[1] * y[i] + a[ 2] * z[i] + a[ 3];
+        p[1] = a[4] * x[i] + a[5] * y[i] + a[ 6] * z[i] + a[ 7];
+        p[2] = a[8] * x[i] + a[9] * y[i] + a[10] * z[i] + a[11];
+        for (int c = 0; c < 3; ++c)
+        {
+            lo[c] = p[c] < lo[c] ? p[c] : lo[c];
+            hi[c] = p[c] > hi[c] ? p[c] : hi[c];
+        }
+    }
+}
+
+#if defined(MODELER_X86)
+
+// ****************************************************************************
+// SSE2, 4 points at a time
+// ****************************************************************************
+
+static int _affine_sse2(const float *a, const float *x, const float *y, const float *z,
+                        float *ox, float *oy, float *oz, int count, bool normalize)
+{
+    __m128 m[12];
+    for (int k = 0; k < 12; ++k)
+        m[k] = _mm_set1_ps(a[k]);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], px), _mm_mul_ps(m[1], py)),
+                               _mm_add_ps(_mm_mul_ps(m[ 2], pz), m[ 3]));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], px), _mm_mul_ps(m[5], py)),
+                               _mm_add_ps(_mm_mul_ps(m[ 6], pz), m[ 7]));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], px), _mm_mul_ps(m[9], py)),
+                               _mm_add_ps(_mm_mul_ps(m[10], pz), m[11]));
+        if (normalize)
+        {
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+                                     _mm_mul_ps(rz, rz));
+            __m128 s = _mm_div_ps(_mm_set1_ps(1.0f),
+                                  _mm_sqrt_ps(_mm_max_ps(len2, _mm_set1_ps(kMinLength2))));
+            rx = _mm_mul_ps(rx, s);
+            ry = _mm_mul_ps(ry, s);
+            rz = _mm_mul_ps(rz, s);
+        }
+        _mm_storeu_ps(ox + i, rx);
+        _mm_storeu_ps(oy + i, ry);
+        _mm_storeu_ps(oz + i, rz);
+    }
+    return i;
+}
+
+static int _bounds_sse2(const float *a, const float *x, const float *y, const float *z,
+                        int count, float lo[3], float hi[3])
+{
+    if (count < 4)
+        return 0;
+
+    __m128 m[12];
+    for (int k = 0; k < 12; ++k)
+        m[k] = _mm_set1_ps(a[k]);
+
+    __m128 lx = _mm_set1_ps(FLT_MAX), ly = lx, lz = lx;
+    __m128 hx = _mm_set1_ps(-FLT_MAX), hy = hx, hz = hx;
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], px), _mm_mul_ps(m[1], py)),
+                               _mm_add_ps(_mm_mul_ps(m[ 2], pz), m[ 3]));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], px), _mm_mul_ps(m[5], py)),
+                               _mm_add_ps(_mm_mul_ps(m[ 6], pz), m[ 7]));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], px), _mm_mul_ps(m[9], py)),
+                               _mm_add_ps(_mm_mul_ps(m[10], pz), m[11]));
+        lx = _mm_min_ps(lx, rx); hx = _mm_max_ps(hx, rx);
+        ly = _mm_min_ps(ly, ry); hy = _mm_max_ps(hy, ry);
+        lz = _mm_min_ps(lz, rz); hz = _mm_max_ps(hz, rz);
+    }
+
+    float l[3][4], h[3][4];
+    _mm_storeu_ps(l[0], lx); _mm_storeu_ps(l[1], ly); _mm_storeu_ps(l[2], lz);
+    _mm_storeu_ps(h[0], hx); _mm_storeu_ps(h[1], hy); _mm_storeu_ps(h[2], hz);
+    for (int c = 0; c < 3; ++c)
+        for (int k = 0; k < 4; ++k)
+        {
+            lo[c] = l[c][k] < lo[c] ? l[c][k] : lo[c];
+            hi[c] = h[c][k] > hi[c] ? h[c][k] : hi[c];
+        }
+    return i;
+}
+
+// ****************************************************************************
+// AVX, 8 points at a time
+// ****************************************************************************
+
+MODELER_TARGET("avx")
+static int _affine_avx(const float *a, const float *x, const float *y, const float *z,
+                       float *ox, float *oy, float *oz, int count, bool normalize)
+{
+    __m256 m[12];
+    for (int k = 0; k < 12; ++k)
+        m[k] = _mm256_set1_ps(a[k]);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], px), _mm256_mul_ps(m[1], py)),
+                                  _mm256_add_ps(_mm256_mul_ps(m[ 2], pz), m[ 3]));
+        __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], px), _mm256_mul_ps(m[5], py)),
+                                  _mm256_add_ps(_mm256_mul_ps(m[ 6], pz), m[ 7]));
+        __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], px), _mm256_mul_ps(m[9], py)),
+                                  _mm256_add_ps(_mm256_mul_ps(m[10], pz), m[11]));
+        if (normalize)
+        {
+            __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, rx), _mm256_mul_ps(ry, ry)),
+                                        _mm256_mul_ps(rz, rz));
+            __m256 s = _mm256_div_ps(_mm256_set1_ps(1.0f),
+                                     _mm256_sqrt_ps(_mm256_max_ps(len2, _mm256_set1_ps(kMinLength2))));
+            rx = _mm256_mul_ps(rx, s);
+            ry = _mm256_mul_ps(ry, s);
+            rz = _mm256_mul_ps(rz, s);
+        }
+        _mm256_storeu_ps(ox + i, rx);
+        _mm256_storeu_ps(oy + i, ry);
+        _mm256_storeu_ps(oz + i, rz);
+    }
+    _mm256_zeroupper();
+    return i;
+}
+
+MODELER_TARGET("avx")
+static int _bounds_avx(const float *a, const float *x, const float *y, const float *z,
+                       int count, float lo[3], float hi[3])
+{
+    if (count < 8)
+        return 0;
+
+    __m256 m[12];
+    for (int k = 0; k < 12; ++k)
+        m[k] = _mm256_set1_ps(a[k]);
+
+    __m256 lx = _mm256_set1_ps(FLT_MAX), ly = lx, lz = lx;
+    __m256 hx = _mm256_set1_ps(-FLT_MAX), hy = hx, hz = hx;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], px), _mm256_mul_ps(m[1], py)),
+                                  _mm256_add_ps(_mm256_mul_ps(m[ 2], pz), m[ 3]));
+        __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], px), _mm256_mul_ps(m[5], py)),
+                                  _mm256_add_ps(_mm256_mul_ps(m[ 6], pz), m[ 7]));
+        __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], px), _mm256_mul_ps(m[9], py)),
+                                  _mm256_add_ps(_mm256_mul_ps(m[10], pz), m[11]));
+        lx = _mm256_min_ps(lx, rx); hx = _mm256_max_ps(hx, rx);
+        ly = _mm256_min_ps(ly, ry); hy = _mm256_max_ps(hy, ry);
+        lz = _mm256_min_ps(lz, rz); hz = _mm256_max_ps(hz, rz);
+    }
+
+    float l[3][8], h[3][8];
+    _mm256_storeu_ps(l[0], lx); _mm256_storeu_ps(l[1], ly); _mm256_storeu_ps(l[2], lz);
+    _mm256_storeu_ps(h[0], hx); _mm256_storeu_ps(h[1], hy); _mm256_storeu_ps(h[2], hz);
+    _mm256_zeroupper();
+    for (int c = 0; c < 3; ++c)
+        for (int k = 0; k < 8; ++k)
+        {
+            lo[c] = l[c][k] < lo[c] ? l[c][k] : lo[c];
+            hi[c] = h[c][k] > hi[c] ? h[c][k] : hi[c];
+        }
+    return i;
+}
+
+#endif
+
+// ****************************************************************************
+// Entry points
+// ****************************************************************************
+
+static void _affine(const float *a, const float *x, const float *y, const float *z,
+                    float *ox, float *oy, float *oz, int count, bool normalize)
+{
+    int done = 0;
+#if defined(MODELER_X86)
+    if (cpuHasAVX())
+        done = _affine_avx(a, x, y, z, ox, oy, oz, count, normalize);
+    done += _affine_sse2(a, x + done, y + done, z + done, ox + done, oy + done, oz + done,
+                         count - done, normalize);
+#endif
+    _affine_scalar(a, x, y, z, ox, oy, oz, done, count, normalize);
+}
+
+void transformPoints(const Mat4f &m, const float *x, const float *y, const float *z,
+                     float *outX, float *outY, float *outZ, int count)
+{
+    float a[12];
+    for (int k = 0; k < 12; ++k)
+        a[k] = m[k / 4][k % 4];
+    _affine(a, x, y, z, outX, outY, outZ, count, false);
+}
+
+bool normalMatrix(const Mat4f &m, float normal[9])
+{
+    // The inverse transpose is the cofactor matrix over the determinant
+    float c[9] = {
+        m[1][1] * m[2][2] - m[1][2] * m[2][1], m[1][2] * m[2][0] - m[1][0] * m[2][2], m[1][0] * m[2][1] - m[1][1] * m[2][0],
+        m[2][1] * m[0][2] - m[2][2] * m[0][1], m[2][2] * m[0][0] - m[2][0] * m[0][2], m[2][0] * m[0][1] - m[2][1] * m[0][0],
+        m[0][1] * m[1][2] - m[0][2] * m[1][1], m[0][2] * m[1][0] - m[0][0] * m[1][2], m[0][0] * m[1][1] - m[0][1] * m[1][0] };
+    float det = m[0][0] * c[0] + m[0][1] * c[1] + m[0][2] * c[2];
+
+    for (int k = 0; k < 9; ++k)
+        normal[k] = det != 0 ? c[k] / det : (k % 4 == 0 ? 1.0f : 0.0f);
+    return det != 0;
+}
+
+void transformNormals(const Mat4f &m, const float *x, const float *y, const float *z,
+                      float *outX, float *outY, float *outZ, int count, bool normalize)
+{
+    float normal[9];
+    normalMatrix(m, normal);
+
+    float a[12] = { normal[0], normal[1], normal[2], 0,
+                    normal[3], normal[4], normal[5], 0,
+                    normal[6], normal[7], normal[8], 0 };
+    _affine(a, x, y, z, outX, outY, outZ, count, normalize);
+}
+
+void transformedBounds(const Mat4f &m, const float *x, const float *y, const float *z,
+                       int count, float lo[3], float hi[3])
+{
+    float a[12];
+    for (int k = 0; k < 12; ++k)
+        a[k] = m[k / 4][k % 4];
+
+    for (int c = 0; c < 3; ++c)
+    {
+        lo[c] = FLT_MAX;
+        hi[c] = -FLT_MAX;
+    }
+
+    int done = 0;
+#if defined(MODELER_X86)
+    if (cpuHasAVX())
+        done = _bounds_avx(a, x, y, z, count, lo, hi);
+    done += _bounds_sse2(a, x + done, y + done, z + done, count - done, lo, hi);
+#endif
+    _bounds_scalar(a, x, y, z, done, count, lo, hi);
+}
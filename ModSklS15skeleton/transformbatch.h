@@ -0,0 +1,38 @@
+// transformbatch.h
+
+// Transforms whole arrays of points or normals through one Mat4f.  The
+// coordinates come as separate x, y and z arrays (structure of arrays), so
+// the work runs 8 points at a time on AVX machines and 4 on plain SSE2,
+// with no per-point call or shuffling; the scalar loop finishes the tail.
+// TransformStack::transformPoints() hands its arrays to transformPoints()
+// here, and the transform benchmarks in modelerbench.cpp time all three
+// against looping over Mat4f * Vec3f.
+//
+// Outputs may be the inputs (transform in place) but must not otherwise
+// overlap them.
+
+#ifndef TRANSFORMBATCH_H
+#define TRANSFORMBATCH_H
+
+#include "mat.h"
+
+// Points, w taken as 1 and not divided out, like Mat4f * Vec3f
+void transformPoints(const Mat4f &m, const float *x, const float *y, const float *z,
+                     float *outX, float *outY, float *outZ, int count);
+
+// The matrix that carries normals through m: the inverse transpose of its
+// upper 3x3, row major.  False (and identity) if that part is singular.
+bool normalMatrix(const Mat4f &m, float normal[9]);
+
+// Normals through the normal matrix of m, optionally rescaled to unit length
+void transformNormals(const Mat4f &m, const float *x, const float *y, const float *z,
+                      float *outX, float *outY, float *outZ, int count,
+                      bool normalize = true);
+
+// Axis-aligned bounds of the points after transforming them by m, without
+// writing the transformed points anywhere; lo/hi are x, y, z.  Empty input
+// leaves lo above hi.
+void transformedBounds(const Mat4f &m, const float *x, const float *y, const float *z,
+                       int count, float lo[3], float hi[3]);
+
+#endif
@@ -0,0 +1,136 @@
+// transformstack.cpp
+
+#include "transformstack.h"
+#include "transformbatch.h"
+
+TransformStack::TransformStack()
+{
+    m_levels.reserve(32);
+    loadIdentity();
+}
+
+void TransformStack::push()
+{
+    Level top = m_levels.back();
+    if (top.m_general >= 0)
+    {
+        Mat4f m = m_matrices[top.m_general];
+        m_matrices.push_back(m);
+        top.m_general = (int)m_matrices.size() - 1;
+    }
+    m_levels.push_back(top);
+}
+
+void TransformStack::pop()
+{
+    if (m_levels.size() < 2)
+        return;
+
+    // General levels are pushed in order, so the top one owns the last matrix
+    if (m_levels.back().m_general >= 0)
+        m_matrices.pop_back();
+    m_levels.pop_back();
+}
+
+void TransformStack::loadIdentity()
+{
+    if (m_levels.empty())
+        m_levels.push_back(Level());
+    else if (m_levels.back().m_general >= 0)
+        m_matrices.pop_back();
+
+    Level &top = m_levels.back();
+    top.m_rigid   = DualQuatf();
+    top.m_scale   = 1;
+    top.m_general = -1;
+}
+
+Mat4f &TransformStack::general()
+{
+    Level &top = m_levels.back();
+    if (top.m_general < 0)
+    {
+        m_matrices.push_back(matrix());
+        top.m_general = (int)m_matrices.size() - 1;
+    }
+    return m_matrices[top.m_general];
+}
+
+void TransformStack::translate(float x, float y, float z)
+{
+    Level &top = m_levels.back();
+    if (top.m_general >= 0)
+        m_matrices[top.m_general] = m_matrices[top.m_general] *
+            Mat4f(1, 0, 0, x,  0, 1, 0, y,  0, 0, 1, z,  0, 0, 0, 1);
+    else
+    {
+        // The rigid part times a pure translation only changes the dual
+        // part, by real * t / 2; the scale applies to the offset too
+        float s = top.m_scale * 0.5f;
+        const Quatf &r = top.m_rigid.real();
+        top.m_rigid = DualQuatf(r, top.m_rigid.dual() + r * Quatf(x * s, y * s, z * s, 0));
+    }
+}
+
+void TransformStack::rotate(float degrees, float x, float y, float z)
+{
+    rotate(Quatf::rotation(degrees, x, y, z));
+}
+
+void TransformStack::rotate(const Quatf &q)
+{
+    Level &top = m_levels.back();
+    if (top.m_general >= 0)
+        m_matrices[top.m_general] = m_matrices[top.m_general] * q.toMat4();
+    else
+        // A uniform scale commutes with the rotation, and a pure rotation
+        // has no dual part, so this is two quaternion products, not three
+        top.m_rigid = DualQuatf(top.m_rigid.real() * q, top.m_rigid.dual() * q);
+}
+
+void TransformStack::scale(float x, float y, float z)
+{
+    Level &top = m_levels.back();
+    if (top.m_general < 0 && x == y && y == z)
+        top.m_scale *= x;
+    else
+    {
+        Mat4f &m = general();
+        m = m * Mat4f(x, 0, 0, 0,  0, y, 0, 0,  0, 0, z, 0,  0, 0, 0, 1);
+    }
+}
+
+void TransformStack::multiply(const Mat4f &m)
+{
+    Mat4f &top = general();
+    top = top * m;
+}
+
+Mat4f TransformStack::matrix() const
+{
+    const Level &top = m_levels.back();
+    if (top.m_general >= 0)
+        return m_matrices[top.m_general];
+
+    Mat4f m = top.m_rigid.toMat4();
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            m[i][j] *= top.m_scale;
+    return m;
+}
+
+Vec3f TransformStack::transformPoint(const Vec3f &p) const
+{
+    const Level &top = m_levels.back();
+    if (top.m_general >= 0)
+        return m_matrices[top.m_general] * p;
+
+    float s = top.m_scale;
+    return top.m_rigid.transformPoint(Vec3f(p[0] * s, p[1] * s, p[2] * s));
+}
+
+void TransformStack::transformPoints(const float *x, const float *y, const float *z,
+                                     float *outX, float *outY, float *outZ, int count) const
+{
+    ::transformPoints(matrix(), x, y, z, outX, outY, outZ, count);
+}
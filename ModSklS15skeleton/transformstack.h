@@ -0,0 +1,69 @@
+// transformstack.h
+
+// A CPU-side matrix stack, for walking the model hierarchy without GL: the
+// .ray exporter, instancing and the software renderer all need to know
+// where each primitive ends up.
+//
+// Model hierarchies are almost all rotations and translations with the odd
+// uniform scale, so each level is kept as a dual quaternion plus a scale:
+// 9 floats that compose with a couple of quaternion products.  Only a
+// non-uniform scale or an arbitrary matrix turns a level (and the levels
+// pushed from it) into a full Mat4f.
+
+#ifndef TRANSFORMSTACK_H
+#define TRANSFORMSTACK_H
+
+#include "quat.h"
+
+#include <vector>
+
+class TransformStack
+{
+public:
+    TransformStack();
+
+    // Same meaning as glPushMatrix/glPopMatrix; popping the last level is
+    // ignored
+    void push();
+    void pop();
+    int depth() const { return (int)m_levels.size(); }
+
+    // Each right-multiplies the current transform, as the GL calls do
+    void loadIdentity();
+    void translate(float x, float y, float z);
+    void rotate(float degrees, float x, float y, float z);
+    void rotate(const Quatf &q);
+    void scale(float x, float y, float z);
+    void multiply(const Mat4f &m);
+
+    // The current transform
+    Mat4f matrix() const;
+
+    // Whether the current transform is rotation, translation and uniform
+    // scale only.  If so, p maps to rigid() applied to uniformScale() * p.
+    bool isRigid() const { return m_levels.back().m_general < 0; }
+    const DualQuatf &rigid() const { return m_levels.back().m_rigid; }
+    float uniformScale() const { return m_levels.back().m_scale; }
+
+    Vec3f transformPoint(const Vec3f &p) const;
+
+    // Whole arrays through the current transform (see transformbatch.h)
+    void transformPoints(const float *x, const float *y, const float *z,
+                         float *outX, float *outY, float *outZ, int count) const;
+
+private:
+    struct Level
+    {
+        DualQuatf m_rigid;
+        float     m_scale;
+        int       m_general;    // index into m_matrices, or -1 if rigid
+    };
+
+    // Switches the top level to a full matrix
+    Mat4f &general();
+
+    std::vector<Level> m_levels;
+    std::vector<Mat4f> m_matrices;
+};
+
+#endif
@@ -0,0 +1,64 @@
+// triplebuffer.h
+
+// Hands the latest of a stream of values from one thread to another
+// without either side ever waiting.
+//
+// There are three slots.  The writer fills its own back slot and publishes
+// it by swapping it with the middle one; the reader takes the middle slot
+// by swapping it with its own front slot.  Each swap is one atomic
+// exchange, and every slot is only ever touched by whoever holds it, so a
+// value in the middle that the reader hasn't picked up yet is simply
+// replaced by the next one.  The reader always gets the newest complete
+// value, and the writer can always start on another.
+//
+//     Pose &pose = buffer.back();         // writer thread
+//     ... fill it in ...
+//     buffer.publish();
+//
+//     buffer.update();                    // reader thread
+//     draw(buffer.front());
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : m_back(0), m_middle(1), m_front(2) {}
+
+    // Writer side
+    T &back() { return m_slots[m_back]; }
+    void publish()
+    {
+        m_back = m_middle.exchange(m_back | kFresh) & kSlot;
+    }
+
+    // Reader side.  update() moves to the newest published value and
+    // returns true, or returns false if there is none since last time.
+    bool fresh() const { return (m_middle.load() & kFresh) != 0; }
+    bool update()
+    {
+        if (!fresh())
+            return false;
+        m_front = m_middle.exchange(m_front) & kSlot;
+        return true;
+    }
+    const T &front() const { return m_slots[m_front]; }
+    T &front()             { return m_slots[m_front]; }
+
+private:
+    enum { kSlot = 3, kFresh = 4 };
+
+    T                m_slots[3];
+    int              m_back;        // writer's
+    std::atomic<int> m_middle;      // slot index, plus kFresh once published
+    int              m_front;       // reader's
+
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer &operator=(const TripleBuffer &);
+};
+
+#endif
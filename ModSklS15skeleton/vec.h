@@ -4,7 +4,7 @@
 // Stupid FLTK includes iostream.h, so I can't include the official 
 // STL version of iostream.  Damn it all to bloody hell!  -- ehsu
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 #include <iostream>
 using namespace std;
@@ -99,7 +99,7 @@ public:
 
 	//---[ Friend Methods ]----------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template <class U> friend U operator *( const Vec<U>& a, const Vec<U>& b );
 	template <class U> friend Vec<U> operator -( const Vec<U>& v );
@@ -208,14 +208,14 @@ public:
 
 	//---[ Friend Methods ]----------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template<class U> friend U operator *( const Vec3<U>& a, const Vec4<U>& b );
 	template<class U> friend U operator *( const Vec4<U>& b, const Vec3<U>& a );
 	template<class U> friend Vec3<U> operator -( const Vec3<U>& v );
 	template<class U> friend Vec3<U> operator *( const Vec3<U>& a, const double d );
 	template<class U> friend Vec3<U> operator *( const double d, const Vec3<U>& a );
-	template<class U> friend Vec3<U> operator *( const Vec3<U>& v, Mat4<U>& a );
+	template<class U> friend Vec3<U> operator *( const Vec3<U>& v, const Mat4<U>& a );
 	template<class U> friend U operator *( const Vec3<U>& a, const Vec3<U>& b );
 	template<class U> friend Vec3<U> operator *( const Mat3<U>& a, const Vec3<U>& v );
 	template<class U> friend Vec3<U> operator *( const Vec3<U>& v, const Mat3<U>& a );
@@ -237,7 +237,7 @@ public:
 	friend Vec3<T> operator -( const Vec3<T>& v );
 	friend Vec3<T> operator *( const Vec3<T>& a, const double d );
 	friend Vec3<T> operator *( const double d, const Vec3<T>& a );
-	friend Vec3<T> operator *( const Vec3<T>& v, Mat4<T>& a );
+	friend Vec3<T> operator *( const Vec3<T>& v, const Mat4<T>& a );
 	friend T operator *( const Vec3<T>& a, const Vec3<T>& b );
 	friend Vec3<T> operator *( const Mat3<T>& a, const Vec3<T>& v );
 	friend Vec3<T> operator *( const Vec3<T>& v, const Mat3<T>& a );
@@ -305,7 +305,7 @@ public:
 	//---[ Arithmetic Operators ]----------------
 
 	Vec4<T> operator-( const Vec4<T>& a ) { return Vec4<T>(n[0]-a.n[0],n[1]-a.n[1],n[2]-a.n[2],n[3]-a.n[3]); }
-	Vec4<T> operator+( const Vec4<T>& a ) { return Vec4<T>(a.n[0]+n[0],a.n[1]+n[1],a.n[2]+n[2],a.n[3]-n[3]); }
+	Vec4<T> operator+( const Vec4<T>& a ) { return Vec4<T>(a.n[0]+n[0],a.n[1]+n[1],a.n[2]+n[2],a.n[3]+n[3]); }
 
 	//---[ Length Methods ]----------------------
 
@@ -328,7 +328,7 @@ public:
 	
 	//---[ Friend Methods ]----------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template<class U> friend U operator *( const Vec3<U>& a, const Vec4<U>& b );
 	template<class U> friend U operator *( const Vec4<U>& b, const Vec3<U>& a );
@@ -557,7 +557,7 @@ Vec<T> operator-( const Vec<T>& v ) {
 	Vec<T>	result( v.numElements, false );
 
 	for( int i=0;i<v.numElements;i++ )
-		result.n[i] = -n[i];
+		result.n[i] = -v.n[i];
 
 	return result;
 }
@@ -599,7 +599,8 @@ Vec<T> operator^( const Vec<T>& a, const Vec<T>& b ) {
 		throw VectorSizeMismatch();
 #endif
 
-	return *this;
+		// no cross product outside three dimensions
+	return Vec<T>( a.numElements, true );
 }
 
 template <class T>
@@ -725,7 +726,7 @@ inline Vec3<T> operator *(const Mat4<T>& a, const Vec3<T>& v){
 }
 
 template <class T>
-inline Vec3<T> operator *(const Vec3<T>& v, Mat4<T>& a) {
+inline Vec3<T> operator *(const Vec3<T>& v, const Mat4<T>& a) {
 	return a.transpose() * v;
 }
 
@@ -822,14 +823,14 @@ inline T operator *(const Vec4<T>& a, const Vec4<T>& b) {
 
 template <class T>
 inline Vec4<T> operator *(const Mat4<T>& a, const Vec4<T>& v) {
-	return Vec3<T>( a.n[0]*v.n[0]+a.n[1]*v.n[1]+a.n[2]*v.n[2]+a.n[3]*v.n[3],
+	return Vec4<T>( a.n[0]*v.n[0]+a.n[1]*v.n[1]+a.n[2]*v.n[2]+a.n[3]*v.n[3],
 					a.n[4]*v.n[0]+a.n[5]*v.n[1]+a.n[6]*v.n[2]+a.n[7]*v.n[3],
 					a.n[8]*v.n[0]+a.n[9]*v.n[1]+a.n[10]*v.n[2]+a.n[11]*v.n[3],
-					a.n[12]*v.n[0]+a.n[13]*v.n[1]+a.n[14]*v.n[2]+a.n[15]*v.n[3],);
+					a.n[12]*v.n[0]+a.n[13]*v.n[1]+a.n[14]*v.n[2]+a.n[15]*v.n[3] );
 }
 
 template <class T>
-inline Vec4<T> operator *( const Vec4<T>& v, Mat4<T>& a ){
+inline Vec4<T> operator *( const Vec4<T>& v, const Mat4<T>& a ){
 	return a.transpose() * v;
 }
 
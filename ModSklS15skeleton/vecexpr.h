@@ -0,0 +1,243 @@
+#ifndef __VECEXPR_HEADER__
+#define __VECEXPR_HEADER__
+
+// Lazy arithmetic for Vec3, Vec4 and Mat4.
+//
+// The operators in vec.h and mat.h build a temporary for every step, so
+// a + b*s + c*t makes four vectors.  Wrap the operands in lazy() and the
+// same expression just records what to do; it's worked out one element at
+// a time, in a single pass, when it's assigned to a Vec3/Vec4:
+//
+//		setLookAt( lazy(getLookAt()) + lazy(transXAxis)*xTrack + lazy(transYAxis)*yTrack );
+//
+// Products of matrices stay unevaluated too, and applied to a vector they
+// run as a chain of matrix-vector products from the right instead of
+// multiplying the matrices together first:
+//
+//		p = lazy(origin) * azim * elev * dolly * p;	// four Mat4*Vec3, no Mat4*Mat4
+//
+// Expressions refer to the vectors and matrices they were built from, so
+// evaluate them in the statement that builds them; don't keep one around.
+
+#include "vec.h"
+#include "mat.h"
+
+// The whole point is that an expression flattens into straight-line code,
+// which needs every little operator[] inlined; ordinary inline isn't
+// always enough to get the optimizer to go that deep.
+#if defined(_MSC_VER) && !defined(__GNUC__)
+#define VECEXPR_INLINE __forceinline
+#elif defined(__GNUC__)
+#define VECEXPR_INLINE inline __attribute__((always_inline))
+#else
+#define VECEXPR_INLINE inline
+#endif
+
+//==========[ Vector Expressions ]=========================
+
+template <class V> struct VecTraits;
+
+	// what each vector type holds, and how to build one from an expression
+template <class T> struct VecTraits< Vec3<T> > {
+	typedef T			Elem;
+	typedef Vec3<T>		Result;
+	enum { Size = 3 };
+
+	template <class E>
+	static VECEXPR_INLINE Result eval( const E& e ) { return Result( e[0], e[1], e[2] ); }
+};
+
+template <class T> struct VecTraits< Vec4<T> > {
+	typedef T			Elem;
+	typedef Vec4<T>		Result;
+	enum { Size = 4 };
+
+	template <class E>
+	static VECEXPR_INLINE Result eval( const E& e ) { return Result( e[0], e[1], e[2], e[3] ); }
+};
+
+	// base of every vector expression; E is the expression itself
+template <class E, class V>
+class VecExpr {
+public:
+	typedef typename VecTraits<V>::Elem		Elem;
+	typedef V								Result;
+
+	VECEXPR_INLINE Elem operator []( int i ) const
+		{ return static_cast<const E&>(*this)[i]; }
+
+		// evaluates the whole expression, element by element, unrolled
+	VECEXPR_INLINE operator Result() const
+		{ return VecTraits<V>::eval( static_cast<const E&>(*this) ); }
+};
+
+template <class V>
+class VecLeaf : public VecExpr< VecLeaf<V>, V > {
+	const V&	v;
+public:
+	explicit VecLeaf( const V& v_ ) : v(v_) {}
+	VECEXPR_INLINE typename VecTraits<V>::Elem operator []( int i ) const { return v[i]; }
+};
+
+template <class L, class R, class V>
+class VecSum : public VecExpr< VecSum<L,R,V>, V > {
+	L	l;
+	R	r;
+public:
+	VecSum( const L& l_, const R& r_ ) : l(l_), r(r_) {}
+	VECEXPR_INLINE typename VecTraits<V>::Elem operator []( int i ) const { return l[i] + r[i]; }
+};
+
+template <class L, class R, class V>
+class VecDiff : public VecExpr< VecDiff<L,R,V>, V > {
+	L	l;
+	R	r;
+public:
+	VecDiff( const L& l_, const R& r_ ) : l(l_), r(r_) {}
+	VECEXPR_INLINE typename VecTraits<V>::Elem operator []( int i ) const { return l[i] - r[i]; }
+};
+
+template <class E, class V>
+class VecScale : public VecExpr< VecScale<E,V>, V > {
+	E		e;
+	double	d;
+public:
+	VecScale( const E& e_, double d_ ) : e(e_), d(d_) {}
+	VECEXPR_INLINE typename VecTraits<V>::Elem operator []( int i ) const { return e[i] * d; }
+};
+
+template <class E, class V>
+class VecNeg : public VecExpr< VecNeg<E,V>, V > {
+	E	e;
+public:
+	explicit VecNeg( const E& e_ ) : e(e_) {}
+	VECEXPR_INLINE typename VecTraits<V>::Elem operator []( int i ) const { return -e[i]; }
+};
+
+//---[ Building Expressions ]------------------------------
+
+template <class T>
+VECEXPR_INLINE VecLeaf< Vec3<T> > lazy( const Vec3<T>& v ) { return VecLeaf< Vec3<T> >( v ); }
+
+template <class T>
+VECEXPR_INLINE VecLeaf< Vec4<T> > lazy( const Vec4<T>& v ) { return VecLeaf< Vec4<T> >( v ); }
+
+template <class L, class R, class V>
+VECEXPR_INLINE VecSum<L,R,V> operator +( const VecExpr<L,V>& a, const VecExpr<R,V>& b ) {
+	return VecSum<L,R,V>( static_cast<const L&>(a), static_cast<const R&>(b) );
+}
+
+template <class L, class R, class V>
+VECEXPR_INLINE VecDiff<L,R,V> operator -( const VecExpr<L,V>& a, const VecExpr<R,V>& b ) {
+	return VecDiff<L,R,V>( static_cast<const L&>(a), static_cast<const R&>(b) );
+}
+
+	// a plain vector on either side of + or - joins the expression
+template <class L, class V>
+VECEXPR_INLINE VecSum<L,VecLeaf<V>,V> operator +( const VecExpr<L,V>& a, const V& b ) {
+	return VecSum<L,VecLeaf<V>,V>( static_cast<const L&>(a), VecLeaf<V>(b) );
+}
+
+template <class R, class V>
+VECEXPR_INLINE VecSum<VecLeaf<V>,R,V> operator +( const V& a, const VecExpr<R,V>& b ) {
+	return VecSum<VecLeaf<V>,R,V>( VecLeaf<V>(a), static_cast<const R&>(b) );
+}
+
+template <class L, class V>
+VECEXPR_INLINE VecDiff<L,VecLeaf<V>,V> operator -( const VecExpr<L,V>& a, const V& b ) {
+	return VecDiff<L,VecLeaf<V>,V>( static_cast<const L&>(a), VecLeaf<V>(b) );
+}
+
+template <class R, class V>
+VECEXPR_INLINE VecDiff<VecLeaf<V>,R,V> operator -( const V& a, const VecExpr<R,V>& b ) {
+	return VecDiff<VecLeaf<V>,R,V>( VecLeaf<V>(a), static_cast<const R&>(b) );
+}
+
+template <class E, class V>
+VECEXPR_INLINE VecScale<E,V> operator *( const VecExpr<E,V>& a, const double d ) {
+	return VecScale<E,V>( static_cast<const E&>(a), d );
+}
+
+template <class E, class V>
+VECEXPR_INLINE VecScale<E,V> operator *( const double d, const VecExpr<E,V>& a ) {
+	return VecScale<E,V>( static_cast<const E&>(a), d );
+}
+
+template <class E, class V>
+VECEXPR_INLINE VecScale<E,V> operator /( const VecExpr<E,V>& a, const double d ) {
+	return VecScale<E,V>( static_cast<const E&>(a), 1.0 / d );
+}
+
+template <class E, class V>
+VECEXPR_INLINE VecNeg<E,V> operator -( const VecExpr<E,V>& a ) {
+	return VecNeg<E,V>( static_cast<const E&>(a) );
+}
+
+//==========[ Matrix Expressions ]=========================
+
+	// base of every matrix product; E is the expression itself
+template <class E, class T>
+class MatExpr {
+public:
+		// the expression applied to a point or vector, innermost matrix first
+	VECEXPR_INLINE Vec3<T> apply( const Vec3<T>& v ) const
+		{ return static_cast<const E&>(*this).apply( v ); }
+	VECEXPR_INLINE Vec4<T> apply( const Vec4<T>& v ) const
+		{ return static_cast<const E&>(*this).apply( v ); }
+
+	VECEXPR_INLINE operator Mat4<T>() const
+		{ return static_cast<const E&>(*this).eval(); }
+};
+
+template <class T>
+class MatLeaf : public MatExpr< MatLeaf<T>, T > {
+	const Mat4<T>&	m;
+public:
+	explicit MatLeaf( const Mat4<T>& m_ ) : m(m_) {}
+	VECEXPR_INLINE Vec3<T> apply( const Vec3<T>& v ) const { return m * v; }
+	VECEXPR_INLINE Vec4<T> apply( const Vec4<T>& v ) const { return m * v; }
+	VECEXPR_INLINE Mat4<T> eval() const { return m; }
+};
+
+template <class L, class R, class T>
+class MatProduct : public MatExpr< MatProduct<L,R,T>, T > {
+	L	l;
+	R	r;
+public:
+	MatProduct( const L& l_, const R& r_ ) : l(l_), r(r_) {}
+	VECEXPR_INLINE Vec3<T> apply( const Vec3<T>& v ) const { return l.apply( r.apply( v ) ); }
+	VECEXPR_INLINE Vec4<T> apply( const Vec4<T>& v ) const { return l.apply( r.apply( v ) ); }
+	VECEXPR_INLINE Mat4<T> eval() const { return l.eval() * r.eval(); }
+};
+
+//---[ Building Expressions ]------------------------------
+
+template <class T>
+VECEXPR_INLINE MatLeaf<T> lazy( const Mat4<T>& m ) { return MatLeaf<T>( m ); }
+
+template <class L, class R, class T>
+VECEXPR_INLINE MatProduct<L,R,T> operator *( const MatExpr<L,T>& a, const MatExpr<R,T>& b ) {
+	return MatProduct<L,R,T>( static_cast<const L&>(a), static_cast<const R&>(b) );
+}
+
+template <class L, class T>
+VECEXPR_INLINE MatProduct<L,MatLeaf<T>,T> operator *( const MatExpr<L,T>& a, const Mat4<T>& b ) {
+	return MatProduct<L,MatLeaf<T>,T>( static_cast<const L&>(a), MatLeaf<T>(b) );
+}
+
+template <class R, class T>
+VECEXPR_INLINE MatProduct<MatLeaf<T>,R,T> operator *( const Mat4<T>& a, const MatExpr<R,T>& b ) {
+	return MatProduct<MatLeaf<T>,R,T>( MatLeaf<T>(a), static_cast<const R&>(b) );
+}
+
+template <class E, class T>
+VECEXPR_INLINE Vec3<T> operator *( const MatExpr<E,T>& a, const Vec3<T>& v ) {
+	return a.apply( v );
+}
+
+template <class E, class T>
+VECEXPR_INLINE Vec4<T> operator *( const MatExpr<E,T>& a, const Vec4<T>& v ) {
+	return a.apply( v );
+}
+
+#endif
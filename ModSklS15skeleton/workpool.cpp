@@ -0,0 +1,168 @@
+// workpool.cpp
+
+#include "workpool.h"
+
+WorkPool::WorkPool(int numThreads)
+    : m_item(NULL), m_context(NULL), m_remaining(0), m_stolen(0),
+      m_generation(0), m_busy(0), m_stop(false)
+{
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads <= 0)
+        numThreads = 1;
+
+    for (int i = 0; i < numThreads; ++i)
+        m_queues.push_back(new Queue);
+    for (int i = 1; i < numThreads; ++i)
+        m_threads.push_back(std::thread(&WorkPool::workerLoop, this, i));
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+    for (size_t i = 0; i < m_queues.size(); ++i)
+        delete m_queues[i];
+}
+
+// ****************************************************************************
+// Scheduling
+// ****************************************************************************
+
+// Takes the back run of the thread's own deque, leaving the front half of
+// it behind for thieves when it's more than one item
+bool WorkPool::takeOwn(int thread, Run &run)
+{
+    Queue &q = *m_queues[thread];
+    std::lock_guard<std::mutex> lock(q.m_mutex);
+    if (q.m_runs.empty())
+        return false;
+
+    run = q.m_runs.back();
+    q.m_runs.pop_back();
+    if (run.m_end - run.m_begin > 1)
+    {
+        Run front = { run.m_begin, run.m_begin + (run.m_end - run.m_begin) / 2 };
+        q.m_runs.push_back(front);
+        run.m_begin = front.m_end;
+    }
+    return true;
+}
+
+// Takes the front (oldest, largest) run of the first other deque that has
+// one, starting after the thief so thieves spread out
+bool WorkPool::steal(int thread, Run &run)
+{
+    int n = threadCount();
+    for (int i = 1; i < n; ++i)
+    {
+        Queue &q = *m_queues[(thread + i) % n];
+        std::lock_guard<std::mutex> lock(q.m_mutex);
+        if (!q.m_runs.empty())
+        {
+            run = q.m_runs.front();
+            q.m_runs.erase(q.m_runs.begin());
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::work(int thread)
+{
+    Run run;
+    for (;;)
+    {
+        bool stolen = false;
+        if (!takeOwn(thread, run))
+        {
+            if (!steal(thread, run))
+            {
+                // nothing queued anywhere; the rest is already being worked on
+                return;
+            }
+            stolen = true;
+        }
+
+        // Stolen runs go on our own deque so they split up in turn
+        if (stolen && run.m_end - run.m_begin > 1)
+        {
+            Queue &q = *m_queues[thread];
+            std::lock_guard<std::mutex> lock(q.m_mutex);
+            q.m_runs.push_back(run);
+            m_stolen += run.m_end - run.m_begin;
+            continue;
+        }
+        if (stolen)
+            ++m_stolen;
+
+        for (int i = run.m_begin; i < run.m_end; ++i)
+            m_item(m_context, i, thread);
+        m_remaining -= run.m_end - run.m_begin;
+    }
+}
+
+void WorkPool::workerLoop(int thread)
+{
+    unsigned seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]{ return m_stop || m_generation != seen; });
+            if (m_stop)
+                return;
+            seen = m_generation;
+            ++m_busy;
+        }
+
+        work(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busy;
+        }
+        m_finished.notify_all();
+    }
+}
+
+void WorkPool::parallelFor(int count, WorkItem_f item, void *context)
+{
+    if (count <= 0)
+        return;
+
+    m_item = item;
+    m_context = context;
+    m_remaining = count;
+    m_stolen = 0;
+
+    // Deal out one contiguous run per thread
+    int n = threadCount();
+    for (int t = 0; t < n; ++t)
+    {
+        Run run = { (int)((long long)count * t / n), (int)((long long)count * (t + 1) / n) };
+        Queue &q = *m_queues[t];
+        std::lock_guard<std::mutex> lock(q.m_mutex);
+        q.m_runs.clear();
+        if (run.m_end > run.m_begin)
+            q.m_runs.push_back(run);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_generation;
+    }
+    m_start.notify_all();
+
+    work(0);
+
+    // Wait for the items other threads are still on, and for every worker
+    // to be back asleep so the next loop can't be mixed up with this one
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [&]{ return m_remaining == 0 && m_busy == 0; });
+}
@@ -0,0 +1,82 @@
+// workpool.h
+
+// A work-stealing thread pool for data-parallel loops.
+//
+// parallelFor() deals the indices out to the threads in contiguous runs,
+// one deque of runs per thread.  Each thread works through its own deque
+// from the back, halving runs as it goes so there is always something left
+// to steal; a thread that runs dry takes the front run of another thread's
+// deque.  Uneven items (a crowd member close to the camera, a tile with
+// most of the model in it) therefore even out without a central queue
+// every item has to go through.
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Does item index of a loop; thread is 0 .. threadCount()-1, for indexing
+// per-thread scratch
+typedef void (*WorkItem_f)(void *context, int index, int thread);
+
+class WorkPool
+{
+public:
+    // numThreads <= 0 picks one per core.  The thread calling
+    // parallelFor() is one of them, so this starts numThreads - 1.
+    explicit WorkPool(int numThreads = 0);
+    ~WorkPool();
+
+    int threadCount() const { return (int)m_queues.size(); }
+
+    // Calls item(context, i, thread) for every 0 <= i < count, spread over
+    // the pool, and returns when all are done.  Not reentrant.
+    void parallelFor(int count, WorkItem_f item, void *context);
+
+    // Items the last parallelFor() ran on a thread other than the one
+    // they were dealt to
+    int stolenCount() const { return m_stolen; }
+
+private:
+    WorkPool(const WorkPool &) {}
+    WorkPool& operator=(const WorkPool &) { return *this; }
+
+    // A run of indices [m_begin, m_end)
+    struct Run
+    {
+        int m_begin;
+        int m_end;
+    };
+
+    struct Queue
+    {
+        std::mutex       m_mutex;
+        std::vector<Run> m_runs;    // stolen from the front, worked from the back
+    };
+
+    bool takeOwn(int thread, Run &run);
+    bool steal(int thread, Run &run);
+    void work(int thread);
+    void workerLoop(int thread);
+
+    std::vector<Queue *>     m_queues;
+    std::vector<std::thread> m_threads;
+
+    WorkItem_f               m_item;
+    void                    *m_context;
+    std::atomic<int>         m_remaining;
+    std::atomic<int>         m_stolen;
+
+    std::mutex               m_mutex;
+    std::condition_variable  m_start;
+    std::condition_variable  m_finished;
+    unsigned                 m_generation;
+    int                      m_busy;
+    bool                     m_stop;
+};
+
+#endif